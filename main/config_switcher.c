@@ -38,6 +38,15 @@
  * & add loading functionality to configSwitcherTask. 
  * */
 #include "config_switcher.h"
+#include <esp_timer.h>
+#include "function_tasks/task_debouncer.h"
+#include "function_tasks/handler_chord.h"
+#include "function_tasks/handler_gesture.h"
+#include "function_tasks/handler_hid.h"
+#include "function_tasks/handler_vb.h"
+#include "function_tasks/slot_arena.h"
+#include "function_tasks/fct_infrared.h"
+#include "function_tasks/task_commands.h"
 
 /** Tag for ESP_LOG logging */
 #define LOG_TAG "cfgsw"
@@ -51,6 +60,13 @@
 /** Task handle for the CONTINOUS task responsible for config switching */
 TaskHandle_t configswitcher_handle;
 
+/** Stacksize for continous task configPrefetchTask.
+ * @see configPrefetchTask */
+#define CONFIGPREFETCHTASK_STACKSIZE 3072
+
+/** Task handle for the CONTINOUS task prefetching the neighbour slots */
+static TaskHandle_t configprefetch_handle = NULL;
+
 /** @brief Semaphore for detecting pending config updates
  * 
  * Usually, on saving a new slot, each time a value is changed, configUpdate()
@@ -68,6 +84,32 @@ SemaphoreHandle_t configUpdatePending = NULL;
 /** Currently loaded configuration.*/
 generalConfig_t currentConfigLoaded;
 
+/** @brief Last applied configuration
+ * 
+ * Copy of currentConfigLoaded, taken each time the configuration
+ * is applied. Used to determine which sections have changed.
+ * @see configGetDirtySections */
+static generalConfig_t configApplied;
+
+/** @brief Flag if a coalesced update is already queued
+ * @see configRequestUpdate */
+static volatile uint8_t configUpdateRequested = 0;
+
+/** @brief Tick count of the last update request, used for the settle window
+ * @see CONFIG_UPDATE_SETTLE_MS */
+static volatile TickType_t configUpdateLastRequest = 0;
+
+/** @brief Tick count of the first request of a queued update, used to cap the latency
+ * @see CONFIG_UPDATE_MAX_DELAY_MS */
+static volatile TickType_t configUpdateFirstRequest = 0;
+
+/** @brief Count of avoided config updates (merged requests or nothing changed) */
+static volatile uint32_t configUpdatesAvoided = 0;
+
+/** @brief Timing of slot switches
+ * @see configGetSwitchStats */
+static config_switch_stats_t configSwitchStats;
+
 /** @brief Get the current config struct
  * 
  * This method is used to get a reference to the current config struct.
@@ -85,74 +127,320 @@ generalConfig_t* configGetCurrent(void)
 
 /** @brief Trigger a config update
  * 
- * This method is simply sending an "__UPDATE" command to the
- * config_switcher queue to trigger an update for the virtual buttons
+ * This method is simply requesting a coalesced update.
  * 
  * @see config_switcher
- * @see configUpdate
+ * @see configRequestUpdate
  * @see currentConfig
  * */
 void configTriggerUpdate(void)
 {
-  //reload the slot by sending "__UPDATE" to 
-  // the config_switcher queue
-  char commandname[SLOTNAME_LENGTH];
-  strcpy(commandname,"__UPDATE");
-  if(config_switcher == NULL) return;
-  
-  if(xQueueSend(config_switcher,commandname,0) == pdPASS)
+  if(configRequestUpdate() != ESP_OK)
   {
-    ESP_LOGD(LOG_TAG,"requesting config update");
-  } else {
     ESP_LOGE(LOG_TAG,"Error requesting slot update");
   }
 }
 
+/** @brief Determine changed config sections
+ * 
+ * Compares the current config to the last applied one.
+ * @return Mask of CONFIG_SECTION_* flags
+ * */
+static uint8_t configGetDirtySections(void)
+{
+  uint8_t sections = 0;
+  generalConfig_t *c = &currentConfigLoaded;
+  generalConfig_t *a = &configApplied;
+  
+  if(memcmp(&c->adc,&a->adc,sizeof(adc_config_t)) != 0) sections |= CONFIG_SECTION_ADC;
+  
+  if(c->ble_active != a->ble_active || c->usb_active != a->usb_active) sections |= CONFIG_SECTION_ROUTING;
+  
+  if(c->debounce_press != a->debounce_press || \
+    c->debounce_release != a->debounce_release || \
+    c->debounce_idle != a->debounce_idle || \
+    c->debounce_engine != a->debounce_engine || \
+    c->debounce_vb_count != a->debounce_vb_count || \
+    memcmp(c->debounce_vb,a->debounce_vb,sizeof(c->debounce_vb)) != 0)
+  {
+    sections |= CONFIG_SECTION_DEBOUNCE;
+  }
+  
+  if(c->countryCode != a->countryCode || c->locale != a->locale || \
+    c->deviceIdentifier != a->deviceIdentifier || \
+    c->wheel_stepsize != a->wheel_stepsize) sections |= CONFIG_SECTION_HID;
+  
+  if(c->chord_window != a->chord_window || \
+    memcmp(c->chord_mask,a->chord_mask,sizeof(c->chord_mask)) != 0) sections |= CONFIG_SECTION_CHORD;
+  
+  if(c->gesture_tap != a->gesture_tap || c->gesture_doubletap != a->gesture_doubletap || \
+    c->gesture_longpress != a->gesture_longpress || \
+    c->gesture_repeat != a->gesture_repeat) sections |= CONFIG_SECTION_GESTURE;
+  
+  return sections;
+}
+
+/** @brief Apply the given config sections
+ * 
+ * * CONFIG_SECTION_ADC: reload ADC config (might recreate the ADC task)
+ * * CONFIG_SECTION_ROUTING: set routing bits (USB/BLE), HID reset
+ * * CONFIG_SECTION_HID: HID reset on USB & BLE
+ * * CONFIG_SECTION_DEBOUNCE: resolve & publish the debounce times
+ * * CONFIG_SECTION_CHORD: compile & publish the chord table
+ * * CONFIG_SECTION_GESTURE: set the gesture thresholds
+ * 
+ * Afterwards, the current config is saved as applied config.
+ * @param sections Mask of CONFIG_SECTION_* flags
+ * @return ESP_OK on success, ESP_FAIL otherwise
+ * */
+static esp_err_t configApply(uint8_t sections)
+{
+  ESP_LOGD(LOG_TAG,"applying config sections 0x%02X",sections);
+  
+  //reload ADC
+  if(sections & CONFIG_SECTION_ADC)
+  {
+    if(halAdcUpdateConfig(&currentConfigLoaded.adc) != ESP_OK)
+    {
+      ESP_LOGE(LOG_TAG,"error reloading adc config");
+      return ESP_FAIL;
+    }
+  }
+  
+  //set other config infos
+  if(sections & CONFIG_SECTION_ROUTING)
+  {
+    ESP_LOGD(LOG_TAG,"setting connection bits (USB: %d, BLE: %d)",currentConfigLoaded.usb_active,currentConfigLoaded.ble_active);
+    if(currentConfigLoaded.ble_active != 0)  xEventGroupSetBits(connectionRoutingStatus,DATATO_BLE);
+    else xEventGroupClearBits(connectionRoutingStatus,DATATO_BLE);
+    if(currentConfigLoaded.usb_active != 0)  xEventGroupSetBits(connectionRoutingStatus,DATATO_USB);
+    else xEventGroupClearBits(connectionRoutingStatus,DATATO_USB);
+  }
+  
+  //publish new debounce times
+  if(sections & CONFIG_SECTION_DEBOUNCE)
+  {
+    if(taskDebouncerUpdateConfig(&currentConfigLoaded) != ESP_OK)
+    {
+      ESP_LOGE(LOG_TAG,"error updating debounce times");
+      return ESP_FAIL;
+    }
+  }
+  
+  //publish new chord table
+  if(sections & CONFIG_SECTION_CHORD)
+  {
+    if(handler_chord_update(&currentConfigLoaded) != ESP_OK)
+    {
+      ESP_LOGE(LOG_TAG,"error updating chords");
+      return ESP_FAIL;
+    }
+  }
+  
+  //set new gesture thresholds
+  if(sections & CONFIG_SECTION_GESTURE)
+  {
+    if(handler_gesture_update(&currentConfigLoaded) != ESP_OK)
+    {
+      ESP_LOGE(LOG_TAG,"error updating gestures");
+      return ESP_FAIL;
+    }
+  }
+  
+  //reset HID channels (USB&BLE)
+  if(sections & (CONFIG_SECTION_ROUTING | CONFIG_SECTION_HID))
+  {
+    halBLEReset(0);
+    halSerialReset(0);
+  }
+  
+  //save as applied config
+  memcpy(&configApplied,&currentConfigLoaded,sizeof(generalConfig_t));
+  return ESP_OK;
+}
+
 /** @brief Request config update
  * 
- * This method is requesting a config update for the general config.
- * It is used either by the command parser to activate a changed config
- * (by AT commands) or by the config switcher task, to activate a config
+ * This method is applying all sections of the general config immediately.
+ * It is used by the config switcher task, to activate a config
  * loaded from flash.
  *  
  * @see config_switcher
  * @see currentConfig
- * @param block Time to wait for finished business before updating. 
- * If 0, returns immediately if not possible.
+ * @see configRequestUpdate
+ * @return ESP_OK on success, ESP_FAIL otherwise
+ * */
+esp_err_t configUpdate(void)
+{
+  return configApply(CONFIG_SECTION_ALL);
+}
+
+/** @brief Request a coalesced config update
+ * 
+ * Used by the command parser after a burst of AT commands. The update
+ * is done by the config switcher task after no further request was
+ * received for CONFIG_UPDATE_SETTLE_MS, but not later than
+ * CONFIG_UPDATE_MAX_DELAY_MS after the first request. Only changed
+ * sections are applied.
+ * 
+ * @see configGetUpdatesAvoided
  * @return ESP_OK on success, ESP_FAIL otherwise
  * */
-esp_err_t configUpdate(TickType_t time)
+esp_err_t configRequestUpdate(void)
 {
-  /*
-  ///@todo REMOVE!
-  currentConfigLoaded.adc.reportraw = 1;
-  //check if we are allowed to update
-  if((xEventGroupWaitBits(systemStatus,(SYSTEM_STABLECONFIG | \
-    SYSTEM_EMPTY_CMD_QUEUE), pdFALSE,pdTRUE,time) & (SYSTEM_STABLECONFIG | \
-      SYSTEM_EMPTY_CMD_QUEUE)) == 0)
+  char commandname[SLOTNAME_LENGTH];
+  
+  configUpdateLastRequest = xTaskGetTickCount();
+  
+  //an update is already queued, it will include this request
+  if(configUpdateRequested != 0)
   {
-    //didn't set the flags in time, return fail
-    return ESP_FAIL;
-  }*/
+    configUpdatesAvoided++;
+    return ESP_OK;
+  }
   
-  //reload ADC
-  if(halAdcUpdateConfig(&currentConfigLoaded.adc) != ESP_OK)
+  if(config_switcher == NULL) return ESP_FAIL;
+  configUpdateFirstRequest = configUpdateLastRequest;
+  configUpdateRequested = 1;
+  strcpy(commandname,"__UPDATE");
+  if(xQueueSend(config_switcher,commandname,0) != pdPASS)
   {
-    ESP_LOGE(LOG_TAG,"error reloading adc config");
+    configUpdateRequested = 0;
     return ESP_FAIL;
   }
+  ESP_LOGD(LOG_TAG,"requesting config update");
+  return ESP_OK;
+}
+
+/** @brief Get count of avoided config updates
+ * @see configRequestUpdate
+ * @return Count of requests which were merged or did not change anything */
+uint32_t configGetUpdatesAvoided(void)
+{
+  return configUpdatesAvoided;
+}
+
+void configGetSwitchStats(config_switch_stats_t *stats)
+{
+  if(stats == NULL) return;
+  memcpy(stats,&configSwitchStats,sizeof(config_switch_stats_t));
+}
+
+/** @brief Get the time until a queued update (__UPDATE) is due
+ * 
+ * An update is due after the settle window has passed without further
+ * requests, or CONFIG_UPDATE_MAX_DELAY_MS after the first request.
+ * @return Ticks to wait, 0 if the update is due now
+ * */
+static TickType_t configUpdateDelay(void)
+{
+  TickType_t now = xTaskGetTickCount();
+  TickType_t settle = CONFIG_UPDATE_SETTLE_MS / portTICK_PERIOD_MS;
+  TickType_t maxdelay = CONFIG_UPDATE_MAX_DELAY_MS / portTICK_PERIOD_MS;
+  TickType_t quiet = now - configUpdateLastRequest;
+  TickType_t pending = now - configUpdateFirstRequest;
   
-  //set other config infos
-  ESP_LOGD(LOG_TAG,"setting connection bits (USB: %d, BLE: %d)",currentConfigLoaded.usb_active,currentConfigLoaded.ble_active);
-  if(currentConfigLoaded.ble_active != 0)  xEventGroupSetBits(connectionRoutingStatus,DATATO_BLE);
-  else xEventGroupClearBits(connectionRoutingStatus,DATATO_BLE);
-  if(currentConfigLoaded.usb_active != 0)  xEventGroupSetBits(connectionRoutingStatus,DATATO_USB);
-  else xEventGroupClearBits(connectionRoutingStatus,DATATO_USB);
+  if(quiet >= settle || pending >= maxdelay) return 0;
+  if((settle - quiet) < (maxdelay - pending)) return settle - quiet;
+  return maxdelay - pending;
+}
+
+/** @brief Process a coalesced update request (__UPDATE)
+ * 
+ * Called by the config switcher task if the update is due (see
+ * configUpdateDelay) and applies the changed sections.
+ * */
+static void configProcessUpdateRequest(void)
+{
+  uint8_t sections;
   
-  //reset HID channels (USB&BLE)
-  halBLEReset(0);
-  halSerialReset(0);
-  return ESP_OK;
+  //from now on, new requests need a new update
+  configUpdateRequested = 0;
+  
+  sections = configGetDirtySections();
+  if(sections == 0)
+  {
+    configUpdatesAvoided++;
+    ESP_LOGD(LOG_TAG,"no config changes, update avoided (%d)",configUpdatesAvoided);
+    return;
+  }
+  if(configApply(sections) != ESP_OK) ESP_LOGE(LOG_TAG,"Error updating general config!");
+  else ESP_LOGD(LOG_TAG,"config updated (0x%02X), avoided: %d",sections,configUpdatesAvoided);
+}
+
+/** @brief Release all VB commands of the slot before the current one
+ * 
+ * The handlers continue with the commands of the current slot until
+ * the new slot is published. Commands of the slot before are not used
+ * anymore (sync), their memory is released at once by switching the
+ * slot arena. New, empty drafts are started for both handlers.
+ * */
+static void configReleaseSlot(void)
+{
+  handler_hid_sync();
+  handler_vb_sync();
+  slotArenaSwitch();
+  if(handler_hid_clearCmds() != ESP_OK || handler_vb_clearCmds() != ESP_OK)
+  {
+    ESP_LOGE(LOG_TAG,"cannot clear VB commands");
+  }
+}
+
+/** @brief Reset the optional settings of the current config before a slot is loaded
+ * 
+ * Chords & individual anti-tremor times are stored only if they are
+ * used, older slot files contain neither chords nor gesture thresholds.
+ * Without a reset, these settings would be taken over from the slot
+ * before (and stored with the new one).
+ * An installed image overwrites the whole config anyway.
+ * */
+static void configResetSlotSettings(void)
+{
+  generalConfig_t *c = &currentConfigLoaded;
+  
+  memset(c->chord_mask,0,sizeof(c->chord_mask));
+  c->chord_window = 0;
+  c->gesture_tap = 0;
+  c->gesture_doubletap = 0;
+  c->gesture_longpress = 0;
+  c->gesture_repeat = 0;
+  memset(c->debounce_vb,0,sizeof(c->debounce_vb));
+  c->debounce_vb_count = 0;
+}
+
+/** @brief CONTINOUS TASK - Prefetch the current slot & its neighbours
+ * 
+ * After each slot switch, the images of the current, next & previous
+ * slot are loaded into the slot cache of hal_storage. Cycling through
+ * the slots (__NEXT/__PREV) installs the slot from RAM this way.
+ * This task runs with a low priority, it never delays a slot switch.
+ * @see halStoragePrefetch
+ * @param params Not used, pass NULL.
+ **/
+static void configPrefetchTask(void * params)
+{
+  uint32_t tid;
+  uint8_t count;
+  
+  while(1)
+  {
+    //wait for a finished slot switch
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    
+    if(halStorageStartTransaction(&tid,100,LOG_TAG) != ESP_OK)
+    {
+      ESP_LOGW(LOG_TAG,"Cannot start storage transaction for prefetching");
+      continue;
+    }
+    if(halStorageGetNumberOfSlots(tid,&count) == ESP_OK && count > 0)
+    {
+      uint8_t current = halStorageGetCurrentSlotNumber();
+      halStoragePrefetch(tid,current);
+      halStoragePrefetch(tid,(current + 1) % count);
+      halStoragePrefetch(tid,(current + count - 1) % count);
+    }
+    halStorageFinishTransaction(tid);
+  }
 }
 
 /** @brief CONTINOUS TASK - Config switcher task, internal config reloading
@@ -174,6 +462,7 @@ void configSwitcherTask(void * params)
   
   uint32_t tid = 0;
   uint8_t justupdate = 0;
+  uint8_t updatepending = 0;
   esp_err_t ret;
   
   if(config_switcher == 0)
@@ -184,14 +473,26 @@ void configSwitcherTask(void * params)
   
   while(1)
   {
-    //wait for a command.
-    if(xQueueReceive(config_switcher,command,1000/portTICK_PERIOD_MS) == pdTRUE)
+    //wait for a command. A queued update is applied if it is due,
+    //slot switches are served while the update is settling.
+    TickType_t wait = 1000/portTICK_PERIOD_MS;
+    if(updatepending) wait = configUpdateDelay();
+    if(xQueueReceive(config_switcher,command,wait) == pdTRUE)
     {
+      //coalesced config update, no slot loading necessary
+      if(strcmp(command,"__UPDATE") == 0)
+      {
+        updatepending = 1;
+        continue;
+      }
+      
+      int64_t switchstart = esp_timer_get_time();
+      
       //signal system that we are updating config now.
       xEventGroupSetBits(systemStatus, SYSTEM_LOADCONFIG);
       xEventGroupClearBits(systemStatus, SYSTEM_STABLECONFIG);
-      //clear flag, because we surely will have an unprocessed command here
-      xEventGroupClearBits(systemStatus,SYSTEM_EMPTY_CMD_QUEUE);
+      //clear flags, because we surely will have an unprocessed command here
+      xEventGroupClearBits(systemStatus,SYSTEM_EMPTY_CMD_QUEUE | SYSTEM_SLOT_PARSED);
       
       //request storage access
       while(halStorageStartTransaction(&tid,100,LOG_TAG) != ESP_OK)
@@ -202,6 +503,16 @@ void configSwitcherTask(void * params)
       //just to be sure: normally we are not updating...
       justupdate = 0;
       
+      //remove the commands of the previous slot, except the requested
+      //slot name does not exist (previous slot stays active)
+      uint8_t slotnumber;
+      if(strncmp(command,"__",2) == 0 || \
+        halStorageGetNumberForName(tid,&slotnumber,command) == ESP_OK)
+      {
+        configReleaseSlot();
+        configResetSlotSettings();
+      }
+      
       //command received, load new slot:
       //__NEXT, __PREV, __DEFAULT, __UPDATE, __RESTOREFACTORY
       if(strcmp(command,"__NEXT") == 0)
@@ -258,15 +569,57 @@ void configSwitcherTask(void * params)
       ESP_LOGD(LOG_TAG,"storage");
       
       //now we wait for finished processing of AT commands.
-      if((xEventGroupWaitBits(systemStatus,SYSTEM_EMPTY_CMD_QUEUE, \
-        pdFALSE,pdFALSE,10) & SYSTEM_EMPTY_CMD_QUEUE) == 0)
+      //An installed image did not send any commands.
+      uint8_t image = (ret == ESP_OK) && halStorageIsImageLoaded();
+      uint8_t parsed = 0;
+      if(image)
+      {
+        xEventGroupSetBits(systemStatus,SYSTEM_EMPTY_CMD_QUEUE);
+      } else if(ret != ESP_OK) {
+        //slot file was not loaded (completely), no end marker
+        if((xEventGroupWaitBits(systemStatus,SYSTEM_EMPTY_CMD_QUEUE, \
+          pdFALSE,pdFALSE,10) & SYSTEM_EMPTY_CMD_QUEUE) == 0)
+        {
+          ESP_LOGW(LOG_TAG,"command queue not emptied in time!");
+        }
+      } else if((xEventGroupWaitBits(systemStatus,SYSTEM_SLOT_PARSED, \
+        pdFALSE,pdFALSE,CONFIG_SLOT_PARSE_TIMEOUT_MS/portTICK_PERIOD_MS) & SYSTEM_SLOT_PARSED) == 0)
       {
-        ///TODO: check the queue itself, if we don't send anything (e.g. if ther is no data), we will come here.
-        ESP_LOGW(LOG_TAG,"command queue not emptied in time!");
+        ESP_LOGW(LOG_TAG,"slot file not parsed in time!");
+      } else if(taskCommandsGetSlotSideEffects() != 0) {
+        ESP_LOGI(LOG_TAG,"%u commands with side effects, no image is stored", \
+          taskCommandsGetSlotSideEffects());
+      } else {
+        parsed = 1;
+      }
+      
+      //create the image of the parsed slot now, before other commands
+      //(serial, macros) can change the config or the VB commands
+      uint8_t *slotimage = NULL;
+      uint32_t slotimagesize = 0;
+      if(parsed && halStorageStartTransaction(&tid,100,LOG_TAG) == ESP_OK)
+      {
+        if(halStorageCreateImage(tid,halStorageGetCurrentSlotNumber(), \
+          &slotimage,&slotimagesize) != ESP_OK) slotimage = NULL;
+        halStorageFinishTransaction(tid);
+        tid = 0;
+        //a command was processed after the slot file, the image might contain it
+        if(slotimage != NULL && taskCommandsGetSlotSideEffects() != 0)
+        {
+          ESP_LOGI(LOG_TAG,"config changed after the slot file, no image is stored");
+          free(slotimage);
+          slotimage = NULL;
+        }
       }
       
       ESP_LOGD(LOG_TAG,"wait for cmds");
       
+      //activate the new slot for the handlers (one atomic swap each)
+      if(handler_hid_publish() != ESP_OK || handler_vb_publish() != ESP_OK)
+      {
+        ESP_LOGE(LOG_TAG,"cannot publish VB commands");
+      }
+      
       //calibrate
       halAdcCalibrate();
       
@@ -278,11 +631,35 @@ void configSwitcherTask(void * params)
       
       ESP_LOGD(LOG_TAG,"bits set");
       
+      //load the IR commands of this slot into the cache
+      fct_infrared_prefetch();
+      
       //reload general config
-      configUpdate(0);
+      configUpdate();
       
       ESP_LOGD(LOG_TAG,"cfg update");
       
+      configSwitchStats.last = (uint32_t)(esp_timer_get_time() - switchstart);
+      configSwitchStats.image = image;
+      if(image) configSwitchStats.images++;
+      else configSwitchStats.texts++;
+      ESP_LOGI(LOG_TAG,"Slot switch took %uus (%s)",configSwitchStats.last, \
+        image ? "image" : "parsed");
+      
+      //slot file was parsed completely without side effects, store the image for the next switch
+      if(slotimage != NULL)
+      {
+        if(halStorageStartTransaction(&tid,100,LOG_TAG) == ESP_OK)
+        {
+          halStorageStoreImage(tid,halStorageGetCurrentSlotNumber(),slotimage,slotimagesize);
+          halStorageFinishTransaction(tid);
+          tid = 0;
+        } else free(slotimage);
+      }
+      
+      //load the neighbours of this slot into the slot cache
+      if(configprefetch_handle != NULL) xTaskNotifyGive(configprefetch_handle);
+      
       if(justupdate)
       {
         xSemaphoreGive(configUpdatePending);
@@ -290,6 +667,10 @@ void configSwitcherTask(void * params)
       } else {
         ESP_LOGI(LOG_TAG,"----Config Switch Complete, loaded slot %s----",currentConfigLoaded.slotName);
       }
+    } else if(updatepending) {
+      //queued update is due
+      updatepending = 0;
+      configProcessUpdateRequest();
     }
   }
 }
@@ -325,6 +706,14 @@ esp_err_t configSwitcherInit(void)
     ESP_LOGD(LOG_TAG,"configSwitcherTask created");
   }
   
+  //start configPrefetchTask (slot switches work without it)
+  if(xTaskCreate(configPrefetchTask,"configprefetch",CONFIGPREFETCHTASK_STACKSIZE,(void *)NULL,
+    HAL_CONFIG_PREFETCH_PRIORITY,&configprefetch_handle) != pdPASS)
+  {
+    ESP_LOGE(LOG_TAG,"error creating slot prefetch task");
+    configprefetch_handle = NULL;
+  }
+  
   //load the default slot by sending "__DEFAULT" to 
   // the config_switcher queue
   char commandname[SLOTNAME_LENGTH];
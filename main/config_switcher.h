@@ -54,6 +54,57 @@
 #include "hal_ble.h"
 #include "hal_serial.h"
 
+/** @brief Settle window for coalesced config updates [ms]
+ * 
+ * A requested update is applied after no further request
+ * was received within this time.
+ * @see configRequestUpdate */
+#define CONFIG_UPDATE_SETTLE_MS 100
+
+/** @brief Maximum latency of a coalesced config update [ms]
+ * 
+ * A requested update is applied at latest this time after the first
+ * request, even if further requests are received (e.g. a long macro).
+ * @see CONFIG_UPDATE_SETTLE_MS */
+#define CONFIG_UPDATE_MAX_DELAY_MS (CONFIG_UPDATE_SETTLE_MS * 5)
+
+/** @brief Maximum time to wait for the parser after a slot file was loaded [ms]
+ * 
+ * If the end marker of the slot file is not processed within this time,
+ * the slot is activated anyway, but no image is stored.
+ * @see SYSTEM_SLOT_PARSED */
+#define CONFIG_SLOT_PARSE_TIMEOUT_MS 1000
+
+/** @brief Config section: ADC settings (adc_config_t) */
+#define CONFIG_SECTION_ADC      (1<<0)
+/** @brief Config section: routing (USB/BLE active) */
+#define CONFIG_SECTION_ROUTING  (1<<1)
+/** @brief Config section: debounce times */
+#define CONFIG_SECTION_DEBOUNCE (1<<2)
+/** @brief Config section: HID settings (locale, country code, ...) */
+#define CONFIG_SECTION_HID      (1<<3)
+/** @brief Config section: chords (masks & window) */
+#define CONFIG_SECTION_CHORD    (1<<4)
+/** @brief Config section: gesture thresholds */
+#define CONFIG_SECTION_GESTURE  (1<<5)
+/** @brief All config sections */
+#define CONFIG_SECTION_ALL      (CONFIG_SECTION_ADC | CONFIG_SECTION_ROUTING | \
+  CONFIG_SECTION_DEBOUNCE | CONFIG_SECTION_HID | CONFIG_SECTION_CHORD | \
+  CONFIG_SECTION_GESTURE)
+
+/** @brief Timing of slot switches
+ * @see configGetSwitchStats */
+typedef struct config_switch_stats {
+  /** @brief Duration of the last slot switch [us] */
+  uint32_t last;
+  /** @brief 1 if the last slot was installed from its image, 0 if parsed */
+  uint8_t image;
+  /** @brief Count of slot switches done by installing an image */
+  uint32_t images;
+  /** @brief Count of slot switches done by parsing the slot file */
+  uint32_t texts;
+} config_switch_stats_t;
+
 /** Stacksize for functional task task_configswitcher.
  * @see task_configswitcher */
 #define TASK_CONFIGSWITCHER_STACKSIZE 2048
@@ -80,18 +131,41 @@ generalConfig_t* configGetCurrent(void);
 
 /** @brief Request config update
  * 
- * This method is requesting a config update for the general config.
- * It is used either by the command parser to activate a changed config
- * (by AT commands) or by the config switcher task, to activate a config
+ * This method is applying all sections of the general config immediately.
+ * It is used by the config switcher task, to activate a config
  * loaded from flash.
  *  
  * @see config_switcher
  * @see currentConfig
- * @param block Time to wait for finished business before updating. 
- * If 0, returns immediately if not possible.
+ * @see configRequestUpdate
  * @return ESP_OK on success, ESP_FAIL otherwise
  * */
-esp_err_t configUpdate(TickType_t time);
+esp_err_t configUpdate(void);
+
+/** @brief Request a coalesced config update
+ * 
+ * Used by the command parser after a burst of AT commands. The update
+ * is done by the config switcher task after no further request was
+ * received for CONFIG_UPDATE_SETTLE_MS, but not later than
+ * CONFIG_UPDATE_MAX_DELAY_MS after the first request. Only changed
+ * sections (CONFIG_SECTION_*) are applied.
+ * 
+ * @see configGetUpdatesAvoided
+ * @return ESP_OK on success, ESP_FAIL otherwise
+ * */
+esp_err_t configRequestUpdate(void);
+
+/** @brief Get count of avoided config updates
+ * @see configRequestUpdate
+ * @return Count of requests which were merged or did not change anything */
+uint32_t configGetUpdatesAvoided(void);
+
+/** @brief Get the timing of slot switches
+ * 
+ * The duration is measured from receiving a switch request until the
+ * new slot is published & the config is applied.
+ * @param stats Output of the statistics */
+void configGetSwitchStats(config_switch_stats_t *stats);
 
 
 #endif
@@ -41,6 +41,8 @@
 #include "function_tasks/task_debouncer.h"
 #include "function_tasks/task_commands.h"
 #include "function_tasks/task_webgui.h"
+#include "function_tasks/task_cim.h"
+#include "function_tasks/task_rawstream.h"
 #include "hal/hal_adc.h"
 #include "hal/hal_io.h"
 #include "ble_hid/hal_ble.h"
@@ -48,6 +50,11 @@
 #include "config_switcher.h"
 #include "function_tasks/handler_hid.h"
 #include "function_tasks/handler_vb.h"
+#include "function_tasks/handler_chord.h"
+#include "function_tasks/handler_gesture.h"
+#include "function_tasks/slot_arena.h"
+#include "function_tasks/fct_macros.h"
+#include "function_tasks/fct_infrared.h"
 
 #include "config.h"
 
@@ -156,6 +163,14 @@ void app_main()
     
     esp_event_loop_create_default();
 
+    //init slot arena (memory for the VB commands)
+    if(slotArenaInit() == ESP_OK)
+    {
+        ESP_LOGD(LOG_TAG,"slot arena initialized");
+    } else {
+        ESP_LOGE(LOG_TAG,"error initializing slot arena");
+    }
+
     //init HID handler
     if(handler_hid_init() == ESP_OK)
     {
@@ -172,6 +187,38 @@ void app_main()
         ESP_LOGE(LOG_TAG,"error adding VB handler");
     }
 
+    //init chord handler
+    if(handler_chord_init() == ESP_OK)
+    {
+        ESP_LOGD(LOG_TAG,"chord handler initialized");
+    } else {
+        ESP_LOGE(LOG_TAG,"error adding chord handler");
+    }
+
+    //init gesture handler
+    if(handler_gesture_init() == ESP_OK)
+    {
+        ESP_LOGD(LOG_TAG,"gesture handler initialized");
+    } else {
+        ESP_LOGE(LOG_TAG,"error adding gesture handler");
+    }
+
+    //start macro executor
+    if(fct_macro_init() == ESP_OK)
+    {
+        ESP_LOGD(LOG_TAG,"macro executor initialized");
+    } else {
+        ESP_LOGE(LOG_TAG,"error initializing macro executor");
+    }
+
+    //init IR command cache
+    if(fct_infrared_init() == ESP_OK)
+    {
+        ESP_LOGD(LOG_TAG,"IR cache initialized");
+    } else {
+        ESP_LOGE(LOG_TAG,"error initializing IR cache");
+    }
+
     //start BLE (mouse/keyboard interfaces active)
     if(halBLEInit(1,1,0) == ESP_OK)
     {
@@ -189,6 +236,22 @@ void app_main()
         ESP_LOGE(LOG_TAG,"error initializing halSerial");
     }
     
+    //CIM mode (AsTeRICS binary protocol)
+    if(taskCIMInit() == ESP_OK)
+    {
+        ESP_LOGD(LOG_TAG,"initialized taskCIM");
+    } else {
+        ESP_LOGE(LOG_TAG,"error initializing taskCIM");
+    }
+    
+    //raw value stream (AT SR)
+    if(taskRawStreamInit() == ESP_OK)
+    {
+        ESP_LOGD(LOG_TAG,"initialized taskRawStream");
+    } else {
+        ESP_LOGE(LOG_TAG,"error initializing taskRawStream");
+    }
+    
     //command parser
     if(taskCommandsInit() == ESP_OK)
     {
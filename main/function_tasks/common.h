@@ -95,6 +95,20 @@
 /** @brief maximum length for an AT command (including parameters & 'AT ', e.g., macro text) */
 #define ATCMD_LENGTH   256
 
+/** @brief Marker, queued to task_commands before the lines of a slot file
+ * 
+ * The parser starts with a clean context & counts the commands with
+ * side effects from now on.
+ * @see halStorageLoadNumber */
+#define CMD_SLOT_BEGIN "__SLOTBEGIN"
+
+/** @brief Marker, queued to task_commands after the last line of a slot file
+ * 
+ * The parser sets SYSTEM_SLOT_PARSED, if all lines are processed.
+ * @see SYSTEM_SLOT_PARSED
+ * @see halStorageLoadNumber */
+#define CMD_SLOT_END "__SLOTEND"
+
 /** ID of storage revision. Is used to determine any data storage upgrades */
 #define STORAGE_ID    0xC0FFEE01
 
@@ -137,6 +151,10 @@
 /** @brief AT command queue is empty */
 #define SYSTEM_EMPTY_CMD_QUEUE (1<<2)
 
+/** @brief All lines of a slot file are parsed (end marker was processed)
+ * @see CMD_SLOT_END */
+#define SYSTEM_SLOT_PARSED (1<<3)
+
 /** this flag group is used to determine the routing
  * of different data to either USB, BLE or both.
  * In addition this flag group contains status information
@@ -190,8 +208,9 @@ extern QueueHandle_t hid_ble;
  * * "__DEFAULT" for default slot
  * * "__RESTOREFACTORY" to delete all slots & reset default 
  *    slot to factory defaults
- * * "__UPDATE" to reload tasks based on currentConfig. Used to
+ * * "__UPDATE" to apply changed sections of currentConfig. Used to
  *  update the configuration when changed by configuration software/GUI.
+ *  Do not send directly, use configRequestUpdate (coalesced updates).
  * 
  * @see SLOTNAME_LENGTH
  * @see configSwitcherTask
@@ -271,6 +290,60 @@ extern QueueHandle_t debouncer_in;
  * immediately, instead of attaching it to a VB. */
 #define VB_SINGLESHOT   32
 
+/** @brief Gesture: short press & release */
+#define VB_GESTURE_TAP        0
+/** @brief Gesture: two taps */
+#define VB_GESTURE_DOUBLETAP  1
+/** @brief Gesture: held longer than the long press time, released with the VB */
+#define VB_GESTURE_LONGPRESS  2
+/** @brief Gesture: repeated while held after a long press */
+#define VB_GESTURE_REPEAT     3
+/** @brief Count of gestures */
+#define VB_GESTURE_COUNT      4
+
+/** @brief First VB number of a gesture (after VB_SINGLESHOT)
+ * @see VB_GESTURE
+ * @see handler_gesture.h */
+#define VB_GESTURE_FIRST (VB_SINGLESHOT+1)
+
+/** @brief VB number of a gesture for an input VB (< VB_MAX)
+ * 
+ * Gestures are grouped by type, e.g. for the FLipMouse the taps are
+ * VB 33-52, double taps VB 53-72,...
+ * @param vb Input VB
+ * @param gesture Gesture type (VB_GESTURE_*) */
+#define VB_GESTURE(vb,gesture) (VB_GESTURE_FIRST + ((gesture)*VB_MAX) + (vb))
+
+/** @brief Count of available chords
+ * 
+ * Can be set by the build (e.g. -DVB_CHORD_COUNT=24), max. 32.
+ * Each chord needs 4 bytes in the config & 2 VB bindings.
+ * @see handler_chord.h */
+#ifndef VB_CHORD_COUNT
+  #define VB_CHORD_COUNT  16
+#endif
+
+#if VB_CHORD_COUNT > 32
+  #error "VB_CHORD_COUNT: max. 32 chords are supported"
+#endif
+
+/** @brief First VB number of a chord, chord n triggers VB (VB_CHORD_FIRST+n)
+ * 
+ * Chords follow the gestures, e.g. for the FLipMouse chord 0 is VB 113.
+ * @note VBs from VB_MAX up to VB_SINGLESHOT are not used.
+ * @see handler_chord.h */
+#define VB_CHORD_FIRST  VB_GESTURE(0,VB_GESTURE_COUNT)
+
+/** @brief Count of VBs, which can be used for HID/VB commands.
+ * 
+ * Includes the input VBs, gestures and chords.
+ * @note VB_SINGLESHOT is within this range, but cannot be used with AT BM. */
+#define VB_MAX_BINDABLE (VB_CHORD_FIRST + VB_CHORD_COUNT)
+
+#if VB_MAX_BINDABLE > 0xFFFF
+  #error "VB numbers must fit into 16 bits"
+#endif
+
 /** @brief Event ID for the event loop of press/release events for VBs
  * 
  * If there is a button pressed, the sip/puff is triggered,..., an event
@@ -295,6 +368,14 @@ ESP_EVENT_DECLARE_BASE(VB_EVENT);
 #define HAL_BLE_TASK_PRIORITY_BASE  (tskIDLE_PRIORITY + 2)
 #define HAL_CONFIG_TASK_PRIORITY  (tskIDLE_PRIORITY + 5)
 #define TASK_COMMANDS_PRIORITY  (tskIDLE_PRIORITY + 6)
+/** CIM task, needs to process samples at least with ADC rate */
+#define TASK_CIM_PRIORITY  (tskIDLE_PRIORITY + 3)
+/** Raw value stream sender, lower than ADC tasks (ADC never waits for it) */
+#define TASK_RAWSTREAM_PRIORITY  (tskIDLE_PRIORITY + 1)
+/** Macro executor, below the command parser (which processes the macro's commands) */
+#define TASK_MACRO_PRIORITY  (tskIDLE_PRIORITY + 4)
+/** Slot prefetching, in the background (after all other tasks) */
+#define HAL_CONFIG_PREFETCH_PRIORITY  (tskIDLE_PRIORITY + 1)
 
 /*++++ MAIN CONFIG STRUCT ++++*/
 
@@ -356,7 +437,8 @@ typedef struct adc_config {
   uint16_t threshold_strongsip;
   /** pressure sensor, strongpuff threshold */
   uint16_t threshold_strongpuff;
-  /** Enable report RAW values (!=0), values are sent via halSerialSendUSBSerial */
+  /** Enable report RAW values (!=0), values are passed to task_rawstream
+   * @see taskRawStreamPush */
   uint8_t reportraw;
   /** joystick axis assignment TBD: assign axis to numbers*/
   uint8_t axis;
@@ -378,6 +460,27 @@ typedef enum {
   T_MACRO /** @brief Trigger macro execution */
 } vb_cmd_type_t;
 
+/** @brief Maximum count of VBs with individual anti-tremor times in one slot
+ * 
+ * Only input VBs are debounced, so each of them can have own times. */
+#define DEBOUNCE_VB_PARAMS VB_MAX
+
+/** @brief Individual anti-tremor (debounce) times of one VB
+ * 
+ * Only VBs with an individual setting (AT BM + AT AP/AR/AI) are stored,
+ * the config does not grow with the number of VBs.
+ * A time of 0 uses the global time. */
+typedef struct vb_param {
+  /** @brief Number of the virtual button */
+  uint16_t vb;
+  /** @brief Anti-tremor time for press */
+  uint16_t press;
+  /** @brief Anti-tremor time for release */
+  uint16_t release;
+  /** @brief Anti-tremor time for idle */
+  uint16_t idle;
+} vb_param_t;
+
 typedef struct generalConfig {
   uint32_t slotversion;
   adc_config_t adc;
@@ -401,6 +504,12 @@ typedef struct generalConfig {
   uint16_t debounce_release;
   /** @brief Global anti-tremor time for idle */
   uint16_t debounce_idle;
+  /** @brief Debouncer engine for this slot.
+   * 
+   * * 0 uses one esp_timer per VB (default)
+   * * 1 uses one periodic tick for all VBs
+   * @see task_debouncer.h */
+  uint8_t debounce_engine;
   /** @brief Enable/disable button learning mode
    * @todo Move to "volatile" storage, independent from slot change */
   uint8_t button_learn;
@@ -412,22 +521,53 @@ typedef struct generalConfig {
    * * 3 gives LED and buzzer feedback
    * */
   uint8_t feedback;
-  /** @brief Anti-tremor (debounce) time for press of each VB */
-  uint16_t debounce_press_vb[NUMBER_VIRTUALBUTTONS*4];
-  /** @brief Anti-tremor (debounce) time for release of each VB */
-  uint16_t debounce_release_vb[NUMBER_VIRTUALBUTTONS*4];
-  /** @brief Anti-tremor (debounce) time for idle of each VB */
-  uint16_t debounce_idle_vb[NUMBER_VIRTUALBUTTONS*4];
+  /** @brief Individual anti-tremor (debounce) times, first debounce_vb_count entries are used */
+  vb_param_t debounce_vb[DEBOUNCE_VB_PARAMS];
+  /** @brief Count of used entries in debounce_vb */
+  uint8_t debounce_vb_count;
+  /** @brief Chord definitions, one bitmask of VBs (< VB_MAX) for each chord
+   * 
+   * A mask of 0 disables this chord.
+   * @see handler_chord.h */
+  uint32_t chord_mask[VB_CHORD_COUNT];
+  /** @brief Simultaneity window for chords in [ms]
+   * 
+   * All VBs of a chord must be pressed within this time.
+   * 0 disables the window (any order & time) */
+  uint16_t chord_window;
+  /** @brief Gesture: maximum press time for a tap in [ms]
+   * 
+   * 0 disables taps & double taps.
+   * @see handler_gesture.h */
+  uint16_t gesture_tap;
+  /** @brief Gesture: maximum time between 2 taps for a double tap in [ms]
+   * 
+   * 0 disables double taps, a tap is reported immediately on release. */
+  uint16_t gesture_doubletap;
+  /** @brief Gesture: minimum press time for a long press in [ms]
+   * 
+   * 0 disables long press & repeat. */
+  uint16_t gesture_longpress;
+  /** @brief Gesture: repeat interval in [ms] while held after a long press
+   * 
+   * 0 disables repeat. */
+  uint16_t gesture_repeat;
+  /** @brief Cancel running macros on the release of their VB
+   * 
+   * 0 lets macros run to the end (default).
+   * @see fct_macros.h */
+  uint8_t macro_release;
   /** @brief Slotname of this config */
   char slotName[SLOTNAME_LENGTH];
 } generalConfig_t;
 
-/** @brief One VB command (not HID), maybe an element of a command chain */
+/** @brief One VB command (not HID) */
 typedef struct vb_cmd vb_cmd_t;
 
-/** @brief One VB command (not HID), maybe an element of a command chain 
+/** @brief One VB command (not HID)
  * 
  * This struct is used for VB commands, which are not HID commands.
+ * Stored commands are kept in arrays per VB & event by handler_vb.
  * 
  * @todo Document this struct more.
  * @see task_vb_addCmd
@@ -435,53 +575,51 @@ typedef struct vb_cmd vb_cmd_t;
  * @see task_vb_getCmdChain
  * @see task_vb_setCmdChain */
 struct vb_cmd {
-  /** @brief Number of virtual button. MSB signals if this is a press or
-   * release action:
-   * * If it is set (mask: 0x80), it is a press action
-   * * If it is cleared, it is a release action 
-   * */
-  uint8_t vb;
+  /** @brief Number of virtual button
+   * @see VB_MAX_BINDABLE */
+  uint16_t vb;
+  /** @brief Triggering event of this VB (VB_PRESS_EVENT or VB_RELEASE_EVENT) */
+  uint8_t event;
   /** @brief Type of command */
   vb_cmd_type_t cmd;
-  /** @brief Original AT command string, might be NULL if not used */
+  /** @brief Original AT command string, might be NULL if not used or
+   * if it can be regenerated. Stored strings are interned (shared). */
   char *atoriginal;
   /** @brief Parameter string, e.g. for slot names. Might be NULL if not necessary */
   char *cmdparam;
-  /** @brief Pointer to next VB command element, might be NULL. */
-  struct vb_cmd *next;
+  /** @brief Compiled macro (T_MACRO), NULL if not compiled
+   * @see cmdMacroCompile */
+  uint8_t *macro;
 };
 
 
-/** @brief One HID command, maybe an element of a command chain */
+/** @brief One HID command */
 typedef struct hid_cmd hid_cmd_t;
 
-/** @brief  One HID command, maybe an element of a command chain
+/** @brief  One HID command
  *
  * This struct is used either as one element to be passed to hal_serial
- * or the BLE class OR it is used to form a chained list of all HID
- * commands, which are currently active. task_hid takes care
- * of maintaining a list of all active VBs, if one gets triggered (via
- * task_debouncer), the HID task walks through this list for one or more
- * (in case of multiple press/release actions) HID commands, which are
- * sent to the BLE/USB HAL.
+ * or the BLE class OR it is stored in the arrays of all HID commands,
+ * which are currently active. handler_hid keeps these arrays per VB &
+ * event, if one VB gets triggered (via task_debouncer), the handler
+ * sends all (in case of multiple press/release actions) HID commands
+ * of this VB & event to the BLE/USB HAL.
  * @see task_hid_addCmd
  * @see task_hid_clearCmds
  * @see task_hid_getCmdChain
  * @see task_hid_setCmdChain */
 struct hid_cmd {
-  /** @brief Number of virtual button. MSB signals if this is a press or
-   * release action:
-   * * If it is set (mask: 0x80), it is a press action
-   * * If it is cleared, it is a release action 
-   * */
-  uint8_t vb;
+  /** @brief Number of virtual button
+   * @see VB_MAX_BINDABLE */
+  uint16_t vb;
+  /** @brief Triggering event of this VB (VB_PRESS_EVENT or VB_RELEASE_EVENT) */
+  uint8_t event;
   /** @brief Command to be sent, see HID_kbdmousejoystick.cpp or the
    * usb_bridge for explanations. */
   uint8_t cmd[3];
-  /** @brief Original AT command string, might be NULL if not used */
+  /** @brief Original AT command string, might be NULL if not used.
+   * Stored strings are interned (shared). */
   char *atoriginal;
-  /** @brief Pointer to next HID command element, might be NULL. */
-  struct hid_cmd *next;
 };
 
 /** @brief State of IR receiver
@@ -523,12 +661,20 @@ typedef struct raw_action {
   void *payload;
 } raw_action_t;
 
+/** @brief VB number of a raw_action_t, which only notifies the debouncer
+ * about a new published state.
+ * @see taskDebouncerPublish */
+#define RAW_ACTION_SNAPSHOT 0xFFFFFFFF
+
 /** @brief Strips away \\r\\t and \\n */
 void strip(char *s);
 
 /** @brief NVS key for wifi password */
 #define NVS_WIFIPW  "nvswifipw"
 
+/** @brief NVS key for the memory budget of the slot cache */
+#define NVS_SLOTCACHE  "nvsslotcache"
+
 /** @brief Minutes between last client disconnected and WiFi is switched off */
 #define WIFI_OFF_TIME 5
 
@@ -26,18 +26,218 @@
  * Pinning and low-level interfacing for infrared is done in hal_io.c,
  * this part here manages loading & storing the commands.
  * 
+ * Loaded IR commands are kept in a LRU cache (IR_CACHE_ENTRIES), a
+ * repeated IR command is sent without accessing the storage. The cache
+ * is invalidated if IR commands are stored or deleted, the IR commands
+ * of a new slot are prefetched by the config switcher.
+ * 
  * @see hal_io.c
  */
 #include "fct_infrared.h"
+#include "handler_vb.h"
 
 /** @brief Logging tag for this module */
 #define LOG_TAG "fct_IR"
 
+/** @brief One cached IR command */
+typedef struct ir_cache_entry {
+  /** @brief Name of the IR command */
+  char name[SLOTNAME_LENGTH];
+  /** @brief IR edges, NULL if this entry is not used */
+  rmt_item32_t *buffer;
+  /** @brief Count of IR edges */
+  uint16_t count;
+  /** @brief Value of irCacheStamp on the last use, for LRU replacement */
+  uint32_t lastUsed;
+} ir_cache_entry_t;
+
+/** @brief Cached IR commands */
+static ir_cache_entry_t irCache[IR_CACHE_ENTRIES];
+
+/** @brief Counter for the LRU replacement, increased on each use */
+static uint32_t irCacheStamp = 0;
+
+/** @brief Generation of the stored IR commands, the cache is valid for
+ * @see halStorageGetIRGeneration */
+static uint32_t irCacheGeneration = 0;
+
+/** @brief Statistics, returned by fct_infrared_get_stats */
+static ir_cache_stats_t irCacheStats;
+
+/** @brief Synchronization mutex for accessing the cache */
+static SemaphoreHandle_t irCacheSem = NULL;
+
+/** @brief Release all cached IR commands, if IR commands were changed
+ * @note irCacheSem must be taken */
+static void fct_infrared_cache_check(void)
+{
+  uint32_t generation = halStorageGetIRGeneration();
+  if(generation == irCacheGeneration) return;
+  
+  for(uint8_t i = 0; i<IR_CACHE_ENTRIES; i++)
+  {
+    if(irCache[i].buffer != NULL) free(irCache[i].buffer);
+    irCache[i].buffer = NULL;
+  }
+  irCacheStats.entries = 0;
+  irCacheStats.bytes = 0;
+  irCacheGeneration = generation;
+  ESP_LOGD(LOG_TAG,"IR commands changed, cache cleared");
+}
+
+/** @brief Get a copy of a cached IR command
+ * @param cmdName Name of the IR command
+ * @param cfg Output, a copy of the IR edges is allocated
+ * @return ESP_OK if found, ESP_FAIL if not cached (or no memory) */
+static esp_err_t fct_infrared_cache_get(char *cmdName, halIOIR_t *cfg)
+{
+  esp_err_t ret = ESP_FAIL;
+  
+  if(irCacheSem == NULL) return ESP_FAIL;
+  if(xSemaphoreTake(irCacheSem,10) != pdTRUE) return ESP_FAIL;
+  fct_infrared_cache_check();
+  
+  for(uint8_t i = 0; i<IR_CACHE_ENTRIES; i++)
+  {
+    ir_cache_entry_t *e = &irCache[i];
+    if(e->buffer == NULL || strcmp(e->name,cmdName) != 0) continue;
+    //the buffer is freed after sending, we need a copy
+    cfg->buffer = malloc(sizeof(rmt_item32_t)*e->count);
+    if(cfg->buffer != NULL)
+    {
+      memcpy(cfg->buffer,e->buffer,sizeof(rmt_item32_t)*e->count);
+      cfg->count = e->count;
+      e->lastUsed = ++irCacheStamp;
+      ret = ESP_OK;
+    }
+    break;
+  }
+  xSemaphoreGive(irCacheSem);
+  return ret;
+}
+
+/** @brief Add an IR command to the cache
+ * 
+ * If the cache is full, the least recently used command is replaced.
+ * @param cmdName Name of the IR command
+ * @param cfg IR command, the edges are copied
+ * @param generation Generation of the IR commands, when this command was loaded */
+static void fct_infrared_cache_put(char *cmdName, halIOIR_t *cfg, uint32_t generation)
+{
+  if(irCacheSem == NULL) return;
+  if(xSemaphoreTake(irCacheSem,10) != pdTRUE) return;
+  fct_infrared_cache_check();
+  
+  //IR commands were changed while loading, don't cache an old one
+  if(generation != irCacheGeneration)
+  {
+    xSemaphoreGive(irCacheSem);
+    return;
+  }
+  
+  //use the entry of this name, a free one or the least recently used
+  ir_cache_entry_t *e = &irCache[0];
+  for(uint8_t i = 0; i<IR_CACHE_ENTRIES; i++)
+  {
+    if(irCache[i].buffer != NULL && strcmp(irCache[i].name,cmdName) == 0)
+    {
+      e = &irCache[i];
+      break;
+    }
+    if(e->buffer == NULL) continue;
+    if(irCache[i].buffer == NULL || irCache[i].lastUsed < e->lastUsed) e = &irCache[i];
+  }
+  
+  rmt_item32_t *buf = malloc(sizeof(rmt_item32_t)*cfg->count);
+  if(buf != NULL)
+  {
+    memcpy(buf,cfg->buffer,sizeof(rmt_item32_t)*cfg->count);
+    if(e->buffer != NULL)
+    {
+      free(e->buffer);
+      irCacheStats.entries--;
+      irCacheStats.bytes -= sizeof(rmt_item32_t)*e->count;
+    }
+    e->buffer = buf;
+    e->count = cfg->count;
+    strncpy(e->name,cmdName,SLOTNAME_LENGTH-1);
+    e->name[SLOTNAME_LENGTH-1] = 0;
+    e->lastUsed = ++irCacheStamp;
+    irCacheStats.entries++;
+    irCacheStats.bytes += sizeof(rmt_item32_t)*e->count;
+  } else {
+    ESP_LOGW(LOG_TAG,"No memory to cache IR cmd");
+  }
+  xSemaphoreGive(irCacheSem);
+}
+
+/** @brief Load an IR command from the storage & add it to the cache
+ * @param cmdName Name of the IR command
+ * @param cfg Output of the IR command, the edges are allocated
+ * @param tid Transaction ID
+ * @return ESP_OK if loaded, ESP_FAIL otherwise */
+static esp_err_t fct_infrared_load(char *cmdName, halIOIR_t *cfg, uint32_t tid)
+{
+  //no changes within a transaction
+  uint32_t generation = halStorageGetIRGeneration();
+  if(halStorageLoadIR(cmdName,cfg,tid) != ESP_OK) return ESP_FAIL;
+  fct_infrared_cache_put(cmdName,cfg,generation);
+  return ESP_OK;
+}
+
+esp_err_t fct_infrared_init(void)
+{
+  if(irCacheSem == NULL) irCacheSem = xSemaphoreCreateMutex();
+  if(irCacheSem == NULL)
+  {
+    ESP_LOGE(LOG_TAG,"Cannot create mutex, exiting!");
+    return ESP_FAIL;
+  }
+  return ESP_OK;
+}
+
+void fct_infrared_prefetch(void)
+{
+  char names[IR_CACHE_ENTRIES][SLOTNAME_LENGTH];
+  halIOIR_t cfg;
+  uint32_t tid;
+  
+  //IR commands of this slot, more than the cache can hold are not loaded
+  uint16_t count = handler_vb_getParams(T_SENDIR,names,IR_CACHE_ENTRIES);
+  if(count == 0) return;
+  
+  if(halStorageStartTransaction(&tid,20,LOG_TAG) != ESP_OK)
+  {
+    ESP_LOGE(LOG_TAG,"Error starting transaction for IR prefetch");
+    return;
+  }
+  for(uint16_t i = 0; i<count; i++)
+  {
+    //already cached, just mark it as used
+    if(fct_infrared_cache_get(names[i],&cfg) == ESP_OK)
+    {
+      free(cfg.buffer);
+      continue;
+    }
+    if(fct_infrared_load(names[i],&cfg,tid) == ESP_OK) free(cfg.buffer);
+    else ESP_LOGW(LOG_TAG,"Cannot prefetch IR cmd %s",names[i]);
+  }
+  halStorageFinishTransaction(tid);
+  ESP_LOGI(LOG_TAG,"Prefetched %d IR cmds",count);
+}
+
+void fct_infrared_get_stats(ir_cache_stats_t *stats)
+{
+  if(stats == NULL) return;
+  memcpy(stats,&irCacheStats,sizeof(ir_cache_stats_t));
+}
+
 
 /**@brief FUNCTION - Infrared command sending
  * 
  * This task is used to trigger an IR command on a VB action.
  * The IR command which should be sent is identified by a name.
+ * If the command is not cached, it is loaded from the storage.
  * 
  * @see taskInfraredConfig_t
  * @param param Task config
@@ -49,20 +249,32 @@ void fct_infrared_send(char* cmdName)
   halIOIR_t *cfg = malloc(sizeof(halIOIR_t));
   //transaction ID for IR data
   uint32_t tid;
+  
+  if(cfg == NULL)
+  {
+    ESP_LOGE(LOG_TAG,"IR cfg is NULL!");
+    return;
+  }
+  
+  //try the cache first, no storage access is necessary
+  if(fct_infrared_cache_get(cmdName,cfg) == ESP_OK)
+  {
+    irCacheStats.hits++;
+    ESP_LOGI(LOG_TAG,"Triggering cached IR cmd, length %d",cfg->count);
+    SENDIRSTRUCT(cfg);
+    free(cfg);
+    TONE(TONE_IR_SEND_FREQ,TONE_IR_SEND_DURATION);
+    return;
+  }
+  irCacheStats.misses++;
+  
   if(halStorageStartTransaction(&tid,20,LOG_TAG) == ESP_OK)
   {
-    if(halStorageLoadIR(cmdName,cfg,tid) == ESP_OK)
+    if(fct_infrared_load(cmdName,cfg,tid) == ESP_OK)
     {
       //send pointer to IR send queue
-      if(cfg != NULL)
-      {
-        ESP_LOGI(LOG_TAG,"Triggering IR cmd, length %d",cfg->count);
-        SENDIRSTRUCT(cfg);
-        //free config afterwards (whole config is saved to queue)
-        free(cfg);
-      } else {
-        ESP_LOGE(LOG_TAG,"IR cfg is NULL!");
-      }
+      ESP_LOGI(LOG_TAG,"Triggering IR cmd, length %d",cfg->count);
+      SENDIRSTRUCT(cfg);
       //create tone
       TONE(TONE_IR_SEND_FREQ,TONE_IR_SEND_DURATION);
     } else {
@@ -72,6 +284,8 @@ void fct_infrared_send(char* cmdName)
   } else {
     ESP_LOGE(LOG_TAG,"Error starting transaction for IR cmd");
   }
+  //free config afterwards (edges are freed by sending)
+  free(cfg);
 }
 
 /** @brief FUNCTION - Trigger an IR command recording.
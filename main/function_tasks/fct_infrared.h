@@ -26,6 +26,11 @@
  * Pinning and low-level interfacing for infrared is done in hal_io.c,
  * this part here manages loading & storing the commands.
  * 
+ * Loaded IR commands are kept in a LRU cache (IR_CACHE_ENTRIES), a
+ * repeated IR command is sent without accessing the storage. The cache
+ * is invalidated if IR commands are stored or deleted, the IR commands
+ * of a new slot are prefetched by the config switcher.
+ * 
  * @see hal_io.c
  */
 
@@ -35,6 +40,7 @@
 #include <freertos/FreeRTOS.h>
 #include <freertos/event_groups.h>
 #include <freertos/queue.h>
+#include <freertos/semphr.h>
 #include <esp_log.h>
 //used for rmt_item32_t type
 #include "driver/rmt.h"
@@ -42,6 +48,36 @@
 #include "common.h"
 #include "../config_switcher.h"
 
+/** @brief Count of IR commands kept in the cache */
+#define IR_CACHE_ENTRIES 8
+
+/** @brief Statistics of the IR command cache */
+typedef struct ir_cache_stats {
+  /** @brief IR commands sent from the cache */
+  uint32_t hits;
+  /** @brief IR commands loaded from the storage */
+  uint32_t misses;
+  /** @brief Count of cached IR commands */
+  uint8_t entries;
+  /** @brief Bytes used by the cached IR commands */
+  uint32_t bytes;
+} ir_cache_stats_t;
+
+/** @brief Init the IR command cache
+ * @return ESP_OK on success, ESP_FAIL otherwise */
+esp_err_t fct_infrared_init(void);
+
+/** @brief Load the IR commands used by the active slot into the cache
+ * 
+ * The IR commands of all VB commands (AT IP) are loaded, until the cache
+ * is full. Called by the config switcher, after a new slot is active.
+ * @see handler_vb_getParams */
+void fct_infrared_prefetch(void);
+
+/** @brief Get the statistics of the IR command cache
+ * @param stats Output of the statistics */
+void fct_infrared_get_stats(ir_cache_stats_t *stats);
+
 /**@brief FUNCTION - Set the time between two IR edges which will trigger the timeout
  * (end of received command)
  * 
@@ -77,6 +113,7 @@ esp_err_t fct_infrared_record(char* cmdName, uint8_t outputtoserial);
  * 
  * This task is used to trigger an IR command on a VB action.
  * The IR command which should be sent is identified by a name.
+ * If the command is not cached, it is loaded from the storage.
  * 
  * @see taskInfraredConfig_t
  * @param param Task config
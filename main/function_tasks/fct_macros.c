@@ -26,97 +26,401 @@
  * Macros in context of FLipMouse/FABI are a string of concatenated
  * AT commands, equal to normal AT commands sent by the host.
  * 
+ * Macros are executed by an own task (macro executor), fct_macro only
+ * queues a request and never blocks the caller (e.g. the event loop).
+ * The executor holds up to MACRO_INSTANCES running macros, which
+ * might overlap. Instead of delaying the task, an AT WA sets the wake
+ * up time of this macro, the executor sleeps until the next macro is due
+ * (or a new request is received).
+ * 
+ * A running macro is canceled if its VB triggers the macro again
+ * (restart). If enabled in the config (AT MR), it is canceled on the
+ * release of its VB as well.
+ * 
+ * Macros are compiled to a list of operations (cmdMacroCompile), when
+ * the AT MA command is parsed for a VB. Mouse, keyboard & joystick
+ * commands are stored as HID commands, AT WA as wait time, other commands
+ * are stored as text and sent to the command parser on execution.
+ * 
  * @note AT command separation is done by a semicolon (';')
  * @warning If you want to write the semicolon within a macro, use AT KP with the corresponding keycode!
  */
 
 #include "fct_macros.h"
+#include "task_commands.h"
+#include "../config_switcher.h"
 
 /** @brief Logging tag for this module */
 #define LOG_TAG "macro"
 
+/** @brief Type of a request for the macro executor */
+typedef enum {
+  MACRO_START, /** @brief Start a new macro */
+  MACRO_RELEASE /** @brief VB was released, cancel its macros */
+} macro_request_type_t;
 
-/**@brief FUNCTION - Macro execution
- * 
- * This function is used to trigger macro on a VB action.
- * 
- * @param param Macro command string
- * @return ESP_OK on success, ESP_FAIL otherwise
- * */
-esp_err_t fct_macro(char *param)
+/** @brief Request for the macro executor */
+typedef struct macro_request {
+  /** @brief Type of request */
+  macro_request_type_t type;
+  /** @brief Triggering/released VB */
+  uint16_t vb;
+  /** @brief Compiled macro (MACRO_START), freed by the executor */
+  uint8_t *macro;
+} macro_request_t;
+
+/** @brief One running macro */
+typedef struct macro_instance {
+  /** @brief Compiled macro, NULL if this instance is not used */
+  uint8_t *macro;
+  /** @brief Offset of the next operation in the compiled macro */
+  uint32_t offset;
+  /** @brief Triggering VB */
+  uint16_t vb;
+  /** @brief Tick count, when the next command is due */
+  TickType_t wake;
+} macro_instance_t;
+
+/** @brief Running macros, only accessed by the macro executor */
+static macro_instance_t macroInstances[MACRO_INSTANCES];
+
+/** @brief Request queue of the macro executor */
+static QueueHandle_t macroQueue = NULL;
+
+/** @brief Count of running macros, which are triggered by a VB.
+ * Used to avoid release requests if nothing is running. */
+static volatile uint8_t macroRunning = 0;
+
+/** @brief Send one command of a macro to the command parser
+ * @param cmd AT command string */
+static void fct_macro_send(const char *cmd)
 {
-  //check for param struct
-  if(param == NULL)
+  atcmd_t command;
+  uint32_t length = strlen(cmd);
+  uint8_t *buffer = malloc(sizeof(uint8_t)*(length+1));
+  if(buffer != NULL)
   {
-    ESP_LOGE(LOG_TAG,"param is NULL ");
-    return ESP_FAIL;
+    //copy data, including the terminator
+    memcpy(buffer,cmd,length+1);
+    //save to queue struct
+    command.buf = buffer;
+    command.len = length;
+    ESP_LOGD(LOG_TAG,"Sent AT cmd: %s",buffer);
+    //send to queue, wait maximum 10 ticks (100ms) for a free space.
+    if(xQueueSend(halSerialATCmds,(void*)&command,10) != pdTRUE)
+    {
+      ESP_LOGE(LOG_TAG,"Cmd queue is full, cannot send command");
+      free(buffer);
+    }
+  } else {
+    ESP_LOGE(LOG_TAG,"Cannot allocate memory for command!");
   }
+}
+
+/** @brief Send one HID command of a macro to the HID tasks
+ * @param data Command bytes (3 bytes) */
+static void fct_macro_hid(const uint8_t *data)
+{
+  hid_cmd_t cmd;
+  memset(&cmd,0,sizeof(hid_cmd_t));
+  memcpy(cmd.cmd,data,3);
   
-  int offset = 0;
-  int start = 0;
+  //post values to mouse queue (USB and/or BLE)
+  if(xEventGroupGetBits(connectionRoutingStatus) & DATATO_USB)
+  {
+    if(xQueueSend(hid_usb,&cmd,2) != pdTRUE) ESP_LOGW(LOG_TAG,"USB HID queue is full");
+  }
+  if(xEventGroupGetBits(connectionRoutingStatus) & DATATO_BLE)
+  {
+    if(xQueueSend(hid_ble,&cmd,2) != pdTRUE) ESP_LOGW(LOG_TAG,"BLE HID queue is full");
+  }
+}
+
+/** @brief Execute one VB command of a macro
+ * @param type Type of the VB command
+ * @param param Parameter string */
+static void fct_macro_vb(vb_cmd_type_t type, const char *param)
+{
+  switch(type)
+  {
+    case T_CONFIGCHANGE:
+    {
+      char slotname[SLOTNAME_LENGTH];
+      strncpy(slotname,param,SLOTNAME_LENGTH-1);
+      slotname[SLOTNAME_LENGTH-1] = 0;
+      xQueueSend(config_switcher,(void*)slotname,(TickType_t)10);
+      break;
+    }
+    case T_CALIBRATE:
+      halAdcCalibrate();
+      break;
+    case T_SENDIR:
+      fct_infrared_send((char*)param);
+      break;
+    default:
+      ESP_LOGE(LOG_TAG,"Unsupported VB command in macro: %d",type);
+      break;
+  }
+}
+
+/** @brief Execute the next operations of a macro
+ * 
+ * All operations are executed until a wait is reached (the wake up time
+ * is set) or the macro is finished.
+ * @param m Running macro
+ * @return 1 if the macro waits, 0 if it is finished */
+static uint8_t fct_macro_step(macro_instance_t *m)
+{
+  const uint8_t *op = &m->macro[m->offset];
   
-  while(offset < SLOTNAME_LENGTH)
+  while(1)
   {
-    //end loop if terminators are detected.
-    if(param[offset] == '\r' || param[offset] == '\n') break;
-    
-    //do we reach a command terminator?
-    if(param[offset] == ';')
+    switch(op[0])
     {
-      //check if this character is escaped:
-      if(offset > 0)
+      case MACRO_OP_HID:
+        fct_macro_hid(&op[1]);
+        op += 4;
+        break;
+      case MACRO_OP_WAIT:
       {
-        if(param[offset-1] == '\\')
-        {
-          //if it escaped "\;", just continue.
-          offset++;
-          continue;
-        }
+        //set the wake up time & continue after this operation
+        uint32_t time = op[1] | (op[2] << 8);
+        m->wake += time / portTICK_PERIOD_MS;
+        m->offset = (op + 3) - m->macro;
+        return 1;
       }
+      case MACRO_OP_VB:
+        fct_macro_vb(op[1],(const char*)&op[2]);
+        op += 3 + strlen((const char*)&op[2]);
+        break;
+      case MACRO_OP_AT:
+        fct_macro_send((const char*)&op[1]);
+        op += 2 + strlen((const char*)&op[1]);
+        break;
+      case MACRO_OP_END:
+      default:
+        return 0;
+    }
+  }
+}
+
+/** @brief Cancel (or finish) a running macro
+ * @param m Running macro */
+static void fct_macro_free(macro_instance_t *m)
+{
+  if(m->macro == NULL) return;
+  free(m->macro);
+  m->macro = NULL;
+  if(m->vb != VB_SINGLESHOT) macroRunning--;
+}
+
+/** @brief Cancel all running macros of one VB
+ * @param vb VB of the macros to be canceled */
+static void fct_macro_cancel(uint16_t vb)
+{
+  for(uint8_t i = 0; i<MACRO_INSTANCES; i++)
+  {
+    if(macroInstances[i].macro != NULL && macroInstances[i].vb == vb)
+    {
+      ESP_LOGD(LOG_TAG,"Canceled macro of VB %d",vb);
+      fct_macro_free(&macroInstances[i]);
+    }
+  }
+}
+
+/** @brief Start a new macro
+ * @param req Start request, the macro string is taken over */
+static void fct_macro_start(macro_request_t *req)
+{
+  //a new trigger restarts a running macro of this VB
+  if(req->vb != VB_SINGLESHOT) fct_macro_cancel(req->vb);
+  
+  for(uint8_t i = 0; i<MACRO_INSTANCES; i++)
+  {
+    macro_instance_t *m = &macroInstances[i];
+    if(m->macro != NULL) continue;
+    m->macro = req->macro;
+    m->offset = 0;
+    m->vb = req->vb;
+    m->wake = xTaskGetTickCount();
+    if(m->vb != VB_SINGLESHOT) macroRunning++;
+    return;
+  }
+  ESP_LOGE(LOG_TAG,"Too many running macros, discarding macro of VB %d",req->vb);
+  free(req->macro);
+}
+
+/** @brief CONTINOUS TASK - Macro executor
+ * 
+ * Executes all due macros, afterwards the task waits for new requests
+ * until the next macro is due.
+ * @param param Unused */
+static void fct_macro_task(void *param)
+{
+  macro_request_t req;
+  
+  while(1)
+  {
+    TickType_t timeout = portMAX_DELAY;
+    
+    for(uint8_t i = 0; i<MACRO_INSTANCES; i++)
+    {
+      macro_instance_t *m = &macroInstances[i];
+      if(m->macro == NULL) continue;
       
-      //check if we hit an AT WA (wait)
-      if(memcmp(&param[start],"AT WA",5) == 0)
+      //execute due macros
+      if((int32_t)(m->wake - xTaskGetTickCount()) <= 0)
       {
-        //if yes, delay this task.
-        uint32_t time = strtol((char*)&(param[start+6]),NULL,10);
-        if(time < 30000)
-        {
-          vTaskDelay(time / portTICK_PERIOD_MS);
-        } else {
-          ESP_LOGE(LOG_TAG,"Hit AT WA with a delay time too high: %d",time);
-        }
-      } else {
-        //if not an AT WA, allocate memory and send to queue.
-        atcmd_t command;
-        uint16_t length = offset-start;
-        uint8_t *buffer = malloc(sizeof(uint8_t)*(length+1));
-        if(buffer != NULL)
+        if(fct_macro_step(m) == 0)
         {
-          //copy data
-          memcpy(buffer,&param[start],length);
-          //terminate
-          buffer[length] = 0;
-          //save to queue struct
-          command.buf = buffer;
-          command.len = length;
-          ESP_LOGD(LOG_TAG,"Sent AT cmd: %s",buffer);
-          //send to queue, wait maximum 10 ticks (100ms) for a free space.
-          if(xQueueSend(halSerialATCmds,(void*)&command,10) != pdTRUE)
-          {
-            ESP_LOGE(LOG_TAG,"Cmd queue is full, cannot send command");
-          }
-        } else {
-          ESP_LOGE(LOG_TAG,"Cannot allocate memory for command!");
+          fct_macro_free(m);
+          continue;
         }
       }
       
-      //save new start position for next command
-      start = offset + 1;
+      //time until this macro is due (0 if already late)
+      int32_t wait = (int32_t)(m->wake - xTaskGetTickCount());
+      if(wait < 0) wait = 0;
+      if((TickType_t)wait < timeout) timeout = wait;
     }
     
-    //go to next character
-    offset++;
+    //wait for new requests until the next macro is due
+    if(xQueueReceive(macroQueue,&req,timeout) != pdTRUE) continue;
+    
+    switch(req.type)
+    {
+      case MACRO_START:
+        fct_macro_start(&req);
+        break;
+      case MACRO_RELEASE:
+        fct_macro_cancel(req.vb);
+        break;
+    }
+  }
+}
+
+esp_err_t fct_macro_init(void)
+{
+  if(macroQueue == NULL) macroQueue = xQueueCreate(TASK_MACRO_QUEUE_LENGTH,sizeof(macro_request_t));
+  if(macroQueue == NULL)
+  {
+    ESP_LOGE(LOG_TAG,"Cannot create macro queue");
+    return ESP_FAIL;
   }
   
+  if(xTaskCreate(fct_macro_task,"macro",TASK_MACRO_STACKSIZE, \
+    NULL,TASK_MACRO_PRIORITY,NULL) != pdPASS)
+  {
+    ESP_LOGE(LOG_TAG,"Cannot create macro task");
+    return ESP_FAIL;
+  }
   return ESP_OK;
 }
+
+/** @brief Queue a compiled macro for the executor
+ * @param macro Compiled macro, taken over (freed on errors)
+ * @param vb Triggering VB
+ * @return ESP_OK on success, ESP_FAIL otherwise */
+static esp_err_t fct_macro_queue(uint8_t *macro, uint16_t vb)
+{
+  macro_request_t req;
+  req.type = MACRO_START;
+  req.vb = vb;
+  req.macro = macro;
+  
+  //never block the caller (event loop)
+  if(xQueueSend(macroQueue,&req,0) != pdTRUE)
+  {
+    ESP_LOGE(LOG_TAG,"Macro queue is full, discarding macro");
+    free(macro);
+    return ESP_FAIL;
+  }
+  return ESP_OK;
+}
+
+esp_err_t fct_macro(char *param, uint16_t vb)
+{
+  //check for param struct
+  if(param == NULL)
+  {
+    ESP_LOGE(LOG_TAG,"param is NULL ");
+    return ESP_FAIL;
+  }
+  if(macroQueue == NULL)
+  {
+    ESP_LOGE(LOG_TAG,"macro executor is not initialized");
+    return ESP_FAIL;
+  }
+  
+  //not compiled yet (e.g. singleshot), do it now.
+  uint8_t *macro = cmdMacroCompile(param,configGetCurrent());
+  if(macro == NULL)
+  {
+    ESP_LOGE(LOG_TAG,"Cannot compile macro!");
+    return ESP_FAIL;
+  }
+  return fct_macro_queue(macro,vb);
+}
+
+esp_err_t fct_macro_run(const uint8_t *macro, uint16_t vb)
+{
+  if(macro == NULL)
+  {
+    ESP_LOGE(LOG_TAG,"macro is NULL ");
+    return ESP_FAIL;
+  }
+  if(macroQueue == NULL)
+  {
+    ESP_LOGE(LOG_TAG,"macro executor is not initialized");
+    return ESP_FAIL;
+  }
+  
+  //the compiled macro might be released before it is finished, copy it.
+  uint32_t length = fct_macro_length(macro);
+  uint8_t *copy = malloc(length);
+  if(copy == NULL)
+  {
+    ESP_LOGE(LOG_TAG,"Cannot allocate memory for macro!");
+    return ESP_FAIL;
+  }
+  memcpy(copy,macro,length);
+  return fct_macro_queue(copy,vb);
+}
+
+uint32_t fct_macro_length(const uint8_t *macro)
+{
+  const uint8_t *op = macro;
+  if(macro == NULL) return 0;
+  
+  while(1)
+  {
+    switch(op[0])
+    {
+      case MACRO_OP_HID: op += 4; break;
+      case MACRO_OP_WAIT: op += 3; break;
+      case MACRO_OP_VB: op += 3 + strlen((const char*)&op[2]); break;
+      case MACRO_OP_AT: op += 2 + strlen((const char*)&op[1]); break;
+      case MACRO_OP_END:
+      default:
+        return (op - macro) + 1;
+    }
+  }
+}
+
+void fct_macro_release(uint16_t vb)
+{
+  //nothing to cancel
+  if(macroRunning == 0 || macroQueue == NULL) return;
+  //canceling on release is disabled
+  generalConfig_t *cfg = configGetCurrent();
+  if(cfg == NULL || cfg->macro_release == 0) return;
+  
+  macro_request_t req;
+  req.type = MACRO_RELEASE;
+  req.vb = vb;
+  req.macro = NULL;
+  if(xQueueSend(macroQueue,&req,0) != pdTRUE)
+  {
+    ESP_LOGE(LOG_TAG,"Macro queue is full, cannot cancel macro");
+  }
+}
@@ -26,6 +26,22 @@
  * Macros in context of FLipMouse/FABI are a string of concatenated
  * AT commands, equal to normal AT commands sent by the host.
  * 
+ * Macros are executed by an own task (macro executor), fct_macro only
+ * queues a request and never blocks the caller (e.g. the event loop).
+ * The executor holds up to MACRO_INSTANCES running macros, which
+ * might overlap. Instead of delaying the task, an AT WA sets the wake
+ * up time of this macro, the executor sleeps until the next macro is due
+ * (or a new request is received).
+ * 
+ * A running macro is canceled if its VB triggers the macro again
+ * (restart). If enabled in the config (AT MR), it is canceled on the
+ * release of its VB as well.
+ * 
+ * Macros are compiled to a list of operations (cmdMacroCompile), when
+ * the AT MA command is parsed for a VB. Mouse, keyboard & joystick
+ * commands are stored as HID commands, AT WA as wait time, other commands
+ * are stored as text and sent to the command parser on execution.
+ * 
  * @note AT command separation is done by a semicolon (';')
  * @warning If you want to write the semicolon within a macro, use AT KP with the corresponding keycode!
  */
@@ -36,18 +52,77 @@
 #include <freertos/FreeRTOS.h>
 #include <freertos/event_groups.h>
 #include <freertos/queue.h>
+#include <freertos/task.h>
 #include <esp_log.h>
 //common definitions & data for all of these functional tasks
 #include "common.h"
 #include "hal_serial.h"
 
+/** @brief Stack size for the macro executor task */
+#define TASK_MACRO_STACKSIZE 2048
+
+/** @brief Length of the request queue of the macro executor */
+#define TASK_MACRO_QUEUE_LENGTH 8
+
+/** @brief Maximum count of concurrently running macros */
+#define MACRO_INSTANCES 4
+
+/** @brief Operation types of a compiled macro
+ * 
+ * Each operation starts with this type byte, followed by its data.
+ * @see cmdMacroCompile */
+typedef enum macro_op {
+  /** @brief End of the macro, no data */
+  MACRO_OP_END = 0,
+  /** @brief HID command, data: 3 command bytes (hid_cmd_t.cmd) */
+  MACRO_OP_HID,
+  /** @brief Wait, data: time in ms (2 bytes, little endian) */
+  MACRO_OP_WAIT,
+  /** @brief VB command, data: vb_cmd_type_t (1 byte) & parameter string (terminated) */
+  MACRO_OP_VB,
+  /** @brief AT command for the parser, data: command string (terminated) */
+  MACRO_OP_AT
+} macro_op_t;
+
+/**@brief Init the macro executor (queue & task)
+ * @return ESP_OK on success, ESP_FAIL otherwise */
+esp_err_t fct_macro_init(void);
+
 /**@brief FUNCTION - Macro execution
  * 
  * This function is used to trigger macro on a VB action.
+ * The macro string is copied and executed by the macro executor,
+ * this function does not block.
  * 
  * @param param Macro command string
+ * @param vb Triggering VB, VB_SINGLESHOT if not triggered by a VB.
+ * A running macro of the same VB is canceled (not for VB_SINGLESHOT).
  * @return ESP_OK on success, ESP_FAIL otherwise
  * */
-esp_err_t fct_macro(char *param);
+esp_err_t fct_macro(char *param, uint16_t vb);
+
+/**@brief Execute a compiled macro
+ * 
+ * The compiled macro is copied and executed by the macro executor,
+ * this function does not block.
+ * 
+ * @param macro Compiled macro
+ * @param vb Triggering VB, VB_SINGLESHOT if not triggered by a VB.
+ * @return ESP_OK on success, ESP_FAIL otherwise
+ * @see cmdMacroCompile
+ * */
+esp_err_t fct_macro_run(const uint8_t *macro, uint16_t vb);
+
+/**@brief Get the length of a compiled macro
+ * @param macro Compiled macro
+ * @return Count of bytes, including MACRO_OP_END */
+uint32_t fct_macro_length(const uint8_t *macro);
+
+/**@brief Signal the release of a VB
+ * 
+ * If enabled in the config (macro_release), running macros triggered
+ * by this VB are canceled. This function does not block.
+ * @param vb Released VB */
+void fct_macro_release(uint16_t vb);
 
 #endif /*_FCT_MACROS_H*/
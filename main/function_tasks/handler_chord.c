@@ -0,0 +1,207 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ * 
+ * Copyright 2019 Benjamin Aigner <aignerb@technikum-wien.at,
+ * beni@asterics-foundation.org>
+ */
+/** @file 
+ * @brief Event Handler - Chords (combinations of VBs)
+ * 
+ * This module is an event handler for the debounced VB events.
+ * It keeps the state of all VBs (< VB_MAX) as a bitmask and compares
+ * it to the chord masks of the current slot (AT CH).
+ * 
+ * @see handler_chord.h
+ */
+ 
+#include "handler_chord.h"
+
+/** @brief Logging tag for this module */
+#define LOG_TAG "handler_chord"
+/** @brief Set a global log limit for this file */
+#define LOG_LEVEL_CHORD ESP_LOG_INFO
+
+/** @brief Compiled chord table, built from the config by handler_chord_update */
+typedef struct chord_table {
+  /** @brief Masks of all used chords (no empty masks) */
+  uint32_t mask[VB_CHORD_COUNT];
+  /** @brief Chord number for each mask */
+  uint8_t chord[VB_CHORD_COUNT];
+  /** @brief Count of used entries in mask & chord */
+  uint8_t count;
+  /** @brief All VBs, which are part of any chord */
+  uint32_t members;
+  /** @brief Simultaneity window in [us], 0 if disabled */
+  uint32_t window;
+  /** @brief Incremented on each update */
+  uint32_t generation;
+} chord_table_t;
+
+/** @brief Double buffer for chord tables, one is active, one is used for the update */
+static chord_table_t chordTables[2];
+
+/** @brief Currently active chord table, NULL if no chords are set
+ * @note Only accessed atomically */
+static chord_table_t *chordTableActive = NULL;
+
+/** @brief Generation of the chord table, which was used for the previous event
+ * 
+ * Used to detect a changed table, active chords are released in this case.
+ * @note Only accessed by handler_chord */
+static uint32_t chordGenerationLast = 0;
+
+/** @brief Generation counter for chord tables */
+static uint32_t chordGeneration = 0;
+
+/** @brief Current state of all VBs (< VB_MAX), bit set if pressed */
+static uint32_t chordLive = 0;
+
+/** @brief Currently triggered chords, bit n is set if chord n is pressed */
+static uint32_t chordActive = 0;
+
+/** @brief Timestamp of the last press for each VB [us] */
+static uint32_t chordPressTime[VB_MAX];
+
+/** @brief Post a press/release event for a chord VB */
+static void chordPost(int32_t type, uint8_t chord)
+{
+  uint32_t vb = VB_CHORD_FIRST + chord;
+  if(esp_event_post(VB_EVENT,type,(void*)&vb,sizeof(uint32_t),0) != ESP_OK)
+  {
+    ESP_LOGE(LOG_TAG,"Cannot post chord event for VB %d",vb);
+  } else {
+    ESP_LOGD(LOG_TAG,"Chord %d %s",chord,type == VB_PRESS_EVENT ? "pressed" : "released");
+  }
+}
+
+/** @brief Check the simultaneity window for a chord
+ * @param mask VBs of this chord
+ * @param now Timestamp of the last press [us]
+ * @param window Window in [us]
+ * @return 1 if all VBs were pressed within the window, 0 otherwise */
+static uint8_t chordInWindow(uint32_t mask, uint32_t now, uint32_t window)
+{
+  for(uint8_t vb = 0; vb < VB_MAX; vb++)
+  {
+    if((mask & (1<<vb)) == 0) continue;
+    if((uint32_t)(now - chordPressTime[vb]) > window) return 0;
+  }
+  return 1;
+}
+
+/**
+ * @brief VB event handler, detecting chords.
+ *
+ * @param event_handler_arg handler specific arguments
+ * @param event_base event base, here is fixed to VB_EVENT
+ * @param event_id event id, subscribed to all events
+ * @param event_data Contains the VB number
+ */
+static void handler_chord(void *event_handler_arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
+{
+  if(event_id != VB_PRESS_EVENT && event_id != VB_RELEASE_EVENT) return;
+  if(event_data == 0) return;
+  
+  uint32_t vb = *((uint32_t*) event_data);
+  //chord VBs (posted by ourselves) & singleshots are not tracked.
+  if(vb >= VB_MAX) return;
+  
+  //track the state of each VB, even without any chord.
+  uint32_t bit = 1<<vb;
+  uint32_t now = (uint32_t)esp_timer_get_time();
+  if(event_id == VB_PRESS_EVENT)
+  {
+    chordLive |= bit;
+    chordPressTime[vb] = now;
+  } else chordLive &= ~bit;
+  
+  chord_table_t *table = __atomic_load_n(&chordTableActive,__ATOMIC_ACQUIRE);
+  
+  //table changed (new slot), release all chords of the previous one
+  uint32_t generation = (table != NULL) ? table->generation : 0;
+  if(generation != chordGenerationLast)
+  {
+    for(uint8_t i = 0; i < VB_CHORD_COUNT; i++)
+    {
+      if(chordActive & (1<<i)) chordPost(VB_RELEASE_EVENT,i);
+    }
+    chordActive = 0;
+    chordGenerationLast = generation;
+  }
+  
+  //nothing to do if this VB is not part of any chord
+  if(table == NULL || (table->members & bit) == 0) return;
+  
+  for(uint8_t i = 0; i < table->count; i++)
+  {
+    uint32_t m = table->mask[i];
+    uint32_t c = 1<<table->chord[i];
+    if((m & bit) == 0) continue;
+    
+    if(chordActive & c)
+    {
+      //any VB of an active chord released -> release chord
+      if(event_id == VB_RELEASE_EVENT)
+      {
+        chordActive &= ~c;
+        chordPost(VB_RELEASE_EVENT,table->chord[i]);
+      }
+    } else if(event_id == VB_PRESS_EVENT && (chordLive & m) == m) {
+      //all VBs pressed, check the window (if set)
+      if(table->window != 0 && chordInWindow(m,now,table->window) == 0) continue;
+      chordActive |= c;
+      chordPost(VB_PRESS_EVENT,table->chord[i]);
+    }
+  }
+}
+
+esp_err_t handler_chord_update(generalConfig_t *cfg)
+{
+  if(cfg == NULL) return ESP_FAIL;
+  
+  chord_table_t *t = &chordTables[0];
+  if(__atomic_load_n(&chordTableActive,__ATOMIC_ACQUIRE) == t) t = &chordTables[1];
+  
+  t->count = 0;
+  t->members = 0;
+  for(uint8_t i = 0; i<VB_CHORD_COUNT; i++)
+  {
+    //only VBs with an input are possible
+    uint32_t m = cfg->chord_mask[i] & ((1<<VB_MAX)-1);
+    if(m == 0) continue;
+    t->mask[t->count] = m;
+    t->chord[t->count] = i;
+    t->members |= m;
+    t->count++;
+  }
+  t->window = (uint32_t)cfg->chord_window * 1000;
+  //0 is reserved for "no table"
+  if(++chordGeneration == 0) chordGeneration = 1;
+  t->generation = chordGeneration;
+  
+  __atomic_store_n(&chordTableActive,t,__ATOMIC_RELEASE);
+  ESP_LOGD(LOG_TAG,"%d chords active",t->count);
+  return ESP_OK;
+}
+
+esp_err_t handler_chord_init(void)
+{
+  //set log level to given log level
+  esp_log_level_set(LOG_TAG,LOG_LEVEL_CHORD);
+  
+  return esp_event_handler_register(VB_EVENT,ESP_EVENT_ANY_ID,handler_chord,NULL);
+}
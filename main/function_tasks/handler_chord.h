@@ -0,0 +1,71 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ * 
+ * Copyright 2019 Benjamin Aigner <aignerb@technikum-wien.at,
+ * beni@asterics-foundation.org>
+ */
+/** @file 
+ * @brief Event Handler - Chords (combinations of VBs)
+ * 
+ * This module is an event handler for the debounced VB events.
+ * It keeps the state of all VBs (< VB_MAX) as a bitmask and compares
+ * it to the chord masks of the current slot (AT CH). If all VBs of a
+ * chord are pressed, a press event for the chord's VB is posted
+ * (VB_CHORD_FIRST + chord number). If one of these VBs is released,
+ * the release event is posted.
+ * 
+ * If a simultaneity window is set (AT CW), all VBs of a chord must
+ * be pressed within this time, otherwise the chord is not triggered.
+ * 
+ * The chord VBs can be used as any other VB (AT BM), the events of the
+ * single VBs are still posted.
+ * 
+ * @note Per event, each chord is checked once with a precomputed mask,
+ * the effort is O(VB_CHORD_COUNT).
+ * @see VB_CHORD_FIRST
+ * @see VB_CHORD_COUNT
+ */
+
+#ifndef _HANDLER_CHORD_H
+#define _HANDLER_CHORD_H
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/event_groups.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_event.h>
+//common definitions & data for all of these functional tasks
+#include "common.h"
+
+/** @brief Init for the chord handler
+ * 
+ * Adds handler_chord to the system event queue.
+ * @return ESP_OK on success, ESP_FAIL on an error.*/
+esp_err_t handler_chord_init(void);
+
+/** @brief Compile the chords of a new config
+ * 
+ * Called by the config switcher, if chord masks or window changed.
+ * The chord table is built in a second buffer and swapped afterwards,
+ * the event handler never sees a partially updated table.
+ * Active chords are released on the next event.
+ * @param cfg Config with the new chord masks & window
+ * @return ESP_OK on success, ESP_FAIL otherwise
+ */
+esp_err_t handler_chord_update(generalConfig_t *cfg);
+
+#endif /*_HANDLER_CHORD_H*/
@@ -0,0 +1,318 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ * 
+ * Copyright 2019 Benjamin Aigner <aignerb@technikum-wien.at,
+ * beni@asterics-foundation.org>
+ */
+/** @file 
+ * @brief Event Handler - Gestures (tap, double tap, long press, repeat)
+ * 
+ * This module is an event handler for the debounced VB events,
+ * converting press & release of each input VB into gestures.
+ * 
+ * @see handler_gesture.h
+ */
+ 
+#include "handler_gesture.h"
+#include <string.h>
+
+/** @brief Logging tag for this module */
+#define LOG_TAG "handler_gesture"
+/** @brief Set a global log limit for this file */
+#define LOG_LEVEL_GESTURE ESP_LOG_INFO
+
+/** @brief State of the gesture recognition for one VB */
+typedef enum gesture_state {
+  /** @brief Released, nothing pending */
+  GESTURE_IDLE = 0,
+  /** @brief Pressed */
+  GESTURE_DOWN,
+  /** @brief Released after a tap, waiting for a second press */
+  GESTURE_WAIT,
+  /** @brief Pressed the second time */
+  GESTURE_DOWN2,
+  /** @brief Long press reported, waiting for release (& repeating) */
+  GESTURE_HELD
+} gesture_state_t;
+
+/** @brief Gesture recognition data for one VB */
+typedef struct gesture_vb {
+  /** @brief Timestamp of the last press [us] */
+  uint32_t press;
+  /** @brief Timestamp of the next action [us], valid if scheduled is set */
+  uint32_t deadline;
+  /** @brief Current state */
+  gesture_state_t state;
+  /** @brief Set if deadline is valid */
+  uint8_t scheduled;
+} gesture_vb_t;
+
+/** @brief Gesture thresholds, in [us] */
+typedef struct gesture_times {
+  uint32_t tap;
+  uint32_t doubletap;
+  uint32_t longpress;
+  uint32_t repeat;
+} gesture_times_t;
+
+/** @brief Recognition data for each input VB */
+static gesture_vb_t gestureState[VB_MAX];
+
+/** @brief Current thresholds */
+static gesture_times_t gestureTimes;
+
+/** @brief Synchronization mutex for the recognition data
+ * 
+ * Used by the event handler (event loop task) and the timer callback
+ * (esp_timer task). */
+static SemaphoreHandle_t gestureSem = NULL;
+
+/** @brief One timer for all deadlines */
+static esp_timer_handle_t gestureTimer = NULL;
+
+/** @brief Post a gesture event
+ * @param vb Input VB
+ * @param gesture Gesture type (VB_GESTURE_*)
+ * @param type VB_PRESS_EVENT or VB_RELEASE_EVENT */
+static void gesturePost(uint32_t vb, uint8_t gesture, int32_t type)
+{
+  uint32_t gvb = VB_GESTURE(vb,gesture);
+  if(esp_event_post(VB_EVENT,type,(void*)&gvb,sizeof(uint32_t),0) != ESP_OK)
+  {
+    ESP_LOGE(LOG_TAG,"Cannot post gesture event for VB %d",gvb);
+  }
+}
+
+/** @brief Post press & release of a gesture (tap, double tap & repeat) */
+static void gesturePostClick(uint32_t vb, uint8_t gesture)
+{
+  ESP_LOGD(LOG_TAG,"VB %d: gesture %d",vb,gesture);
+  gesturePost(vb,gesture,VB_PRESS_EVENT);
+  gesturePost(vb,gesture,VB_RELEASE_EVENT);
+}
+
+/** @brief (Re-)start the timer for the earliest deadline
+ * @note Must be called with gestureSem taken
+ * @param now Current timestamp [us] */
+static void gestureSchedule(uint32_t now)
+{
+  int32_t next = INT32_MAX;
+  uint8_t found = 0;
+  for(uint8_t i = 0; i<VB_MAX; i++)
+  {
+    if(gestureState[i].scheduled == 0) continue;
+    int32_t diff = (int32_t)(gestureState[i].deadline - now);
+    if(diff < next) next = diff;
+    found = 1;
+  }
+  esp_timer_stop(gestureTimer);
+  if(found == 0) return;
+  if(next < 1) next = 1;
+  esp_timer_start_once(gestureTimer,next);
+}
+
+/** @brief Process a press of an input VB
+ * @note Must be called with gestureSem taken */
+static void gesturePress(uint32_t vb, uint32_t now)
+{
+  gesture_vb_t *s = &gestureState[vb];
+  s->state = (s->state == GESTURE_WAIT) ? GESTURE_DOWN2 : GESTURE_DOWN;
+  s->press = now;
+  s->scheduled = 0;
+  if(gestureTimes.longpress != 0)
+  {
+    s->deadline = now + gestureTimes.longpress;
+    s->scheduled = 1;
+  }
+}
+
+/** @brief Process a release of an input VB
+ * @note Must be called with gestureSem taken */
+static void gestureRelease(uint32_t vb, uint32_t now)
+{
+  gesture_vb_t *s = &gestureState[vb];
+  uint8_t tap = (gestureTimes.tap != 0) && ((uint32_t)(now - s->press) <= gestureTimes.tap);
+  
+  s->scheduled = 0;
+  switch(s->state)
+  {
+    case GESTURE_DOWN:
+      s->state = GESTURE_IDLE;
+      if(tap == 0) break;
+      //wait for a second tap, if double taps are enabled
+      if(gestureTimes.doubletap != 0)
+      {
+        s->state = GESTURE_WAIT;
+        s->deadline = now + gestureTimes.doubletap;
+        s->scheduled = 1;
+      } else gesturePostClick(vb,VB_GESTURE_TAP);
+      break;
+    case GESTURE_DOWN2:
+      s->state = GESTURE_IDLE;
+      //second press was no tap: report only the first one
+      gesturePostClick(vb,tap ? VB_GESTURE_DOUBLETAP : VB_GESTURE_TAP);
+      break;
+    case GESTURE_HELD:
+      s->state = GESTURE_IDLE;
+      gesturePost(vb,VB_GESTURE_LONGPRESS,VB_RELEASE_EVENT);
+      break;
+    default:
+      s->state = GESTURE_IDLE;
+      break;
+  }
+}
+
+/** @brief Process a reached deadline of an input VB
+ * @note Must be called with gestureSem taken */
+static void gestureExpire(uint32_t vb)
+{
+  gesture_vb_t *s = &gestureState[vb];
+  
+  s->scheduled = 0;
+  switch(s->state)
+  {
+    //no second tap within time
+    case GESTURE_WAIT:
+      s->state = GESTURE_IDLE;
+      gesturePostClick(vb,VB_GESTURE_TAP);
+      break;
+    //long press
+    case GESTURE_DOWN2:
+      gesturePostClick(vb,VB_GESTURE_TAP);
+      //fall through
+    case GESTURE_DOWN:
+      s->state = GESTURE_HELD;
+      ESP_LOGD(LOG_TAG,"VB %d: long press",vb);
+      gesturePost(vb,VB_GESTURE_LONGPRESS,VB_PRESS_EVENT);
+      if(gestureTimes.repeat != 0)
+      {
+        s->deadline += gestureTimes.repeat;
+        s->scheduled = 1;
+      }
+      break;
+    //repeat while held
+    case GESTURE_HELD:
+      gesturePostClick(vb,VB_GESTURE_REPEAT);
+      if(gestureTimes.repeat != 0)
+      {
+        s->deadline += gestureTimes.repeat;
+        s->scheduled = 1;
+      }
+      break;
+    default: break;
+  }
+}
+
+/** @brief Timer callback, processes all reached deadlines */
+static void gestureTimerCallback(void* arg)
+{
+  if(xSemaphoreTake(gestureSem,portMAX_DELAY) != pdTRUE) return;
+  uint32_t now = (uint32_t)esp_timer_get_time();
+  for(uint8_t i = 0; i<VB_MAX; i++)
+  {
+    if(gestureState[i].scheduled == 0) continue;
+    if((int32_t)(now - gestureState[i].deadline) >= 0) gestureExpire(i);
+  }
+  gestureSchedule(now);
+  xSemaphoreGive(gestureSem);
+}
+
+/**
+ * @brief VB event handler, detecting gestures.
+ *
+ * @param event_handler_arg handler specific arguments
+ * @param event_base event base, here is fixed to VB_EVENT
+ * @param event_id event id, subscribed to all events
+ * @param event_data Contains the VB number
+ */
+static void handler_gesture(void *event_handler_arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
+{
+  if(event_id != VB_PRESS_EVENT && event_id != VB_RELEASE_EVENT) return;
+  if(event_data == 0) return;
+  
+  uint32_t vb = *((uint32_t*) event_data);
+  //chords, gestures (posted by ourselves) & singleshots are not used.
+  if(vb >= VB_MAX) return;
+  
+  //never drop an edge, a long press would not be released.
+  if(xSemaphoreTake(gestureSem,portMAX_DELAY) != pdTRUE) return;
+  //gestures disabled
+  if(gestureTimes.tap == 0 && gestureTimes.longpress == 0)
+  {
+    xSemaphoreGive(gestureSem);
+    return;
+  }
+  uint32_t now = (uint32_t)esp_timer_get_time();
+  if(event_id == VB_PRESS_EVENT) gesturePress(vb,now);
+  else gestureRelease(vb,now);
+  gestureSchedule(now);
+  xSemaphoreGive(gestureSem);
+}
+
+esp_err_t handler_gesture_update(generalConfig_t *cfg)
+{
+  if(cfg == NULL) return ESP_FAIL;
+  if(gestureSem == NULL || xSemaphoreTake(gestureSem,portMAX_DELAY) != pdTRUE) return ESP_FAIL;
+  
+  gestureTimes.tap = (uint32_t)cfg->gesture_tap * 1000;
+  gestureTimes.doubletap = (uint32_t)cfg->gesture_doubletap * 1000;
+  gestureTimes.longpress = (uint32_t)cfg->gesture_longpress * 1000;
+  gestureTimes.repeat = (uint32_t)cfg->gesture_repeat * 1000;
+  
+  //cancel everything, but don't leave a long press active
+  for(uint8_t i = 0; i<VB_MAX; i++)
+  {
+    if(gestureState[i].state == GESTURE_HELD) gesturePost(i,VB_GESTURE_LONGPRESS,VB_RELEASE_EVENT);
+    gestureState[i].state = GESTURE_IDLE;
+    gestureState[i].scheduled = 0;
+  }
+  esp_timer_stop(gestureTimer);
+  
+  xSemaphoreGive(gestureSem);
+  ESP_LOGD(LOG_TAG,"Gesture times: tap %d, double %d, long %d, repeat %d",cfg->gesture_tap, \
+    cfg->gesture_doubletap,cfg->gesture_longpress,cfg->gesture_repeat);
+  return ESP_OK;
+}
+
+esp_err_t handler_gesture_init(void)
+{
+  //set log level to given log level
+  esp_log_level_set(LOG_TAG,LOG_LEVEL_GESTURE);
+  
+  if(gestureSem == NULL) gestureSem = xSemaphoreCreateMutex();
+  if(gestureSem == NULL)
+  {
+    ESP_LOGE(LOG_TAG,"Cannot create mutex, exiting!");
+    return ESP_FAIL;
+  }
+  
+  if(gestureTimer == NULL)
+  {
+    esp_timer_create_args_t args;
+    memset(&args,0,sizeof(args));
+    args.callback = gestureTimerCallback;
+    args.dispatch_method = ESP_TIMER_TASK;
+    args.name = "gesture";
+    if(esp_timer_create(&args,&gestureTimer) != ESP_OK)
+    {
+      ESP_LOGE(LOG_TAG,"Cannot create timer, exiting!");
+      return ESP_FAIL;
+    }
+  }
+  
+  return esp_event_handler_register(VB_EVENT,ESP_EVENT_ANY_ID,handler_gesture,NULL);
+}
@@ -0,0 +1,74 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ * 
+ * Copyright 2019 Benjamin Aigner <aignerb@technikum-wien.at,
+ * beni@asterics-foundation.org>
+ */
+/** @file 
+ * @brief Event Handler - Gestures (tap, double tap, long press, repeat)
+ * 
+ * This module is an event handler for the debounced VB events.
+ * Press & release of each input VB (< VB_MAX) are timestamped and
+ * converted into gestures, which are posted as VB events for the
+ * gesture's VB (see VB_GESTURE):
+ * * Tap: pressed shorter than AT GT. If double taps are enabled (AT GD),
+ *   the tap is reported after this time without a second press. <br>
+ * * Double tap: 2 taps within AT GD. <br>
+ * * Long press: held longer than AT GL, pressed when reaching this time
+ *   and released with the VB. <br>
+ * * Repeat: while held after a long press, every AT GR ms. <br>
+ * 
+ * Tap, double tap & repeat are posted as press & release at once.
+ * The events of the VBs themselves are still posted, gestures can be used
+ * in addition (AT BM with the gesture's VB).
+ * 
+ * All deadlines (double tap window, long press, repeat) are handled by
+ * one esp_timer, which is started for the earliest deadline of all VBs.
+ * 
+ * @see VB_GESTURE
+ * @see VB_GESTURE_FIRST
+ */
+
+#ifndef _HANDLER_GESTURE_H
+#define _HANDLER_GESTURE_H
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/event_groups.h>
+#include <freertos/semphr.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_event.h>
+//common definitions & data for all of these functional tasks
+#include "common.h"
+
+/** @brief Init for the gesture handler
+ * 
+ * Creates the mutex & the timer and adds handler_gesture to the
+ * system event queue.
+ * @return ESP_OK on success, ESP_FAIL on an error.*/
+esp_err_t handler_gesture_init(void);
+
+/** @brief Set the gesture thresholds of a new config
+ * 
+ * Called by the config switcher, if any gesture time changed.
+ * All pending gestures are canceled, a running long press is released.
+ * @param cfg Config with the new thresholds
+ * @return ESP_OK on success, ESP_FAIL otherwise
+ */
+esp_err_t handler_gesture_update(generalConfig_t *cfg);
+
+#endif /*_HANDLER_GESTURE_H*/
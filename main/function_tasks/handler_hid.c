@@ -28,7 +28,20 @@
  * * Joystick press,hold,release & axis movement
  * 
  * handler_hid_init is initializing the mutex for adding a command to the
- * chained list and adding handler_hid to the system event queue.
+ * binding table and adding handler_hid to the system event queue.
+ * 
+ * Commands are stored per VB & event (press/release) in a contiguous
+ * array. Dispatching an event is a direct lookup, the effort depends only
+ * on the count of commands of this VB, not on the size of the slot.
+ * The arrays and strings are taken from the slot arena, they are released
+ * at once on a slot switch.
+ *
+ * The binding table is published as an immutable generation. The handler
+ * reads the published generation without locking. Adding, deleting or
+ * clearing commands changes a draft generation (protected by the mutex),
+ * which is published by handler_hid_publish. While a slot is loaded, the
+ * previous slot stays active until the new one is published, button
+ * events are never dropped during a slot switch.
  *
  * @note Currently, we use the system event queue (because there is already
  * a task attached). Maybe we switch to an unique one.
@@ -43,22 +56,53 @@
 /** @brief Set a global log limit for this file */
 #define LOG_LEVEL_HID ESP_LOG_INFO
 
-/** @brief Beginning of all HID commands
+/** @brief All HID commands of one VB & event */
+typedef struct hid_binding {
+  /** @brief Array of commands, in the order they were added */
+  hid_cmd_t *cmds;
+  /** @brief Count of commands in this array */
+  uint16_t count;
+  /** @brief Count of allocated elements of this array */
+  uint16_t capacity;
+} hid_binding_t;
+
+/** @brief One generation of HID commands, indexed by VB number & event (press/release)
  * 
- * This pointer is the beginning of the HID command chain.
- * Each time an active VB posted to the event loop, handler_hid walks through this
- * chained list for a corresponding command and sends it either to the
- * USB queue, the BLE queue or both.
+ * Each time an active VB posted to the event loop, handler_hid sends all
+ * commands of this VB & event either to the USB queue, the BLE queue or both.
  * 
- * Adding a new command is done via handler_hid_addCmd, the full list
- * is freed and cleared via handler_hid_clearCmds.
+ * A published generation is never modified, except appending commands
+ * behind the count of a binding (not visible to readers).
  * 
  * @see handler_hid
  * @see handler_hid_addCmd
- * @see handler_hid_clearCmds*/
-static hid_cmd_t *cmd_chain = NULL;
+ * @see handler_hid_publish */
+typedef struct hid_generation {
+  /** @brief Commands per VB & event */
+  hid_binding_t bindings[VB_MAX_BINDABLE][2];
+  /** @brief Count of all stored HID commands */
+  uint32_t count;
+} hid_generation_t;
+
+/** @brief Count of generation buffers: the published one, the draft and
+ * one, which might still be used by the handler */
+#define HID_GENERATIONS 3
+
+/** @brief Buffers for the generations, reused in turn */
+static hid_generation_t hidGenerations[HID_GENERATIONS];
 
-/** @brief Synchronization mutex for accessing the HID command chain */
+/** @brief Published generation, read by handler_hid without locking */
+static hid_generation_t *hidActive = NULL;
+
+/** @brief Generation, which is modified by add/del/clear. NULL if there
+ * are no changes since the last publish.
+ * @note Only accessed with hidCmdSem */
+static hid_generation_t *hidDraft = NULL;
+
+/** @brief Generation currently used by handler_hid, NULL if not dispatching */
+static hid_generation_t *hidReader = NULL;
+
+/** @brief Synchronization mutex for modifying the HID bindings */
 SemaphoreHandle_t hidCmdSem = NULL;
 
 /**
@@ -71,27 +115,9 @@ SemaphoreHandle_t hidCmdSem = NULL;
  */
 static void handler_hid(void *event_handler_arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
 {
-  //if we don't have a stable config, simply return...
-  if((xEventGroupGetBits(systemStatus) & SYSTEM_STABLECONFIG) == 0) return;
-
-  //use the mutex to ensure a valid chained list. 
-  if(xSemaphoreTake(hidCmdSem,4) != pdTRUE)
-  {
-    ESP_LOGW(LOG_TAG,"HID mutex not free for handler");
-    return;
-  }
-  //if command chain is empty, we cannot do anything.
-  if(cmd_chain == NULL) 
-  {
-    xSemaphoreGive(hidCmdSem);
-    return;
-  }
-  
-  uint8_t vb = 0;
-  uint32_t count = 0;
   switch(event_id)
   {
-    case VB_PRESS_EVENT: vb |= 0x80; //set uppermost bit for press event.
+    case VB_PRESS_EVENT:
     case VB_RELEASE_EVENT:
       break;
     default: //might be another type of event, we don't care of.
@@ -104,30 +130,34 @@ static void handler_hid(void *event_handler_arg, esp_event_base_t event_base, in
     ESP_LOGE(LOG_TAG,"Empty event data, cannot proceed!");
     return;
   }
+  uint32_t vb = *((uint32_t*) event_data);
+  if(vb >= VB_MAX_BINDABLE) return;
+
+  //get the published generation & mark it as used. If it was replaced
+  //in between, the writer might not have seen our mark -> retry.
+  hid_generation_t *g;
+  do {
+    g = __atomic_load_n(&hidActive,__ATOMIC_SEQ_CST);
+    __atomic_store_n(&hidReader,g,__ATOMIC_SEQ_CST);
+  } while(g != __atomic_load_n(&hidActive,__ATOMIC_SEQ_CST));
+  //no slot loaded yet
+  if(g == NULL) return;
   
-  vb |= (*((uint32_t*) event_data)) & 0x7F;
-  //begin with head of chain
-  hid_cmd_t *current = cmd_chain;
-  //iterate through all available hid cmds
-  while(current != NULL)
+  //send all HID command(s) of this VB & event
+  //this way, we can do more button presses on one VB (e.g. AT KW, AT KP KEY_SHIFT KEY_A)
+  hid_binding_t *b = &g->bindings[vb][event_id];
+  for(uint16_t i = 0; i<b->count; i++)
   {
-    //send HID command(s), if VB matches
-    //this way, we can do more button presses on one VB (e.g. AT KW, AT KP KEY_SHIFT KEY_A)
-    if(current->vb == vb)
-    {
-      count++;
-      if(xEventGroupGetBits(connectionRoutingStatus) & DATATO_USB) 
-      { xQueueSend(hid_usb,current,2); }
-      if(xEventGroupGetBits(connectionRoutingStatus) & DATATO_BLE) 
-      { xQueueSend(hid_ble,current,2); }
-    }
-    current = current->next;
+    if(xEventGroupGetBits(connectionRoutingStatus) & DATATO_USB) 
+    { xQueueSend(hid_usb,&b->cmds[i],2); }
+    if(xEventGroupGetBits(connectionRoutingStatus) & DATATO_BLE) 
+    { xQueueSend(hid_ble,&b->cmds[i],2); }
   }
   #if LOG_LEVEL_VB >= ESP_LOG_DEBUG
-  if(count == 0) ESP_LOGD(LOG_TAG,"Sent %d cmds for VB %d", count, vb & 0x7F);
+  if(b->count == 0) ESP_LOGD(LOG_TAG,"Sent %d cmds for VB %d", b->count, vb);
   #endif
-  if(count != 0) ESP_LOGI(LOG_TAG,"Sent %d cmds for VB %d", count, vb & 0x7F);
-  xSemaphoreGive(hidCmdSem);
+  if(b->count != 0) ESP_LOGI(LOG_TAG,"Sent %d cmds for VB %d", b->count, vb);
+  __atomic_store_n(&hidReader,NULL,__ATOMIC_RELEASE);
 }
 
 /** @brief Init for the HID handler
@@ -151,47 +181,87 @@ esp_err_t handler_hid_init(void)
   return esp_event_handler_register(VB_EVENT,ESP_EVENT_ANY_ID,handler_hid,NULL);
 }
 
+/** @brief Get the draft generation, create it if necessary
+ *
+ * A new draft is a copy of the published generation (the command
+ * arrays are shared). The buffer is neither the published one nor the
+ * one used by the handler.
+ * @note hidCmdSem must be taken
+ * @param empty If != 0, a new, empty draft is created
+ * @return Draft generation */
+static hid_generation_t *handler_hid_getDraft(uint8_t empty)
+{
+  hid_generation_t *g = hidDraft;
+  hid_generation_t *active = __atomic_load_n(&hidActive,__ATOMIC_SEQ_CST);
+
+  if(g == NULL)
+  {
+    //a reader marks a generation before using it, a buffer which is
+    //not active and not marked cannot be used by the handler.
+    hid_generation_t *reader = __atomic_load_n(&hidReader,__ATOMIC_SEQ_CST);
+    for(uint8_t i = 0; i<HID_GENERATIONS; i++)
+    {
+      if(&hidGenerations[i] != active && &hidGenerations[i] != reader)
+      {
+        g = &hidGenerations[i];
+        break;
+      }
+    }
+    empty |= (active == NULL);
+    if(empty == 0) memcpy(g,active,sizeof(hid_generation_t));
+  }
+  if(empty) memset(g,0,sizeof(hid_generation_t));
+  hidDraft = g;
+  return g;
+}
+
+/** @brief Remove all commands of one VB & event
+ *
+ * The array might be used by a published generation, it is not modified.
+ * The next command of this VB & event gets a new array.
+ * @note hidCmdSem must be taken
+ * @return Count of removed commands */
+static uint16_t handler_hid_freeBinding(hid_generation_t *g, hid_binding_t *b)
+{
+  uint16_t count = b->count;
+  b->cmds = NULL;
+  b->count = 0;
+  b->capacity = 0;
+  g->count -= count;
+  return count;
+}
+
 /** @brief Remove HID command for a virtual button
  * 
  * This method removes any HID command from the list of HID commands
  * which are assigned to this VB.
  * 
+ * @note Changes are active after handler_hid_publish.
  * @param vb VB which should be removed
  * @return ESP_OK if deleted, ESP_FAIL if not in list */
-esp_err_t handler_hid_delCmd(uint8_t vb)
+esp_err_t handler_hid_delCmd(uint16_t vb)
 {
-  //existing chain, add to end
-  hid_cmd_t *current = cmd_chain;
-  hid_cmd_t *prev = NULL;
-  uint count = 0;;
-  
-  //do as long as we don't have a null pointer
-  while(current != NULL)
+  if(vb >= VB_MAX_BINDABLE || hidCmdSem == NULL) return ESP_FAIL;
+  //take mutex for modifying
+  if(xSemaphoreTake(hidCmdSem,50) != pdTRUE)
   {
-    //if the VB number matches (discarding press/release flag)
-    if((current->vb & 0x7F) == (vb & 0x7F))
-    {
-      //set pointer from previous element to next one
-      //but only if we are not at the head (no previous element)
-      if(prev != NULL) prev->next = current->next;
-      //if no previous element -> replace 
-      else cmd_chain = current->next;
-      //free an AT string
-      if(current->atoriginal != NULL) free(current->atoriginal);
-      //free this element
-      free(current);
-      
-      //just begin at the front again (easiest way if we removed the head)
-      current = cmd_chain;
-      prev = NULL;
-      
-      count++;
-    } else { //does not match
-      //set pointers to next element
-      prev = current;
-      current = current->next;
-    }
+    ESP_LOGE(LOG_TAG,"HID mutex not free for deleting");
+    return ESP_FAIL;
+  }
+  //nothing to do, if this VB has no commands
+  hid_generation_t *g = hidDraft ? hidDraft : __atomic_load_n(&hidActive,__ATOMIC_ACQUIRE);
+  if(g == NULL || (g->bindings[vb][VB_PRESS_EVENT].count == 0 && \
+    g->bindings[vb][VB_RELEASE_EVENT].count == 0))
+  {
+    xSemaphoreGive(hidCmdSem);
+    return ESP_FAIL;
   }
+  //press & release
+  g = handler_hid_getDraft(0);
+  uint16_t count = handler_hid_freeBinding(g,&g->bindings[vb][VB_PRESS_EVENT]);
+  count += handler_hid_freeBinding(g,&g->bindings[vb][VB_RELEASE_EVENT]);
+  xSemaphoreGive(hidCmdSem);
+  
   if(count != 0) return ESP_OK;
   else return ESP_FAIL;
 }
@@ -201,9 +271,12 @@ esp_err_t handler_hid_delCmd(uint8_t vb)
  * This method adds the given HID command to the list of HID commands
  * which will be processed if the corresponding VB is triggered.
  * 
- * @note Highest bit determines press/release action. If set, it is a press!
+ * @note newCmd->event determines the triggering action (VB_PRESS_EVENT or VB_RELEASE_EVENT).
  * @note If VB number is set to VB_SINGLESHOT, the command will be sent immediately.
- * @note We will malloc for each command here. To free the memory, call handler_hid_clearCmds .
+ * @note The command is copied to the slot arena, its AT string is interned
+ * (equal strings are stored once per slot). The memory is released on the
+ * next slot switch.
+ * @note Changes are active after handler_hid_publish.
  * @param newCmd New command to be added.
  * @param replace If set to != 0, any previously assigned command is removed from list.
  * @return ESP_OK if added, ESP_FAIL if not added (out of memory) */
@@ -220,14 +293,14 @@ esp_err_t handler_hid_addCmd(hid_cmd_t *newCmd, uint8_t replace)
     ESP_LOGE(LOG_TAG,"hidCmdSem is NULL");
     return ESP_FAIL;
   }
-  if((newCmd->vb & 0x7F) >= VB_MAX)
+  if(newCmd->vb >= VB_MAX_BINDABLE)
   {
     ESP_LOGE(LOG_TAG,"newCmd->vb out of range");
     return ESP_FAIL;
   }
-  if(((newCmd->vb & 0x7F) / 4) >= NUMBER_VIRTUALBUTTONS)
+  if(newCmd->event != VB_PRESS_EVENT && newCmd->event != VB_RELEASE_EVENT)
   {
-    ESP_LOGE(LOG_TAG,"array out of bounds -> unrecoverable!");
+    ESP_LOGE(LOG_TAG,"newCmd->event out of range");
     return ESP_FAIL;
   }
   
@@ -237,222 +310,166 @@ esp_err_t handler_hid_addCmd(hid_cmd_t *newCmd, uint8_t replace)
     ESP_LOGE(LOG_TAG,"HID mutex not free for adding");
     return ESP_FAIL;
   }
+  hid_generation_t *g = handler_hid_getDraft(0);
   
-  //set pointer of next element to NULL, so we have a defined
-  //invalid pointer to check for.
-  newCmd->next = NULL;
-  
-  //existing chain, add to end
-  hid_cmd_t *current = cmd_chain;
-  int count = 0;
-  
-  //debugging...
-  #if LOG_LEVEL_HID >= ESP_LOG_DEBUG
-  while(current!=NULL)
+  //if set, remove any previously set commands (press & release).
+  if(replace)
   {
-    count++;
-    ESP_LOGD(LOG_TAG,"%d:%2d:0x%X",count,current->vb,(uint32_t)current);
-    current = current->next;
+    handler_hid_freeBinding(g,&g->bindings[newCmd->vb][VB_PRESS_EVENT]);
+    handler_hid_freeBinding(g,&g->bindings[newCmd->vb][VB_RELEASE_EVENT]);
   }
-  current = cmd_chain;
-  count = 0;
-  #endif
-  
-  //if set, remove any previously set commands.
-  if(replace) handler_hid_delCmd(newCmd->vb);
   
-  //allocate new command
-  current = cmd_chain;
-  hid_cmd_t *new;
-  new = malloc(sizeof(*new));
-  
-  if(new != NULL)
+  //append to the array of this VB & event. Elements behind the count
+  //are not used by a published generation.
+  hid_binding_t *b = &g->bindings[newCmd->vb][newCmd->event];
+  if(b->count == b->capacity)
   {
-    memcpy(new, newCmd, sizeof(*new));
-    //save pointer of new config to end of chain
-    new->next = NULL;
-    //use as head if the head was not here before.
-    if(cmd_chain == NULL) {
-      cmd_chain = new;
-    } else {
-      //otherwise append to the tail.
-      while(current->next != NULL)
-      {
-        #if LOG_LEVEL_HID >= ESP_LOG_DEBUG
-        ESP_LOGD(LOG_TAG,"Nr %d, @0x%8X",count,(uint32_t)current);
-        #endif
-        count++;
-        current = current->next;
-      }
-      current->next = new;
+    //array is full, get a new one with double size from the arena
+    uint16_t capacity = b->capacity ? b->capacity*2 : 2;
+    hid_cmd_t *cmds = slotArenaAlloc(capacity*sizeof(hid_cmd_t));
+    if(cmds == NULL)
+    {
+      ESP_LOGE(LOG_TAG,"Cannot allocate memory for new HID cmd!");
+      xSemaphoreGive(hidCmdSem);
+      return ESP_FAIL;
     }
-    count++;
-    #if LOG_LEVEL_HID >= ESP_LOG_DEBUG
-    ESP_LOGI(LOG_TAG,"Added new cmd nr %d, new: 0x%8X, prev: 0x%8X",count,(uint32_t)new,(uint32_t)current);
-    #endif
-    
-    current = new;
-    xSemaphoreGive(hidCmdSem);
-    return ESP_OK;
-  } else {
-    ESP_LOGE(LOG_TAG,"Cannot allocate memory for new HID cmd!");
-    xSemaphoreGive(hidCmdSem);
-    return ESP_FAIL;
+    if(b->count != 0) memcpy(cmds,b->cmds,b->count*sizeof(hid_cmd_t));
+    b->cmds = cmds;
+    b->capacity = capacity;
   }
-
-  //should not be here, but return ok anyway
+  memcpy(&b->cmds[b->count],newCmd,sizeof(hid_cmd_t));
+  //the AT string is interned, the caller keeps its string
+  if(newCmd->atoriginal != NULL)
+  {
+    b->cmds[b->count].atoriginal = slotArenaIntern(newCmd->atoriginal);
+    if(b->cmds[b->count].atoriginal == NULL) ESP_LOGE(LOG_TAG,"Cannot allocate AT string");
+  }
+  b->count++;
+  g->count++;
+  
+  #if LOG_LEVEL_HID >= ESP_LOG_DEBUG
+  ESP_LOGD(LOG_TAG,"Added new cmd for VB %d/%d, %d cmds total",newCmd->vb,newCmd->event,g->count);
+  #endif
   xSemaphoreGive(hidCmdSem);
   return ESP_OK;
 }
 
-/** @brief Get current root of HID command chain
- * @warning Modifying this chain without acquiring the hidCmdSem could result in
- * undefined behaviour!
- * @return Pointer to root of HID chain
- */
-hid_cmd_t *handler_hid_getCmdChain(void)
-{
-  return cmd_chain;
-}
-
-/** @brief Set current root of HID command chain!
- * @warning By using this function, previously used HID commands are cleared!
- * @param chain Pointer to root of HID chain
- * @return ESP_OK if chain is saved, ESP_FAIL otherwise (lock was not free, deleting old chain failed..)
- */
-esp_err_t handler_hid_setCmdChain(hid_cmd_t *chain)
+/** @brief Clear all stored HID commands.
+ *
+ * This method starts a new, empty draft generation. The published
+ * generation is still active until handler_hid_publish is called.
+ *
+ * @return ESP_OK if commands are cleared, ESP_FAIL otherwise
+ * */
+esp_err_t handler_hid_clearCmds(void)
 {
-  esp_err_t ret = ESP_OK;
-  
-  //check if chain is currently active,
-  //if yes clear it before setting a new one
-  if(cmd_chain != NULL)
-  {
-    ret = handler_hid_clearCmds();
-    if(ret != ESP_OK)
-    {
-      ESP_LOGE(LOG_TAG,"Cannot clear old chain");
-      return ret;
-    }
-  }
-  
-  //enter critical section for setting new cmd chain
   if(hidCmdSem == NULL)
   {
     ESP_LOGE(LOG_TAG,"hidCmdSem is NULL");
     return ESP_FAIL;
   }
+  
   //take mutex for modifying
   if(xSemaphoreTake(hidCmdSem,50) != pdTRUE)
   {
-    ESP_LOGE(LOG_TAG,"cannot enter critical section");
+    ESP_LOGE(LOG_TAG,"HID mutex not free for clearing");
     return ESP_FAIL;
   }
-  //save the pointer
-  cmd_chain = chain;
+  
+  handler_hid_getDraft(1);
+
+  #if LOG_LEVEL_HID >= ESP_LOG_INFO
+  ESP_LOGI(LOG_TAG,"Cleared HID cmds");
+  #endif
 
   //release mutex
   xSemaphoreGive(hidCmdSem);
   return ESP_OK;
 }
 
-/** @brief Clear all stored HID commands.
- * 
- * This method clears all stored HID commands and frees the allocated memory.
- * 
- * @return ESP_OK if commands are cleared, ESP_FAIL otherwise
+/** @brief Publish all changes of the HID commands
+ *
+ * The draft generation is activated with one atomic pointer swap.
+ * The handler uses either the previous or the new generation, never
+ * a partially modified one.
+ * @return ESP_OK if published (or nothing to publish), ESP_FAIL otherwise
  * */
-esp_err_t handler_hid_clearCmds(void)
+esp_err_t handler_hid_publish(void)
 {
-  if(cmd_chain == NULL)
-  {
-    ESP_LOGW(LOG_TAG,"HID cmds already empty");
-    return ESP_FAIL;
-  }
   if(hidCmdSem == NULL)
   {
     ESP_LOGE(LOG_TAG,"hidCmdSem is NULL");
     return ESP_FAIL;
   }
-  
-  //take mutex for modifying
   if(xSemaphoreTake(hidCmdSem,50) != pdTRUE)
   {
-    ESP_LOGE(LOG_TAG,"HID mutex not free for clearing");
+    ESP_LOGE(LOG_TAG,"HID mutex not free for publishing");
     return ESP_FAIL;
   }
-  
-  //pointers for next and current command
-  hid_cmd_t *next = NULL;
-  hid_cmd_t *current = cmd_chain;
-  int count = 0;
-  
-  do {
-    //load next block
-    next = current->next;
-    //if set, free the original AT command
-    if(current->atoriginal != NULL) free(current->atoriginal);
-    current->atoriginal = NULL;
-    //free the current one
-    free(current);
-    //count for statistics
-    count++;
-    //previous next is current for next while iteration
-    current = next;
-    //break the loop if current is NULL (we reached end of chain)
-  } while(current != NULL);
-  
-  #if LOG_LEVEL_HID >= ESP_LOG_INFO
-  ESP_LOGI(LOG_TAG,"Cleared %d HID cmds",count);
-  #endif
-
-  cmd_chain = NULL;
-  //release mutex
+  if(hidDraft != NULL)
+  {
+    __atomic_store_n(&hidActive,hidDraft,__ATOMIC_SEQ_CST);
+    #if LOG_LEVEL_HID >= ESP_LOG_DEBUG
+    ESP_LOGD(LOG_TAG,"Published %d HID cmds",hidDraft->count);
+    #endif
+    hidDraft = NULL;
+  }
   xSemaphoreGive(hidCmdSem);
   return ESP_OK;
 }
 
+/** @brief Wait until handler_hid uses only the published generation
+ *
+ * After this call, older generations are not used anymore and their
+ * memory might be released (slotArenaSwitch).
+ * */
+void handler_hid_sync(void)
+{
+  hid_generation_t *r;
+  while((r = __atomic_load_n(&hidReader,__ATOMIC_SEQ_CST)) != NULL && \
+    r != __atomic_load_n(&hidActive,__ATOMIC_SEQ_CST))
+  {
+    vTaskDelay(1);
+  }
+}
+
 /** @brief Reverse Parsing - get AT command for HID VB
  * 
  * This function parses the current configuration of a virtual button
  * to an AT command used to print the configuration.
+ * @note If there are unpublished changes, they are used.
  * @param output Output string, where the full AT command will be stored
  * @param vb Number of virtual button for getting the AT command
  * @return ESP_OK if everything went fine, ESP_FAIL otherwise
  * */
-esp_err_t handler_hid_getAT(char* output, uint8_t vb)
+esp_err_t handler_hid_getAT(char* output, uint16_t vb)
 {
   if(hidCmdSem == NULL)
   {
     ESP_LOGE(LOG_TAG,"hidCmdSem is NULL");
     return ESP_FAIL;
   }
+  if(vb >= VB_MAX_BINDABLE) return ESP_FAIL;
   
-  if(cmd_chain == NULL)
-  {
-    ESP_LOGE(LOG_TAG,"Chain empty!");
-    return ESP_FAIL;
-  }
   //take mutex for reading
   if(xSemaphoreTake(hidCmdSem,50) != pdTRUE)
   {
     ESP_LOGE(LOG_TAG,"HID mutex not free for getting");
     return ESP_FAIL;
   }
+  hid_generation_t *g = hidDraft ? hidDraft : __atomic_load_n(&hidActive,__ATOMIC_ACQUIRE);
   
-  //pointers for current command
-  hid_cmd_t *current = cmd_chain;
-  
-  //iterate through all available hid cmds
-  while(current != NULL)
+  //the AT string is stored with the first action of a command,
+  //which might be a press or a release action
+  for(uint8_t e = 0; g != NULL && e<2; e++)
   {
-    //is this the requested button?
-    if((current->vb & 0x7F) == vb)
+    hid_binding_t *b = &g->bindings[vb][e];
+    for(uint16_t i = 0; i<b->count; i++)
     {
       //check if we found an AT string
-      if(current->atoriginal != NULL)
+      if(b->cmds[i].atoriginal != NULL)
       {
-        strncpy(output,current->atoriginal,ATCMD_LENGTH);
+        strncpy(output,b->cmds[i].atoriginal,ATCMD_LENGTH);
         #if LOG_LEVEL_HID >= ESP_LOG_INFO
         ESP_LOGI(LOG_TAG,"BM%02d: %s",vb,output);
         #endif
@@ -460,10 +477,49 @@ esp_err_t handler_hid_getAT(char* output, uint8_t vb)
         return ESP_OK;
       }
     }
-    current = current->next;
   }
   ESP_LOGD(LOG_TAG,"No AT command found");
   xSemaphoreGive(hidCmdSem);
   return ESP_FAIL;
 }
 
+/** @brief Get a copy of all HID commands (used for slot images)
+ * 
+ * @note If there are unpublished changes, they are used.
+ * @param cmds Output array, NULL to get the count of all commands
+ * @param max Count of elements of cmds
+ * @return Count of returned commands
+ * */
+uint32_t handler_hid_getCmds(hid_cmd_t *cmds, uint32_t max)
+{
+  uint32_t count = 0;
+  
+  if(hidCmdSem == NULL) return 0;
+  if(xSemaphoreTake(hidCmdSem,50) != pdTRUE)
+  {
+    ESP_LOGE(LOG_TAG,"HID mutex not free for getting cmds");
+    return 0;
+  }
+  hid_generation_t *g = hidDraft ? hidDraft : __atomic_load_n(&hidActive,__ATOMIC_ACQUIRE);
+  
+  if(cmds == NULL)
+  {
+    if(g != NULL) count = g->count;
+    xSemaphoreGive(hidCmdSem);
+    return count;
+  }
+  for(uint16_t vb = 0; g != NULL && vb<VB_MAX_BINDABLE; vb++)
+  {
+    for(uint8_t e = 0; e<2; e++)
+    {
+      hid_binding_t *b = &g->bindings[vb][e];
+      for(uint16_t i = 0; i<b->count && count<max; i++)
+      {
+        memcpy(&cmds[count],&b->cmds[i],sizeof(hid_cmd_t));
+        count++;
+      }
+    }
+  }
+  xSemaphoreGive(hidCmdSem);
+  return count;
+}
@@ -28,7 +28,20 @@
  * * Joystick press,hold,release & axis movement
  * 
  * handler_hid_init is initializing the mutex for adding a command to the
- * chained list and adding handler_hid to the system event queue.
+ * binding table and adding handler_hid to the system event queue.
+ * 
+ * Commands are stored per VB & event (press/release) in a contiguous
+ * array. Dispatching an event is a direct lookup, the effort depends only
+ * on the count of commands of this VB, not on the size of the slot.
+ * The arrays and strings are taken from the slot arena, they are released
+ * at once on a slot switch.
+ * 
+ * The binding table is published as an immutable generation. The handler
+ * reads the published generation without locking. Adding, deleting or
+ * clearing commands changes a draft generation (protected by the mutex),
+ * which is published by handler_hid_publish. While a slot is loaded, the
+ * previous slot stays active until the new one is published, button
+ * events are never dropped during a slot switch.
  *
  * @note Currently, we use the system event queue (because there is already
  * a task attached). Maybe we switch to an unique one.
@@ -42,10 +55,12 @@
 #include <freertos/FreeRTOS.h>
 #include <freertos/event_groups.h>
 #include <freertos/queue.h>
+#include <freertos/task.h>
 #include <esp_log.h>
 #include <esp_event.h>
 //common definitions & data for all of these functional tasks
 #include "common.h"
+#include "slot_arena.h"
 #include "fct_macros.h"
 #include "../config_switcher.h"
 
@@ -55,28 +70,17 @@
  * @return ESP_OK on success, ESP_FAIL on an error.*/
 esp_err_t handler_hid_init(void);
 
-/** @brief Get current root of HID command chain
- * @warning Modifying this chain without acquiring the hidCmdSem could result in
- * undefined behaviour!
- * @return Pointer to root of HID chain
- */
-hid_cmd_t *handler_hid_getCmdChain(void);
-
-/** @brief Set current root of HID command chain!
- * @warning By using this function, previously used HID commands are cleared!
- * @param chain Pointer to root of HID chain
- * @return ESP_OK if chain is saved, ESP_FAIL otherwise (lock was not free, deleting old chain failed..)
- */
-esp_err_t handler_hid_setCmdChain(hid_cmd_t *chain);
-
 /** @brief Add a new HID command for a virtual button
  * 
  * This method adds the given HID command to the list of HID commands
  * which will be processed if the corresponding VB is triggered.
  * 
- * @note Highest bit determines press/release action. If set, it is a press!
+ * @note newCmd->event determines the triggering action (VB_PRESS_EVENT or VB_RELEASE_EVENT).
  * @note If VB number is set to VB_SINGLESHOT, the command will be sent immediately.
- * @note We will malloc for each command here. To free the memory, call handler_hid_clearCmds .
+ * @note The command is copied to the slot arena, its AT string is interned
+ * (equal strings are stored once per slot). The memory is released on the
+ * next slot switch.
+ * @note Changes are active after handler_hid_publish.
  * @param newCmd New command to be added.
  * @param replace If set to != 0, any previously assigned command is removed from list.
  * @return ESP_OK if added, ESP_FAIL if not added (out of memory) */
@@ -87,18 +91,36 @@ esp_err_t handler_hid_addCmd(hid_cmd_t *newCmd, uint8_t replace);
  * This method removes any HID command from the list of HID commands
  * which are assigned to this VB.
  * 
+ * @note Changes are active after handler_hid_publish.
  * @param vb VB which should be removed
  * @return ESP_OK if deleted, ESP_FAIL if not in list */
-esp_err_t handler_hid_delCmd(uint8_t vb);
+esp_err_t handler_hid_delCmd(uint16_t vb);
 
 /** @brief Clear all stored HID commands.
- * 
- * This method clears all stored HID commands and frees the allocated memory.
- * 
+ *
+ * This method starts a new, empty draft generation. The published
+ * generation is still active until handler_hid_publish is called.
+ *
  * @return ESP_OK if commands are cleared, ESP_FAIL otherwise
  * */
 esp_err_t handler_hid_clearCmds(void);
 
+/** @brief Publish all changes of the HID commands
+ *
+ * The draft generation is activated with one atomic pointer swap.
+ * The handler uses either the previous or the new generation, never
+ * a partially modified one.
+ * @return ESP_OK if published (or nothing to publish), ESP_FAIL otherwise
+ * */
+esp_err_t handler_hid_publish(void);
+
+/** @brief Wait until handler_hid uses only the published generation
+ *
+ * After this call, older generations are not used anymore and their
+ * memory might be released (slotArenaSwitch).
+ * */
+void handler_hid_sync(void);
+
 /** @brief Reverse Parsing - get AT command for HID VB
  * 
  * This function parses the current configuration of a virtual button
@@ -107,6 +129,18 @@ esp_err_t handler_hid_clearCmds(void);
  * @param vb Number of virtual button for getting the AT command
  * @return ESP_OK if everything went fine, ESP_FAIL otherwise
  * */
-esp_err_t handler_hid_getAT(char* output, uint8_t vb);
+esp_err_t handler_hid_getAT(char* output, uint16_t vb);
+
+/** @brief Get a copy of all HID commands (used for slot images)
+ * 
+ * Commands are returned ordered by VB & event, in the order they were
+ * added. Strings are not copied, they stay valid until the
+ * next slot switch.
+ * @note If there are unpublished changes, they are used.
+ * @param cmds Output array, NULL to get the count of all commands
+ * @param max Count of elements of cmds
+ * @return Count of returned commands
+ * */
+uint32_t handler_hid_getCmds(hid_cmd_t *cmds, uint32_t max);
 
 #endif /* _HANDLER_HID_H */
@@ -28,6 +28,19 @@
  * * Macro execution
  * * Calibration
  * * Slot switching
+ * 
+ * Commands are stored per VB & event (press/release) in a contiguous
+ * array. Dispatching an event is a direct lookup, the effort depends only
+ * on the count of commands of this VB, not on the size of the slot.
+ * The arrays and strings are taken from the slot arena, they are released
+ * at once on a slot switch.
+ *
+ * The binding table is published as an immutable generation. The handler
+ * reads the published generation without locking. Adding, deleting or
+ * clearing commands changes a draft generation (protected by the mutex),
+ * which is published by handler_vb_publish. While a slot is loaded, the
+ * previous slot stays active until the new one is published, button
+ * events are never dropped during a slot switch.
  * @note Currently, we use the system event queue (because there is already
  * a task attached). Maybe we switch to an unique one.
  */
@@ -39,23 +52,54 @@
 /** @brief Set a global log limit for this file */
 #define LOG_LEVEL_VB ESP_LOG_DEBUG
 
-/** @brief Beginning of all VB commands
+/** @brief All VB commands of one VB & event */
+typedef struct vb_binding {
+  /** @brief Array of commands, in the order they were added */
+  vb_cmd_t *cmds;
+  /** @brief Count of commands in this array */
+  uint16_t count;
+  /** @brief Count of allocated elements of this array */
+  uint16_t capacity;
+} vb_binding_t;
+
+/** @brief One generation of VB commands, indexed by VB number & event (press/release)
  * 
- * This pointer is the beginning of the VB command chain.
- * Each time an active VB is triggered, the handler_vb walks through this
- * chained list for a corresponding command and triggers the given action.
+ * Each time an active VB is triggered, the handler_vb triggers the
+ * actions of all commands of this VB & event.
  * 
- * Adding a new command is done via handler_vb_addCmd, the full list
- * is freed and cleared via handler_vb_clearCmds.
+ * A published generation is never modified, except appending commands
+ * behind the count of a binding (not visible to readers).
  * 
  * @see handler_vb
  * @see handler_vb_addCmd
- * @see handler_vb_clearCmds*/
-static vb_cmd_t *cmd_chain = NULL;
+ * @see handler_vb_publish */
+typedef struct vb_generation {
+  /** @brief Commands per VB & event */
+  vb_binding_t bindings[VB_MAX_BINDABLE][2];
+  /** @brief Count of all stored VB commands */
+  uint32_t count;
+} vb_generation_t;
 
-/** @brief Synchronization mutex for accessing the VB command chain */
-SemaphoreHandle_t vbCmdSem = NULL;
+/** @brief Count of generation buffers: the published one, the draft and
+ * one, which might still be used by the handler */
+#define VB_GENERATIONS 3
+
+/** @brief Buffers for the generations, reused in turn */
+static vb_generation_t vbGenerations[VB_GENERATIONS];
+
+/** @brief Published generation, read by handler_vb without locking */
+static vb_generation_t *vbActive = NULL;
 
+/** @brief Generation, which is modified by add/del/clear. NULL if there
+ * are no changes since the last publish.
+ * @note Only accessed with vbCmdSem */
+static vb_generation_t *vbDraft = NULL;
+
+/** @brief Generation currently used by handler_vb, NULL if not dispatching */
+static vb_generation_t *vbReader = NULL;
+
+/** @brief Synchronization mutex for modifying the VB bindings */
+SemaphoreHandle_t vbCmdSem = NULL;
 
 /**
  * @brief VB event handler, triggering VB general actions.
@@ -67,27 +111,9 @@ SemaphoreHandle_t vbCmdSem = NULL;
  */
 static void handler_vb(void *event_handler_arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
 {
-  //if we don't have a stable config, simply return...
-  if((xEventGroupGetBits(systemStatus) & SYSTEM_STABLECONFIG) == 0) return;
-
-  //use the mutex to ensure a valid chained list. 
-  if(xSemaphoreTake(vbCmdSem,4) != pdTRUE)
-  {
-    ESP_LOGW(LOG_TAG,"VB mutex not free for handler");
-    return;
-  }
-  //if command chain is empty, we cannot do anything.
-  if(cmd_chain == NULL) 
-  {
-    xSemaphoreGive(vbCmdSem);
-    return;
-  }
-  
-  uint8_t vb = 0;
-  uint32_t count = 0;
   switch(event_id)
   {
-    case VB_PRESS_EVENT: vb |= 0x80; //set uppermost bit for press event.
+    case VB_PRESS_EVENT:
     case VB_RELEASE_EVENT:
       break;
     default: //might be another type of event, we don't care of.
@@ -100,67 +126,76 @@ static void handler_vb(void *event_handler_arg, esp_event_base_t event_base, int
     ESP_LOGE(LOG_TAG,"Empty event data, cannot proceed!");
     return;
   }
+  uint32_t vb = *((uint32_t*) event_data);
+  if(vb >= VB_MAX_BINDABLE) return;
   
-  vb |= (*((uint32_t*) event_data)) & 0x7F;
+  //running macros of this VB might be canceled on release
+  if(event_id == VB_RELEASE_EVENT) fct_macro_release(vb);
+
+  //get the published generation & mark it as used. If it was replaced
+  //in between, the writer might not have seen our mark -> retry.
+  vb_generation_t *g;
+  do {
+    g = __atomic_load_n(&vbActive,__ATOMIC_SEQ_CST);
+    __atomic_store_n(&vbReader,g,__ATOMIC_SEQ_CST);
+  } while(g != __atomic_load_n(&vbActive,__ATOMIC_SEQ_CST));
+  //no slot loaded yet
+  if(g == NULL) return;
   
-  //begin with head of chain
-  vb_cmd_t *current = cmd_chain;
-  //iterate through all available vb cmds
-  while(current != NULL)
-  {
-    //send VB command(s), if VB matches
-    //this way, we can do more actions on one VB
-    if(current->vb == vb)
+  //trigger all VB command(s) of this VB & event
+  //this way, we can do more actions on one VB
+  vb_binding_t *b = &g->bindings[vb][event_id];
+  for(uint16_t i = 0; i<b->count; i++)
+  {
+    vb_cmd_t *c = &b->cmds[i];
+    /* determine action to be triggered */
+    switch(c->cmd)
     {
-      count++;
-      /* determine action to be triggered */
-      switch(current->cmd)
-      {
-        case T_MACRO:
-          if(current->cmdparam == NULL)
-          {
-            ESP_LOGE(LOG_TAG,"Param is null, cannot execute macro");
-          } else {
-            #if LOG_LEVEL_VB >= ESP_LOG_DEBUG
-            ESP_LOGD(LOG_TAG,"Sent macro %s for VB %d", (char*)current->cmdparam, vb & 0x7F);
-            #endif
-            fct_macro(current->cmdparam);
-          }
-          break;
-        case T_CONFIGCHANGE:
-          if(current->cmdparam == NULL)
-          {
-            ESP_LOGE(LOG_TAG,"Param is null, cannot request config change");
-          } else {
-            #if LOG_LEVEL_VB >= ESP_LOG_DEBUG
-            ESP_LOGD(LOG_TAG,"Sent CFG change %s for VB %d", (char*)current->cmdparam, vb & 0x7F);
-            #endif
-            xQueueSend(config_switcher,(void*)current->cmdparam,(TickType_t)10);
-          }
-          break;
-        case T_CALIBRATE:
-          halAdcCalibrate();
-          break;
-        case T_SENDIR:
-          if(current->cmdparam == NULL)
-          {
-            ESP_LOGE(LOG_TAG,"Param is null, cannot send IR");
-          } else {
-            fct_infrared_send(current->cmdparam);
-          }
-          break;
-        default:
-          ESP_LOGE(LOG_TAG,"Unknown VB cmd type");
-          break;
-      }
+      case T_MACRO:
+        if(c->cmdparam == NULL)
+        {
+          ESP_LOGE(LOG_TAG,"Param is null, cannot execute macro");
+        } else {
+          #if LOG_LEVEL_VB >= ESP_LOG_DEBUG
+          ESP_LOGD(LOG_TAG,"Sent macro %s for VB %d", (char*)c->cmdparam, vb);
+          #endif
+          //use the compiled macro, compile it now if not available
+          if(c->macro != NULL) fct_macro_run(c->macro,vb);
+          else fct_macro(c->cmdparam,vb);
+        }
+        break;
+      case T_CONFIGCHANGE:
+        if(c->cmdparam == NULL)
+        {
+          ESP_LOGE(LOG_TAG,"Param is null, cannot request config change");
+        } else {
+          #if LOG_LEVEL_VB >= ESP_LOG_DEBUG
+          ESP_LOGD(LOG_TAG,"Sent CFG change %s for VB %d", (char*)c->cmdparam, vb);
+          #endif
+          xQueueSend(config_switcher,(void*)c->cmdparam,(TickType_t)10);
+        }
+        break;
+      case T_CALIBRATE:
+        halAdcCalibrate();
+        break;
+      case T_SENDIR:
+        if(c->cmdparam == NULL)
+        {
+          ESP_LOGE(LOG_TAG,"Param is null, cannot send IR");
+        } else {
+          fct_infrared_send(c->cmdparam);
+        }
+        break;
+      default:
+        ESP_LOGE(LOG_TAG,"Unknown VB cmd type");
+        break;
     }
-    current = current->next;
   }
   #if LOG_LEVEL_VB >= ESP_LOG_DEBUG
-  if(count == 0) ESP_LOGD(LOG_TAG,"Sent %d cmds for VB %d", count, vb & 0x7F);
+  if(b->count == 0) ESP_LOGD(LOG_TAG,"Sent %d cmds for VB %d", b->count, vb);
   #endif
-  if(count != 0) ESP_LOGI(LOG_TAG,"Sent %d cmds for VB %d", count, vb & 0x7F);
-  xSemaphoreGive(vbCmdSem);
+  if(b->count != 0) ESP_LOGI(LOG_TAG,"Sent %d cmds for VB %d", b->count, vb);
+  __atomic_store_n(&vbReader,NULL,__ATOMIC_RELEASE);
 }
 
 /** @brief Init for the VB handler
@@ -184,47 +219,119 @@ esp_err_t handler_vb_init(void)
   return esp_event_handler_register(VB_EVENT,ESP_EVENT_ANY_ID,handler_vb,NULL);
 }
 
+/** @brief Regenerate the canonical AT command of a VB command
+ *
+ * Each VB command is created by exactly one AT command, which can be
+ * generated from the command type & parameter.
+ * @param c VB command
+ * @param output Output string (ATCMD_LENGTH)
+ * @return ESP_OK if generated, ESP_FAIL otherwise */
+static esp_err_t handler_vb_canonicalAT(vb_cmd_t *c, char *output)
+{
+  switch(c->cmd)
+  {
+    case T_MACRO:
+      if(c->cmdparam == NULL) return ESP_FAIL;
+      snprintf(output,ATCMD_LENGTH,"AT MA %s",c->cmdparam);
+      return ESP_OK;
+    case T_CONFIGCHANGE:
+      if(c->cmdparam == NULL) return ESP_FAIL;
+      if(strcmp(c->cmdparam,"__NEXT") == 0) snprintf(output,ATCMD_LENGTH,"AT NE");
+      else snprintf(output,ATCMD_LENGTH,"AT LO %s",c->cmdparam);
+      return ESP_OK;
+    case T_CALIBRATE:
+      snprintf(output,ATCMD_LENGTH,"AT CA");
+      return ESP_OK;
+    case T_SENDIR:
+      if(c->cmdparam == NULL) return ESP_FAIL;
+      snprintf(output,ATCMD_LENGTH,"AT IP %s",c->cmdparam);
+      return ESP_OK;
+    default:
+      return ESP_FAIL;
+  }
+}
+
+/** @brief Get the draft generation, create it if necessary
+ *
+ * A new draft is a copy of the published generation (the command
+ * arrays are shared). The buffer is neither the published one nor the
+ * one used by the handler.
+ * @note vbCmdSem must be taken
+ * @param empty If != 0, a new, empty draft is created
+ * @return Draft generation */
+static vb_generation_t *handler_vb_getDraft(uint8_t empty)
+{
+  vb_generation_t *g = vbDraft;
+  vb_generation_t *active = __atomic_load_n(&vbActive,__ATOMIC_SEQ_CST);
+
+  if(g == NULL)
+  {
+    //a reader marks a generation before using it, a buffer which is
+    //not active and not marked cannot be used by the handler.
+    vb_generation_t *reader = __atomic_load_n(&vbReader,__ATOMIC_SEQ_CST);
+    for(uint8_t i = 0; i<VB_GENERATIONS; i++)
+    {
+      if(&vbGenerations[i] != active && &vbGenerations[i] != reader)
+      {
+        g = &vbGenerations[i];
+        break;
+      }
+    }
+    empty |= (active == NULL);
+    if(empty == 0) memcpy(g,active,sizeof(vb_generation_t));
+  }
+  if(empty) memset(g,0,sizeof(vb_generation_t));
+  vbDraft = g;
+  return g;
+}
+
+/** @brief Remove all commands of one VB & event
+ *
+ * The array might be used by a published generation, it is not modified.
+ * The next command of this VB & event gets a new array.
+ * @note vbCmdSem must be taken
+ * @return Count of removed commands */
+static uint16_t handler_vb_freeBinding(vb_generation_t *g, vb_binding_t *b)
+{
+  uint16_t count = b->count;
+  b->cmds = NULL;
+  b->count = 0;
+  b->capacity = 0;
+  g->count -= count;
+  return count;
+}
+
 /** @brief Remove command for a virtual button
  * 
  * This method removes any command from the list of commands
  * which are assigned to this VB.
  * 
+ * @note Changes are active after handler_vb_publish.
  * @param vb VB which should be removed
  * @return ESP_OK if deleted, ESP_FAIL if not in list */
-esp_err_t handler_vb_delCmd(uint8_t vb)
+esp_err_t handler_vb_delCmd(uint16_t vb)
 {
-  //existing chain
-  vb_cmd_t *current = cmd_chain;
-  vb_cmd_t *prev = NULL;
-  uint count = 0;
-
-  heap_caps_check_integrity_all(true);
-  //do as long as we don't have a null pointer
-  while(current != NULL)
+  if(vb >= VB_MAX_BINDABLE || vbCmdSem == NULL) return ESP_FAIL;
+  //take mutex for modifying
+  if(xSemaphoreTake(vbCmdSem,50) != pdTRUE)
   {
-    //if the VB number matches (discarding press/release flag)
-    if((current->vb & 0x7F) == (vb & 0x7F))
-    {
-      //set pointer from previous element to next one
-      //but only if we are not at the head (no previous element)
-      if(prev != NULL) prev->next = current->next;
-      //if no previous element -> replace 
-      else cmd_chain = current->next;
-      //free an AT string
-      if(current->atoriginal != NULL) free(current->atoriginal);
-      //if set, free param string
-      if(current->cmdparam != NULL) free(current->cmdparam);
-      //free this element
-      free(current);
-      //just begin at the front again (easiest way if we removed the head)
-      current = cmd_chain;
-      prev = NULL;
-    } else { //does not match
-      //set pointers to next element
-      prev = current;
-      current = current->next;
-    }
+    ESP_LOGE(LOG_TAG,"VB mutex not free for deleting");
+    return ESP_FAIL;
+  }
+  //nothing to do, if this VB has no commands
+  vb_generation_t *g = vbDraft ? vbDraft : __atomic_load_n(&vbActive,__ATOMIC_ACQUIRE);
+  if(g == NULL || (g->bindings[vb][VB_PRESS_EVENT].count == 0 && \
+    g->bindings[vb][VB_RELEASE_EVENT].count == 0))
+  {
+    xSemaphoreGive(vbCmdSem);
+    return ESP_FAIL;
   }
+  //press & release
+  g = handler_vb_getDraft(0);
+  uint16_t count = handler_vb_freeBinding(g,&g->bindings[vb][VB_PRESS_EVENT]);
+  count += handler_vb_freeBinding(g,&g->bindings[vb][VB_RELEASE_EVENT]);
+  xSemaphoreGive(vbCmdSem);
+  
   if(count != 0) return ESP_OK;
   else return ESP_FAIL;
 }
@@ -234,10 +341,14 @@ esp_err_t handler_vb_delCmd(uint8_t vb)
  * This method adds the given VB command to the list of VB commands
  * which will be processed if the corresponding VB is triggered.
  * 
- * @note Highest bit determines press/release action. If set, it is a press!
+ * @note newCmd->event determines the triggering action (VB_PRESS_EVENT or VB_RELEASE_EVENT).
  * @note If VB number is set to VB_SINGLESHOT, the command will be sent immediately.
- * @note We will malloc for each command here. To free the memory, call handler_vb_clearCmds .
- * @param newCmd New command to be added or triggered if vb is VB_SINGLESHOT
+ * @note The command is copied to the slot arena, its strings are interned
+ * (equal strings are stored once per slot). The memory is released on
+ * the next slot switch. An AT string, which is equal to the regenerated
+ * one, is not stored at all.
+ * @note Changes are active after handler_vb_publish.
+ * @param newCmd New command to be added.
  * @param replace If set to != 0, any previously assigned command is removed from list.
  * @return ESP_OK if added, ESP_FAIL if not added (out of memory) */
 esp_err_t handler_vb_addCmd(vb_cmd_t *newCmd, uint8_t replace)
@@ -253,14 +364,14 @@ esp_err_t handler_vb_addCmd(vb_cmd_t *newCmd, uint8_t replace)
     ESP_LOGE(LOG_TAG,"vbCmdSem is NULL");
     return ESP_FAIL;
   }
-  if((newCmd->vb & 0x7F) >= VB_MAX)
+  if(newCmd->vb >= VB_MAX_BINDABLE)
   {
     ESP_LOGE(LOG_TAG,"newCmd->vb out of range");
     return ESP_FAIL;
   }
-  if(((newCmd->vb & 0x7F) / 4) >= NUMBER_VIRTUALBUTTONS)
+  if(newCmd->event != VB_PRESS_EVENT && newCmd->event != VB_RELEASE_EVENT)
   {
-    ESP_LOGE(LOG_TAG,"array out of bounds -> unrecoverable!");
+    ESP_LOGE(LOG_TAG,"newCmd->event out of range");
     return ESP_FAIL;
   }
   
@@ -270,133 +381,84 @@ esp_err_t handler_vb_addCmd(vb_cmd_t *newCmd, uint8_t replace)
     ESP_LOGE(LOG_TAG,"VB mutex not free for adding");
     return ESP_FAIL;
   }
+  vb_generation_t *g = handler_vb_getDraft(0);
   
-  //existing chain, add to end
-  vb_cmd_t *current = cmd_chain;
-  int count = 0;
-  
-  //debugging...
-  #if LOG_LEVEL_VB >= ESP_LOG_DEBUG
-  while(current!=NULL)
+  //if set, remove any previously set commands (press & release).
+  if(replace)
   {
-    count++;
-    ESP_LOGD(LOG_TAG,"%d:%2d:0x%X",count,current->vb,(uint32_t)current);
-    current = current->next;
-  }
-  current = cmd_chain;
-  count = 0;
-  #endif
-  
-  //if set, remove any previously set commands.
-  if(replace) handler_vb_delCmd(newCmd->vb);
-  
-  //allocate new command
-  current = cmd_chain;
-  vb_cmd_t *new;
-  new = malloc(sizeof(vb_cmd_t));
-  
-  if(new != NULL)
-  {
-    memcpy(new, newCmd, sizeof(vb_cmd_t));
-    //save pointer of new config to end of chain
-    new->next = NULL;
-    //if we don't have a head, use this one
-    if(cmd_chain == NULL) {
-      cmd_chain = new;
-    } else {
-      //otherwise append to tail.
-      while(current->next != NULL)
-      {
-        #if LOG_LEVEL_VB >= ESP_LOG_DEBUG
-        ESP_LOGD(LOG_TAG,"Nr %d, @0x%8X",count,(uint32_t)current);
-        #endif
-        count++;
-        current = current->next;
-      }
-      current->next = new;
-    }
-    count++;
-    #if LOG_LEVEL_VB >= ESP_LOG_DEBUG
-    ESP_LOGI(LOG_TAG,"Added new cmd nr %d, new: 0x%8X, prev: 0x%8X",count,(uint32_t)new,(uint32_t)current);
-    #endif
-    
-    current = new;
-    xSemaphoreGive(vbCmdSem);
-    return ESP_OK;
-  } else {
-    ESP_LOGE(LOG_TAG,"Cannot allocate memory for new VB cmd!");
-    xSemaphoreGive(vbCmdSem);
-    return ESP_FAIL;
+    handler_vb_freeBinding(g,&g->bindings[newCmd->vb][VB_PRESS_EVENT]);
+    handler_vb_freeBinding(g,&g->bindings[newCmd->vb][VB_RELEASE_EVENT]);
   }
-
-  //should not be here, but return ok anyway
-  xSemaphoreGive(vbCmdSem);
-  return ESP_OK;
-}
-
-/** @brief Get current root of VB command chain
- * @warning Modifying this chain without acquiring the vbCmdSem could result in
- * undefined behaviour!.
- * @return Pointer to root of VB chain
- */
-vb_cmd_t *handler_vb_getCmdChain(void)
-{
-  return cmd_chain;
-}
-
-/** @brief Set current root of VB command chain
- * @warning By using this function, previously used VB commands are cleared!
- * @param chain Pointer to root of VB chain
- * @return ESP_OK if chain is saved, ESP_FAIL otherwise (lock was not free, deleting old chain failed..)
- */
-esp_err_t handler_vb_setCmdChain(vb_cmd_t *chain)
-{
-  esp_err_t ret = ESP_OK;
   
-  //check if chain is currently active,
-  //if yes clear it before setting a new one
-  if(cmd_chain != NULL)
+  //append to the array of this VB & event. Elements behind the count
+  //are not used by a published generation.
+  vb_binding_t *b = &g->bindings[newCmd->vb][newCmd->event];
+  if(b->count == b->capacity)
   {
-    ret = handler_vb_clearCmds();
-    if(ret != ESP_OK)
+    //array is full, get a new one with double size from the arena
+    uint16_t capacity = b->capacity ? b->capacity*2 : 2;
+    vb_cmd_t *cmds = slotArenaAlloc(capacity*sizeof(vb_cmd_t));
+    if(cmds == NULL)
     {
-      ESP_LOGE(LOG_TAG,"Cannot clear old chain");
-      return ret;
+      ESP_LOGE(LOG_TAG,"Cannot allocate memory for new VB cmd!");
+      xSemaphoreGive(vbCmdSem);
+      return ESP_FAIL;
     }
+    if(b->count != 0) memcpy(cmds,b->cmds,b->count*sizeof(vb_cmd_t));
+    b->cmds = cmds;
+    b->capacity = capacity;
   }
-  
-  //enter critical section for setting new cmd chain
-  if(vbCmdSem == NULL)
+  memcpy(&b->cmds[b->count],newCmd,sizeof(vb_cmd_t));
+  //strings are interned, the caller keeps its strings
+  vb_cmd_t *c = &b->cmds[b->count];
+  if(newCmd->cmdparam != NULL)
   {
-    ESP_LOGE(LOG_TAG,"vbCmdSem is NULL");
-    return ESP_FAIL;
+    c->cmdparam = slotArenaIntern(newCmd->cmdparam);
+    if(c->cmdparam == NULL) ESP_LOGE(LOG_TAG,"Cannot allocate param string");
   }
-  //take mutex for modifying
-  if(xSemaphoreTake(vbCmdSem,50) != pdTRUE)
+  //compiled macro is copied to the arena as well
+  if(newCmd->macro != NULL)
   {
-    ESP_LOGE(LOG_TAG,"cannot enter critical section");
-    return ESP_FAIL;
+    uint32_t len = fct_macro_length(newCmd->macro);
+    c->macro = slotArenaAlloc(len);
+    if(c->macro != NULL) memcpy(c->macro,newCmd->macro,len);
+    else ESP_LOGE(LOG_TAG,"Cannot allocate compiled macro");
   }
-  //save the pointer
-  cmd_chain = chain;
-  //release mutex
+  //the AT string is not stored, if it can be regenerated from the command
+  //(line endings of the original string are ignored)
+  if(newCmd->atoriginal != NULL)
+  {
+    char canonical[ATCMD_LENGTH];
+    size_t len = 0;
+    if(handler_vb_canonicalAT(c,canonical) == ESP_OK) len = strlen(canonical);
+    if(len != 0 && strncmp(canonical,newCmd->atoriginal,len) == 0 && \
+      strspn(&newCmd->atoriginal[len],"\r\n ") == strlen(&newCmd->atoriginal[len]))
+    {
+      c->atoriginal = NULL;
+    } else {
+      c->atoriginal = slotArenaIntern(newCmd->atoriginal);
+      if(c->atoriginal == NULL) ESP_LOGE(LOG_TAG,"Cannot allocate AT string");
+    }
+  }
+  b->count++;
+  g->count++;
+  
+  #if LOG_LEVEL_VB >= ESP_LOG_DEBUG
+  ESP_LOGD(LOG_TAG,"Added new cmd for VB %d/%d, %d cmds total",newCmd->vb,newCmd->event,g->count);
+  #endif
   xSemaphoreGive(vbCmdSem);
   return ESP_OK;
 }
 
 /** @brief Clear all stored VB commands.
- * 
- * This method clears all stored VB commands and frees the allocated memory.
- * 
+ *
+ * This method starts a new, empty draft generation. The published
+ * generation is still active until handler_vb_publish is called.
+ *
  * @return ESP_OK if commands are cleared, ESP_FAIL otherwise
  * */
 esp_err_t handler_vb_clearCmds(void)
 {
-  if(cmd_chain == NULL)
-  {
-    ESP_LOGW(LOG_TAG,"VB cmds already empty");
-    return ESP_FAIL;
-  }
   if(vbCmdSem == NULL)
   {
     ESP_LOGE(LOG_TAG,"vbCmdSem is NULL");
@@ -410,91 +472,190 @@ esp_err_t handler_vb_clearCmds(void)
     return ESP_FAIL;
   }
   
-  //pointers for next and current command
-  vb_cmd_t *next = NULL;
-  vb_cmd_t *current = cmd_chain;
-  int count = 0;
-  
-  do {
-    //load next block
-    next = current->next;
-    //if set, free the original AT command
-    if(current->atoriginal != NULL) free(current->atoriginal);
-    current->atoriginal = NULL;
-    //if set, free param string
-    if(current->cmdparam != NULL) free(current->cmdparam);
-    current->cmdparam = NULL;
-    //free the current one
-    free(current);
-    //count for statistics
-    count++;
-    //previous next is current for next while iteration
-    current = next;
-    //break the loop if current is NULL (we reached end of chain)
-  } while(current != NULL);
-  
+  handler_vb_getDraft(1);
+
   #if LOG_LEVEL_VB >= ESP_LOG_INFO
-  ESP_LOGI(LOG_TAG,"Cleared %d VB cmds",count);
+  ESP_LOGI(LOG_TAG,"Cleared VB cmds");
   #endif
 
-  cmd_chain = NULL;
   //release mutex
   xSemaphoreGive(vbCmdSem);
   return ESP_OK;
 }
 
+/** @brief Publish all changes of the VB commands
+ *
+ * The draft generation is activated with one atomic pointer swap.
+ * The handler uses either the previous or the new generation, never
+ * a partially modified one.
+ * @return ESP_OK if published (or nothing to publish), ESP_FAIL otherwise
+ * */
+esp_err_t handler_vb_publish(void)
+{
+  if(vbCmdSem == NULL)
+  {
+    ESP_LOGE(LOG_TAG,"vbCmdSem is NULL");
+    return ESP_FAIL;
+  }
+  if(xSemaphoreTake(vbCmdSem,50) != pdTRUE)
+  {
+    ESP_LOGE(LOG_TAG,"VB mutex not free for publishing");
+    return ESP_FAIL;
+  }
+  if(vbDraft != NULL)
+  {
+    __atomic_store_n(&vbActive,vbDraft,__ATOMIC_SEQ_CST);
+    #if LOG_LEVEL_VB >= ESP_LOG_DEBUG
+    ESP_LOGD(LOG_TAG,"Published %d VB cmds",vbDraft->count);
+    #endif
+    vbDraft = NULL;
+  }
+  xSemaphoreGive(vbCmdSem);
+  return ESP_OK;
+}
+
+/** @brief Wait until handler_vb uses only the published generation
+ *
+ * After this call, older generations are not used anymore and their
+ * memory might be released (slotArenaSwitch).
+ * */
+void handler_vb_sync(void)
+{
+  vb_generation_t *r;
+  while((r = __atomic_load_n(&vbReader,__ATOMIC_SEQ_CST)) != NULL && \
+    r != __atomic_load_n(&vbActive,__ATOMIC_SEQ_CST))
+  {
+    vTaskDelay(1);
+  }
+}
+
 /** @brief Reverse Parsing - get AT command of a given VB
  * 
  * This function parses the current configuration of a virtual button
  * to an AT command used to print the configuration.
+ * @note If there are unpublished changes, they are used.
  * @param output Output string, where the full AT command will be stored
  * @param vb Number of virtual button for getting the AT command
  * @return ESP_OK if everything went fine, ESP_FAIL otherwise
  * */
-esp_err_t handler_vb_getAT(char* output, uint8_t vb)
+esp_err_t handler_vb_getAT(char* output, uint16_t vb)
 {
   if(vbCmdSem == NULL)
   {
     ESP_LOGE(LOG_TAG,"vbCmdSem is NULL");
     return ESP_FAIL;
   }
+  if(vb >= VB_MAX_BINDABLE) return ESP_FAIL;
   
-  if(cmd_chain == NULL)
-  {
-    ESP_LOGE(LOG_TAG,"Chain empty!");
-    return ESP_FAIL;
-  }
   //take mutex for reading
   if(xSemaphoreTake(vbCmdSem,50) != pdTRUE)
   {
     ESP_LOGE(LOG_TAG,"VB mutex not free for getting");
     return ESP_FAIL;
   }
+  vb_generation_t *g = vbDraft ? vbDraft : __atomic_load_n(&vbActive,__ATOMIC_ACQUIRE);
   
-  //pointers for current command
-  vb_cmd_t *current = cmd_chain;
+  //the AT string is stored with the first action of a command,
+  //which might be a press or a release action. If not stored, it is
+  //regenerated from this action.
+  for(uint8_t e = 0; g != NULL && e<2; e++)
+  {
+    vb_binding_t *b = &g->bindings[vb][e];
+    if(b->count == 0) continue;
+    vb_cmd_t *c = &b->cmds[0];
+    if(c->atoriginal != NULL) strncpy(output,c->atoriginal,ATCMD_LENGTH);
+    else if(handler_vb_canonicalAT(c,output) != ESP_OK) continue;
+    #if LOG_LEVEL_VB >= ESP_LOG_INFO
+    ESP_LOGI(LOG_TAG,"BM%02d: %s",vb,output);
+    #endif
+    xSemaphoreGive(vbCmdSem);
+    return ESP_OK;
+  }
+  ESP_LOGD(LOG_TAG,"No AT command found");
+  xSemaphoreGive(vbCmdSem);
+  return ESP_FAIL;
+}
+
+/** @brief Get the parameters of all published VB commands of one type
+ * 
+ * @param type Type of the VB commands
+ * @param params Output array for the parameters, each parameter is
+ * returned once (truncated to SLOTNAME_LENGTH)
+ * @param max Count of elements of params
+ * @return Count of returned parameters
+ * */
+uint16_t handler_vb_getParams(vb_cmd_type_t type, char (*params)[SLOTNAME_LENGTH], uint16_t max)
+{
+  uint16_t count = 0;
   
-  //iterate through all available vb cmds
-  while(current != NULL)
+  if(vbCmdSem == NULL || params == NULL) return 0;
+  if(xSemaphoreTake(vbCmdSem,50) != pdTRUE)
   {
-    //is this the requested button?
-    if((current->vb & 0x7F) == vb)
+    ESP_LOGE(LOG_TAG,"VB mutex not free for getting params");
+    return 0;
+  }
+  vb_generation_t *g = __atomic_load_n(&vbActive,__ATOMIC_ACQUIRE);
+  
+  for(uint16_t vb = 0; g != NULL && vb<VB_MAX_BINDABLE; vb++)
+  {
+    for(uint8_t e = 0; e<2; e++)
     {
-      //check if we found an AT string
-      if(current->atoriginal != NULL)
+      vb_binding_t *b = &g->bindings[vb][e];
+      for(uint16_t i = 0; i<b->count && count<max; i++)
       {
-        strncpy(output,current->atoriginal,ATCMD_LENGTH);
-        #if LOG_LEVEL_VB >= ESP_LOG_INFO
-        ESP_LOGI(LOG_TAG,"BM%02d: %s",vb,output);
-        #endif
-        xSemaphoreGive(vbCmdSem);
-        return ESP_OK;
+        vb_cmd_t *c = &b->cmds[i];
+        if(c->cmd != type || c->cmdparam == NULL) continue;
+        //each parameter is returned once
+        uint16_t j;
+        for(j = 0; j<count; j++) if(strncmp(params[j],c->cmdparam,SLOTNAME_LENGTH) == 0) break;
+        if(j != count) continue;
+        strncpy(params[count],c->cmdparam,SLOTNAME_LENGTH-1);
+        params[count][SLOTNAME_LENGTH-1] = 0;
+        count++;
       }
     }
-    current = current->next;
   }
-  ESP_LOGD(LOG_TAG,"No AT command found");
   xSemaphoreGive(vbCmdSem);
-  return ESP_FAIL;
+  return count;
 }
 
+/** @brief Get a copy of all VB commands (used for slot images)
+ * 
+ * @note If there are unpublished changes, they are used.
+ * @param cmds Output array, NULL to get the count of all commands
+ * @param max Count of elements of cmds
+ * @return Count of returned commands
+ * */
+uint32_t handler_vb_getCmds(vb_cmd_t *cmds, uint32_t max)
+{
+  uint32_t count = 0;
+  
+  if(vbCmdSem == NULL) return 0;
+  if(xSemaphoreTake(vbCmdSem,50) != pdTRUE)
+  {
+    ESP_LOGE(LOG_TAG,"VB mutex not free for getting cmds");
+    return 0;
+  }
+  vb_generation_t *g = vbDraft ? vbDraft : __atomic_load_n(&vbActive,__ATOMIC_ACQUIRE);
+  
+  if(cmds == NULL)
+  {
+    if(g != NULL) count = g->count;
+    xSemaphoreGive(vbCmdSem);
+    return count;
+  }
+  for(uint16_t vb = 0; g != NULL && vb<VB_MAX_BINDABLE; vb++)
+  {
+    for(uint8_t e = 0; e<2; e++)
+    {
+      vb_binding_t *b = &g->bindings[vb][e];
+      for(uint16_t i = 0; i<b->count && count<max; i++)
+      {
+        memcpy(&cmds[count],&b->cmds[i],sizeof(vb_cmd_t));
+        count++;
+      }
+    }
+  }
+  xSemaphoreGive(vbCmdSem);
+  return count;
+}
@@ -28,6 +28,19 @@
  * * Macro execution
  * * Calibration
  * * Slot switching
+ * 
+ * Commands are stored per VB & event (press/release) in a contiguous
+ * array. Dispatching an event is a direct lookup, the effort depends only
+ * on the count of commands of this VB, not on the size of the slot.
+ * The arrays and strings are taken from the slot arena, they are released
+ * at once on a slot switch.
+ * 
+ * The binding table is published as an immutable generation. The handler
+ * reads the published generation without locking. Adding, deleting or
+ * clearing commands changes a draft generation (protected by the mutex),
+ * which is published by handler_vb_publish. While a slot is loaded, the
+ * previous slot stays active until the new one is published, button
+ * events are never dropped during a slot switch.
  * @note Currently, we use the system event queue (because there is already
  * a task attached). Maybe we switch to an unique one.
  */
@@ -38,9 +51,11 @@
 #include <freertos/FreeRTOS.h>
 #include <freertos/event_groups.h>
 #include <freertos/queue.h>
+#include <freertos/task.h>
 #include <esp_log.h>
 //common definitions & data for all of these functional tasks
 #include "common.h"
+#include "slot_arena.h"
 #include "../config_switcher.h"
 #include "fct_macros.h"
 #include "fct_infrared.h"
@@ -52,51 +67,58 @@
  * @return ESP_OK on success, ESP_FAIL on an error.*/
 esp_err_t handler_vb_init(void);
 
-/** @brief Get current root of VB command chain
- * @warning Modifying this chain without acquiring the vbCmdSem could result in
- * undefined behaviour!.
- * @return Pointer to root of VB chain
- */
-vb_cmd_t *handler_vb_getCmdChain(void);
-
-
-/** @brief Set current root of VB command chain
- * @warning By using this function, previously used VB commands are cleared!
- * @param chain Pointer to root of VB chain
- * @return ESP_OK if chain is saved, ESP_FAIL otherwise (lock was not free, deleting old chain failed..)
- */
-esp_err_t handler_vb_setCmdChain(vb_cmd_t *chain);
-
 /** @brief Remove command for a virtual button
  * 
  * This method removes any command from the list of commands
  * which are assigned to this VB.
  * 
+ * @note Changes are active after handler_vb_publish.
  * @param vb VB which should be removed
  * @return ESP_OK if deleted, ESP_FAIL if not in list */
-esp_err_t handler_vb_delCmd(uint8_t vb);
+esp_err_t handler_vb_delCmd(uint16_t vb);
 
 /** @brief Add a new VB command for a virtual button
  * 
  * This method adds the given VB command to the list of VB commands
  * which will be processed if the corresponding VB is triggered.
  * 
- * @note Highest bit determines press/release action. If set, it is a press!
+ * @note newCmd->event determines the triggering action (VB_PRESS_EVENT or VB_RELEASE_EVENT).
  * @note If VB number is set to VB_SINGLESHOT, the command will be sent immediately.
- * @note We will malloc for each command here. To free the memory, call handler_vb_clearCmds .
+ * @note The command is copied to the slot arena, its strings are interned
+ * (equal strings are stored once per slot). The memory is released on
+ * the next slot switch. An AT string, which is equal to the regenerated
+ * one, is not stored at all. A compiled macro is copied as well.
+ * @note Changes are active after handler_vb_publish.
  * @param newCmd New command to be added or triggered if vb is VB_SINGLESHOT
  * @param replace If set to != 0, any previously assigned command is removed from list.
  * @return ESP_OK if added, ESP_FAIL if not added (out of memory) */
 esp_err_t handler_vb_addCmd(vb_cmd_t *newCmd, uint8_t replace);
 
 /** @brief Clear all stored VB commands.
- * 
- * This method clears all stored VB commands and frees the allocated memory.
- * 
+ *
+ * This method starts a new, empty draft generation. The published
+ * generation is still active until handler_vb_publish is called.
+ *
  * @return ESP_OK if commands are cleared, ESP_FAIL otherwise
  * */
 esp_err_t handler_vb_clearCmds(void);
 
+/** @brief Publish all changes of the VB commands
+ *
+ * The draft generation is activated with one atomic pointer swap.
+ * The handler uses either the previous or the new generation, never
+ * a partially modified one.
+ * @return ESP_OK if published (or nothing to publish), ESP_FAIL otherwise
+ * */
+esp_err_t handler_vb_publish(void);
+
+/** @brief Wait until handler_vb uses only the published generation
+ *
+ * After this call, older generations are not used anymore and their
+ * memory might be released (slotArenaSwitch).
+ * */
+void handler_vb_sync(void);
+
 /** @brief Reverse Parsing - get AT command of a given VB
  * 
  * This function parses the current configuration of a virtual button
@@ -105,6 +127,30 @@ esp_err_t handler_vb_clearCmds(void);
  * @param vb Number of virtual button for getting the AT command
  * @return ESP_OK if everything went fine, ESP_FAIL otherwise
  * */
-esp_err_t handler_vb_getAT(char* output, uint8_t vb);
+esp_err_t handler_vb_getAT(char* output, uint16_t vb);
+
+/** @brief Get the parameters of all published VB commands of one type
+ * 
+ * Used to find resources of the active slot, e.g. the names of all
+ * IR commands which might be sent (T_SENDIR).
+ * @param type Type of the VB commands
+ * @param params Output array for the parameters, each parameter is
+ * returned once (truncated to SLOTNAME_LENGTH)
+ * @param max Count of elements of params
+ * @return Count of returned parameters
+ * */
+uint16_t handler_vb_getParams(vb_cmd_type_t type, char (*params)[SLOTNAME_LENGTH], uint16_t max);
+
+/** @brief Get a copy of all VB commands (used for slot images)
+ * 
+ * Commands are returned ordered by VB & event, in the order they were
+ * added. Strings & compiled macros are not copied, they stay valid until the
+ * next slot switch.
+ * @note If there are unpublished changes, they are used.
+ * @param cmds Output array, NULL to get the count of all commands
+ * @param max Count of elements of cmds
+ * @return Count of returned commands
+ * */
+uint32_t handler_vb_getCmds(vb_cmd_t *cmds, uint32_t max);
 
 #endif /* _HANDLER_VB_H */
@@ -0,0 +1,341 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ *
+ * Copyright 2019 Benjamin Aigner <aignerb@technikum-wien.at,
+ * beni@asterics-foundation.org>
+ */
+/** @file
+ * @brief Slot scoped memory arena
+ *
+ * All memory, which lives as long as one slot is loaded (command arrays
+ * of handler_hid & handler_vb, AT strings, parameter strings) is taken
+ * from this arena. Allocations are done by advancing an offset in a
+ * chunk (bump allocation), there is no free for single allocations.
+ *
+ * The arena consists of two halves, which are used alternately. On a
+ * slot switch, the config switcher calls slotArenaSwitch: the commands of
+ * the new slot are allocated from the other half, while the commands of
+ * the previous slot are still valid (handlers may still use them until
+ * the new slot is published). The half of the slot before is reset.
+ * The chunks are not freed, they are reused. This way, the heap is not
+ * fragmented by many small allocations on each slot switch.
+ *
+ * Chunks are allocated with SLOT_ARENA_CHUNKSIZE bytes, a larger
+ * allocation gets its own chunk.
+ *
+ * Strings (AT strings, parameters) are interned: each half has a string
+ * table, an equal string is stored only once per slot.
+ *
+ * @note Memory of replaced commands (e.g. AT BM via the serial interface)
+ * is not reused until this half of the arena is reset.
+ * @see slotArenaSwitch
+ */
+
+#include "slot_arena.h"
+#include <esp_heap_caps.h>
+
+/** @brief Logging tag for this module */
+#define LOG_TAG "slot_arena"
+/** @brief Set a global log limit for this file */
+#define LOG_LEVEL_ARENA ESP_LOG_INFO
+
+/** @brief One chunk of the arena, the data follows the header */
+typedef struct slot_arena_chunk {
+  /** @brief Next chunk, NULL for the last one */
+  struct slot_arena_chunk *next;
+  /** @brief Size of the data area */
+  uint32_t size;
+  /** @brief Used bytes of the data area */
+  uint32_t used;
+  /** @brief Data area */
+  uint8_t data[];
+} slot_arena_chunk_t;
+
+/** @brief One entry of the string table, the string follows the header */
+typedef struct slot_arena_string {
+  /** @brief Next entry of this hash bucket, NULL for the last one */
+  struct slot_arena_string *next;
+  /** @brief String data */
+  char str[];
+} slot_arena_string_t;
+
+/** @brief One half of the arena */
+typedef struct slot_arena_half {
+  /** @brief List of reused chunks (SLOT_ARENA_CHUNKSIZE) */
+  slot_arena_chunk_t *head;
+  /** @brief Chunk for the next allocation, all following chunks are unused */
+  slot_arena_chunk_t *current;
+  /** @brief List of chunks for large allocations, freed on each reset */
+  slot_arena_chunk_t *large;
+  /** @brief Bytes allocated in this half */
+  uint32_t used;
+  /** @brief String table, hash buckets of interned strings */
+  slot_arena_string_t *strings[SLOT_ARENA_STRBUCKETS];
+  /** @brief Count of different strings in this half */
+  uint32_t stringCount;
+  /** @brief Bytes saved by reusing strings in this half */
+  uint32_t stringsSaved;
+} slot_arena_half_t;
+
+/** @brief Both halves of the arena */
+static slot_arena_half_t arenaHalves[2];
+
+/** @brief Half of the arena used for allocations */
+static slot_arena_half_t *arena = &arenaHalves[0];
+
+/** @brief Statistics, returned by slotArenaGetStats */
+static slot_arena_stats_t arenaStats;
+
+/** @brief Synchronization mutex for accessing the arena */
+static SemaphoreHandle_t slotArenaSem = NULL;
+
+/** @brief Calculate the current heap fragmentation in percent */
+static uint8_t slotArenaFragmentation(void)
+{
+  size_t freeBytes = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+  size_t largest = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+  if(freeBytes == 0) return 0;
+  return 100 - (largest * 100) / freeBytes;
+}
+
+/** @brief Allocate a new chunk
+ * @param size Size of the data area
+ * @return New chunk, NULL if no memory is available */
+static slot_arena_chunk_t *slotArenaNewChunk(uint32_t size)
+{
+  slot_arena_chunk_t *c = malloc(sizeof(slot_arena_chunk_t) + size);
+  if(c == NULL)
+  {
+    ESP_LOGE(LOG_TAG,"Cannot allocate chunk of %d bytes",size);
+    return NULL;
+  }
+  c->next = NULL;
+  c->size = size;
+  c->used = 0;
+  arenaStats.reserved += size;
+  arenaStats.chunks++;
+  return c;
+}
+
+esp_err_t slotArenaInit(void)
+{
+  if(slotArenaSem == NULL) slotArenaSem = xSemaphoreCreateMutex();
+  if(slotArenaSem == NULL)
+  {
+    ESP_LOGE(LOG_TAG,"Cannot create mutex, exiting!");
+    return ESP_FAIL;
+  }
+  //set log level to given log level
+  esp_log_level_set(LOG_TAG,LOG_LEVEL_ARENA);
+
+  //first chunk of each half, more are allocated on demand
+  for(uint8_t i = 0; i<2; i++)
+  {
+    if(arenaHalves[i].head == NULL)
+    {
+      arenaHalves[i].head = slotArenaNewChunk(SLOT_ARENA_CHUNKSIZE);
+      arenaHalves[i].current = arenaHalves[i].head;
+    }
+    if(arenaHalves[i].head == NULL) return ESP_FAIL;
+  }
+  return ESP_OK;
+}
+
+/** @brief Allocate memory from the current half
+ * @note slotArenaSem must be taken
+ * @param size Count of bytes
+ * @return Pointer to the memory, NULL if no memory is available */
+static void *slotArenaAllocLocked(size_t size)
+{
+  void *ret = NULL;
+  
+  if(size == 0) return NULL;
+  size = (size + SLOT_ARENA_ALIGN - 1) & ~(SLOT_ARENA_ALIGN - 1);
+
+  if(size > SLOT_ARENA_CHUNKSIZE)
+  {
+    //large allocation: own chunk
+    slot_arena_chunk_t *c = slotArenaNewChunk(size);
+    if(c != NULL)
+    {
+      c->next = arena->large;
+      arena->large = c;
+      c->used = size;
+      ret = c->data;
+    }
+  } else {
+    //skip to the next chunk with enough space. Following chunks are
+    //unused, their offset is reset here.
+    while(arena->current != NULL && arena->current->used + size > arena->current->size \
+      && arena->current->next != NULL)
+    {
+      arena->current = arena->current->next;
+      arena->current->used = 0;
+    }
+    //append a new chunk if necessary
+    if(arena->current == NULL || arena->current->used + size > arena->current->size)
+    {
+      slot_arena_chunk_t *c = slotArenaNewChunk(SLOT_ARENA_CHUNKSIZE);
+      if(c != NULL)
+      {
+        if(arena->current == NULL) arena->head = c;
+        else arena->current->next = c;
+        arena->current = c;
+      }
+    }
+    if(arena->current != NULL && arena->current->used + size <= arena->current->size)
+    {
+      ret = &arena->current->data[arena->current->used];
+      arena->current->used += size;
+    }
+  }
+
+  if(ret != NULL)
+  {
+    arena->used += size;
+    if(arena->used > arenaStats.peak) arenaStats.peak = arena->used;
+  }
+  return ret;
+}
+
+void *slotArenaAlloc(size_t size)
+{
+  void *ret;
+
+  if(slotArenaSem == NULL)
+  {
+    ESP_LOGE(LOG_TAG,"slotArenaSem is NULL");
+    return NULL;
+  }
+  if(xSemaphoreTake(slotArenaSem,50) != pdTRUE)
+  {
+    ESP_LOGE(LOG_TAG,"Arena mutex not free for allocating");
+    return NULL;
+  }
+  ret = slotArenaAllocLocked(size);
+  xSemaphoreGive(slotArenaSem);
+  return ret;
+}
+
+char *slotArenaStrdup(const char *str)
+{
+  if(str == NULL) return NULL;
+  size_t len = strlen(str) + 1;
+  char *ret = slotArenaAlloc(len);
+  if(ret != NULL) memcpy(ret,str,len);
+  return ret;
+}
+
+char *slotArenaIntern(const char *str)
+{
+  char *ret = NULL;
+  
+  if(str == NULL) return NULL;
+  if(slotArenaSem == NULL)
+  {
+    ESP_LOGE(LOG_TAG,"slotArenaSem is NULL");
+    return NULL;
+  }
+  
+  //FNV-1a hash of the string
+  uint32_t hash = 2166136261u;
+  size_t len = 0;
+  while(str[len] != 0)
+  {
+    hash = (hash ^ (uint8_t)str[len]) * 16777619u;
+    len++;
+  }
+  
+  if(xSemaphoreTake(slotArenaSem,50) != pdTRUE)
+  {
+    ESP_LOGE(LOG_TAG,"Arena mutex not free for interning");
+    return NULL;
+  }
+  
+  //search the bucket for an equal string
+  slot_arena_string_t **bucket = &arena->strings[hash & (SLOT_ARENA_STRBUCKETS - 1)];
+  for(slot_arena_string_t *e = *bucket; e != NULL; e = e->next)
+  {
+    if(strcmp(e->str,str) == 0)
+    {
+      arena->stringsSaved += len + 1;
+      ret = e->str;
+      break;
+    }
+  }
+  
+  //not found, add a new entry
+  if(ret == NULL)
+  {
+    slot_arena_string_t *e = slotArenaAllocLocked(sizeof(slot_arena_string_t) + len + 1);
+    if(e != NULL)
+    {
+      memcpy(e->str,str,len + 1);
+      e->next = *bucket;
+      *bucket = e;
+      arena->stringCount++;
+      ret = e->str;
+    }
+  }
+  
+  xSemaphoreGive(slotArenaSem);
+  return ret;
+}
+
+void slotArenaSwitch(void)
+{
+  if(slotArenaSem == NULL) return;
+  if(xSemaphoreTake(slotArenaSem,portMAX_DELAY) != pdTRUE) return;
+
+  arenaStats.fragBefore = slotArenaFragmentation();
+
+  //continue with the other half
+  arena = (arena == &arenaHalves[0]) ? &arenaHalves[1] : &arenaHalves[0];
+
+  //large chunks are freed, the others are reused
+  while(arena->large != NULL)
+  {
+    slot_arena_chunk_t *next = arena->large->next;
+    arenaStats.reserved -= arena->large->size;
+    arenaStats.chunks--;
+    free(arena->large);
+    arena->large = next;
+  }
+  arena->current = arena->head;
+  if(arena->current != NULL) arena->current->used = 0;
+
+  #if LOG_LEVEL_ARENA >= ESP_LOG_INFO
+  ESP_LOGI(LOG_TAG,"Released %d bytes, %d bytes in %d chunks reserved", \
+    arena->used,arenaStats.reserved,arenaStats.chunks);
+  #endif
+  arena->used = 0;
+  memset(arena->strings,0,sizeof(arena->strings));
+  arena->stringCount = 0;
+  arena->stringsSaved = 0;
+  arenaStats.fragAfter = slotArenaFragmentation();
+
+  xSemaphoreGive(slotArenaSem);
+}
+
+void slotArenaGetStats(slot_arena_stats_t *stats)
+{
+  if(stats == NULL) return;
+  memcpy(stats,&arenaStats,sizeof(slot_arena_stats_t));
+  stats->used = arena->used;
+  stats->strings = arena->stringCount;
+  stats->stringsSaved = arena->stringsSaved;
+}
@@ -0,0 +1,131 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ *
+ * Copyright 2019 Benjamin Aigner <aignerb@technikum-wien.at,
+ * beni@asterics-foundation.org>
+ */
+/** @file
+ * @brief Slot scoped memory arena
+ *
+ * All memory, which lives as long as one slot is loaded (command arrays
+ * of handler_hid & handler_vb, AT strings, parameter strings) is taken
+ * from this arena. Allocations are done by advancing an offset in a
+ * chunk (bump allocation), there is no free for single allocations.
+ *
+ * The arena consists of two halves, which are used alternately. On a
+ * slot switch, the config switcher calls slotArenaSwitch: the commands of
+ * the new slot are allocated from the other half, while the commands of
+ * the previous slot are still valid (handlers may still use them until
+ * the new slot is published). The half of the slot before is reset.
+ * The chunks are not freed, they are reused. This way, the heap is not
+ * fragmented by many small allocations on each slot switch.
+ *
+ * Chunks are allocated with SLOT_ARENA_CHUNKSIZE bytes, a larger
+ * allocation gets its own chunk.
+ *
+ * Strings (AT strings, parameters) are interned: each half has a string
+ * table, an equal string is stored only once per slot.
+ *
+ * @note Memory of replaced commands (e.g. AT BM via the serial interface)
+ * is not reused until this half of the arena is reset.
+ * @see slotArenaSwitch
+ */
+
+#ifndef _SLOT_ARENA_H
+#define _SLOT_ARENA_H
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <esp_log.h>
+//common definitions & data for all of these functional tasks
+#include "common.h"
+
+/** @brief Size of one arena chunk in bytes */
+#define SLOT_ARENA_CHUNKSIZE 2048
+
+/** @brief Alignment of each allocation in bytes */
+#define SLOT_ARENA_ALIGN 4
+
+/** @brief Count of hash buckets of the string table (power of 2) */
+#define SLOT_ARENA_STRBUCKETS 64
+
+/** @brief Statistics of the slot arena */
+typedef struct slot_arena_stats {
+  /** @brief Bytes allocated for the current slot */
+  uint32_t used;
+  /** @brief Maximum of used bytes since boot */
+  uint32_t peak;
+  /** @brief Bytes reserved in chunks (both halves) */
+  uint32_t reserved;
+  /** @brief Count of chunks (both halves) */
+  uint32_t chunks;
+  /** @brief Heap fragmentation in percent before the last switch
+   * (100 - largest free block * 100 / free heap) */
+  uint8_t fragBefore;
+  /** @brief Heap fragmentation in percent after the last switch */
+  uint8_t fragAfter;
+  /** @brief Count of different strings stored for the current slot */
+  uint32_t strings;
+  /** @brief Bytes saved by reusing equal strings for the current slot */
+  uint32_t stringsSaved;
+} slot_arena_stats_t;
+
+/** @brief Init the slot arena (mutex & first chunk)
+ * @return ESP_OK on success, ESP_FAIL otherwise */
+esp_err_t slotArenaInit(void);
+
+/** @brief Allocate memory for the current slot
+ *
+ * The memory is valid until the second call of slotArenaSwitch.
+ * @param size Count of bytes
+ * @return Pointer to the memory (aligned to SLOT_ARENA_ALIGN), NULL if
+ * no memory is available */
+void *slotArenaAlloc(size_t size);
+
+/** @brief Copy a string to the slot arena
+ * @param str String to be copied
+ * @return Pointer to the copy, NULL if str is NULL or no memory is available */
+char *slotArenaStrdup(const char *str);
+
+/** @brief Get an interned copy of a string for the current slot
+ *
+ * If an equal string was already interned since the last slotArenaSwitch,
+ * this copy is returned. Otherwise the string is copied to the arena.
+ * @warning The returned string is shared, it must not be modified.
+ * @param str String to be interned
+ * @return Pointer to the interned string, NULL if str is NULL or no memory is available */
+char *slotArenaIntern(const char *str);
+
+/** @brief Switch to the other half of the arena for a new slot
+ *
+ * All allocations of the other half (done before the previous switch)
+ * are released, following allocations are done there. The allocations
+ * of the current half stay valid.
+ * The chunks are kept and reused, the effort does not depend on the
+ * count of allocations.
+ * @warning Nobody may use memory of the other half after this call. The
+ * handlers must not use a generation older than the published one.
+ * @see handler_hid_sync
+ * @see handler_vb_sync
+ */
+void slotArenaSwitch(void);
+
+/** @brief Get the statistics of the slot arena
+ * @param stats Output of the statistics */
+void slotArenaGetStats(slot_arena_stats_t *stats);
+
+#endif /*_SLOT_ARENA_H*/
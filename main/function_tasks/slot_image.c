@@ -0,0 +1,255 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ * Copyright 2019 Benjamin Aigner <aignerb@technikum-wien.at,
+ * beni@asterics-foundation.org>
+ */
+/** @file
+ * @brief Binary slot images - creating & installing
+ *
+ * An image is created from the general config and the commands of
+ * handler_hid & handler_vb. Installing an image does the same as
+ * parsing all AT commands of the slot file: the general config is
+ * replaced and all commands are added to the handlers.
+ *
+ * The layout is described in slot_image.h.
+ * @see slot_image.h
+ * @see halStorageLoadNumber
+ */
+
+#include "slot_image.h"
+#include "handler_hid.h"
+#include "handler_vb.h"
+#include "task_commands.h"
+
+/** @brief Logging tag for this module */
+#define LOG_TAG "slot_image"
+
+/** @brief Add a string to the string table of an image (equal strings are stored once)
+ * @param table String table
+ * @param used Used bytes of the string table, updated on adding
+ * @param str String to be added
+ * @return Offset of this string, SLOT_IMAGE_NOSTRING if str is NULL */
+static uint16_t slotImageAddString(char *table, uint32_t *used, const char *str)
+{
+  if(str == NULL) return SLOT_IMAGE_NOSTRING;
+  //search for an equal string
+  for(uint32_t i = 0; i<*used; i += strlen(&table[i])+1)
+  {
+    if(strcmp(&table[i],str) == 0) return i;
+  }
+  uint32_t len = strlen(str)+1;
+  memcpy(&table[*used],str,len);
+  *used += len;
+  return *used - len;
+}
+
+/** @brief Get a string of the string table of an image
+ * @return String, NULL for SLOT_IMAGE_NOSTRING
+ * @note Offsets must be checked by slotImageCheckString before */
+static const char *slotImageGetString(const char *table, uint16_t offset)
+{
+  if(offset == SLOT_IMAGE_NOSTRING) return NULL;
+  return &table[offset];
+}
+
+/** @brief Check a string offset of an image
+ * @return ESP_OK if the offset is unused or a terminated string, ESP_FAIL otherwise */
+static esp_err_t slotImageCheckString(const char *table, uint32_t size, uint16_t offset)
+{
+  if(offset == SLOT_IMAGE_NOSTRING) return ESP_OK;
+  if(offset >= size || memchr(&table[offset],0,size-offset) == NULL) return ESP_FAIL;
+  return ESP_OK;
+}
+
+esp_err_t slotImageCreate(generalConfig_t *cfg, const char *slotname, \
+  uint32_t sourcecrc, uint8_t **image, uint32_t *size)
+{
+  if(cfg == NULL || slotname == NULL || image == NULL || size == NULL) return ESP_FAIL;
+
+  //copy all commands (strings are valid until the next slot switch)
+  uint32_t hidcount = handler_hid_getCmds(NULL,0);
+  uint32_t vbcount = handler_vb_getCmds(NULL,0);
+  hid_cmd_t *hid = malloc((hidcount+1)*sizeof(hid_cmd_t));
+  vb_cmd_t *vb = malloc((vbcount+1)*sizeof(vb_cmd_t));
+  if(hid == NULL || vb == NULL)
+  {
+    ESP_LOGE(LOG_TAG,"No memory for creating an image");
+    free(hid); free(vb);
+    return ESP_FAIL;
+  }
+  hidcount = handler_hid_getCmds(hid,hidcount);
+  vbcount = handler_vb_getCmds(vb,vbcount);
+
+  //maximum size of the string table (no strings are shared)
+  uint32_t strmax = 0;
+  for(uint32_t i = 0; i<hidcount; i++)
+  {
+    if(hid[i].atoriginal != NULL) strmax += strlen(hid[i].atoriginal)+1;
+  }
+  for(uint32_t i = 0; i<vbcount; i++)
+  {
+    if(vb[i].atoriginal != NULL) strmax += strlen(vb[i].atoriginal)+1;
+    if(vb[i].cmdparam != NULL) strmax += strlen(vb[i].cmdparam)+1;
+  }
+
+  uint32_t offset = sizeof(slot_image_header_t) + sizeof(generalConfig_t);
+  uint8_t *img = malloc(offset + hidcount*sizeof(slot_image_hid_t) + \
+    vbcount*sizeof(slot_image_vb_t) + strmax);
+  if(img == NULL)
+  {
+    ESP_LOGE(LOG_TAG,"No memory for creating an image");
+    free(hid); free(vb);
+    return ESP_FAIL;
+  }
+  slot_image_header_t *header = (slot_image_header_t *)img;
+  generalConfig_t *imgcfg = (generalConfig_t *)&img[sizeof(slot_image_header_t)];
+  slot_image_hid_t *imghid = (slot_image_hid_t *)&img[offset];
+  slot_image_vb_t *imgvb = (slot_image_vb_t *)&imghid[hidcount];
+  char *strings = (char *)&imgvb[vbcount];
+  uint32_t strsize = 0;
+
+  memset(header,0,sizeof(slot_image_header_t));
+  header->magic = SLOT_IMAGE_MAGIC;
+  header->version = SLOT_IMAGE_VERSION;
+  header->configsize = sizeof(generalConfig_t);
+  header->sourcecrc = sourcecrc;
+  header->hidcount = hidcount;
+  header->vbcount = vbcount;
+  strncpy(header->slotname,slotname,SLOTNAME_LENGTH-1);
+  memcpy(imgcfg,cfg,sizeof(generalConfig_t));
+  memset(imgcfg->slotName,0,SLOTNAME_LENGTH);
+  strncpy(imgcfg->slotName,slotname,SLOTNAME_LENGTH-1);
+
+  //pack all commands, strings are referenced by offset
+  for(uint32_t i = 0; i<hidcount; i++)
+  {
+    imghid[i].vb = hid[i].vb;
+    imghid[i].event = hid[i].event;
+    memcpy(imghid[i].cmd,hid[i].cmd,sizeof(imghid[i].cmd));
+    imghid[i].atoriginal = slotImageAddString(strings,&strsize,hid[i].atoriginal);
+  }
+  for(uint32_t i = 0; i<vbcount; i++)
+  {
+    imgvb[i].vb = vb[i].vb;
+    imgvb[i].event = vb[i].event;
+    imgvb[i].cmd = vb[i].cmd;
+    imgvb[i].atoriginal = slotImageAddString(strings,&strsize,vb[i].atoriginal);
+    imgvb[i].cmdparam = slotImageAddString(strings,&strsize,vb[i].cmdparam);
+  }
+  free(hid);
+  free(vb);
+
+  //offsets are 16bit
+  if(strsize >= SLOT_IMAGE_NOSTRING)
+  {
+    ESP_LOGE(LOG_TAG,"String table overflow");
+    free(img);
+    return ESP_FAIL;
+  }
+  header->stringsize = strsize;
+
+  *image = img;
+  *size = (uint8_t *)&strings[strsize] - img;
+  return ESP_OK;
+}
+
+esp_err_t slotImageInstall(const uint8_t *image, uint32_t size, generalConfig_t *cfg)
+{
+  const slot_image_header_t *header = (const slot_image_header_t *)image;
+
+  if(image == NULL || cfg == NULL || size < sizeof(slot_image_header_t)) return ESP_FAIL;
+
+  /*++++ check the image ++++*/
+  if(header->magic != SLOT_IMAGE_MAGIC || header->version != SLOT_IMAGE_VERSION || \
+    header->configsize != sizeof(generalConfig_t))
+  {
+    ESP_LOGW(LOG_TAG,"Image format not supported");
+    return ESP_FAIL;
+  }
+  uint32_t offset = sizeof(slot_image_header_t) + sizeof(generalConfig_t);
+  if(size != offset + header->hidcount*sizeof(slot_image_hid_t) + \
+    header->vbcount*sizeof(slot_image_vb_t) + header->stringsize)
+  {
+    ESP_LOGW(LOG_TAG,"Image size mismatch");
+    return ESP_FAIL;
+  }
+  const slot_image_hid_t *hid = (const slot_image_hid_t *)&image[offset];
+  const slot_image_vb_t *vb = (const slot_image_vb_t *)&hid[header->hidcount];
+  const char *strings = (const char *)&vb[header->vbcount];
+  for(uint16_t i = 0; i<header->hidcount; i++)
+  {
+    if(hid[i].vb >= VB_MAX_BINDABLE || \
+      (hid[i].event != VB_PRESS_EVENT && hid[i].event != VB_RELEASE_EVENT) || \
+      slotImageCheckString(strings,header->stringsize,hid[i].atoriginal) != ESP_OK)
+    {
+      ESP_LOGW(LOG_TAG,"Invalid HID cmd %u",i);
+      return ESP_FAIL;
+    }
+  }
+  for(uint16_t i = 0; i<header->vbcount; i++)
+  {
+    if(vb[i].vb >= VB_MAX_BINDABLE || \
+      (vb[i].event != VB_PRESS_EVENT && vb[i].event != VB_RELEASE_EVENT) || \
+      slotImageCheckString(strings,header->stringsize,vb[i].atoriginal) != ESP_OK || \
+      slotImageCheckString(strings,header->stringsize,vb[i].cmdparam) != ESP_OK)
+    {
+      ESP_LOGW(LOG_TAG,"Invalid VB cmd %u",i);
+      return ESP_FAIL;
+    }
+  }
+
+  /*++++ install ++++*/
+  memcpy(cfg,&image[sizeof(slot_image_header_t)],sizeof(generalConfig_t));
+  cfg->slotName[SLOTNAME_LENGTH-1] = '\0';
+
+  esp_err_t ret = ESP_OK;
+  for(uint16_t i = 0; i<header->hidcount && ret == ESP_OK; i++)
+  {
+    hid_cmd_t c;
+    c.vb = hid[i].vb;
+    c.event = hid[i].event;
+    memcpy(c.cmd,hid[i].cmd,sizeof(c.cmd));
+    c.atoriginal = (char *)slotImageGetString(strings,hid[i].atoriginal);
+    ret = handler_hid_addCmd(&c,0);
+  }
+  for(uint16_t i = 0; i<header->vbcount && ret == ESP_OK; i++)
+  {
+    vb_cmd_t c;
+    c.vb = vb[i].vb;
+    c.event = vb[i].event;
+    c.cmd = vb[i].cmd;
+    c.atoriginal = (char *)slotImageGetString(strings,vb[i].atoriginal);
+    c.cmdparam = (char *)slotImageGetString(strings,vb[i].cmdparam);
+    //macros are not stored in the image, compile them now (as AT MA does)
+    c.macro = NULL;
+    if(c.cmd == T_MACRO && c.cmdparam != NULL) c.macro = cmdMacroCompile(c.cmdparam,cfg);
+    ret = handler_vb_addCmd(&c,0);
+    free(c.macro);
+  }
+  
+  if(ret != ESP_OK)
+  {
+    //start again with empty drafts, the slot file is parsed instead
+    ESP_LOGE(LOG_TAG,"Cannot add cmds of image");
+    handler_hid_clearCmds();
+    handler_vb_clearCmds();
+    return ESP_FAIL;
+  }
+  ESP_LOGI(LOG_TAG,"Installed image \"%s\", %u HID / %u VB cmds",header->slotname, \
+    header->hidcount,header->vbcount);
+  return ESP_OK;
+}
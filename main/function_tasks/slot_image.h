@@ -0,0 +1,148 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ * Copyright 2017 Benjamin Aigner <aignerb@technikum-wien.at,
+ * beni@asterics-foundation.org>
+ */
+/** @file
+ * @brief Binary slot image format
+ *
+ * A slot image is the precompiled form of a slot file (xxx.set). It
+ * contains the result of parsing all AT commands of this slot: the
+ * general config and all HID/VB commands, which are assigned to the
+ * virtual buttons. Loading an image avoids parsing the text file.
+ *
+ * Images are created by the host tool in tools/slotcompiler, which is
+ * built from the same command parser sources as the firmware.
+ *
+ * Layout (all values little endian, no padding): <br>
+ * * slot_image_header_t <br>
+ * * generalConfig_t (as it is in memory on the ESP32) <br>
+ * * hidcount x slot_image_hid_t <br>
+ * * vbcount x slot_image_vb_t <br>
+ * * String table (0-terminated strings, referenced by offset) <br>
+ *
+ * An image is only valid if magic, version and config size match and
+ * if the CRC matches the slot file it was created from. Otherwise the
+ * slot file must be parsed as usual.
+ *
+ * The firmware installs a valid image instead of parsing the slot file
+ * (see halStorageLoadNumber). Images are written by the firmware when a
+ * slot is stored (AT SA) or after a slot was loaded from its slot file.
+ *
+ * @see generalConfig_t
+ * @see hid_cmd_t
+ * @see vb_cmd_t
+ */
+
+#ifndef _SLOT_IMAGE_H
+#define _SLOT_IMAGE_H
+
+#include <stdint.h>
+//common definitions & data for all of these functional tasks
+#include "common.h"
+
+/** @brief Magic number of a slot image ("FLSI") */
+#define SLOT_IMAGE_MAGIC 0x49534C46
+
+/** @brief Version of the image format, increase on each change of the layout */
+#define SLOT_IMAGE_VERSION 2
+
+/** @brief File extension for slot images (xxx.set -> xxx.sbi) */
+#define SLOT_IMAGE_EXTENSION "sbi"
+
+/** @brief String offset for an unused string */
+#define SLOT_IMAGE_NOSTRING 0xFFFF
+
+/** @brief Header of a slot image */
+typedef struct __attribute__ ((packed)) slot_image_header {
+  /** @brief Must be SLOT_IMAGE_MAGIC */
+  uint32_t magic;
+  /** @brief Must be SLOT_IMAGE_VERSION */
+  uint16_t version;
+  /** @brief sizeof(generalConfig_t) of the creator, must match */
+  uint16_t configsize;
+  /** @brief CRC32 (as crc32_le of the ESP32 ROM) of the slot file */
+  uint32_t sourcecrc;
+  /** @brief Count of HID commands */
+  uint16_t hidcount;
+  /** @brief Count of VB commands */
+  uint16_t vbcount;
+  /** @brief Size of the string table in bytes */
+  uint32_t stringsize;
+  /** @brief Slot name, as given in the first line of the slot file */
+  char slotname[SLOTNAME_LENGTH];
+} slot_image_header_t;
+
+/** @brief One HID command in a slot image
+ * @see hid_cmd_t */
+typedef struct __attribute__ ((packed)) slot_image_hid {
+  /** @brief VB number */
+  uint16_t vb;
+  /** @brief Triggering event (VB_PRESS_EVENT or VB_RELEASE_EVENT) */
+  uint8_t event;
+  /** @brief HID command bytes */
+  uint8_t cmd[3];
+  /** @brief Offset of the original AT command in the string table */
+  uint16_t atoriginal;
+} slot_image_hid_t;
+
+/** @brief One VB command in a slot image
+ * @see vb_cmd_t */
+typedef struct __attribute__ ((packed)) slot_image_vb {
+  /** @brief VB number */
+  uint16_t vb;
+  /** @brief Triggering event (VB_PRESS_EVENT or VB_RELEASE_EVENT) */
+  uint8_t event;
+  /** @brief Type of command, see vb_cmd_type_t */
+  uint8_t cmd;
+  /** @brief Offset of the original AT command in the string table */
+  uint16_t atoriginal;
+  /** @brief Offset of the parameter string in the string table */
+  uint16_t cmdparam;
+} slot_image_vb_t;
+
+/** @brief Create a slot image of the current config & commands
+ *
+ * The HID/VB commands are taken from handler_hid & handler_vb (including
+ * unpublished changes).
+ * @param cfg General config, stored with the given slot name
+ * @param slotname Name of the slot
+ * @param sourcecrc CRC32 of the slot file
+ * @param image Output: new image, must be freed by the caller
+ * @param size Output: size of the image in bytes
+ * @return ESP_OK on success, ESP_FAIL otherwise (no memory)
+ * @see halStorageStoreImage
+ */
+esp_err_t slotImageCreate(generalConfig_t *cfg, const char *slotname, \
+  uint32_t sourcecrc, uint8_t **image, uint32_t *size);
+
+/** @brief Install a slot image
+ *
+ * The image is checked completely before anything is changed. The general
+ * config is replaced, all commands are added to the drafts of handler_hid
+ * & handler_vb (call handler_hid_publish/handler_vb_publish afterwards).
+ * Macros are compiled while installing.
+ * @note The CRC of the slot file is not checked here.
+ * @param image Image, as read from storage
+ * @param size Size of the image in bytes
+ * @param cfg General config to be replaced
+ * @return ESP_OK if installed, ESP_FAIL if the image is invalid or the
+ * commands cannot be added (drafts are cleared again)
+ */
+esp_err_t slotImageInstall(const uint8_t *image, uint32_t size, generalConfig_t *cfg);
+
+#endif /*_SLOT_IMAGE_H*/
@@ -1 +1,523 @@
- 
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ * Copyright 2017 Benjamin Aigner <aignerb@technikum-wien.at,
+ * beni@asterics-foundation.org>
+ */
+/** @file
+ * @brief CONTINOUS TASK - AsTeRICS CIM (Communication Interface Module) mode
+ *
+ * This module implements the binary CIM protocol, which is used by the
+ * AsTeRICS runtime environment (ARE) to use the FLipMouse/FABI as
+ * sensor and actuator device.
+ *
+ * The CIM mode is entered as soon as a valid CIM frame (starting with
+ * "@T") is received on the serial interface. It is left again if
+ * either a reset request is received or the host starts to send
+ * AT commands ('A' outside of a CIM frame).
+ *
+ * While the CIM mode is active (DATATO_CIM is set), the ADC tasks
+ * pass every sample (full ADC rate, not divided as the "VALUES:" output)
+ * to this module via taskCIMReportSensors. The samples are sent as
+ * compact binary frames, including the state of all virtual buttons.
+ *
+ * Frame layout (all values little endian): <br>
+ * * Host to device: '@' 'T' | ARE ID (2B) | data length (2B) | serial nr (1B) | feature (2B) | request code (2B) | data <br>
+ * * Device to host: '@' 'T' | CIM ID (2B) | data length (2B) | serial nr (1B) | feature (2B) | reply code (2B) | data <br>
+ *
+ * Parsing of the incoming bytes is done in the context of halSerialRXTask
+ * (via taskCIMParseByte), the frames are processed in task_cim.
+ *
+ * @see DATATO_CIM
+ * @see halSerialRXTask
+ * @see halAdcReportRaw
+ */
+
+#include "task_cim.h"
+#include "esp_system.h"
+#include "../config_switcher.h"
+
+/** @brief Logging tag for this module */
+#define LOG_TAG "task_cim"
+/** @brief Set a global log limit for this file */
+#define LOG_LEVEL_CIM ESP_LOG_INFO
+
+/** @brief Maximum data length of an outgoing frame */
+#define CIM_MAX_TX_DATA_LENGTH 32
+
+/** @brief Type of an element in the CIM queue */
+typedef enum {
+  CIM_MSG_SENSOR, /** @brief New sensor sample from hal_adc */
+  CIM_MSG_FRAME /** @brief Complete frame received from the host */
+} cim_msg_type_t;
+
+/** @brief One CIM frame, received from the host */
+typedef struct cim_frame {
+  /** @brief ARE ID of the sender */
+  uint16_t id;
+  /** @brief Length of data */
+  uint16_t length;
+  /** @brief Serial number, echoed in the reply */
+  uint8_t serial;
+  /** @brief Requested feature */
+  uint16_t feature;
+  /** @brief Request code */
+  uint16_t request;
+  /** @brief Data, 0-terminated. Might be NULL if length is 0.
+   * @note Allocated by the parser, freed in task_cim.*/
+  uint8_t *data;
+} cim_frame_t;
+
+/** @brief Element of the CIM queue */
+typedef struct cim_msg {
+  /** @brief Type of this element */
+  cim_msg_type_t type;
+  /** @brief Payload, depending on type */
+  union {
+    cim_sensordata_t sensors;
+    cim_frame_t frame;
+  };
+} cim_msg_t;
+
+/** @brief Queue for sensor samples and received frames
+ * @see cim_msg_t */
+static QueueHandle_t cimQueue = NULL;
+
+/** @brief Periodic sensor reporting enabled (!= 0) */
+static volatile uint8_t cimReportActive = 0;
+
+/** @brief Current state of all VBs, bit n is VB n
+ * @note Only written in the VB event handler */
+static volatile uint32_t cimVBState = 0;
+
+/** @brief Last sensor sample, used for reading the ADC report once */
+static cim_sensordata_t cimLastSample;
+
+/** @brief Lock for accessing cimLastSample */
+static portMUX_TYPE cimSampleLock = portMUX_INITIALIZER_UNLOCKED;
+
+/** @brief Counter for sensor samples, which could not be queued */
+static uint32_t cimDroppedSamples = 0;
+
+/** @brief Parser: header of the currently received frame */
+static uint8_t cimRxHeader[CIM_HEADER_LENGTH];
+/** @brief Parser: count of received bytes of the current frame */
+static uint16_t cimRxOffset = 0;
+/** @brief Parser: data length of the current frame */
+static uint16_t cimRxLength = 0;
+/** @brief Parser: data buffer of the current frame */
+static uint8_t *cimRxData = NULL;
+/** @brief Parser: tick count of the last received byte */
+static TickType_t cimRxLastByte = 0;
+
+/** @brief Check if the CIM mode is currently active
+ * @return 1 if active, 0 otherwise */
+static uint8_t taskCIMIsActive(void)
+{
+  if(connectionRoutingStatus == NULL) return 0;
+  if(xEventGroupGetBits(connectionRoutingStatus) & DATATO_CIM) return 1;
+  return 0;
+}
+
+/** @brief Leave the CIM mode, AT commands are processed again */
+static void taskCIMLeave(void)
+{
+  cimReportActive = 0;
+  xEventGroupClearBits(connectionRoutingStatus,DATATO_CIM);
+  ESP_LOGI(LOG_TAG,"CIM mode deactivated");
+}
+
+/** @brief Reset the frame parser, frees a pending data buffer */
+static void taskCIMResetParser(void)
+{
+  if(cimRxData != NULL) free(cimRxData);
+  cimRxData = NULL;
+  cimRxOffset = 0;
+  cimRxLength = 0;
+}
+
+/** @brief Pass a completely received frame to task_cim
+ *
+ * The CIM mode is activated with the first valid frame.
+ * */
+static void taskCIMDispatchFrame(void)
+{
+  cim_msg_t msg;
+
+  msg.type = CIM_MSG_FRAME;
+  msg.frame.id = cimRxHeader[2] | (cimRxHeader[3] << 8);
+  msg.frame.length = cimRxLength;
+  msg.frame.serial = cimRxHeader[6];
+  msg.frame.feature = cimRxHeader[7] | (cimRxHeader[8] << 8);
+  msg.frame.request = cimRxHeader[9] | (cimRxHeader[10] << 8);
+  msg.frame.data = cimRxData;
+  //buffer is now owned by the queue element
+  cimRxData = NULL;
+  cimRxOffset = 0;
+  cimRxLength = 0;
+
+  //activate CIM mode on first valid frame
+  if(taskCIMIsActive() == 0)
+  {
+    xEventGroupSetBits(connectionRoutingStatus,DATATO_CIM);
+    ESP_LOGI(LOG_TAG,"CIM mode activated by ARE 0x%04X",msg.frame.id);
+  }
+
+  if(cimQueue == NULL || xQueueSend(cimQueue,&msg,10) != pdTRUE)
+  {
+    ESP_LOGE(LOG_TAG,"Cannot queue CIM frame, discarding");
+    if(msg.frame.data != NULL) free(msg.frame.data);
+  }
+}
+
+/** @brief Parse one incoming byte for the CIM protocol
+ *
+ * This function is called by halSerialRXTask for each byte, which
+ * is not part of an AT command. Complete frames are passed to task_cim.
+ *
+ * @param data Received byte
+ * @return 1 if the byte was consumed by the CIM parser, 0 if it should be
+ * processed by the AT command parser (CIM mode is inactive or left)
+ * */
+uint8_t taskCIMParseByte(uint8_t data)
+{
+  uint8_t active = taskCIMIsActive();
+  TickType_t now = xTaskGetTickCount();
+
+  //discard incomplete frames after a timeout
+  if(cimRxOffset != 0 && (now - cimRxLastByte) > (CIM_FRAME_TIMEOUT_MS / portTICK_PERIOD_MS))
+  {
+    ESP_LOGW(LOG_TAG,"Timeout, discarding incomplete frame (%d bytes)",cimRxOffset);
+    taskCIMResetParser();
+  }
+  cimRxLastByte = now;
+
+  //waiting for a new frame
+  if(cimRxOffset == 0)
+  {
+    if(data == CIM_HEADER_1)
+    {
+      cimRxHeader[cimRxOffset++] = data;
+      return 1;
+    }
+    //not in CIM mode, this byte belongs to the AT parser
+    if(active == 0) return 0;
+    //the host switched back to AT commands
+    if(data == 'A' || data == 'a')
+    {
+      taskCIMLeave();
+      return 0;
+    }
+    //discard anything else between two frames
+    return 1;
+  }
+
+  //second header byte
+  if(cimRxOffset == 1)
+  {
+    if(data != CIM_HEADER_2)
+    {
+      taskCIMResetParser();
+      return active;
+    }
+    cimRxHeader[cimRxOffset++] = data;
+    return 1;
+  }
+
+  //remaining header
+  if(cimRxOffset < CIM_HEADER_LENGTH)
+  {
+    cimRxHeader[cimRxOffset++] = data;
+    if(cimRxOffset == CIM_HEADER_LENGTH)
+    {
+      cimRxLength = cimRxHeader[4] | (cimRxHeader[5] << 8);
+      if(cimRxLength > CIM_MAX_DATA_LENGTH)
+      {
+        ESP_LOGW(LOG_TAG,"Frame data too long: %d",cimRxLength);
+        taskCIMResetParser();
+        return 1;
+      }
+      //frame without data is finished here
+      if(cimRxLength == 0)
+      {
+        taskCIMDispatchFrame();
+        return 1;
+      }
+      //+1 for 0-termination (used for AT commands)
+      cimRxData = malloc(cimRxLength + 1);
+      if(cimRxData == NULL)
+      {
+        ESP_LOGE(LOG_TAG,"Cannot allocate %d B for frame data",cimRxLength+1);
+        taskCIMResetParser();
+        return 1;
+      }
+      cimRxData[cimRxLength] = 0;
+    }
+    return 1;
+  }
+
+  //data
+  cimRxData[cimRxOffset - CIM_HEADER_LENGTH] = data;
+  cimRxOffset++;
+  if(cimRxOffset == (CIM_HEADER_LENGTH + cimRxLength)) taskCIMDispatchFrame();
+  return 1;
+}
+
+/** @brief Pass one sensor sample to the CIM module
+ *
+ * Called by the ADC tasks on each sample. If the CIM mode is active
+ * and periodic reporting is enabled, the sample is queued for sending.
+ * @note This function never blocks.
+ * @param data Current sensor values
+ * @return ESP_OK if the sample was queued, ESP_FAIL if not (CIM mode
+ * inactive, reporting disabled or queue full)
+ * */
+esp_err_t taskCIMReportSensors(cim_sensordata_t *data)
+{
+  cim_msg_t msg;
+
+  if(data == NULL || cimQueue == NULL) return ESP_FAIL;
+  if(taskCIMIsActive() == 0) return ESP_FAIL;
+
+  //save for reading the report once
+  portENTER_CRITICAL(&cimSampleLock);
+  memcpy(&cimLastSample,data,sizeof(cim_sensordata_t));
+  portEXIT_CRITICAL(&cimSampleLock);
+
+  if(cimReportActive == 0) return ESP_FAIL;
+
+  msg.type = CIM_MSG_SENSOR;
+  memcpy(&msg.sensors,data,sizeof(cim_sensordata_t));
+  if(xQueueSend(cimQueue,&msg,0) != pdTRUE)
+  {
+    cimDroppedSamples++;
+    if(cimDroppedSamples % 100 == 1) ESP_LOGW(LOG_TAG,"Dropped %d samples",cimDroppedSamples);
+    return ESP_FAIL;
+  }
+  return ESP_OK;
+}
+
+/** @brief Send one CIM frame to the host
+ * @param feature Feature address
+ * @param reply Reply code
+ * @param serial Serial number (echo of the request)
+ * @param data Data, might be NULL if length is 0
+ * @param length Length of data, maximum CIM_MAX_TX_DATA_LENGTH
+ * @return ESP_OK if sent, ESP_FAIL otherwise
+ * */
+static esp_err_t taskCIMSendFrame(uint16_t feature, uint16_t reply, uint8_t serial, void *data, uint16_t length)
+{
+  uint8_t buf[CIM_HEADER_LENGTH + CIM_MAX_TX_DATA_LENGTH];
+
+  if(length > CIM_MAX_TX_DATA_LENGTH) return ESP_FAIL;
+
+  buf[0] = CIM_HEADER_1;
+  buf[1] = CIM_HEADER_2;
+  buf[2] = CIM_ID & 0xFF;
+  buf[3] = (CIM_ID >> 8) & 0xFF;
+  buf[4] = length & 0xFF;
+  buf[5] = (length >> 8) & 0xFF;
+  buf[6] = serial;
+  buf[7] = feature & 0xFF;
+  buf[8] = (feature >> 8) & 0xFF;
+  buf[9] = reply & 0xFF;
+  buf[10] = (reply >> 8) & 0xFF;
+  if(length != 0) memcpy(&buf[CIM_HEADER_LENGTH],data,length);
+
+  if(halSerialSendUSBSerialBinary(buf,CIM_HEADER_LENGTH + length,5) == -1) return ESP_FAIL;
+  return ESP_OK;
+}
+
+/** @brief Process one frame received from the host
+ * @param frame Received frame
+ * @note If the data is used further on, frame->data is set to NULL.
+ * */
+static void taskCIMProcessFrame(cim_frame_t *frame)
+{
+  uint16_t reply = CIM_REPLY_OK;
+  cim_sensorframe_t report;
+
+  //reset request, independent of feature.
+  if(frame->request == CIM_REQ_RESET)
+  {
+    taskCIMSendFrame(frame->feature,CIM_REPLY_OK,frame->serial,NULL,0);
+    taskCIMLeave();
+    return;
+  }
+
+  switch(frame->feature)
+  {
+    case CIM_FEATURE_UNIQUENUMBER:
+    {
+      uint8_t mac[6];
+      if(frame->request != CIM_REQ_READ) { reply = CIM_REPLY_INVALID_DATA; break; }
+      esp_efuse_mac_get_default(mac);
+      taskCIMSendFrame(frame->feature,CIM_REPLY_OK,frame->serial,&mac[2],4);
+      return;
+    }
+    case CIM_FEATURE_FEATURELIST:
+    {
+      const uint16_t features[] = {CIM_FEATURE_UNIQUENUMBER, CIM_FEATURE_FEATURELIST, \
+        CIM_FEATURE_ADCREPORT, CIM_FEATURE_ATCMD, CIM_FEATURE_LED, \
+        CIM_FEATURE_TONE, CIM_FEATURE_CALIBRATE};
+      if(frame->request != CIM_REQ_READ) { reply = CIM_REPLY_INVALID_DATA; break; }
+      taskCIMSendFrame(frame->feature,CIM_REPLY_OK,frame->serial,(void*)features,sizeof(features));
+      return;
+    }
+    case CIM_FEATURE_ADCREPORT:
+      switch(frame->request)
+      {
+        case CIM_REQ_READ:
+          portENTER_CRITICAL(&cimSampleLock);
+          memcpy(&report.sensors,&cimLastSample,sizeof(cim_sensordata_t));
+          portEXIT_CRITICAL(&cimSampleLock);
+          report.vbstate = cimVBState;
+          taskCIMSendFrame(frame->feature,CIM_REPLY_OK,frame->serial,&report,sizeof(report));
+          return;
+        case CIM_REQ_START_PERIODIC: cimReportActive = 1; break;
+        case CIM_REQ_STOP_PERIODIC: cimReportActive = 0; break;
+        default: reply = CIM_REPLY_INVALID_DATA; break;
+      }
+      break;
+    case CIM_FEATURE_ATCMD:
+    {
+      atcmd_t cmd;
+      if(frame->request != CIM_REQ_WRITE || frame->length == 0 || halSerialATCmds == NULL)
+      { reply = CIM_REPLY_INVALID_DATA; break; }
+      //pass the buffer to the command parser, it is freed there.
+      cmd.buf = frame->data;
+      cmd.len = frame->length + 1;
+      if(xQueueSend(halSerialATCmds,&cmd,10) != pdTRUE)
+      {
+        ESP_LOGE(LOG_TAG,"AT cmd queue is full, cannot send cmd");
+        reply = CIM_REPLY_INVALID_DATA;
+      } else frame->data = NULL;
+      break;
+    }
+    case CIM_FEATURE_LED:
+    {
+      uint8_t mode = 0;
+      if(frame->request != CIM_REQ_WRITE || frame->length < 3) { reply = CIM_REPLY_INVALID_DATA; break; }
+      //mode/fading time is optional
+      if(frame->length > 3) mode = frame->data[3];
+      LED(frame->data[0],frame->data[1],frame->data[2],mode);
+      break;
+    }
+    case CIM_FEATURE_TONE:
+      if(frame->request != CIM_REQ_WRITE || frame->length < 4) { reply = CIM_REPLY_INVALID_DATA; break; }
+      TONE(frame->data[0] | (frame->data[1] << 8), frame->data[2] | (frame->data[3] << 8));
+      break;
+    case CIM_FEATURE_CALIBRATE:
+      if(frame->request != CIM_REQ_WRITE) { reply = CIM_REPLY_INVALID_DATA; break; }
+      halAdcCalibrate();
+      break;
+    default:
+      ESP_LOGW(LOG_TAG,"Unsupported feature 0x%04X",frame->feature);
+      reply = CIM_REPLY_INVALID_FEATURE;
+      break;
+  }
+  taskCIMSendFrame(frame->feature,reply,frame->serial,NULL,0);
+}
+
+/** @brief VB event handler, tracking the state of all VBs for the sensor report
+ *
+ * @param event_handler_arg unused
+ * @param event_base event base, here is fixed to VB_EVENT
+ * @param event_id event id, subscribed to all events
+ * @param event_data Contains the VB number
+ */
+static void task_cim_vbhandler(void *event_handler_arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
+{
+  if(event_data == NULL) return;
+  uint32_t vb = *((uint32_t*) event_data);
+  if(vb >= 32) return;
+  switch(event_id)
+  {
+    case VB_PRESS_EVENT: cimVBState |= (1<<vb); break;
+    case VB_RELEASE_EVENT: cimVBState &= ~(1<<vb); break;
+    default: break;
+  }
+}
+
+/** @brief CONTINOUS TASK - CIM task
+ *
+ * This task sends the queued sensor samples as binary frames and
+ * processes the frames received from the host.
+ * @param param Unused
+ * */
+void task_cim(void *param)
+{
+  cim_msg_t msg;
+  cim_sensorframe_t report;
+  uint8_t eventserial = 0;
+
+  while(1)
+  {
+    if(xQueueReceive(cimQueue,&msg,portMAX_DELAY) != pdTRUE) continue;
+
+    switch(msg.type)
+    {
+      case CIM_MSG_SENSOR:
+        //don't send remaining samples after leaving CIM mode
+        if(taskCIMIsActive() == 0 || cimReportActive == 0) break;
+        memcpy(&report.sensors,&msg.sensors,sizeof(cim_sensordata_t));
+        report.vbstate = cimVBState;
+        taskCIMSendFrame(CIM_FEATURE_ADCREPORT,CIM_REPLY_EVENT,eventserial++,&report,sizeof(report));
+        break;
+      case CIM_MSG_FRAME:
+        ESP_LOGD(LOG_TAG,"Frame: feature 0x%04X, request 0x%04X, len %d",\
+          msg.frame.feature,msg.frame.request,msg.frame.length);
+        taskCIMProcessFrame(&msg.frame);
+        if(msg.frame.data != NULL) free(msg.frame.data);
+        break;
+      default:
+        ESP_LOGE(LOG_TAG,"Unknown message type");
+        break;
+    }
+  }
+}
+
+/** @brief Initialize the CIM module
+ *
+ * Creates the CIM queue, registers a VB event handler for tracking
+ * the VB states and starts task_cim.
+ * @return ESP_OK on success, ESP_FAIL otherwise
+ * */
+esp_err_t taskCIMInit(void)
+{
+  //set log level to given log level
+  esp_log_level_set(LOG_TAG,LOG_LEVEL_CIM);
+
+  cimQueue = xQueueCreate(TASK_CIM_QUEUE_LENGTH,sizeof(cim_msg_t));
+  if(cimQueue == NULL)
+  {
+    ESP_LOGE(LOG_TAG,"Cannot create CIM queue");
+    return ESP_FAIL;
+  }
+
+  if(esp_event_handler_register(VB_EVENT,ESP_EVENT_ANY_ID,task_cim_vbhandler,NULL) != ESP_OK)
+  {
+    ESP_LOGE(LOG_TAG,"Cannot register VB event handler");
+    return ESP_FAIL;
+  }
+
+  if(xTaskCreate(task_cim,"cim",TASK_CIM_STACKSIZE,NULL,TASK_CIM_PRIORITY,NULL) != pdPASS)
+  {
+    ESP_LOGE(LOG_TAG,"Cannot create CIM task");
+    return ESP_FAIL;
+  }
+  return ESP_OK;
+}
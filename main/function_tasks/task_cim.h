@@ -1 +1,185 @@
- 
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ * Copyright 2017 Benjamin Aigner <aignerb@technikum-wien.at,
+ * beni@asterics-foundation.org>
+ */
+/** @file
+ * @brief CONTINOUS TASK - AsTeRICS CIM (Communication Interface Module) mode
+ *
+ * This module implements the binary CIM protocol, which is used by the
+ * AsTeRICS runtime environment (ARE) to use the FLipMouse/FABI as
+ * sensor and actuator device.
+ *
+ * The CIM mode is entered as soon as a valid CIM frame (starting with
+ * "@T") is received on the serial interface. It is left again if
+ * either a reset request is received or the host starts to send
+ * AT commands ('A' outside of a CIM frame).
+ *
+ * While the CIM mode is active (DATATO_CIM is set), the ADC tasks
+ * pass every sample (full ADC rate, not divided as the "VALUES:" output)
+ * to this module via taskCIMReportSensors. The samples are sent as
+ * compact binary frames, including the state of all virtual buttons.
+ *
+ * Frame layout (all values little endian): <br>
+ * * Host to device: '@' 'T' | ARE ID (2B) | data length (2B) | serial nr (1B) | feature (2B) | request code (2B) | data <br>
+ * * Device to host: '@' 'T' | CIM ID (2B) | data length (2B) | serial nr (1B) | feature (2B) | reply code (2B) | data <br>
+ *
+ * Parsing of the incoming bytes is done in the context of halSerialRXTask
+ * (via taskCIMParseByte), the frames are processed in task_cim.
+ *
+ * @see DATATO_CIM
+ * @see halSerialRXTask
+ * @see halAdcReportRaw
+ */
+
+#ifndef _TASK_CIM_H
+#define _TASK_CIM_H
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/event_groups.h>
+#include <freertos/queue.h>
+#include <esp_log.h>
+#include <esp_event.h>
+//common definitions & data for all of these functional tasks
+#include "common.h"
+
+/** @brief Stack size for the CIM task */
+#define TASK_CIM_STACKSIZE 2048
+
+/** @brief Length of the CIM queue (sensor samples & received frames) */
+#define TASK_CIM_QUEUE_LENGTH 8
+
+/** @brief First byte of each CIM frame */
+#define CIM_HEADER_1 '@'
+/** @brief Second byte of each CIM frame */
+#define CIM_HEADER_2 'T'
+
+/** @brief Length of a CIM frame header (without data) */
+#define CIM_HEADER_LENGTH 11
+
+/** @brief Maximum length of data for one incoming CIM frame */
+#define CIM_MAX_DATA_LENGTH ATCMD_LENGTH
+
+/** @brief Timeout [ms] between two bytes of one frame, the parser is reset afterwards */
+#define CIM_FRAME_TIMEOUT_MS 100
+
+/** @brief CIM ID, identifies this device in the ARE */
+#ifdef DEVICE_FLIPMOUSE
+  #define CIM_ID 0xA401
+#endif
+#ifdef DEVICE_FABI
+  #define CIM_ID 0xA402
+#endif
+
+/*++++ CIM features ++++*/
+/** @brief Feature: read an unique number of this device */
+#define CIM_FEATURE_UNIQUENUMBER  0x0000
+/** @brief Feature: read a list of all supported features */
+#define CIM_FEATURE_FEATURELIST   0x0001
+/** @brief Feature: sensor report (read once or start/stop periodic reporting)
+ * @see cim_sensorframe_t */
+#define CIM_FEATURE_ADCREPORT     0x00A0
+/** @brief Feature: execute an AT command (data: AT command string) */
+#define CIM_FEATURE_ATCMD         0x00A1
+/** @brief Feature: set the LED (data: r,g,b,mode; each 1B) */
+#define CIM_FEATURE_LED           0x00A2
+/** @brief Feature: play a tone (data: frequency [Hz] 2B, duration [ms] 2B) */
+#define CIM_FEATURE_TONE          0x00A3
+/** @brief Feature: trigger a calibration of the mouthpiece */
+#define CIM_FEATURE_CALIBRATE     0x00A4
+
+/*++++ CIM request codes (host to device) ++++*/
+/** @brief Request: write feature */
+#define CIM_REQ_WRITE             0x0000
+/** @brief Request: read feature */
+#define CIM_REQ_READ              0x0001
+/** @brief Request: start periodic reporting of a feature */
+#define CIM_REQ_START_PERIODIC    0x0002
+/** @brief Request: stop periodic reporting of a feature */
+#define CIM_REQ_STOP_PERIODIC     0x0003
+/** @brief Request: reset CIM, the device switches back to AT command mode */
+#define CIM_REQ_RESET             0x0004
+
+/*++++ CIM reply codes (device to host) ++++*/
+/** @brief Reply: request processed */
+#define CIM_REPLY_OK              0x0000
+/** @brief Reply: feature is not supported */
+#define CIM_REPLY_INVALID_FEATURE 0x0001
+/** @brief Reply: invalid data or request code for this feature */
+#define CIM_REPLY_INVALID_DATA    0x0002
+/** @brief Reply: periodic event (sent without request) */
+#define CIM_REPLY_EVENT           0x0004
+
+/** @brief Sensor data, passed from hal_adc to this module
+ * @see taskCIMReportSensors */
+typedef struct cim_sensordata {
+  /** @brief Raw value of FSR up */
+  uint16_t up;
+  /** @brief Raw value of FSR down */
+  uint16_t down;
+  /** @brief Raw value of FSR left */
+  uint16_t left;
+  /** @brief Raw value of FSR right */
+  uint16_t right;
+  /** @brief Calibrated pressure value (512 is idle) */
+  uint16_t pressure;
+  /** @brief Calibrated X value */
+  int16_t x;
+  /** @brief Calibrated Y value */
+  int16_t y;
+} cim_sensordata_t;
+
+/** @brief Data of one sensor report frame, as it is sent to the host
+ * @see CIM_FEATURE_ADCREPORT */
+typedef struct __attribute__ ((packed)) cim_sensorframe {
+  /** @brief Sensor values */
+  cim_sensordata_t sensors;
+  /** @brief Currently pressed virtual buttons, bit n is VB n */
+  uint32_t vbstate;
+} cim_sensorframe_t;
+
+/** @brief Initialize the CIM module
+ *
+ * Creates the CIM queue, registers a VB event handler for tracking
+ * the VB states and starts task_cim.
+ * @return ESP_OK on success, ESP_FAIL otherwise
+ * */
+esp_err_t taskCIMInit(void);
+
+/** @brief Parse one incoming byte for the CIM protocol
+ *
+ * This function is called by halSerialRXTask for each byte, which
+ * is not part of an AT command. Complete frames are passed to task_cim.
+ *
+ * @param data Received byte
+ * @return 1 if the byte was consumed by the CIM parser, 0 if it should be
+ * processed by the AT command parser (CIM mode is inactive or left)
+ * */
+uint8_t taskCIMParseByte(uint8_t data);
+
+/** @brief Pass one sensor sample to the CIM module
+ *
+ * Called by the ADC tasks on each sample. If the CIM mode is active
+ * and periodic reporting is enabled, the sample is queued for sending.
+ * @note This function never blocks.
+ * @param data Current sensor values
+ * @return ESP_OK if the sample was queued, ESP_FAIL if not (CIM mode
+ * inactive, reporting disabled or queue full)
+ * */
+esp_err_t taskCIMReportSensors(cim_sensordata_t *data);
+
+#endif /*_TASK_CIM_H*/
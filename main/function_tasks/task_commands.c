@@ -28,7 +28,7 @@
  * 
  * By issueing an <b>AT BM</b> command, the next issued AT command
  * will be assigned to a virtual button. This is done via setting
- * the requestVBUpdate variable to the VB number. One time only commands
+ * the VB number in the parse context (cmd_context_t). One time only commands
  * (without AT BM) are defined as VB==VB_SINGLESHOT
  * 
  * @see VB_SINGLESHOT
@@ -49,87 +49,20 @@
 /** @brief Set a global log limit for this file */
 #define LOG_LEVEL_CMDPARSER ESP_LOG_INFO
 
-/** @brief Global HID command for joystick
- * This command is set by the command handlers.
- * If one field was modified by a handler, it
- * will be sent to task_hid */
-hid_cmd_t joystick;
-
-/** @brief Global release HID command for joystick
- * This command is set by the command handlers.
- * If one field was modified by a handler, it
- * will be sent to task_hid */
-hid_cmd_t joystickR;
-
-/** @brief Global HID command for mouse
- * This command is set by the command handlers.
- * If one field was modified by a handler, it
- * will be sent to task_hid */
-hid_cmd_t mouse;
-
-/** @brief Global HID command for general data transmitted via the HID interface.
- * This command is set by the command handlers.
- * If one field was modified by a handler, it
- * will be sent to task_hid */
-hid_cmd_t general;
-
-/** @brief Global release HID command for mouse
- * This command is set by the command handlers.
- * If one field was modified by a handler, it
- * will be sent to task_hid */
-hid_cmd_t mouseR;
-
-/** @brief Global HID command for mouse - 2nd action
- * This command is set by the command handlers.
- * This one is just used for double click.
- * If one field was modified by a handler, it
- * will be sent to task_hid */
-hid_cmd_t mouseD;
-
-/** @brief Global HID command for keyboard
- * This command is set by the command handlers.
- * If one field was modified by a handler, it
- * will be sent to task_hid */
-hid_cmd_t keyboard;
-
-/** @brief Global release HID command for keyboard
- * This command is set by the command handlers.
- * If one field was modified by a handler, it
- * will be sent to task_hid */
-hid_cmd_t keyboardR;
-
-/** @brief Global VB command */
-vb_cmd_t vbaction;
-
-/** @brief Pointer to current configuration
- * @warning Must be set before calling the parser, will be modified there!
- */
-generalConfig_t *currentCfg = NULL;
- 
 static TaskHandle_t currentCommandTask = NULL;
 
-/** If any parsing part requests a general config update, this variable
- * is set to 1. task_commands will reset it to 0 after the update */
-uint8_t requestUpdate = 0;
+/** @brief Parse context for AT commands received via the serial interface
+ * @see cmd_context_t */
+static cmd_context_t serialContext;
 
-/** @brief Currently used virtual button number.
+/** @brief Count of commands with side effects of the last slot file
  * 
- * If this variable is set to a value != VB_SINGLESHOT any following
- * AT command will be set for this virtual button.
- * task_commands will recognize this and triggers the VB update after
- * command parsing.
- * @see VB_SINGLESHOT
- * */
-uint8_t requestVBUpdate = VB_SINGLESHOT;
+ * After the end marker, each further command is counted as well.
+ * @see taskCommandsGetSlotSideEffects */
+static volatile uint32_t slotSideEffects = 0;
 
-/** @brief Currently used virtual button number.
- * 
- * If this variable is set to a value != 0, we know we should
- * wait to reset requestVBUpdate to VB_SINGLESHOT until next command.
- * @see VB_SINGLESHOT
- * @see requestVBUpdate
- * */
-uint8_t requestBM = 0;
+/** @brief Set if the end marker of the last slot file was processed */
+static uint8_t slotParsed = 0;
 
 /** simple helper function which sends back to the USB host "?"
  * and prints an error on the console with the given extra infos. */
@@ -171,16 +104,16 @@ static int checkqueues(void)
 }
 
 /** @brief Helper to route a HID cmd either directly to queue or add it to the list
- * @param sendCmd Hid command */
-void sendHIDCmd(hid_cmd_t *sendCmd, uint8_t vb, uint8_t* atorig, uint8_t replace)
+ * @param ctx Parse context (singleshot or VB mode)
+ * @param sendCmd Hid command
+ * @param vb VB number
+ * @param event Triggering event (VB_PRESS_EVENT or VB_RELEASE_EVENT)
+ * @param atorig Original AT command, stored for the first action of a command
+ * @param replace If != 0, previous actions of this VB are removed */
+static void sendHIDCmd(cmd_context_t *ctx, hid_cmd_t *sendCmd, uint16_t vb, uint8_t event, char* atorig, uint8_t replace)
 {
-  //check if this cmd contains data
-  hid_cmd_t emptyhid; memset(&emptyhid,0,sizeof(hid_cmd_t));
-  if(sendCmd == NULL) return;
-  if(memcmp(sendCmd,&emptyhid,sizeof(hid_cmd_t)) == 0) return;
-  
   //send it directly, if singleshot is active
-  if(requestVBUpdate == VB_SINGLESHOT)
+  if(ctx->vb == VB_SINGLESHOT)
   {
     //post values to mouse queue (USB and/or BLE)
     if(xEventGroupGetBits(connectionRoutingStatus) & DATATO_USB)
@@ -188,122 +121,459 @@ void sendHIDCmd(hid_cmd_t *sendCmd, uint8_t vb, uint8_t* atorig, uint8_t replace
     
     if(xEventGroupGetBits(connectionRoutingStatus) & DATATO_BLE)
     { xQueueSend(hid_ble,sendCmd,0); }
-    
-    if(sendCmd->atoriginal != NULL) free(sendCmd->atoriginal);
   } else {
     //update HID command (set VB, add original string)
+    //the string is copied by handler_hid_addCmd
     sendCmd->vb = vb;
-    if(atorig != NULL)
+    sendCmd->event = event;
+    sendCmd->atoriginal = atorig;
+    //add to HID cmd, remove from VB cmd
+    if(replace) handler_vb_delCmd(sendCmd->vb);
+    handler_hid_addCmd(sendCmd,replace);
+    sendCmd->atoriginal = NULL;
+  }
+}
+/** @brief Helper to add a VB cmd to the list (VB mode only)
+ * @param ctx Parse context (singleshot or VB mode)
+ * @param sendCmd VB command
+ * @param vb VB number
+ * @param event Triggering event (VB_PRESS_EVENT or VB_RELEASE_EVENT)
+ * @param atorig Original AT command, stored for the first action of a command
+ * @param replace If != 0, previous actions of this VB are removed */
+static void sendVBCmd(cmd_context_t *ctx, vb_cmd_t *sendCmd, uint16_t vb, uint8_t event, char* atorig, uint8_t replace)
+{
+  //VB commands are only used for VBs, singleshot actions are
+  //executed directly by the handlers
+  if(ctx->vb == VB_SINGLESHOT)
+  {
+    if(sendCmd->cmdparam != NULL) free(sendCmd->cmdparam);
+    if(sendCmd->macro != NULL) free(sendCmd->macro);
+    return;
+  }
+  
+  //update VB command (set VB, add original string)
+  //strings are copied by handler_vb_addCmd
+  sendCmd->vb = vb;
+  sendCmd->event = event;
+  sendCmd->atoriginal = atorig;
+  //add to VB cmd, remove from HID cmd
+  if(replace) handler_hid_delCmd(sendCmd->vb);
+  handler_vb_addCmd(sendCmd,replace);
+  sendCmd->atoriginal = NULL;
+  if(sendCmd->cmdparam != NULL) free(sendCmd->cmdparam);
+  sendCmd->cmdparam = NULL;
+  if(sendCmd->macro != NULL) free(sendCmd->macro);
+  sendCmd->macro = NULL;
+}
+
+void cmdContextInit(cmd_context_t *ctx, generalConfig_t *cfg)
+{
+  if(ctx == NULL) return;
+  memset(ctx,0,sizeof(cmd_context_t));
+  ctx->cfg = cfg;
+  ctx->vb = VB_SINGLESHOT;
+}
+
+/** @brief Send all collected actions of the current command
+ * 
+ * The first action of a command replaces all previous actions
+ * of this VB and stores the original AT string (used for reverse parsing).
+ * @param ctx Parse context */
+static void cmdContextFlush(cmd_context_t *ctx)
+{
+  for(uint8_t i = 0; i<ctx->count; i++)
+  {
+    cmd_action_t *a = &ctx->actions[i];
+    uint8_t event = a->press ? VB_PRESS_EVENT : VB_RELEASE_EVENT;
+    char *atorig = NULL;
+    uint8_t replace = 0;
+    
+    //first action of this command
+    if(ctx->dispatched == 0)
     {
-      sendCmd->atoriginal = strdup((char*)atorig);
-      if(sendCmd->atoriginal == NULL)
+      atorig = ctx->orig;
+      replace = 1;
+    }
+    
+    if(ctx->sink != NULL) ctx->sink(ctx->sinkArg,a);
+    else if(a->type == CMD_ACTION_HID) sendHIDCmd(ctx,&a->hid,ctx->vb,event,atorig,replace);
+    else sendVBCmd(ctx,&a->vbcmd,ctx->vb,event,atorig,replace);
+    ctx->dispatched++;
+  }
+  ctx->count = 0;
+}
+
+esp_err_t cmdContextAddHID(cmd_context_t *ctx, hid_cmd_t *cmd, uint8_t press)
+{
+  if(ctx == NULL || cmd == NULL) return ESP_FAIL;
+  //list is full, send the previous actions first (order is kept)
+  if(ctx->count == CMD_CONTEXT_ACTIONS) cmdContextFlush(ctx);
+  
+  cmd_action_t *a = &ctx->actions[ctx->count++];
+  a->type = CMD_ACTION_HID;
+  a->press = press;
+  memcpy(&a->hid,cmd,sizeof(hid_cmd_t));
+  a->hid.atoriginal = NULL;
+  return ESP_OK;
+}
+
+esp_err_t cmdContextAddVB(cmd_context_t *ctx, vb_cmd_type_t type, char *param)
+{
+  if(ctx == NULL) return ESP_FAIL;
+  if(ctx->count == CMD_CONTEXT_ACTIONS) cmdContextFlush(ctx);
+  
+  cmd_action_t *a = &ctx->actions[ctx->count];
+  memset(a,0,sizeof(cmd_action_t));
+  a->type = CMD_ACTION_VB;
+  a->press = 1;
+  a->vbcmd.cmd = type;
+  if(param != NULL)
+  {
+    a->vbcmd.cmdparam = strndup(param,ATCMD_LENGTH);
+    if(a->vbcmd.cmdparam == NULL) return ESP_FAIL;
+  }
+  ctx->count++;
+  return ESP_OK;
+}
+
+void cmdContextFinish(cmd_context_t *ctx, cmd_retval result)
+{
+  if(ctx == NULL) return;
+  
+  if(result == SUCCESS)
+  {
+    cmdContextFlush(ctx);
+    //we need to reset the VB to VB_SINGLESHOT
+    //in the case the processed command here was NOT "AT BM"
+    if(ctx->bm != 0)
+    {
+      ESP_LOGD(LOG_TAG,"Got an BM request, not resetting VB now.");
+      ctx->bm = 0;
+    } else {
+      ESP_LOGD(LOG_TAG,"Resetting to VB_SINGLESHOT");
+      ctx->vb = VB_SINGLESHOT;
+    }
+  } else {
+    //discard collected actions
+    for(uint8_t i = 0; i<ctx->count; i++)
+    {
+      if(ctx->actions[i].type == CMD_ACTION_VB)
       {
-        ESP_LOGE(LOG_TAG,"Error allocating AT cmd string");
+        if(ctx->actions[i].vbcmd.cmdparam != NULL) free(ctx->actions[i].vbcmd.cmdparam);
+        if(ctx->actions[i].vbcmd.macro != NULL) free(ctx->actions[i].vbcmd.macro);
       }
-    } else {
-      sendCmd->atoriginal = NULL;
     }
-    //add to HID cmd, remove from VB cmd
-    handler_vb_delCmd(sendCmd->vb);
-    handler_hid_addCmd(sendCmd,replace);
+    ctx->count = 0;
+  }
+  ctx->dispatched = 0;
+  ctx->orig = NULL;
+  
+  //activate changed VB commands immediately, except while a slot is loaded
+  //(the config switcher publishes the complete slot at once)
+  if(ctx->sink == NULL && (xEventGroupGetBits(systemStatus) & SYSTEM_LOADCONFIG) == 0)
+  {
+    handler_hid_publish();
+    handler_vb_publish();
+  }
+}
+
+/** @brief Output buffer of the macro compiler */
+typedef struct macro_buffer {
+  /** @brief Compiled operations */
+  uint8_t *buf;
+  /** @brief Used bytes */
+  uint32_t len;
+  /** @brief Allocated bytes */
+  uint32_t size;
+  /** @brief Set if memory could not be allocated */
+  uint8_t error;
+} macro_buffer_t;
+
+/** @brief Commands, which only generate actions and can be compiled
+ * @note AT KH is not compiled: in VB mode, it releases the keys on the
+ * VB release, which is not done if executed by a macro.
+ * @see cmdMacroCompile */
+static const char *macroCompilable[] = {
+  "CL","CR","CM","CD","HL","PL","HR","PR","HM","PM","RL","RR","RM", \
+  "TL","TR","TM","WU","WD","MX","MY", \
+  "KW","KP","KR","KT", \
+  "JX","JY","JZ","JT","JS","JU","JP","JC","JR","JH", \
+  "LO","NE","CA","IP"
+};
+
+/** @brief Append data to the compiled macro
+ * @param m Output buffer
+ * @param data Data to append
+ * @param len Count of bytes */
+static void macroAppend(macro_buffer_t *m, const void *data, uint32_t len)
+{
+  if(m->error) return;
+  if(m->len + len > m->size)
+  {
+    uint32_t size = (m->size ? m->size*2 : 32) + len;
+    uint8_t *buf = realloc(m->buf,size);
+    if(buf == NULL)
+    {
+      m->error = 1;
+      return;
+    }
+    m->buf = buf;
+    m->size = size;
   }
+  memcpy(&m->buf[m->len],data,len);
+  m->len += len;
 }
-/** @brief Helper to route a VB cmd either directly to queue or add it to the list
- * @param sendCmd Hid command */
-void sendVBCmd(vb_cmd_t *sendCmd, uint8_t vb, uint8_t* atorig, uint8_t replace)
+
+/** @brief Receiver for the actions of a compiled command
+ * @param arg Output buffer (macro_buffer_t)
+ * @param a Action */
+static void macroSink(void *arg, cmd_action_t *a)
 {
-  //check if this cmd contains data
-  vb_cmd_t emptyvb; memset(&emptyvb,0,sizeof(vb_cmd_t));
-  if(sendCmd == NULL) return;
-  if(memcmp(sendCmd,&emptyvb,sizeof(vb_cmd_t)) == 0) return;
+  macro_buffer_t *m = (macro_buffer_t*)arg;
+  uint8_t op[4];
   
-  //send it directly, if singleshot is active
-  if(requestVBUpdate != VB_SINGLESHOT)
+  if(a->type == CMD_ACTION_HID)
   {
-    //update HID command (set VB, add original string)
-    sendCmd->vb = vb;
-    if(atorig != NULL)
+    op[0] = MACRO_OP_HID;
+    memcpy(&op[1],a->hid.cmd,3);
+    macroAppend(m,op,4);
+  } else {
+    op[0] = MACRO_OP_VB;
+    op[1] = a->vbcmd.cmd;
+    macroAppend(m,op,2);
+    if(a->vbcmd.cmdparam != NULL)
     {
-      sendCmd->atoriginal = strdup((char*)atorig);
-      if(sendCmd->atoriginal == NULL)
+      macroAppend(m,a->vbcmd.cmdparam,strlen(a->vbcmd.cmdparam)+1);
+      free(a->vbcmd.cmdparam);
+    } else macroAppend(m,"",1);
+    if(a->vbcmd.macro != NULL) free(a->vbcmd.macro);
+  }
+}
+
+uint8_t *cmdMacroCompile(char *macro, generalConfig_t *cfg)
+{
+  macro_buffer_t m = {NULL,0,0,0};
+  char cmd[ATCMD_LENGTH];
+  cmd_context_t *ctx;
+  uint32_t start = 0;
+  uint32_t offset = 0;
+  
+  if(macro == NULL || cfg == NULL) return NULL;
+  ctx = malloc(sizeof(cmd_context_t));
+  if(ctx == NULL) return NULL;
+  
+  while(1)
+  {
+    char c = macro[offset];
+    //command separator (if not escaped) or end of the macro
+    if((c == ';' && (offset == 0 || macro[offset-1] != '\\')) || \
+      c == 0 || c == '\r' || c == '\n')
+    {
+      uint32_t len = offset - start;
+      if(len >= ATCMD_LENGTH)
       {
-        ESP_LOGE(LOG_TAG,"Error allocating AT cmd string");
+        ESP_LOGE(LOG_TAG,"Macro command too long, skipped");
+        len = 0;
       }
-    } else {
-      sendCmd->atoriginal = NULL;
+      memcpy(cmd,&macro[start],len);
+      cmd[len] = 0;
+      
+      if(len == 0) {
+        //empty command (e.g. trailing ';'), nothing to do
+      } else if(strncasecmp(cmd,"AT WA",5) == 0) {
+        //wait, the time is stored in ms
+        uint32_t time = strtol(&cmd[5],NULL,10);
+        if(time < 30000)
+        {
+          uint8_t op[3] = {MACRO_OP_WAIT, time & 0xFF, (time >> 8) & 0xFF};
+          macroAppend(&m,op,3);
+        } else {
+          ESP_LOGE(LOG_TAG,"Hit AT WA with a delay time too high: %d",time);
+        }
+      } else {
+        //is this command compilable?
+        uint8_t compilable = 0;
+        if(len >= 5 && strncasecmp(cmd,"AT ",3) == 0)
+        {
+          for(uint8_t i = 0; i<sizeof(macroCompilable)/sizeof(macroCompilable[0]); i++)
+          {
+            if(strncasecmp(&cmd[3],macroCompilable[i],2) == 0) compilable = 1;
+          }
+        }
+        
+        //parse it once in VB mode, actions are collected by macroSink
+        if(compilable)
+        {
+          cmdContextInit(ctx,cfg);
+          ctx->vb = 0;
+          ctx->sink = macroSink;
+          ctx->sinkArg = &m;
+          cmd_retval r = cmdParser(cmd,ctx);
+          cmdContextFinish(ctx,r);
+          if(r != SUCCESS) compilable = 0;
+        }
+        
+        //otherwise, the text is sent to the parser on execution
+        if(!compilable)
+        {
+          uint8_t op = MACRO_OP_AT;
+          macroAppend(&m,&op,1);
+          macroAppend(&m,cmd,len+1);
+        }
+      }
+      start = offset + 1;
     }
-    //add to HID cmd, remove from VB cmd
-    handler_hid_delCmd(sendCmd->vb);
-    handler_vb_addCmd(sendCmd,replace);
+    if(c == 0 || c == '\r' || c == '\n') break;
+    offset++;
+  }
+  free(ctx);
+  
+  uint8_t op = MACRO_OP_END;
+  macroAppend(&m,&op,1);
+  if(m.error)
+  {
+    ESP_LOGE(LOG_TAG,"Cannot allocate memory for compiled macro");
+    free(m.buf);
+    return NULL;
   }
+  ESP_LOGD(LOG_TAG,"Compiled macro, %d bytes",m.len);
+  return m.buf;
+}
+
+/** @brief Helper to add one HID action with the given command bytes
+ * @param ctx Parse context
+ * @param press 1 for a press action, 0 for a release action
+ * @return ESP_OK if added, ESP_FAIL otherwise*/
+static esp_err_t cmd_helper_hid(cmd_context_t *ctx, uint8_t press, uint8_t c0, uint8_t c1, uint8_t c2)
+{
+  hid_cmd_t cmd;
+  memset(&cmd,0,sizeof(hid_cmd_t));
+  cmd.cmd[0] = c0;
+  cmd.cmd[1] = c1;
+  cmd.cmd[2] = c2;
+  return cmdContextAddHID(ctx,&cmd,press);
 }
 
 /*++++ command handlers (implemented before commands[] ++++*/
-esp_err_t cmdId(char* orig, void* p1, void* p2) {
+esp_err_t cmdId(char* orig, void* p1, void* p2, cmd_context_t *ctx) {
   halSerialSendUSBSerial((char*)IDSTRING,sizeof(IDSTRING),20);
   return ESP_OK;
 }
-esp_err_t cmdBm(char* orig, void* p1, void* p2) {
-  requestVBUpdate = (int32_t)p1;
+esp_err_t cmdBm(char* orig, void* p1, void* p2, cmd_context_t *ctx) {
+  //VB_SINGLESHOT is within the range of chords & gestures, but not a VB
+  if((int32_t)p1 == VB_SINGLESHOT) return ESP_FAIL;
+  ctx->vb = (int32_t)p1;
   //signal: we got a new VB, 
   //do not reset it to VB_SINGLESHOT this time
-  requestBM = 1;
+  ctx->bm = 1;
   return ESP_OK;
 }
-esp_err_t cmdMa(char* orig, void* p1, void* p2) {
-  if(requestVBUpdate == VB_SINGLESHOT)
+esp_err_t cmdMa(char* orig, void* p1, void* p2, cmd_context_t *ctx) {
+  if(ctx->vb == VB_SINGLESHOT)
   {
-    fct_macro((char*)p1);
+    fct_macro((char*)p1,VB_SINGLESHOT);
   } else {
-    vbaction.cmd = T_MACRO;
-    vbaction.cmdparam = malloc(strnlen((char*)p1,ATCMD_LENGTH)+1);
-    strncpy(vbaction.cmdparam,(char*)p1,strnlen((char*)p1,ATCMD_LENGTH));
+    if(cmdContextAddVB(ctx,T_MACRO,(char*)p1) != ESP_OK) return ESP_FAIL;
+    //compile once, the VB triggers the compiled macro
+    ctx->actions[ctx->count-1].vbcmd.macro = cmdMacroCompile((char*)p1,ctx->cfg);
+    return ESP_OK;
   }
   return ESP_OK;
 }
-esp_err_t cmdWa(char* orig, void* p1, void* p2) {
+esp_err_t cmdWa(char* orig, void* p1, void* p2, cmd_context_t *ctx) {
   //we don't do anything here. AT WA is just placed in this file
   //for a fully implemented command table.
-  //AT WA is implemented in fct_macros.c, where the task is delayed
-  //for the given time before further commands are issued.
+  //AT WA is implemented in fct_macros.c, where the macro executor
+  //continues this macro after the given time.
   return ESP_OK;
 }
-esp_err_t cmdRo(char* orig, void* p1, void* p2) {
+esp_err_t cmdRo(char* orig, void* p1, void* p2, cmd_context_t *ctx) {
   //check if we are "aligned" to 90°
-  if((((int32_t)p1 % 90) != 0) || currentCfg == NULL) return ESP_FAIL;
-  currentCfg->adc.orientation = (int32_t)p1;
+  if((((int32_t)p1 % 90) != 0) || ctx->cfg == NULL) return ESP_FAIL;
+  ctx->cfg->adc.orientation = (int32_t)p1;
   return ESP_OK;
 }
-esp_err_t cmdBt(char* orig, void* p1, void* p2) {
-  if(currentCfg == NULL) return ESP_FAIL;
-  currentCfg->usb_active = ((int32_t)p1) & 0x01;
-  currentCfg->ble_active = (((int32_t)p1) & 0x02)>>1;
+esp_err_t cmdBt(char* orig, void* p1, void* p2, cmd_context_t *ctx) {
+  if(ctx->cfg == NULL) return ESP_FAIL;
+  ctx->cfg->usb_active = ((int32_t)p1) & 0x01;
+  ctx->cfg->ble_active = (((int32_t)p1) & 0x02)>>1;
   return ESP_OK;
 }
-esp_err_t cmdTt(char* orig, void* p1, void* p2) {
-  if(currentCfg == NULL) return ESP_FAIL;
+esp_err_t cmdTt(char* orig, void* p1, void* p2, cmd_context_t *ctx) {
+  if(ctx->cfg == NULL) return ESP_FAIL;
   ///TODO: not implemented yet.
   return ESP_OK;
 }
-esp_err_t cmdAp(char* orig, void* p1, void* p2) {
-  if(currentCfg == NULL) return ESP_FAIL;
-  if(requestVBUpdate == VB_SINGLESHOT) currentCfg->debounce_press = (int32_t)p1;
-  else currentCfg->debounce_press_vb[requestVBUpdate] = (int32_t)p1;
+/** @brief Set one individual anti-tremor time of a VB
+ * 
+ * An entry is added for the first time of a VB, it is removed
+ * if all its times are 0 (global times are used again).
+ * @param cfg Config
+ * @param vb VB number
+ * @param offset Offset of the time in vb_param_t (press, release or idle)
+ * @param time Time in [ms], 0 uses the global time
+ * @return ESP_OK on success, ESP_FAIL if there is no free entry */
+static esp_err_t cmdSetVBParam(generalConfig_t *cfg, uint16_t vb, size_t offset, uint16_t time)
+{
+  vb_param_t *p = NULL;
+  for(uint8_t i = 0; i<cfg->debounce_vb_count; i++)
+  {
+    if(cfg->debounce_vb[i].vb == vb) p = &cfg->debounce_vb[i];
+  }
+  if(p == NULL)
+  {
+    //nothing to clear
+    if(time == 0) return ESP_OK;
+    if(cfg->debounce_vb_count >= DEBOUNCE_VB_PARAMS)
+    {
+      ESP_LOGE(LOG_TAG,"No free entry for individual anti-tremor times (max %d VBs)",DEBOUNCE_VB_PARAMS);
+      return ESP_FAIL;
+    }
+    p = &cfg->debounce_vb[cfg->debounce_vb_count++];
+    memset(p,0,sizeof(vb_param_t));
+    p->vb = vb;
+  }
+  *(uint16_t*)((uint8_t*)p + offset) = time;
+  //all times are global again, move the last entry to this one
+  if(p->press == 0 && p->release == 0 && p->idle == 0)
+  {
+    cfg->debounce_vb_count--;
+    *p = cfg->debounce_vb[cfg->debounce_vb_count];
+    memset(&cfg->debounce_vb[cfg->debounce_vb_count],0,sizeof(vb_param_t));
+  }
   return ESP_OK;
 }
-esp_err_t cmdAr(char* orig, void* p1, void* p2) {
-  if(currentCfg == NULL) return ESP_FAIL;
-  if(requestVBUpdate == VB_SINGLESHOT) currentCfg->debounce_release = (int32_t)p1;
-  else currentCfg->debounce_release_vb[requestVBUpdate] = (int32_t)p1;
-  return ESP_OK;
+/** @brief Set a global or individual (after AT BM) anti-tremor time
+ * @param ctx Parse context
+ * @param global Global time in the config
+ * @param offset Offset of the individual time in vb_param_t
+ * @param time Time in [ms], 0 is valid for individual times only */
+static esp_err_t cmdSetAntiTremor(cmd_context_t *ctx, uint16_t *global, size_t offset, int32_t time)
+{
+  if(ctx->cfg == NULL) return ESP_FAIL;
+  if(ctx->vb == VB_SINGLESHOT)
+  {
+    if(time == 0) return ESP_FAIL;
+    *global = time;
+    return ESP_OK;
+  }
+  //chords & gestures are not debounced
+  if(ctx->vb >= VB_MAX) return ESP_FAIL;
+  return cmdSetVBParam(ctx->cfg,ctx->vb,offset,time);
 }
-esp_err_t cmdAi(char* orig, void* p1, void* p2) {
-  if(currentCfg == NULL) return ESP_FAIL;
-  if(requestVBUpdate == VB_SINGLESHOT) currentCfg->debounce_idle = (int32_t)p1;
-  else currentCfg->debounce_idle_vb[requestVBUpdate] = (int32_t)p1;
-  return ESP_OK;
+esp_err_t cmdAp(char* orig, void* p1, void* p2, cmd_context_t *ctx) {
+  if(ctx->cfg == NULL) return ESP_FAIL;
+  return cmdSetAntiTremor(ctx,&ctx->cfg->debounce_press,offsetof(vb_param_t,press),(int32_t)p1);
 }
-esp_err_t cmdFr(char* orig, void* p1, void* p2) {
+esp_err_t cmdAr(char* orig, void* p1, void* p2, cmd_context_t *ctx) {
+  if(ctx->cfg == NULL) return ESP_FAIL;
+  return cmdSetAntiTremor(ctx,&ctx->cfg->debounce_release,offsetof(vb_param_t,release),(int32_t)p1);
+}
+esp_err_t cmdAi(char* orig, void* p1, void* p2, cmd_context_t *ctx) {
+  if(ctx->cfg == NULL) return ESP_FAIL;
+  return cmdSetAntiTremor(ctx,&ctx->cfg->debounce_idle,offsetof(vb_param_t,idle),(int32_t)p1);
+}
+esp_err_t cmdFr(char* orig, void* p1, void* p2, cmd_context_t *ctx) {
   uint32_t free,total;
   if(halStorageGetFree(&total,&free) == ESP_OK)
   {
@@ -313,96 +583,180 @@ esp_err_t cmdFr(char* orig, void* p1, void* p2) {
     return ESP_OK;
   } else return ESP_FAIL;
 }
-esp_err_t cmdPw(char* orig, void* p1, void* p2)
+esp_err_t cmdDs(char* orig, void* p1, void* p2, cmd_context_t *ctx) {
+  debouncer_stats_t st;
+  char str[160];
+  //report all VBs with recorded edges:
+  //"DS:<vb>,<edges>,<bounces>,<canceled>,<deadtime>,<max latency>,<histogram...>"
+  for(uint32_t i = 0; i<VB_MAX; i++)
+  {
+    if(taskDebouncerGetStats(i,&st) != ESP_OK) return ESP_FAIL;
+    if(st.edges == 0) continue;
+    int len = sprintf(str,"DS:%d,%d,%d,%d,%d,%d",i,st.edges,st.bounces, \
+      st.canceled,st.deadtime,st.latencyMax);
+    for(uint32_t j = 0; j<DEBOUNCE_HIST_BINS; j++) len += sprintf(&str[len],",%d",st.latency[j]);
+    halSerialSendUSBSerial(str,len,20);
+  }
+  //edges merged by the GPIO ISR & lost due to a full queue: "DS:IO,<merged>,<dropped>"
+  uint32_t merged, dropped;
+  halIOGetEdgeStats(&merged,&dropped);
+  int len = sprintf(str,"DS:IO,%d,%d",merged,dropped);
+  halSerialSendUSBSerial(str,len,20);
+  //reset if requested ("AT DS 1")
+  if((int32_t)p1 == 1)
+  {
+    taskDebouncerResetStats();
+    halIOResetEdgeStats();
+  }
+  return ESP_OK;
+}
+esp_err_t cmdMi(char* orig, void* p1, void* p2, cmd_context_t *ctx) {
+  slot_arena_stats_t st;
+  char str[100];
+  //"MI:<used>,<peak>,<reserved>,<chunks>,<fragmentation before>,<after>,
+  //<strings>,<saved>"
+  slotArenaGetStats(&st);
+  int len = sprintf(str,"MI:%d,%d,%d,%d,%d,%d,%d,%d",st.used,st.peak,st.reserved, \
+    st.chunks,st.fragBefore,st.fragAfter,st.strings,st.stringsSaved);
+  halSerialSendUSBSerial(str,len,20);
+  return ESP_OK;
+}
+esp_err_t cmdSi(char* orig, void* p1, void* p2, cmd_context_t *ctx) {
+  config_switch_stats_t st;
+  slot_cache_stats_t cache;
+  char str[128];
+  //"SI:<last switch [us]>,<image>,<switches by image>,<switches by text>,
+  //<cache hits>,<cache misses>,<cached slots>,<cached bytes>,<budget>,<config updates avoided>"
+  configGetSwitchStats(&st);
+  halStorageGetCacheStats(&cache);
+  int len = sprintf(str,"SI:%d,%d,%d,%d,%d,%d,%d,%d,%d,%d",st.last,st.image,st.images,st.texts, \
+    cache.hits,cache.misses,cache.entries,cache.bytes,cache.budget,configGetUpdatesAvoided());
+  halSerialSendUSBSerial(str,len,20);
+  return ESP_OK;
+}
+esp_err_t cmdSb(char* orig, void* p1, void* p2, cmd_context_t *ctx) {
+  uint32_t tid;
+  esp_err_t retval;
+  retval = halStorageStartTransaction(&tid,20,LOG_TAG);
+  if(retval != ESP_OK) return retval;
+  retval = halStorageSetCacheBudget(tid,(int32_t)p1);
+  halStorageFinishTransaction(tid);
+  return retval;
+}
+esp_err_t cmdIs(char* orig, void* p1, void* p2, cmd_context_t *ctx) {
+  ir_cache_stats_t st;
+  char str[64];
+  //"IS:<hits>,<misses>,<cached cmds>,<bytes>"
+  fct_infrared_get_stats(&st);
+  int len = sprintf(str,"IS:%d,%d,%d,%d",st.hits,st.misses,st.entries,st.bytes);
+  halSerialSendUSBSerial(str,len,20);
+  return ESP_OK;
+}
+esp_err_t cmdCh(char* orig, void* p1, void* p2, cmd_context_t *ctx) {
+  if(ctx->cfg == NULL) return ESP_FAIL;
+  //"AT CH <chord> <vb> <vb> ...", without VBs the chord is cleared.
+  char *p = (char*)p1;
+  char *e;
+  long chord = strtol(p,&e,10);
+  if(e == p || chord < 0 || chord >= VB_CHORD_COUNT) return ESP_FAIL;
+  uint32_t mask = 0;
+  uint8_t count = 0;
+  while(1)
+  {
+    p = e;
+    long vb = strtol(p,&e,10);
+    if(e == p) break;
+    if(vb < 0 || vb >= VB_MAX) return ESP_FAIL;
+    if((mask & (1<<vb)) == 0) count++;
+    mask |= (1<<vb);
+  }
+  //trailing garbage is not accepted (line endings are not stripped in all cases)
+  while(*p == ' ' || *p == '\r' || *p == '\n') p++;
+  if(*p != '\0') return ESP_FAIL;
+  //a chord needs at least 2 VBs
+  if(count == 1) return ESP_FAIL;
+  ctx->cfg->chord_mask[chord] = mask;
+  return ESP_OK;
+}
+esp_err_t cmdPw(char* orig, void* p1, void* p2, cmd_context_t *ctx)
 {
   return halStorageNVSStoreString(NVS_WIFIPW,(char*)p1);
 }
-esp_err_t cmdFw(char* orig, void* p1, void* p2) {
-  general.cmd[0] = ((int32_t) p1)+2; //valid: 0x02 / 0x03
-  return ESP_OK;
+esp_err_t cmdFw(char* orig, void* p1, void* p2, cmd_context_t *ctx) {
+  return cmd_helper_hid(ctx,1,((int32_t) p1)+2,0,0); //valid: 0x02 / 0x03
 }
 
 /*++++ Mouse HID command handlers ++++*/
-esp_err_t cmdCl(char* orig, void* p1, void* p2) {
-  mouse.cmd[0] = 0x13; return ESP_OK;
+esp_err_t cmdCl(char* orig, void* p1, void* p2, cmd_context_t *ctx) {
+  return cmd_helper_hid(ctx,1,0x13,0,0);
 }
-esp_err_t cmdCr(char* orig, void* p1, void* p2) {
-  mouse.cmd[0] = 0x14; return ESP_OK;
+esp_err_t cmdCr(char* orig, void* p1, void* p2, cmd_context_t *ctx) {
+  return cmd_helper_hid(ctx,1,0x14,0,0);
 }
-esp_err_t cmdCm(char* orig, void* p1, void* p2) {
-  mouse.cmd[0] = 0x15; return ESP_OK;
+esp_err_t cmdCm(char* orig, void* p1, void* p2, cmd_context_t *ctx) {
+  return cmd_helper_hid(ctx,1,0x15,0,0);
 }
-esp_err_t cmdCd(char* orig, void* p1, void* p2) {
-  mouse.cmd[0] = 0x13;
-  mouseD.cmd[0] = 0x13; return ESP_OK;
+esp_err_t cmdCd(char* orig, void* p1, void* p2, cmd_context_t *ctx) {
+  cmd_helper_hid(ctx,1,0x13,0,0);
+  return cmd_helper_hid(ctx,1,0x13,0,0);
 }
-esp_err_t cmdHl(char* orig, void* p1, void* p2) {
-  mouse.cmd[0] = 0x16;
-  mouseR.cmd[0] = 0x19; return ESP_OK;
+esp_err_t cmdHl(char* orig, void* p1, void* p2, cmd_context_t *ctx) {
+  cmd_helper_hid(ctx,1,0x16,0,0);
+  return cmd_helper_hid(ctx,0,0x19,0,0);
 }
-esp_err_t cmdHr(char* orig, void* p1, void* p2) {
-  mouse.cmd[0] = 0x17;
-  mouseR.cmd[0] = 0x1A; return ESP_OK;
+esp_err_t cmdHr(char* orig, void* p1, void* p2, cmd_context_t *ctx) {
+  cmd_helper_hid(ctx,1,0x17,0,0);
+  return cmd_helper_hid(ctx,0,0x1A,0,0);
 }
-esp_err_t cmdHm(char* orig, void* p1, void* p2) {
-  mouse.cmd[0] = 0x18;
-  mouseR.cmd[0] = 0x1B; return ESP_OK;
+esp_err_t cmdHm(char* orig, void* p1, void* p2, cmd_context_t *ctx) {
+  cmd_helper_hid(ctx,1,0x18,0,0);
+  return cmd_helper_hid(ctx,0,0x1B,0,0);
 }
-esp_err_t cmdRl(char* orig, void* p1, void* p2) {
-  mouse.cmd[0] = 0x19; return ESP_OK;
+esp_err_t cmdRl(char* orig, void* p1, void* p2, cmd_context_t *ctx) {
+  return cmd_helper_hid(ctx,1,0x19,0,0);
 }
-esp_err_t cmdRr(char* orig, void* p1, void* p2) {
-  mouse.cmd[0] = 0x1A; return ESP_OK;
+esp_err_t cmdRr(char* orig, void* p1, void* p2, cmd_context_t *ctx) {
+  return cmd_helper_hid(ctx,1,0x1A,0,0);
 }
-esp_err_t cmdRm(char* orig, void* p1, void* p2) {
-  mouse.cmd[0] = 0x1B; return ESP_OK;
+esp_err_t cmdRm(char* orig, void* p1, void* p2, cmd_context_t *ctx) {
+  return cmd_helper_hid(ctx,1,0x1B,0,0);
 }
-esp_err_t cmdTl(char* orig, void* p1, void* p2) {
-  mouse.cmd[0] = 0x1C; return ESP_OK;
+esp_err_t cmdTl(char* orig, void* p1, void* p2, cmd_context_t *ctx) {
+  return cmd_helper_hid(ctx,1,0x1C,0,0);
 }
-esp_err_t cmdTr(char* orig, void* p1, void* p2) {
-  mouse.cmd[0] = 0x1D; return ESP_OK;
+esp_err_t cmdTr(char* orig, void* p1, void* p2, cmd_context_t *ctx) {
+  return cmd_helper_hid(ctx,1,0x1D,0,0);
 }
-esp_err_t cmdTm(char* orig, void* p1, void* p2) {
-  mouse.cmd[0] = 0x1E; return ESP_OK;
+esp_err_t cmdTm(char* orig, void* p1, void* p2, cmd_context_t *ctx) {
+  return cmd_helper_hid(ctx,1,0x1E,0,0);
 }
-esp_err_t cmdWu(char* orig, void* p1, void* p2) {
-  if(currentCfg == NULL) return ESP_FAIL;
-  mouse.cmd[0] = 0x12; 
-  mouse.cmd[1] = currentCfg->wheel_stepsize;
-  return ESP_OK;
+esp_err_t cmdWu(char* orig, void* p1, void* p2, cmd_context_t *ctx) {
+  if(ctx->cfg == NULL) return ESP_FAIL;
+  return cmd_helper_hid(ctx,1,0x12,ctx->cfg->wheel_stepsize,0);
 }
-esp_err_t cmdWd(char* orig, void* p1, void* p2) {
-  if(currentCfg == NULL) return ESP_FAIL;
-  mouse.cmd[0] = 0x12; 
-  mouse.cmd[1] = -currentCfg->wheel_stepsize;
-  return ESP_OK;
+esp_err_t cmdWd(char* orig, void* p1, void* p2, cmd_context_t *ctx) {
+  if(ctx->cfg == NULL) return ESP_FAIL;
+  return cmd_helper_hid(ctx,1,0x12,-ctx->cfg->wheel_stepsize,0);
 }
-esp_err_t cmdWs(char* orig, void* p1, void* p2) {
-  if(currentCfg == NULL) return ESP_FAIL;
-  currentCfg->wheel_stepsize = (int32_t)p1;
+esp_err_t cmdWs(char* orig, void* p1, void* p2, cmd_context_t *ctx) {
+  if(ctx->cfg == NULL) return ESP_FAIL;
+  ctx->cfg->wheel_stepsize = (int32_t)p1;
   return ESP_OK;
 }
-esp_err_t cmdMx(char* orig, void* p1, void* p2) {
-  if(currentCfg == NULL) return ESP_FAIL;
-  mouse.cmd[0] = 0x10; 
-  mouse.cmd[1] = (int32_t)p1;
-  return ESP_OK;
+esp_err_t cmdMx(char* orig, void* p1, void* p2, cmd_context_t *ctx) {
+  if(ctx->cfg == NULL) return ESP_FAIL;
+  return cmd_helper_hid(ctx,1,0x10,(int32_t)p1,0);
 }
-esp_err_t cmdMy(char* orig, void* p1, void* p2) {
-  if(currentCfg == NULL) return ESP_FAIL;
-  mouse.cmd[0] = 0x11; 
-  mouse.cmd[1] = (int32_t)p1;
-  return ESP_OK;
+esp_err_t cmdMy(char* orig, void* p1, void* p2, cmd_context_t *ctx) {
+  if(ctx->cfg == NULL) return ESP_FAIL;
+  return cmd_helper_hid(ctx,1,0x11,(int32_t)p1,0);
 }
 
 /*++++ Keyboard HID command handlers ++++*/
-esp_err_t keyboard_helper_parsekeycode(char t, uint8_t *buf)
+esp_err_t keyboard_helper_parsekeycode(cmd_context_t *ctx, char t, uint8_t *buf)
 {
   hid_cmd_t cmd;  //this would be the press or press&release action
   memset(&cmd,0,sizeof(hid_cmd_t));
-  //if the first HID cmd is sent, this flag is set.
-  uint8_t deleted = 0;
   char *pch;
   uint8_t cnt = 0;
   uint16_t keycode = 0;
@@ -454,11 +808,8 @@ esp_err_t keyboard_helper_parsekeycode(char t, uint8_t *buf)
           }
         }
 
-        //send the cmd either directly or save it to the HID task
-        //we do the press event here.
-        if(deleted == 0) sendHIDCmd(&cmd,requestVBUpdate|0x80,buf,1);        
-        else sendHIDCmd(&cmd,requestVBUpdate|0x80,NULL,0);
-        deleted = 1;
+        //add the cmd to the output list, we do the press event here.
+        cmdContextAddHID(ctx,&cmd,1);
         ESP_LOGI(LOG_TAG,"Press action 0x%2X, keycode/modifier: 0x%2X",cmd.cmd[0],cmd.cmd[1]);
         //save for later release
         releaseArr[cnt] = keycode;
@@ -488,12 +839,11 @@ esp_err_t keyboard_helper_parsekeycode(char t, uint8_t *buf)
   //AT KH releases all keys on a VB release trigger. If we
   //got that command via the serial interface, we don't do this (AT KR is needed)
   
-  if((t=='P') || ((t=='H')&&(requestVBUpdate != VB_SINGLESHOT)))
+  if((t=='P') || ((t=='H')&&(ctx->vb != VB_SINGLESHOT)))
   {
-    //this has to be a press action too, but at the end
-    if(t=='P') cmd.vb = requestVBUpdate | 0x80;
-    //we need to have this action on a VB release trigger
-    if(t=='H') cmd.vb = requestVBUpdate;
+    //this has to be a press action too, but at the end (KP)
+    //KH: we need to have this action on a VB release trigger
+    uint8_t press = (t=='P') ? 1 : 0;
     
     //now either send directly or add to HID task...
     for(uint8_t i = 0; i<cnt; i++)
@@ -510,23 +860,19 @@ esp_err_t keyboard_helper_parsekeycode(char t, uint8_t *buf)
         cmd.cmd[1] = keycode_to_key(releaseArr[i]);
       }
       
-      if(deleted == 0) sendHIDCmd(&cmd,requestVBUpdate,buf,1);        
-      else sendHIDCmd(&cmd,requestVBUpdate,NULL,0);
-      deleted = 1;
+      cmdContextAddHID(ctx,&cmd,press);
       ESP_LOGI(LOG_TAG,"Release action 0x%2X, keycode/modifier: 0x%2X",cmd.cmd[0],cmd.cmd[1]);
     }
   }
   return ESP_OK;
 }
-esp_err_t cmdKw(char* orig, void* p1, void* p2) {
+esp_err_t cmdKw(char* orig, void* p1, void* p2, cmd_context_t *ctx) {
   int offset = 0;
   int offsetOut = 0;
   uint8_t deadkeyfirst = 0;
   uint8_t modifier = 0;
   uint8_t keycode = 0;
   hid_cmd_t cmd;
-  //if the first HID cmd is sent, this flag is set.
-  uint8_t deleted = 0;
   memset(&cmd,0,sizeof(hid_cmd_t));
   
   //remove trailing \r/\n
@@ -542,10 +888,10 @@ esp_err_t cmdKw(char* orig, void* p1, void* p2) {
     
     
     //parse ASCII/unicode to keycode sequence
-    keycode = unicode_to_keycode(((char*)p1)[offset], currentCfg->locale);
-    deadkeyfirst = deadkey_to_keycode(keycode,currentCfg->locale);
+    keycode = unicode_to_keycode(((char*)p1)[offset], ctx->cfg->locale);
+    deadkeyfirst = deadkey_to_keycode(keycode,ctx->cfg->locale);
     if(deadkeyfirst != 0) deadkeyfirst = keycode_to_key(deadkeyfirst);
-    modifier = keycode_to_modifier(keycode, currentCfg->locale);
+    modifier = keycode_to_modifier(keycode, ctx->cfg->locale);
     keycode = keycode_to_key(keycode);
     
     //if a keycode is found
@@ -557,10 +903,8 @@ esp_err_t cmdKw(char* orig, void* p1, void* p2) {
         cmd.cmd[0] = 0x20; //press&release
         cmd.cmd[1] = deadkeyfirst;
         
-        //send the cmd either directly or save it to the HID task
-        if(deleted == 0) sendHIDCmd(&cmd,requestVBUpdate|0x80,(uint8_t*)orig,1);        
-        else sendHIDCmd(&cmd,requestVBUpdate|0x80,NULL,0);
-        deleted = 1;
+        //add the cmd to the output list (sent directly or saved to the HID task)
+        cmdContextAddHID(ctx,&cmd,1);
         
         offsetOut++;
         ESP_LOGD(LOG_TAG, "Deadkey 0x%X@%d",deadkeyfirst,offsetOut);
@@ -575,24 +919,18 @@ esp_err_t cmdKw(char* orig, void* p1, void* p2) {
       //release a modifier
       if(modifier){
         cmd.cmd[0] = 0x25; cmd.cmd[1] = modifier;
-        //send the cmd either directly or save it to the HID task
-        if(deleted == 0) sendHIDCmd(&cmd,requestVBUpdate|0x80,(uint8_t*)orig,1);        
-        else sendHIDCmd(&cmd,requestVBUpdate|0x80,NULL,0);
-        deleted = 1;
+        //add the cmd to the output list (sent directly or saved to the HID task)
+        cmdContextAddHID(ctx,&cmd,1);
       }
       
       cmd.cmd[0] = 0x20; cmd.cmd[1] = keycode;
-      //send the cmd either directly or save it to the HID task
-      if(deleted == 0) sendHIDCmd(&cmd,requestVBUpdate|0x80,(uint8_t*)orig,1);        
-      else sendHIDCmd(&cmd,requestVBUpdate|0x80,NULL,0);
-      deleted = 1;
+      //add the cmd to the output list (sent directly or saved to the HID task)
+      cmdContextAddHID(ctx,&cmd,1);
       
       if(modifier){
         cmd.cmd[0] = 0x26; cmd.cmd[1] = modifier;
-        //send the cmd either directly or save it to the HID task
-        if(deleted == 0) sendHIDCmd(&cmd,requestVBUpdate|0x80,(uint8_t*)orig,1);        
-        else sendHIDCmd(&cmd,requestVBUpdate|0x80,NULL,0);
-        deleted = 1;
+        //add the cmd to the output list (sent directly or saved to the HID task)
+        cmdContextAddHID(ctx,&cmd,1);
       }
       
       offsetOut++;
@@ -603,53 +941,51 @@ esp_err_t cmdKw(char* orig, void* p1, void* p2) {
   }
   return ESP_OK;
 }
-esp_err_t cmdKp(char* orig, void* p1, void* p2) {
-  return keyboard_helper_parsekeycode('P',(uint8_t*)orig);}
-esp_err_t cmdKh(char* orig, void* p1, void* p2) {
-  return keyboard_helper_parsekeycode('H',(uint8_t*)orig);}
-esp_err_t cmdKr(char* orig, void* p1, void* p2) {
-  return keyboard_helper_parsekeycode('R',(uint8_t*)orig);}
-esp_err_t cmdKt(char* orig, void* p1, void* p2) {
-  return keyboard_helper_parsekeycode('T',(uint8_t*)orig);}
-esp_err_t cmdRa(char* orig, void* p1, void* p2) {
+esp_err_t cmdKp(char* orig, void* p1, void* p2, cmd_context_t *ctx) {
+  return keyboard_helper_parsekeycode(ctx,'P',(uint8_t*)orig);}
+esp_err_t cmdKh(char* orig, void* p1, void* p2, cmd_context_t *ctx) {
+  return keyboard_helper_parsekeycode(ctx,'H',(uint8_t*)orig);}
+esp_err_t cmdKr(char* orig, void* p1, void* p2, cmd_context_t *ctx) {
+  return keyboard_helper_parsekeycode(ctx,'R',(uint8_t*)orig);}
+esp_err_t cmdKt(char* orig, void* p1, void* p2, cmd_context_t *ctx) {
+  return keyboard_helper_parsekeycode(ctx,'T',(uint8_t*)orig);}
+esp_err_t cmdRa(char* orig, void* p1, void* p2, cmd_context_t *ctx) {
   halBLEReset(0xFE);
   halSerialReset(0xFE);
   return ESP_OK;
 }
 
 /*++++ Storage related handlers ++++*/
-esp_err_t cmdSa(char* orig, void* p1, void* p2) {
+esp_err_t cmdSa(char* orig, void* p1, void* p2, cmd_context_t *ctx) {
   storeSlot((char*)p1);
   return ESP_OK;
 }
-esp_err_t cmdLo(char* orig, void* p1, void* p2) {
-  if(requestVBUpdate == VB_SINGLESHOT)
+esp_err_t cmdLo(char* orig, void* p1, void* p2, cmd_context_t *ctx) {
+  if(ctx->vb == VB_SINGLESHOT)
   {
     xQueueSend(config_switcher,p1,(TickType_t)10);
   } else {
-    vbaction.cmd = T_CONFIGCHANGE;
+    return cmdContextAddVB(ctx,T_CONFIGCHANGE,(char*)p1);
   }
   return ESP_OK;
 }
-esp_err_t cmdLa(char* orig, void* p1, void* p2) {
+esp_err_t cmdLa(char* orig, void* p1, void* p2, cmd_context_t *ctx) {
   printAllSlots(1); return ESP_OK;
 }
-esp_err_t cmdLi(char* orig, void* p1, void* p2) {
+esp_err_t cmdLi(char* orig, void* p1, void* p2, cmd_context_t *ctx) {
   printAllSlots(0); return ESP_OK;
 }
-esp_err_t cmdNe(char* orig, void* p1, void* p2) {
-  if(requestVBUpdate == VB_SINGLESHOT)
+esp_err_t cmdNe(char* orig, void* p1, void* p2, cmd_context_t *ctx) {
+  if(ctx->vb == VB_SINGLESHOT)
   {
     char slotname[SLOTNAME_LENGTH] = "__NEXT";
     xQueueSend(config_switcher,(void*)slotname,(TickType_t)10);
   } else {
-    vbaction.cmd = T_CONFIGCHANGE;
-    vbaction.cmdparam = malloc(strlen("__NEXT")+1);
-    strcpy(vbaction.cmdparam,"__NEXT");
+    return cmdContextAddVB(ctx,T_CONFIGCHANGE,"__NEXT");
   }
   return ESP_OK;
 }
-esp_err_t cmdDe(char* orig, void* p1, void* p2) {
+esp_err_t cmdDe(char* orig, void* p1, void* p2, cmd_context_t *ctx) {
   uint32_t tid;
   esp_err_t retval;
   retval = halStorageStartTransaction(&tid,20,LOG_TAG);
@@ -658,7 +994,7 @@ esp_err_t cmdDe(char* orig, void* p1, void* p2) {
   halStorageFinishTransaction(tid);
   return retval;
 }
-esp_err_t cmdDl(char* orig, void* p1, void* p2) {
+esp_err_t cmdDl(char* orig, void* p1, void* p2, cmd_context_t *ctx) {
   uint32_t tid;
   esp_err_t retval;
   retval = halStorageStartTransaction(&tid,20,LOG_TAG);
@@ -667,7 +1003,7 @@ esp_err_t cmdDl(char* orig, void* p1, void* p2) {
   halStorageFinishTransaction(tid);
   return retval;
 }
-esp_err_t cmdDn(char* orig, void* p1, void* p2) {
+esp_err_t cmdDn(char* orig, void* p1, void* p2, cmd_context_t *ctx) {
   uint32_t tid;
   uint8_t slotnumber;
   esp_err_t retval;
@@ -682,124 +1018,130 @@ esp_err_t cmdDn(char* orig, void* p1, void* p2) {
   halStorageFinishTransaction(tid);
   return retval;
 }
-esp_err_t cmdNc(char* orig, void* p1, void* p2) {
-  if(requestVBUpdate != VB_SINGLESHOT)
+esp_err_t cmdNc(char* orig, void* p1, void* p2, cmd_context_t *ctx) {
+  if(ctx->vb != VB_SINGLESHOT)
   {
-    handler_hid_delCmd(requestVBUpdate);
-    handler_vb_delCmd(requestVBUpdate);
-    requestVBUpdate = VB_SINGLESHOT;
+    handler_hid_delCmd(ctx->vb);
+    handler_vb_delCmd(ctx->vb);
+    ctx->vb = VB_SINGLESHOT;
   }
   return ESP_OK;
 }
 
 /*++++ Mouthpiece mode handlers ++++*/
-esp_err_t cmdMm(char* orig, void* p1, void* p2) {
-  if(currentCfg == NULL) return ESP_FAIL;
+esp_err_t cmdMm(char* orig, void* p1, void* p2, cmd_context_t *ctx) {
+  if(ctx->cfg == NULL) return ESP_FAIL;
   switch((int32_t)p1)
   {
-    case 0: currentCfg->adc.mode = THRESHOLD; break;
-    case 1: currentCfg->adc.mode = MOUSE; break;
-    case 2: currentCfg->adc.mode = JOYSTICK; break;
-    case 3: currentCfg->adc.mode = NONE; break;
+    case 0: ctx->cfg->adc.mode = THRESHOLD; break;
+    case 1: ctx->cfg->adc.mode = MOUSE; break;
+    case 2: ctx->cfg->adc.mode = JOYSTICK; break;
+    case 3: ctx->cfg->adc.mode = NONE; break;
     default: return ESP_FAIL;
   }
   return ESP_OK;
 }
-esp_err_t cmdSw(char* orig, void* p1, void* p2) {
-  switch(currentCfg->adc.mode)
+esp_err_t cmdSw(char* orig, void* p1, void* p2, cmd_context_t *ctx) {
+  switch(ctx->cfg->adc.mode)
   {
-    case MOUSE: currentCfg->adc.mode = THRESHOLD; break;
-    case THRESHOLD: currentCfg->adc.mode = MOUSE; break;
+    case MOUSE: ctx->cfg->adc.mode = THRESHOLD; break;
+    case THRESHOLD: ctx->cfg->adc.mode = MOUSE; break;
     case JOYSTICK: case NONE: return ESP_FAIL;
   }
   return ESP_OK;
 }
-esp_err_t cmdSr(char* orig, void* p1, void* p2) {
-  if(currentCfg == NULL) return ESP_FAIL;
-  currentCfg->adc.reportraw = 1;
+esp_err_t cmdSr(char* orig, void* p1, void* p2, cmd_context_t *ctx) {
+  if(ctx->cfg == NULL) return ESP_FAIL;
+  //optional parameters: format & decimation ("AT SR [format] [decimation]")
+  //parsed here, because the parser has no optional parameters.
+  long format = RAWSTREAM_ASCII;
+  long decimation = 0;
+  char *p = &orig[strlen(CMD_PREFIX) + CMD_LENGTH];
+  char *e;
+  format = strtol(p,&e,10);
+  if(e == p) format = RAWSTREAM_ASCII;
+  else {
+    p = e;
+    decimation = strtol(p,&e,10);
+    if(e == p) decimation = 0;
+  }
+  if(decimation < 0 || decimation > 255) return ESP_FAIL;
+  if(taskRawStreamConfigure((rawstream_format_t)format,decimation) != ESP_OK) return ESP_FAIL;
+  ctx->cfg->adc.reportraw = 1;
   return ESP_OK;
 }
-esp_err_t cmdEr(char* orig, void* p1, void* p2) {
-  if(currentCfg == NULL) return ESP_FAIL;
-  currentCfg->adc.reportraw = 0;
+esp_err_t cmdEr(char* orig, void* p1, void* p2, cmd_context_t *ctx) {
+  if(ctx->cfg == NULL) return ESP_FAIL;
+  ctx->cfg->adc.reportraw = 0;
   return ESP_OK;
 }
-esp_err_t cmdCa(char* orig, void* p1, void* p2) {
-  if(requestVBUpdate == VB_SINGLESHOT)
+esp_err_t cmdCa(char* orig, void* p1, void* p2, cmd_context_t *ctx) {
+  if(ctx->vb == VB_SINGLESHOT)
   {
     halAdcCalibrate();
   } else {
-    vbaction.cmd = T_CALIBRATE;
+    return cmdContextAddVB(ctx,T_CALIBRATE,NULL);
   }
   return ESP_OK;
 }
 /*++++ joystick command handler ++++*/
-void joystick_helper_axis(uint8_t val1, uint8_t val2, uint16_t v)
+void joystick_helper_axis(cmd_context_t *ctx, uint8_t val1, uint8_t val2, uint16_t v)
 {
-  joystick.cmd[0] = val1;
-  joystick.cmd[1] = v & 0xFF;
-  joystick.cmd[2] = (v & 0xFF00)>>8;
-  joystickR.cmd[0] = val2;
+  cmd_helper_hid(ctx,1,val1,v & 0xFF,(v & 0xFF00)>>8);
+  //release action only if requested
+  if(val2 != 0) cmd_helper_hid(ctx,0,val2,0,0);
 }
 
-esp_err_t cmdJx(char* orig, void* p1, void* p2) {
+esp_err_t cmdJx(char* orig, void* p1, void* p2, cmd_context_t *ctx) {
   //if p2 is set, we need a release action.
-  if(((int32_t) p2) == 0) joystick_helper_axis(0x34,0,(int32_t) p1);
-  else joystick_helper_axis(0x34,0x34,(int32_t) p1);
+  if(((int32_t) p2) == 0) joystick_helper_axis(ctx,0x34,0,(int32_t) p1);
+  else joystick_helper_axis(ctx,0x34,0x34,(int32_t) p1);
   return ESP_OK;
 }
-esp_err_t cmdJy(char* orig, void* p1, void* p2) {
+esp_err_t cmdJy(char* orig, void* p1, void* p2, cmd_context_t *ctx) {
   //if p2 is set, we need a release action.
-  if(((int32_t) p2) == 0) joystick_helper_axis(0x35,0,(int32_t) p1);
-  else joystick_helper_axis(0x35,0x35,(int32_t) p1);
+  if(((int32_t) p2) == 0) joystick_helper_axis(ctx,0x35,0,(int32_t) p1);
+  else joystick_helper_axis(ctx,0x35,0x35,(int32_t) p1);
   return ESP_OK;
 }
-esp_err_t cmdJz(char* orig, void* p1, void* p2) {
+esp_err_t cmdJz(char* orig, void* p1, void* p2, cmd_context_t *ctx) {
   //if p2 is set, we need a release action.
-  if(((int32_t) p2) == 0) joystick_helper_axis(0x36,0,(int32_t) p1);
-  else joystick_helper_axis(0x36,0x36,(int32_t) p1);
+  if(((int32_t) p2) == 0) joystick_helper_axis(ctx,0x36,0,(int32_t) p1);
+  else joystick_helper_axis(ctx,0x36,0x36,(int32_t) p1);
   return ESP_OK;
 }
-esp_err_t cmdJt(char* orig, void* p1, void* p2) {
+esp_err_t cmdJt(char* orig, void* p1, void* p2, cmd_context_t *ctx) {
   //if p2 is set, we need a release action.
-  if(((int32_t) p2) == 0) joystick_helper_axis(0x37,0,(int32_t) p1);
-  else joystick_helper_axis(0x37,0x37,(int32_t) p1);
+  if(((int32_t) p2) == 0) joystick_helper_axis(ctx,0x37,0,(int32_t) p1);
+  else joystick_helper_axis(ctx,0x37,0x37,(int32_t) p1);
   return ESP_OK;
 }
-esp_err_t cmdJs(char* orig, void* p1, void* p2) {
+esp_err_t cmdJs(char* orig, void* p1, void* p2, cmd_context_t *ctx) {
   //if p2 is set, we need a release action.
-  if(((int32_t) p2) == 0) joystick_helper_axis(0x38,0,(int32_t) p1);
-  else joystick_helper_axis(0x38,0x38,(int32_t) p1);
+  if(((int32_t) p2) == 0) joystick_helper_axis(ctx,0x38,0,(int32_t) p1);
+  else joystick_helper_axis(ctx,0x38,0x38,(int32_t) p1);
   return ESP_OK;
 }
-esp_err_t cmdJu(char* orig, void* p1, void* p2) {
+esp_err_t cmdJu(char* orig, void* p1, void* p2, cmd_context_t *ctx) {
   //if p2 is set, we need a release action.
-  if(((int32_t) p2) == 0) joystick_helper_axis(0x39,0,(int32_t) p1);
-  else joystick_helper_axis(0x39,0x39,(int32_t)p1);
+  if(((int32_t) p2) == 0) joystick_helper_axis(ctx,0x39,0,(int32_t) p1);
+  else joystick_helper_axis(ctx,0x39,0x39,(int32_t)p1);
   return ESP_OK;
 }
-esp_err_t cmdJp(char* orig, void* p1, void* p2) {
-  joystick.cmd[0] = 0x31;
-  joystick.cmd[1] = ((int32_t) p1)&0x7F; //high bit determines it is a joystick hat
-  return ESP_OK;
+esp_err_t cmdJp(char* orig, void* p1, void* p2, cmd_context_t *ctx) {
+  return cmd_helper_hid(ctx,1,0x31,((int32_t) p1)&0x7F,0); //high bit determines it is a joystick hat
 }
-esp_err_t cmdJc(char* orig, void* p1, void* p2) {
-  joystick.cmd[0] = 0x30;
-  joystick.cmd[1] = ((int32_t) p1)&0x7F; //high bit determines it is a joystick hat
-  return ESP_OK;
+esp_err_t cmdJc(char* orig, void* p1, void* p2, cmd_context_t *ctx) {
+  return cmd_helper_hid(ctx,1,0x30,((int32_t) p1)&0x7F,0); //high bit determines it is a joystick hat
 }
-esp_err_t cmdJr(char* orig, void* p1, void* p2) {
-  joystick.cmd[0] = 0x32;
-  joystick.cmd[1] = ((int32_t) p1)&0x7F; //high bit determines it is a joystick hat
-  return ESP_OK;
+esp_err_t cmdJr(char* orig, void* p1, void* p2, cmd_context_t *ctx) {
+  return cmd_helper_hid(ctx,1,0x32,((int32_t) p1)&0x7F,0); //high bit determines it is a joystick hat
 }
-esp_err_t cmdJh(char* orig, void* p1, void* p2) {
-  joystick.cmd[0] = 0x32;
-  if(((int32_t) p1) == -1) joystick.cmd[1] = 0x8F;
-  else joystick.cmd[1] = (((int32_t) p1)&0x7F) | 0x80; //high bit determines it is a joystick hat
-  return ESP_OK;
+esp_err_t cmdJh(char* orig, void* p1, void* p2, cmd_context_t *ctx) {
+  if(((int32_t) p1) == -1) return cmd_helper_hid(ctx,1,0x32,0x8F,0);
+  else return cmd_helper_hid(ctx,1,0x32,(((int32_t) p1)&0x7F) | 0x80,0); //high bit determines it is a joystick hat
 }
-esp_err_t cmdIr(char* orig, void* p1, void* p2) {
+esp_err_t cmdIr(char* orig, void* p1, void* p2, cmd_context_t *ctx) {
   //trigger record
   if(fct_infrared_record((char*)p1,1) == ESP_OK)
   {
@@ -807,22 +1149,20 @@ esp_err_t cmdIr(char* orig, void* p1, void* p2) {
     return ESP_OK;
   } else return ESP_FAIL;
 }
-esp_err_t cmdIp(char* orig, void* p1, void* p2) {
-  if(requestVBUpdate == VB_SINGLESHOT)
+esp_err_t cmdIp(char* orig, void* p1, void* p2, cmd_context_t *ctx) {
+  if(ctx->vb == VB_SINGLESHOT)
   {
     fct_infrared_send((char*)p1);
   } else {
     //set action type
-    vbaction.cmd = T_SENDIR;
-    vbaction.cmdparam = malloc(strnlen((char*)p1,ATCMD_LENGTH)+1);
-    strncpy(vbaction.cmdparam,(char*)p1,strnlen((char*)p1,ATCMD_LENGTH));
+    return cmdContextAddVB(ctx,T_SENDIR,(char*)p1);
   }
   return ESP_OK;
 }
-esp_err_t cmdIh(char* orig, void* p1, void* p2) {
+esp_err_t cmdIh(char* orig, void* p1, void* p2, cmd_context_t *ctx) {
   return ESP_OK;
 }
-esp_err_t cmdIc(char* orig, void* p1, void* p2) {
+esp_err_t cmdIc(char* orig, void* p1, void* p2, cmd_context_t *ctx) {
   uint32_t tid;
   if(halStorageStartTransaction(&tid,20,LOG_TAG) == ESP_OK)
   {
@@ -844,7 +1184,7 @@ esp_err_t cmdIc(char* orig, void* p1, void* p2) {
   }
   return ESP_OK;
 }
-esp_err_t cmdIw(char* orig, void* p1, void* p2) {
+esp_err_t cmdIw(char* orig, void* p1, void* p2, cmd_context_t *ctx) {
   uint32_t tid;
   if(halStorageStartTransaction(&tid,20,LOG_TAG) == ESP_OK)
   {
@@ -858,7 +1198,7 @@ esp_err_t cmdIw(char* orig, void* p1, void* p2) {
   }
   return ESP_OK;
 }
-esp_err_t cmdIl(char* orig, void* p1, void* p2) {
+esp_err_t cmdIl(char* orig, void* p1, void* p2, cmd_context_t *ctx) {
   uint32_t tid;
   if(halStorageStartTransaction(&tid,20,LOG_TAG) == ESP_OK)
   {
@@ -866,7 +1206,6 @@ esp_err_t cmdIl(char* orig, void* p1, void* p2) {
     uint8_t printed = 0;
     char name[SLOTNAME_LENGTH+1];
     char output[SLOTNAME_LENGTH+10];
-    halStorageGetNumberOfIRCmds(tid,&count);
     if(halStorageGetNumberOfIRCmds(tid,&count) == ESP_OK)
     {
       for(uint8_t i = 0; i<100;i++)
@@ -896,7 +1235,7 @@ esp_err_t cmdIl(char* orig, void* p1, void* p2) {
   }
   return ESP_FAIL;
 }
-esp_err_t cmdIx(char* orig, void* p1, void* p2) {
+esp_err_t cmdIx(char* orig, void* p1, void* p2, cmd_context_t *ctx) {
   uint32_t tid;
   if(halStorageStartTransaction(&tid,20,LOG_TAG) == ESP_OK)
   {
@@ -917,7 +1256,7 @@ esp_err_t cmdIx(char* orig, void* p1, void* p2) {
 const onecmd_t commands[] = {
   // general commands
   {"ID", {PARAM_NONE,PARAM_NONE},{0,0},{0,0},cmdId,0,NOCAST},
-  {"BM", {PARAM_NUMBER,PARAM_NONE},{0,0},{VB_MAX-1,0},cmdBm,0,NOCAST},
+  {"BM", {PARAM_NUMBER,PARAM_NONE},{0,0},{VB_MAX_BINDABLE-1,0},cmdBm,0,NOCAST},
   {"BL", {PARAM_NUMBER,PARAM_NONE},{0,0},{1,0},NULL,offsetof(CMD_TARGET_TYPE,button_learn),UINT8},
   {"MA", {PARAM_STRING,PARAM_NONE},{5,0},{ATCMD_LENGTH-strlen(CMD_PREFIX)-CMD_LENGTH,0},cmdMa,0,NOCAST},
   {"WA", {PARAM_NUMBER,PARAM_NONE},{0,0},{30000,0},cmdWa,0,NOCAST},
@@ -925,10 +1264,22 @@ const onecmd_t commands[] = {
   {"KL", {PARAM_NUMBER,PARAM_NONE},{0,0},{24,0},NULL,offsetof(CMD_TARGET_TYPE,locale),UINT8},
   {"BT", {PARAM_NUMBER,PARAM_NONE},{0,0},{3,0},cmdBt,0,NOCAST},
   {"TT", {PARAM_NUMBER,PARAM_NONE},{100,0},{5000,0},cmdTt,0,NOCAST},
-  {"AP", {PARAM_NUMBER,PARAM_NONE},{1,0},{500,0},cmdAp,0,NOCAST},
-  {"AR", {PARAM_NUMBER,PARAM_NONE},{1,0},{500,0},cmdAr,0,NOCAST},
-  {"AI", {PARAM_NUMBER,PARAM_NONE},{1,0},{500,0},cmdAi,0,NOCAST},
+  {"AP", {PARAM_NUMBER,PARAM_NONE},{0,0},{500,0},cmdAp,0,NOCAST},
+  {"AR", {PARAM_NUMBER,PARAM_NONE},{0,0},{500,0},cmdAr,0,NOCAST},
+  {"AI", {PARAM_NUMBER,PARAM_NONE},{0,0},{500,0},cmdAi,0,NOCAST},
+  {"DM", {PARAM_NUMBER,PARAM_NONE},{0,0},{1,0},NULL,offsetof(CMD_TARGET_TYPE,debounce_engine),UINT8},
+  {"DS", {PARAM_NUMBER,PARAM_NONE},{0,0},{1,0},cmdDs,0,NOCAST},
+  {"CH", {PARAM_STRING,PARAM_NONE},{1,0},{ATCMD_LENGTH-strlen(CMD_PREFIX)-CMD_LENGTH,0},cmdCh,0,NOCAST},
+  {"CW", {PARAM_NUMBER,PARAM_NONE},{0,0},{5000,0},NULL,offsetof(CMD_TARGET_TYPE,chord_window),UINT16},
+  {"GT", {PARAM_NUMBER,PARAM_NONE},{0,0},{5000,0},NULL,offsetof(CMD_TARGET_TYPE,gesture_tap),UINT16},
+  {"GD", {PARAM_NUMBER,PARAM_NONE},{0,0},{5000,0},NULL,offsetof(CMD_TARGET_TYPE,gesture_doubletap),UINT16},
+  {"GL", {PARAM_NUMBER,PARAM_NONE},{0,0},{10000,0},NULL,offsetof(CMD_TARGET_TYPE,gesture_longpress),UINT16},
+  {"GR", {PARAM_NUMBER,PARAM_NONE},{0,0},{5000,0},NULL,offsetof(CMD_TARGET_TYPE,gesture_repeat),UINT16},
+  {"MR", {PARAM_NUMBER,PARAM_NONE},{0,0},{1,0},NULL,offsetof(CMD_TARGET_TYPE,macro_release),UINT8},
   {"FR", {PARAM_NONE,PARAM_NONE},{0,0},{0,0},cmdFr,0,NOCAST},
+  {"MI", {PARAM_NONE,PARAM_NONE},{0,0},{0,0},cmdMi,0,NOCAST},
+  {"SI", {PARAM_NONE,PARAM_NONE},{0,0},{0,0},cmdSi,0,NOCAST},
+  {"SB", {PARAM_NUMBER,PARAM_NONE},{0,0},{65535,0},cmdSb,0,NOCAST},
   {"FB", {PARAM_NUMBER,PARAM_NONE},{0,0},{3,0},NULL,offsetof(CMD_TARGET_TYPE,feedback),UINT8},
   {"PW", {PARAM_STRING,PARAM_NONE},{8,0},{32,0},cmdPw,0,NOCAST},
   {"FW", {PARAM_NUMBER,PARAM_NONE},{0,0},{1,0},cmdFw,0,NOCAST},
@@ -1009,8 +1360,38 @@ const onecmd_t commands[] = {
   {"IT", {PARAM_NUMBER,PARAM_NONE},{2,0},{100,0},NULL,offsetof(CMD_TARGET_TYPE,irtimeout),UINT8},
   {"IL", {PARAM_NONE,PARAM_NONE},{0,0},{0,0},cmdIl,0,NOCAST},
   {"IX", {PARAM_NUMBER,PARAM_NONE},{1,0},{99,0},cmdIx,0,NOCAST},
+  {"IS", {PARAM_NONE,PARAM_NONE},{0,0},{0,0},cmdIs,0,NOCAST},
 };
 
+/** @brief Handlers, which change the config or the parse context only
+ * 
+ * All other handlers have side effects, except they added their actions
+ * to a VB (AT BM before).
+ * @see cmdHasSideEffect */
+static const cmd_handler cmdConfigOnly[] = {
+  cmdBm, cmdWa, cmdRo, cmdBt, cmdTt, cmdAp, cmdAr, cmdAi, cmdCh, cmdWs,
+  cmdNc, cmdMm, cmdSw, cmdEr, cmdIh
+};
+
+/** @brief Check if an executed command has side effects
+ * 
+ * A command without side effects is fully contained in the config &
+ * the VB commands, so it can be stored in a slot image.
+ * @param handler Handler of the command, NULL if a config field was set
+ * @param ctx Parse context after the handler
+ * @return 1 if this command has side effects, 0 otherwise */
+static uint8_t cmdHasSideEffect(cmd_handler handler, cmd_context_t *ctx)
+{
+  if(handler == NULL) return 0;
+  for(uint8_t i = 0; i<sizeof(cmdConfigOnly)/sizeof(cmd_handler); i++)
+  {
+    if(handler == cmdConfigOnly[i]) return 0;
+  }
+  //actions are assigned to a VB (sent immediately otherwise)
+  if(ctx->vb != VB_SINGLESHOT && (ctx->count != 0 || ctx->dispatched != 0)) return 0;
+  return 1;
+}
+
 #if 0
 parserstate_t doKeyboardParsing(uint8_t *cmdBuffer, int length)
 {
@@ -1352,6 +1733,55 @@ parserstate_t doKeyboardParsing(uint8_t *cmdBuffer, int length)
 }
 
 #endif
+/** @brief Check if all queued commands are processed
+ * 
+ * If the queue is empty, a (coalesced) config update is requested
+ * and SYSTEM_EMPTY_CMD_QUEUE is set. */
+static void cmdCheckEmptyQueue(void)
+{
+  //if we have processed all commands (queue is empty),
+  //we set the corresponding flag
+  //check if there are still elements in the queue
+  if(uxQueueMessagesWaiting(halSerialATCmds) == 0)
+  {
+    //no more commands, ready to update config (coalesced, only changed sections)
+    if(configRequestUpdate() != ESP_OK) ESP_LOGE(LOG_TAG,"Error updating general config!");
+    else ESP_LOGD(LOG_TAG,"requesting config update");
+    //yeah, processed everything, tell it to the whole firmware :-)
+    xEventGroupSetBits(systemStatus,SYSTEM_EMPTY_CMD_QUEUE);
+  }
+}
+
+/** @brief Process the begin & end marker of a slot file
+ * 
+ * On the begin marker, the serial context is reset (no AT BM of the
+ * slot before is used) & side effects are counted from now on.
+ * On the end marker, the count is saved and SYSTEM_SLOT_PARSED is set.
+ * Each following command is counted as well, it might change the config
+ * before the image of this slot is created.
+ * @see CMD_SLOT_BEGIN
+ * @see CMD_SLOT_END
+ * @param data Received line
+ * @return ESP_OK if the line is a marker, ESP_FAIL otherwise */
+static esp_err_t cmdSlotMarker(char *data)
+{
+  if(strcmp(data,CMD_SLOT_BEGIN) == 0)
+  {
+    cmdContextInit(&serialContext,configGetCurrent());
+    slotParsed = 0;
+    xEventGroupClearBits(systemStatus,SYSTEM_SLOT_PARSED);
+    return ESP_OK;
+  }
+  if(strcmp(data,CMD_SLOT_END) == 0)
+  {
+    slotSideEffects = serialContext.sideEffects;
+    slotParsed = 1;
+    xEventGroupSetBits(systemStatus,SYSTEM_SLOT_PARSED);
+    return ESP_OK;
+  }
+  return ESP_FAIL;
+}
+
 void task_commands(void *params)
 {
   uint8_t queuesready = checkqueues();
@@ -1369,27 +1799,27 @@ void task_commands(void *params)
       //if no command received, try again...
       if(received == -1 || commandBuffer == NULL) continue;
       
-      //before we start parsing anything, we need to be sure
-      //all global commands are cleared.
-      memset(&mouse,0,sizeof(hid_cmd_t));
-      memset(&mouseR,0,sizeof(hid_cmd_t));
-      memset(&mouseD,0,sizeof(hid_cmd_t));
-      memset(&keyboard,0,sizeof(hid_cmd_t));
-      memset(&keyboardR,0,sizeof(hid_cmd_t));
-      memset(&joystick,0,sizeof(hid_cmd_t));
-      memset(&joystickR,0,sizeof(hid_cmd_t));
-      memset(&general,0,sizeof(hid_cmd_t));
-      memset(&vbaction,0,sizeof(vb_cmd_t));
+      //begin & end of a slot file are not parsed
+      if(cmdSlotMarker((char*)commandBuffer) == ESP_OK)
+      {
+        free(commandBuffer);
+        cmdCheckEmptyQueue();
+        continue;
+      }
       
       //to be sure, we want a valid cfg pointer...
-      currentCfg = configGetCurrent();
-      if(currentCfg == NULL)
+      serialContext.cfg = configGetCurrent();
+      if(serialContext.cfg == NULL)
       {
         ESP_LOGE(LOG_TAG,"Cannot proceed with parsing, config is NULL");
+        free(commandBuffer);
         continue;
       }
+      //the config is not the result of the slot file anymore
+      if(slotParsed) slotSideEffects++;
+      
       //now send it to the parser and validate result.
-      cmd_retval retvalparser = cmdParser((char*)commandBuffer,currentCfg);
+      cmd_retval retvalparser = cmdParser((char*)commandBuffer,&serialContext);
       
       //take actions according to return value
       //we need to clean up, so we cannot stop after this switch
@@ -1422,55 +1852,15 @@ void task_commands(void *params)
           break;
       }
       
-      //do further things only if successful:
-      //1.) we need to check if some handler modified any of
-      //the hid_cmd_t or vb_cmd_t structs (mouse,general,keyboard,
-      //joystick,vbaction).
-      //2.) If yes, we need to send these structs to the corresponding
-      //queues. We need to do this always, because these structs are used
-      //by all handlers.
-      //3.) the generalConfig_t struct might be modified too. We
-      //call configUpdate(), but only if there are no more commands
-      //remaining.
-      if(retvalparser == SUCCESS)
-      {
-        //now send all VBs. They are checked for data in the helper.
-        sendVBCmd(&vbaction,requestVBUpdate | (0x80),commandBuffer,1);
-        //sendVBCmd(&generalR,requestVBUpdate,(char*)commandBuffer); //currently unused
-        
-        //HID related
-        sendHIDCmd(&mouse,requestVBUpdate | (0x80),commandBuffer,1);
-        sendHIDCmd(&mouseD,requestVBUpdate | (0x80),commandBuffer,1);
-        sendHIDCmd(&mouseR,requestVBUpdate,commandBuffer,1);
-        sendHIDCmd(&joystick,requestVBUpdate | (0x80),commandBuffer,1);
-        sendHIDCmd(&joystickR,requestVBUpdate,commandBuffer,1);
-        //we need to reset requestVBUpdate to VB_SINGLESHOT
-        //in the case the processed command here was NOT "AT BM"
-        //currently no better solution as comparing the command.
-        if(requestBM != 0)
-        {
-          ESP_LOGD(LOG_TAG,"Got an BM request, not resetting VB now.");
-          requestBM = 0;
-        } else {
-          ESP_LOGD(LOG_TAG,"Resetting to VB_SINGLESHOT");
-          requestVBUpdate = VB_SINGLESHOT;
-        }
-      }
+      //send all actions, which were generated by the handler(s) of this
+      //command (either directly or added to the VB). If the parser was
+      //not successful, they are discarded.
+      cmdContextFinish(&serialContext,retvalparser);
       
       //free used buffer (MANDATORY here!), only if valid
       if(commandBuffer != NULL) free(commandBuffer);
 
-      //if we have processed all commands (queue is empty),
-      //we set the corresponding flag
-      //check if there are still elements in the queue
-      if(uxQueueMessagesWaiting(halSerialATCmds) == 0)
-      {
-        //no more commands, ready to update config
-        if(configUpdate(20) != ESP_OK) ESP_LOGE(LOG_TAG,"Error updating general config!");
-        else ESP_LOGD(LOG_TAG,"requesting config update");
-        //yeah, processed everything, tell it to the whole firmware :-)
-        xEventGroupSetBits(systemStatus,SYSTEM_EMPTY_CMD_QUEUE);
-      }
+      cmdCheckEmptyQueue();
     } else {
       //check again for initialized queues
       ESP_LOGE(LOG_TAG,"Queues uninitialized, rechecking in 1s");
@@ -1641,25 +2031,67 @@ void storeSlot(char* slotname)
   if(currentcfg->usb_active != 0) btret+=1;
   sprintf(outputstring,"AT BT %d\n",btret);
   halStorageStore(tid,outputstring,250);
+  
+  sprintf(outputstring,"AT DM %d\n",currentcfg->debounce_engine);
+  halStorageStore(tid,outputstring,250);
+  
+  //chords: window & one line for each used chord ("AT CH <chord> <vb> <vb> ...")
+  sprintf(outputstring,"AT CW %d\n",currentcfg->chord_window);
+  halStorageStore(tid,outputstring,250);
+  for(uint8_t j = 0; j<VB_CHORD_COUNT; j++)
+  {
+    if(currentcfg->chord_mask[j] == 0) continue;
+    int len = sprintf(outputstring,"AT CH %d",j);
+    for(uint8_t k = 0; k<VB_MAX; k++)
+    {
+      if(currentcfg->chord_mask[j] & (1<<k)) len += sprintf(&outputstring[len]," %d",k);
+    }
+    sprintf(&outputstring[len],"\n");
+    halStorageStore(tid,outputstring,250);
+  }
+  
+  //gesture thresholds
+  sprintf(outputstring,"AT GT %d\nAT GD %d\nAT GL %d\nAT GR %d\n", \
+    currentcfg->gesture_tap,currentcfg->gesture_doubletap, \
+    currentcfg->gesture_longpress,currentcfg->gesture_repeat);
+  halStorageStore(tid,outputstring,250);
+  
+  sprintf(outputstring,"AT MR %d\n",currentcfg->macro_release);
+  halStorageStore(tid,outputstring,250);
+  
+  //individual anti-tremor times, each one with its own "AT BM"
+  for(uint8_t j = 0; j<currentcfg->debounce_vb_count; j++)
+  {
+    vb_param_t *p = &currentcfg->debounce_vb[j];
+    int len = 0;
+    if(p->press) len += sprintf(&outputstring[len],"AT BM %02d\nAT AP %d\n",p->vb,p->press);
+    if(p->release) len += sprintf(&outputstring[len],"AT BM %02d\nAT AR %d\n",p->vb,p->release);
+    if(p->idle) len += sprintf(&outputstring[len],"AT BM %02d\nAT AI %d\n",p->vb,p->idle);
+    halStorageStore(tid,outputstring,250);
+  }
       
   //iterate over all possible VBs.
-  for(uint8_t j = 0; j<VB_MAX; j++)
+  for(uint16_t j = 0; j<VB_MAX_BINDABLE; j++)
   {
-    //print AT BM (button mode) command first
-    sprintf(outputstring,"AT BM %02d\n",j);
-    ///@todo remove this logging tag
-    ESP_LOGD(LOG_TAG,"AT BM %02d",j);
-    halStorageStore(tid,outputstring,250);
+    if(j == VB_SINGLESHOT) continue;
     //try to parse command either via HID or VB task
     if(handler_hid_getAT(outputstring,j) != ESP_OK)
     {
       if(handler_vb_getAT(outputstring,j) != ESP_OK)
       {
+        //chords & gestures are stored only if they are used
+        if(j >= VB_MAX) continue;
         //if no command was found, this usually means this one is not used.
         ESP_LOGD(LOG_TAG,"Unused VB, neither HID nor VB task found AT string");
         sprintf(outputstring,"AT NC");
       }
     }
+    //print AT BM (button mode) command first
+    char bm[12];
+    sprintf(bm,"AT BM %02d\n",j);
+    ///@todo remove this logging tag
+    ESP_LOGD(LOG_TAG,"AT BM %02d",j);
+    halStorageStore(tid,bm,250);
     //store reverse parsed at string
     halStorageStore(tid,outputstring,250);
     halStorageStore(tid,"\n",250);
@@ -1669,6 +2101,14 @@ void storeSlot(char* slotname)
 
   //release storage
   free(outputstring);
+  //the precompiled image is installed on the next load of this slot
+  uint8_t *image;
+  uint32_t size;
+  if(halStorageCreateImage(tid,slotnumber,&image,&size) != ESP_OK || \
+    halStorageStoreImage(tid,slotnumber,image,size) != ESP_OK)
+  {
+    ESP_LOGW(LOG_TAG,"Cannot store image of slot %d",slotnumber);
+  }
   halStorageFinishTransaction(tid);
 }
 
@@ -1685,6 +2125,8 @@ esp_err_t taskCommandsInit(void)
 {
   //set log level to given log level
   esp_log_level_set(LOG_TAG,LOG_LEVEL_CMDPARSER);
+  //init parse context for the serial interface
+  cmdContextInit(&serialContext,configGetCurrent());
   //create receive task
   xTaskCreate(task_commands, "cmdtask", TASK_COMMANDS_STACKSIZE, NULL, TASK_COMMANDS_PRIORITY, &currentCommandTask);
   if(currentCommandTask == NULL)
@@ -1709,6 +2151,11 @@ esp_err_t taskCommandsRestart(void)
   else return ESP_FAIL;
 }
 
+uint32_t taskCommandsGetSlotSideEffects(void)
+{
+  return slotSideEffects;
+}
+
 
 /** @brief Main parser
  * 
@@ -1722,10 +2169,15 @@ esp_err_t taskCommandsRestart(void)
  * * Validating input values against the given ranges
  * * Executing the handler (if it is != NULL) or modifying the target struct
  * 
+ * Actions generated by the handlers are collected in the given context,
+ * call cmdContextFinish afterwards to send them.
+ * The parser itself uses no global state, so it can be used by different
+ * tasks in parallel (each one with its own context).
+ * 
  * @note This is part of an external project, see https://gitlab.com/ba.1150/cmd_parser_esp32
  * @return See cmd_retval. SUCCESS on success.
  */
-cmd_retval cmdParser(char * data, generalConfig_t *target)
+cmd_retval cmdParser(char * data, cmd_context_t *ctx)
 {
     uint32_t len; //length of input string, 
     esp_err_t retval = ESP_FAIL; //return value of handler
@@ -1734,7 +2186,10 @@ cmd_retval cmdParser(char * data, generalConfig_t *target)
     
     //1.) check for valid pointers
     if(data == NULL) return ESP_FAIL;
-    if(target == NULL) return POINTERERROR;
+    if(ctx == NULL || ctx->cfg == NULL) return POINTERERROR;
+    generalConfig_t *target = ctx->cfg;
+    //actions generated by handlers will reference this command
+    ctx->orig = data;
     
     //2.) check if this string is terminated
     //iterate over the string, as long as we don't reach max size or
@@ -1912,13 +2367,16 @@ cmd_retval cmdParser(char * data, generalConfig_t *target)
                     if(commands[id].offset > sizeof(CMD_TARGET_TYPE)-length) retval = ESP_FAIL;
                     else memcpy(&(((uint8_t *)target)[commands[id].offset]),&paramFinal[0],length);
                 }
-            } else retval = commands[id].handler(data,paramFinal[0],paramFinal[1]);
+            } else retval = commands[id].handler(data,paramFinal[0],paramFinal[1],ctx);
             
             //d.) cleanup (free allocated strings)
             if(commands[id].ptype[0] == PARAM_STRING && paramFinal[0] != NULL) free(paramFinal[0]);
             if(commands[id].ptype[1] == PARAM_STRING && paramFinal[1] != NULL) free(paramFinal[1]);
             matchedcmds++;
             
+            //a failed handler might have done a part of its work, count it as well
+            if(cmdHasSideEffect(commands[id].handler,ctx)) ctx->sideEffects++;
+            
             //stop if the handler was not successful
             if((commands[id].handler != NULL) && (retval != ESP_OK)) return HANDLERERROR;
             //or if had some kind of pointer error
@@ -28,9 +28,14 @@
  * 
  * By issueing an <b>AT BM</b> command, the next issued AT command
  * will be assigned to a virtual button. This is done via setting
- * the requestVBUpdate variable to the VB number. One time only commands
+ * the VB number in the parse context (cmd_context_t). One time only commands
  * (without AT BM) are defined as VB==VB_SINGLESHOT
  * 
+ * Command handlers do not send any HID or VB commands directly, they
+ * append their actions to the output list of the parse context. After
+ * parsing, cmdContextFinish sends them either directly (singleshot) or
+ * assigns them to the VB.
+ * 
  * @see VB_SINGLESHOT
  * @see hal_serial
  * @see atcmd_api
@@ -55,6 +60,8 @@
 #include <inttypes.h>
 
 #include "hal_serial.h"
+#include "task_rawstream.h"
+#include "task_debouncer.h"
 #include "fct_infrared.h"
 #include "fct_macros.h"
 #include "handler_hid.h"
@@ -83,6 +90,16 @@ esp_err_t taskCommandsInit(void);
  * */
 esp_err_t taskCommandsRestart(void);
 
+/** @brief Get the count of commands with side effects of the last slot file
+ * 
+ * Valid after SYSTEM_SLOT_PARSED is set. Each command after the end
+ * marker is counted as well (the config might differ from the slot file).
+ * @see cmd_context_t
+ * @see CMD_SLOT_END
+ * @return Count of commands with side effects between CMD_SLOT_BEGIN & CMD_SLOT_END,
+ * plus all commands after CMD_SLOT_END */
+uint32_t taskCommandsGetSlotSideEffects(void);
+
 /*++++ following parts are used from the cmd_parser project */
 
 
@@ -93,12 +110,84 @@ esp_err_t taskCommandsRestart(void);
 ///Maximum length of a command (including parameters, prefix and command itself -> full line)
 #define CMD_MAXLENGTH   ATCMD_LENGTH
 
+/** @brief Maximum count of actions, which are collected in a parse context
+ * before they are sent.
+ * @note If a command generates more actions, the list is sent in between
+ * (order is kept). */
+#define CMD_CONTEXT_ACTIONS 8
+
+/** @brief Type of an action in the output list of a parse context */
+typedef enum cmd_actiontype {
+  CMD_ACTION_HID, /** @brief HID command (hid_cmd_t) */
+  CMD_ACTION_VB /** @brief VB command (vb_cmd_t) */
+} cmd_actiontype_t;
+
+/** @brief One action, generated by a command handler */
+typedef struct cmd_action {
+  /** @brief Type of this action */
+  cmd_actiontype_t type;
+  /** @brief 1 for a press action, 0 for a release action (VB mode) */
+  uint8_t press;
+  /** @brief Command, depending on type */
+  union {
+    hid_cmd_t hid;
+    vb_cmd_t vbcmd;
+  };
+} cmd_action_t;
+
+/** @brief Receiver for actions of a parse context (instead of the handlers)
+ * @param arg Argument, as set in the context (sinkArg)
+ * @param action Action, the receiver takes over the parameter string */
+typedef void(*cmd_sink)(void *arg, cmd_action_t *action);
+
+/** @brief Parse context for AT commands
+ * 
+ * Contains all state of the command parser, which is necessary between
+ * two commands (VB mode via AT BM) and the output list of generated
+ * actions. Each task which parses commands uses its own context.
+ * @see cmdContextInit
+ * @see cmdParser
+ * @see cmdContextFinish */
+typedef struct cmd_context {
+  /** @brief Config, which is modified by the commands */
+  generalConfig_t *cfg;
+  /** @brief Currently used virtual button number.
+   * 
+   * If set to a value != VB_SINGLESHOT, any following AT command
+   * will be assigned to this virtual button.
+   * @see VB_SINGLESHOT */
+  uint16_t vb;
+  /** @brief If != 0, the last command was AT BM. vb is not reset to
+   * VB_SINGLESHOT for the next command. */
+  uint8_t bm;
+  /** @brief Currently parsed command, stored with the first action */
+  char *orig;
+  /** @brief Count of already sent actions of the current command */
+  uint8_t dispatched;
+  /** @brief Count of actions in the output list */
+  uint8_t count;
+  /** @brief Output list of actions */
+  cmd_action_t actions[CMD_CONTEXT_ACTIONS];
+  /** @brief If set, actions are passed to this function instead of the
+   * handlers (used by the macro compiler) */
+  cmd_sink sink;
+  /** @brief Argument for sink */
+  void *sinkArg;
+  /** @brief Count of commands with side effects
+   * 
+   * These commands neither change the config nor add actions to a VB
+   * (e.g. HID commands without AT BM, storage access, statistics).
+   * A slot file with side effects cannot be stored as image. */
+  uint32_t sideEffects;
+} cmd_context_t;
+
 /** @brief Handler function pointer for a recognized command
  * @note First parameter is the full received string
  * @note Although we have void* parameters,
  * the given data is either an (int32_t) or a (char*), depending
- * on given parameter types.*/
-typedef esp_err_t(*cmd_handler)(char* , void* , void* );
+ * on given parameter types.
+ * @note Last parameter is the parse context, actions are added there.*/
+typedef esp_err_t(*cmd_handler)(char* , void* , void* , cmd_context_t*);
 
 /** @brief Type of parameter for a command */
 typedef enum ParamType {
@@ -162,6 +251,49 @@ typedef enum ParserTargetType {
   /** Parse data to target int32_t */
 } cmd_typecast;
 
+/** @brief Initialize a parse context
+ * @param ctx Context to initialize (singleshot mode, empty output list)
+ * @param cfg Config which is modified by the commands */
+void cmdContextInit(cmd_context_t *ctx, generalConfig_t *cfg);
+
+/** @brief Add a HID action to the output list of a parse context
+ * @param ctx Parse context
+ * @param cmd HID command (copied, vb/atoriginal are set on sending)
+ * @param press 1 for a press action, 0 for a release action
+ * @return ESP_OK on success, ESP_FAIL otherwise */
+esp_err_t cmdContextAddHID(cmd_context_t *ctx, hid_cmd_t *cmd, uint8_t press);
+
+/** @brief Add a VB action to the output list of a parse context
+ * @param ctx Parse context
+ * @param type Type of VB command
+ * @param param Parameter string (copied), might be NULL
+ * @return ESP_OK on success, ESP_FAIL otherwise */
+esp_err_t cmdContextAddVB(cmd_context_t *ctx, vb_cmd_type_t type, char *param);
+
+/** @brief Compile a macro to a list of operations
+ * 
+ * The macro (AT commands separated by ';') is split into commands.
+ * AT WA is compiled to a wait operation, commands which only generate
+ * HID/VB actions (mouse, keyboard, joystick, AT LO/NE/CA/IP) are parsed
+ * once and compiled to these actions. All other commands are kept as
+ * text and are sent to the command parser on execution.
+ * @note Commands are parsed with the given config (e.g. wheel step size,
+ * keyboard locale), later changes of the config are not used.
+ * @see fct_macros.h
+ * @param macro Macro string
+ * @param cfg Config used for parsing
+ * @return Compiled macro (malloc'ed, terminated by MACRO_OP_END), NULL on errors */
+uint8_t *cmdMacroCompile(char *macro, generalConfig_t *cfg);
+
+/** @brief Finish the current command of a parse context
+ * 
+ * If the parser was successful, all collected actions are sent
+ * (singleshot) or assigned to the VB and VB mode is reset (except
+ * after AT BM). Otherwise, the actions are discarded.
+ * @param ctx Parse context
+ * @param result Return value of cmdParser */
+void cmdContextFinish(cmd_context_t *ctx, cmd_retval result);
+
 /** @brief Main parser
  * 
  * This parser is called with one finished (and 0-terminated line).
@@ -174,9 +306,14 @@ typedef enum ParserTargetType {
  * * Validating input values against the given ranges
  * * Executing the handler (if it is != NULL) or modifying the target struct
  * 
+ * Actions generated by the handlers are collected in the given context,
+ * call cmdContextFinish afterwards to send them.
+ * 
+ * @param data Command line, 0-terminated
+ * @param ctx Parse context, ctx->cfg is the target struct
  * @return See cmd_retval. SUCCESS on success.
  */
-cmd_retval cmdParser(char * data, generalConfig_t *target);
+cmd_retval cmdParser(char * data, cmd_context_t *ctx);
 
 /** @brief Type for one new command
  * 
@@ -28,6 +28,10 @@
  * is registered, a timer (esp_timer) will be started. On a finished
  * debounce event, the corresponding event is sent to the system event
  * loop.
+ * Each VB owns one timer, which is created on startup and reused for
+ * each edge. No memory is allocated while debouncing.
+ * Alternatively (selected per slot), all VBs are debounced by one
+ * periodic tick, see DEBOUNCE_ENGINE_TICK.
  * 
  * The debouncing itself can be controlled via following variables
  * (these settings are located in the global config):
@@ -40,6 +44,11 @@
  * If there is no setting, the device's default will be used. If the
  * there is no default setting for this device, a hardcoded debounce time
  * of DEBOUNCETIME_MS is used.
+ * This fallback is resolved once for each new config, the debouncer
+ * reads only the resulting table (debouncer_times_t).
+ * 
+ * For tuning the debounce times, statistics are recorded for each VB
+ * (see debouncer_stats_t, AT DS).
  * 
  * @note For each VB, a debouncer_cfg_t element will be used. The size
  * of this array is determined by VB_MAX. Please set this define accordingly!
@@ -109,6 +118,185 @@ esp_err_t startTimer(debouncer_cfg_t *cfg, uint16_t debounceTime);
  */
 debouncer_cfg_t xTimers[VB_MAX];
 
+/** @brief Tick engine: input state of each VB (1 is pressed)
+ * @note Written by the debouncer task, read by the tick callback. Access only atomic. */
+static uint32_t tickIn[DEBOUNCE_MASK_WORDS];
+/** @brief Tick engine: debounced output state of each VB (1 is pressed) */
+static uint32_t tickOut[DEBOUNCE_MASK_WORDS];
+/** @brief Tick engine: debounce counter is running for this VB */
+static uint32_t tickPending[DEBOUNCE_MASK_WORDS];
+/** @brief Tick engine: deadtime counter is running for this VB */
+static uint32_t tickDead[DEBOUNCE_MASK_WORDS];
+/** @brief Tick engine: remaining ticks of debounce or deadtime for each VB */
+static uint16_t tickCounter[VB_MAX];
+/** @brief Tick engine: periodic timer */
+static esp_timer_handle_t tickHandle = NULL;
+/** @brief Currently active debouncer engine */
+static uint8_t activeEngine = DEBOUNCE_ENGINE_TIMER;
+
+/** @brief Debounce statistics of each VB
+ * @see taskDebouncerGetStats */
+static debouncer_stats_t debounceStats[VB_MAX];
+/** @brief Timestamp of the last raw edge of each VB, unit: [us] (lower 32bit of esp_timer_get_time) */
+static uint32_t edgeTime[VB_MAX];
+
+/** @brief Record the latency between the last raw edge and now
+ * @param vb Virtual button number, must be valid */
+static void statsLatency(uint32_t vb)
+{
+  uint32_t latency = (uint32_t)esp_timer_get_time() - edgeTime[vb];
+  uint32_t bin = 0;
+  while(bin < (DEBOUNCE_HIST_BINS-1) && latency >= (DEBOUNCE_HIST_BASE_US << bin)) bin++;
+  debounceStats[vb].latency[bin]++;
+  if(latency > debounceStats[vb].latencyMax) debounceStats[vb].latencyMax = latency;
+}
+
+/** @brief Get the debounce statistics of one VB
+ * @param vb Virtual button number
+ * @param stats Statistics are copied to this struct
+ * @return ESP_OK on success, ESP_FAIL on invalid parameters
+ * */
+esp_err_t taskDebouncerGetStats(uint32_t vb, debouncer_stats_t *stats)
+{
+  if(vb >= VB_MAX || stats == NULL) return ESP_FAIL;
+  memcpy(stats,&debounceStats[vb],sizeof(debouncer_stats_t));
+  return ESP_OK;
+}
+
+/** @brief Reset the debounce statistics of all VBs */
+void taskDebouncerResetStats(void)
+{
+  memset(debounceStats,0,sizeof(debounceStats));
+}
+
+/** @brief Published input state of all VBs, bit set: pressed
+ * @see taskDebouncerPublish */
+static uint32_t snapIn = 0;
+/** @brief VBs which were published at least once, bit set: published */
+static uint32_t snapMask = 0;
+/** @brief Timestamp of the last published change of each VB, unit: [us] (lower 32bit of esp_timer_get_time) */
+static volatile uint32_t snapTime[32];
+/** @brief A snapshot notification is already in debouncer_in */
+static uint32_t snapPending = 0;
+/** @brief Input state of the last processed snapshot (debouncer task only) */
+static uint32_t snapLast = 0;
+
+/** @brief Publish the current input state of a group of VBs
+ * 
+ * Updates the published input state for all VBs in mask & notifies
+ * the debouncer task (one notification in debouncer_in at once).
+ * The debouncer task diffs this state against the last processed one
+ * on each wakeup, so an edge is never lost on a full queue.
+ * @param mask VBs owned by this producer (bit n: VB n)
+ * @param state Current state of these VBs (bit set: pressed)
+ * @param woken Pointer for the ISR yield flag, NULL if called from a task
+ * @return ESP_OK if published, ESP_FAIL if the notification could not be sent
+ * (the state is published anyway)
+ * */
+esp_err_t taskDebouncerPublish(uint32_t mask, uint32_t state, BaseType_t *woken)
+{
+  raw_action_t evt;
+  BaseType_t ret;
+  
+  //nothing changed
+  uint32_t changed = (__atomic_load_n(&snapIn,__ATOMIC_RELAXED) ^ state) & mask;
+  if(changed == 0) return ESP_OK;
+  
+  //timestamp each changed VB, for the latency of this edge
+  uint32_t now = (uint32_t)esp_timer_get_time();
+  while(changed != 0)
+  {
+    snapTime[__builtin_ctz(changed)] = now;
+    changed &= changed - 1;
+  }
+  __atomic_or_fetch(&snapMask,mask,__ATOMIC_RELAXED);
+  __atomic_or_fetch(&snapIn,mask & state,__ATOMIC_RELEASE);
+  __atomic_and_fetch(&snapIn,~(mask & ~state),__ATOMIC_RELEASE);
+  
+  if(debouncer_in == NULL) return ESP_FAIL;
+  //notification is already pending
+  if(__atomic_exchange_n(&snapPending,1,__ATOMIC_ACQ_REL) != 0) return ESP_OK;
+  
+  evt.vb = RAW_ACTION_SNAPSHOT;
+  evt.type = VB_PRESS_EVENT;
+  evt.payload = NULL;
+  if(woken != NULL) ret = xQueueSendToBackFromISR(debouncer_in,&evt,woken);
+  else ret = xQueueSendToBack(debouncer_in,&evt,0);
+  if(ret != pdTRUE)
+  {
+    __atomic_store_n(&snapPending,0,__ATOMIC_RELEASE);
+    return ESP_FAIL;
+  }
+  return ESP_OK;
+}
+
+/** @brief Two tables of effective debounce times, one active & one for updates
+ * @see taskDebouncerUpdateConfig */
+static debouncer_times_t debounceTimes[2];
+/** @brief Currently active table of debounce times, NULL until the first config is applied */
+static debouncer_times_t *debounceTimesActive = NULL;
+
+/** @brief Get the currently active table of debounce times
+ * @return Pointer to the active table, NULL if no config was applied yet */
+static debouncer_times_t *getTimes(void)
+{
+  return __atomic_load_n(&debounceTimesActive,__ATOMIC_ACQUIRE);
+}
+
+/** @brief Resolve & publish the debounce times of a new config
+ * 
+ * Fills the inactive one of two debouncer_times_t tables and
+ * switches the debouncer to this table afterwards.
+ * For each VB: the VB value is used if set, otherwise the global value.
+ * Press & release times default to DEBOUNCETIME_MS, times up to
+ * DEBOUNCETIME_MIN_MS are mapped directly (stored as 0).
+ * @param cfg Config to resolve the debounce times from
+ * @return ESP_OK on success, ESP_FAIL on a NULL config
+ * */
+esp_err_t taskDebouncerUpdateConfig(generalConfig_t *cfg)
+{
+  if(cfg == NULL) return ESP_FAIL;
+  
+  debouncer_times_t *t = &debounceTimes[0];
+  if(getTimes() == t) t = &debounceTimes[1];
+  
+  //individual times are stored sparse, expand them for all VBs
+  uint16_t pressVB[VB_MAX], releaseVB[VB_MAX], idleVB[VB_MAX];
+  memset(pressVB,0,sizeof(pressVB));
+  memset(releaseVB,0,sizeof(releaseVB));
+  memset(idleVB,0,sizeof(idleVB));
+  for(uint8_t i = 0; i<cfg->debounce_vb_count && i<DEBOUNCE_VB_PARAMS; i++)
+  {
+    vb_param_t *p = &cfg->debounce_vb[i];
+    if(p->vb >= VB_MAX) continue;
+    pressVB[p->vb] = p->press;
+    releaseVB[p->vb] = p->release;
+    idleVB[p->vb] = p->idle;
+  }
+  
+  memset(t->releaseSet,0,sizeof(t->releaseSet));
+  for(uint32_t i = 0; i<VB_MAX; i++)
+  {
+    //is a VB value set in config? if not, is a global value set?
+    uint16_t press = pressVB[i] ? pressVB[i] : cfg->debounce_press;
+    uint16_t release = releaseVB[i] ? releaseVB[i] : cfg->debounce_release;
+    
+    if(release != 0) t->releaseSet[i/32] |= 1UL << (i%32);
+    //no? just use the default value
+    if(press == 0) press = DEBOUNCETIME_MS;
+    if(release == 0) release = DEBOUNCETIME_MS;
+    
+    t->press[i] = (press > DEBOUNCETIME_MIN_MS) ? press : 0;
+    t->release[i] = (release > DEBOUNCETIME_MIN_MS) ? release : 0;
+    t->idle[i] = idleVB[i] ? idleVB[i] : cfg->debounce_idle;
+  }
+  t->engine = cfg->debounce_engine;
+  
+  __atomic_store_n(&debounceTimesActive,t,__ATOMIC_RELEASE);
+  ESP_LOGD(LOG_TAG,"Debounce times updated");
+  return ESP_OK;
+}
+
 
 /** @brief Look for a possibly running debouncing timer
  * 
@@ -128,10 +316,12 @@ debouncer_direction_t isDebouncerActive(uint32_t virtualButton)
 /** @brief Cancel a possibly running debouncing timer
  * 
  * This method does a look-up in the xTimers array to find a running
- * timer with the given VB number (used as timer id) and cancel it
+ * timer with the given VB number (used as timer id) and cancel it.
+ * The timer itself is not deleted, it is reused for the next edge.
  * @param virtualButton Number of VB to look for a running timer, use
  * VB_MAX to cancel all timers.
- * @param stop Should we stop the timer before deleting (if set != 0)
+ * @param stop Should we stop the timer (if set != 0). Not necessary if called
+ * from the timer callback (one-shot timer is already expired)
  * @return Array offset where this running timer was found & canceled,\
  *  -1 if no timer was found (or all were cleared)
  * @note If VB_MAX is given, all timers are canceled.
@@ -143,11 +333,10 @@ int cancelTimer(uint32_t virtualButton, uint8_t stop)
   {
     for(int i = 0; i<VB_MAX; i++)
     {
-      if(xTimers[i].handle != NULL)
+      if(xTimers[i].handle != NULL && xTimers[i].dir != TIMER_IDLE)
       {
+        //returns an error if the timer is not running, which is fine here
         if(stop != 0) esp_timer_stop(xTimers[i].handle);
-        esp_timer_delete(xTimers[i].handle);
-        xTimers[i].handle = NULL;
       }
       xTimers[i].dir = TIMER_IDLE;
     }
@@ -156,16 +345,15 @@ int cancelTimer(uint32_t virtualButton, uint8_t stop)
   }
   
   //else: cancel only requested timer
-  if(xTimers[virtualButton].handle != NULL)
+  if(xTimers[virtualButton].handle != NULL && xTimers[virtualButton].dir != TIMER_IDLE)
   {
     if(stop != 0)
     {
-      if(esp_timer_stop(xTimers[virtualButton].handle) != ESP_OK)
+      //ESP_ERR_INVALID_STATE: timer already expired, but callback is not processed yet
+      esp_err_t ret = esp_timer_stop(xTimers[virtualButton].handle);
+      if(ret != ESP_OK && ret != ESP_ERR_INVALID_STATE)
       { ESP_LOGW(LOG_TAG,"Error stopping timer %d",virtualButton); }
     }
-    if(esp_timer_delete(xTimers[virtualButton].handle) != ESP_OK)
-    { ESP_LOGW(LOG_TAG,"Error deleting timer %d",virtualButton); }
-    xTimers[virtualButton].handle = NULL; //set handle to NULL, so we remember a stopped timer
     xTimers[virtualButton].dir = TIMER_IDLE;
     return virtualButton;
   } else {
@@ -227,17 +415,14 @@ void debouncerCallback(void *arg) {
   
   uint32_t virtualButton = debcfg->vb;
   generalConfig_t *cfg = configGetCurrent();
+  debouncer_times_t *times = getTimes();
   uint16_t deadtime = 0;
   
-  if(cfg == NULL)
+  if(times == NULL)
   {
-    ESP_LOGE(LOG_TAG,"Cannot do deadtime for VB %d, global config is NULL!",virtualButton);
-    deadtime = 0;
+    ESP_LOGE(LOG_TAG,"Cannot do deadtime for VB %d, no debounce times!",virtualButton);
   } else {
-    //check if an individual deadtime is set
-    if(cfg->debounce_idle_vb[virtualButton] != 0) deadtime = cfg->debounce_idle_vb[virtualButton];
-    //check if we have to use global deadtime
-    if(deadtime == 0 && cfg->debounce_idle != 0) deadtime = cfg->debounce_idle;
+    deadtime = times->idle[virtualButton];
   }
 
   switch(debcfg->dir)
@@ -247,6 +432,7 @@ void debouncerCallback(void *arg) {
       return;
     case TIMER_PRESS:
       ESP_LOGD(LOG_TAG,"Debounce finished, map in to out for press VB%d",virtualButton);
+      statsLatency(virtualButton);
       //map in to out and clear from in...
       if(esp_event_post(VB_EVENT,VB_PRESS_EVENT,(void*)&virtualButton,sizeof(uint32_t),0) != ESP_OK)
       {
@@ -259,6 +445,7 @@ void debouncerCallback(void *arg) {
       break;
     case TIMER_RELEASE:
       ESP_LOGD(LOG_TAG,"Debounce finished, map in to out for release VB%d",virtualButton);
+      statsLatency(virtualButton);
       //map in to out and clear from in...
       if(esp_event_post(VB_EVENT,VB_RELEASE_EVENT,(void*)&virtualButton,sizeof(uint32_t),0) != ESP_OK)
       {
@@ -278,7 +465,6 @@ void debouncerCallback(void *arg) {
   //if necessary, start timer again for deadtime.
   if(deadtime != 0)
   {
-    if(cancelTimer(virtualButton,0) == -1) ESP_LOGE(LOG_TAG,"Cannot cancel timer (CB)!");
     debcfg->dir = TIMER_DEADTIME;
     if(startTimer(debcfg,deadtime) != ESP_OK) 
     {
@@ -290,6 +476,9 @@ void debouncerCallback(void *arg) {
 }
 
 /** @brief Start a timer with a given config and debounce time
+ * 
+ * The timer of this VB is created once (createTimers), here it is
+ * only (re-)started. No memory is allocated.
  * @param cfg Config for the timer to be started
  * @param debounceTime Timeout for the new timer, unit: [ms]
  * @return ESP_OK on success, ESP_FAIL if timer cannot be started */
@@ -297,31 +486,25 @@ esp_err_t startTimer(debouncer_cfg_t *cfg, uint16_t debounceTime)
 {
   //check if there is a valid VB number (used as index)
   if(cfg->vb >= VB_MAX) return ESP_FAIL;
-  
+  if(xTimers[cfg->vb].handle == NULL) return ESP_FAIL;
+
+  //cfg might be the entry in xTimers (deadtime from the callback),
+  //which is reset by cancelTimer. Save the new direction before.
+  debouncer_direction_t dir = cfg->dir;
+
   //if there is a timer running, cancel it before.
   if(isDebouncerActive(cfg->vb) != TIMER_IDLE) cancelTimer(cfg->vb,1);
-  
-  //create the timer
-  esp_timer_create_args_t args;
-  xTimers[cfg->vb].dir = cfg->dir;
-  args.callback = debouncerCallback; //always the same callback
-  args.arg = (void *)&xTimers[cfg->vb]; //we assign a pointer to this array member
-  args.dispatch_method = ESP_TIMER_TASK; //no other option possible
-  esp_err_t ret = esp_timer_create(&args,&xTimers[cfg->vb].handle);
-  
-  if(ret != ESP_OK)
-  {
-    ESP_LOGE(LOG_TAG,"Cannot create timer, ret: %d",ret);
-    return ESP_FAIL;
-  }
+
+  xTimers[cfg->vb].dir = dir;
   
   //now start this timer (only one-shot)
   //we need to multiply the given time (in [ms]) to have the
   //necessary [us] parameter.
-  ret = esp_timer_start_once(xTimers[cfg->vb].handle, debounceTime * 1000);
+  esp_err_t ret = esp_timer_start_once(xTimers[cfg->vb].handle, debounceTime * 1000);
   
   if(ret != ESP_OK)
   {
+    xTimers[cfg->vb].dir = TIMER_IDLE;
     ESP_LOGE(LOG_TAG,"Cannot start timer, ret: %d",ret);
     return ESP_FAIL;
   }
@@ -330,6 +513,432 @@ esp_err_t startTimer(debouncer_cfg_t *cfg, uint16_t debounceTime)
   return ESP_OK;
 }
 
+/** @brief Convert a debounce time to ticks of the tick engine
+ * @param time Debounce time, unit: [ms]
+ * @return Count of ticks */
+static uint16_t tickConvert(uint16_t time)
+{
+  return (uint16_t)(((uint32_t)time * 1000) / DEBOUNCE_TICK_US);
+}
+
+/** @brief Tick engine: callback of the periodic timer
+ * 
+ * Evaluates all VBs, 32 at once. Only VBs with a different input and
+ * output state or with a running deadtime are processed further:
+ * * An edge without running counter loads the press/release time
+ * * An edge with running counter decrements it and sends the event on 0
+ * * A running counter without edge (input bounced back) is canceled
+ * * A running deadtime is decremented, new edges are processed afterwards
+ * 
+ * @param arg Unused
+ * */
+static void debounceTick(void *arg)
+{
+  generalConfig_t *cfg = configGetCurrent();
+  debouncer_times_t *times = getTimes();
+  if(times == NULL) return;
+  
+  for(uint32_t w = 0; w<DEBOUNCE_MASK_WORDS; w++)
+  {
+    uint32_t in = __atomic_load_n(&tickIn[w],__ATOMIC_RELAXED);
+    uint32_t changed = (in ^ tickOut[w]) & ~tickDead[w];
+    //input bounced back before the counter expired -> cancel
+    uint32_t dropped = tickPending[w] & ~changed;
+    tickPending[w] &= changed;
+    while(dropped != 0)
+    {
+      uint32_t vb = w*32 + __builtin_ctz(dropped);
+      //output is released -> a press was canceled, otherwise a release bounced back
+      if(tickOut[w] & (1UL << (vb%32))) debounceStats[vb].bounces++;
+      else debounceStats[vb].canceled++;
+      dropped &= dropped - 1;
+    }
+    uint32_t work = changed | tickDead[w];
+    
+    while(work != 0)
+    {
+      uint32_t bit = __builtin_ctz(work);
+      uint32_t mask = 1UL << bit;
+      uint32_t vb = w*32 + bit;
+      work &= work - 1;
+      
+      //deadtime is running, count down & continue
+      if(tickDead[w] & mask)
+      {
+        if(tickCounter[vb] != 0) tickCounter[vb]--;
+        if(tickCounter[vb] == 0) tickDead[w] &= ~mask;
+        continue;
+      }
+      
+      if((tickPending[w] & mask) == 0)
+      {
+        //new edge, load the debounce time (0 is mapped directly on this tick)
+        tickCounter[vb] = tickConvert((in & mask) ? times->press[vb] : times->release[vb]);
+        tickPending[w] |= mask;
+      } else if(tickCounter[vb] != 0) {
+        tickCounter[vb]--;
+      }
+      if(tickCounter[vb] != 0) continue;
+      
+      //debounce finished, map in to out
+      vb_event_t type = (in & mask) ? VB_PRESS_EVENT : VB_RELEASE_EVENT;
+      tickPending[w] &= ~mask;
+      tickOut[w] ^= mask;
+      ESP_LOGD(LOG_TAG,"Debounce finished (tick), VB%d / T: %d",vb,type);
+      statsLatency(vb);
+      if(esp_event_post(VB_EVENT,type,(void*)&vb,sizeof(uint32_t),0) != ESP_OK)
+      {
+        ESP_LOGW(LOG_TAG,"Cannot post event!");
+      }
+      sendButtonLearn(vb,type,cfg);
+      
+      //if necessary, start deadtime
+      tickCounter[vb] = tickConvert(times->idle[vb]);
+      if(tickCounter[vb] != 0) tickDead[w] |= mask;
+    }
+  }
+}
+
+/** @brief Tick engine: stop the periodic timer and clear all states
+ * 
+ * The active engine is set back to DEBOUNCE_ENGINE_TIMER.
+ * */
+static void tickStop(void)
+{
+  if(tickHandle != NULL) esp_timer_stop(tickHandle);
+  for(uint32_t w = 0; w<DEBOUNCE_MASK_WORDS; w++)
+  {
+    __atomic_store_n(&tickIn[w],0,__ATOMIC_RELAXED);
+    tickOut[w] = 0;
+    tickPending[w] = 0;
+    tickDead[w] = 0;
+  }
+  memset(tickCounter,0,sizeof(tickCounter));
+  activeEngine = DEBOUNCE_ENGINE_TIMER;
+}
+
+/** @brief Reset the last processed snapshot to the sent state of each VB
+ * 
+ * Must be called before running debounces are canceled. A published VB
+ * with a canceled press is set to released (the press was not sent yet),
+ * one with a canceled release to pressed. The next debounceSnapshot
+ * processes these VBs again.
+ * */
+static void snapRewind(void)
+{
+  uint32_t mask = __atomic_load_n(&snapMask,__ATOMIC_RELAXED);
+  
+  //tick engine: the output is the sent state
+  if(activeEngine == DEBOUNCE_ENGINE_TICK)
+  {
+    snapLast = (snapLast & ~mask) | (tickOut[0] & mask);
+    return;
+  }
+  for(uint32_t vb = 0; vb<VB_MAX && vb<32; vb++)
+  {
+    if((mask & (1UL << vb)) == 0) continue;
+    if(xTimers[vb].dir == TIMER_PRESS) snapLast &= ~(1UL << vb);
+    if(xTimers[vb].dir == TIMER_RELEASE) snapLast |= (1UL << vb);
+  }
+}
+
+/** @brief Switch to another debouncer engine
+ * 
+ * All running timers of the previous engine are canceled.
+ * If the tick engine cannot be started, the timer engine is used.
+ * Published VBs keep their sent state in the tick engine.
+ * @param engine DEBOUNCE_ENGINE_TIMER or DEBOUNCE_ENGINE_TICK
+ * */
+static void selectEngine(uint8_t engine)
+{
+  snapRewind();
+  cancelTimer(VB_MAX,1);
+  tickStop();
+  
+  if(engine == DEBOUNCE_ENGINE_TICK)
+  {
+    uint32_t mask = __atomic_load_n(&snapMask,__ATOMIC_RELAXED);
+    if(VB_MAX < 32) mask &= (1UL << (VB_MAX % 32)) - 1;
+    __atomic_store_n(&tickIn[0],snapLast & mask,__ATOMIC_RELAXED);
+    tickOut[0] = snapLast & mask;
+    if(tickHandle == NULL || esp_timer_start_periodic(tickHandle,DEBOUNCE_TICK_US) != ESP_OK)
+    {
+      ESP_LOGE(LOG_TAG,"Cannot start tick, using timer engine");
+      tickStop();
+      return;
+    }
+    activeEngine = DEBOUNCE_ENGINE_TICK;
+  }
+  ESP_LOGI(LOG_TAG,"Debouncer engine: %d",activeEngine);
+}
+
+/** @brief Create one debounce timer for each VB & the tick timer
+ * 
+ * Called once on startup, the timers are reused for all edges.
+ * @return ESP_OK on success, ESP_FAIL if a timer cannot be created */
+static esp_err_t createTimers(void)
+{
+  esp_timer_create_args_t args;
+  memset(&args,0,sizeof(args));
+  args.callback = debouncerCallback; //always the same callback
+  args.dispatch_method = ESP_TIMER_TASK; //no other option possible
+  args.name = "debounce";
+  
+  for(int i = 0; i<VB_MAX; i++)
+  {
+    xTimers[i].dir = TIMER_IDLE;
+    xTimers[i].vb = i;
+    args.arg = (void *)&xTimers[i]; //we assign a pointer to this array member
+    if(esp_timer_create(&args,&xTimers[i].handle) != ESP_OK)
+    {
+      ESP_LOGE(LOG_TAG,"Cannot create timer for VB%d",i);
+      xTimers[i].handle = NULL;
+      return ESP_FAIL;
+    }
+  }
+  
+  //one periodic timer for the tick engine
+  args.callback = debounceTick;
+  args.arg = NULL;
+  args.name = "debounce_tick";
+  if(esp_timer_create(&args,&tickHandle) != ESP_OK)
+  {
+    ESP_LOGE(LOG_TAG,"Cannot create tick timer");
+    tickHandle = NULL;
+    return ESP_FAIL;
+  }
+  return ESP_OK;
+}
+
+/** @brief Process one raw edge of a VB
+ * 
+ * Depending on the active engine, either the input state of the tick
+ * engine is updated or the timer of this VB is started/canceled:
+ * * Starts a new timer (no timer is running)
+ * * Cancels a running timer (timer is running in the opposite debouncer direction)
+ * * Does nothing (timer is already running in the same direction)
+ * 
+ * @param evt Raw action, VB must be valid
+ * @param times Currently active debounce times
+ * @param timestamp Time of this edge, unit: [us] (lower 32bit of esp_timer_get_time)
+ * */
+static void debounceEdge(raw_action_t evt, debouncer_times_t *times, uint32_t timestamp)
+{
+  debouncer_cfg_t debcfg;
+  debcfg.handle = NULL;
+  uint16_t time = 0;
+  
+  debounceStats[evt.vb].edges++;
+  //tick engine: just update the input state, everything else is done in debounceTick
+  if(activeEngine == DEBOUNCE_ENGINE_TICK)
+  {
+    uint32_t mask = 1UL << (evt.vb%32);
+    uint32_t in = __atomic_load_n(&tickIn[evt.vb/32],__ATOMIC_RELAXED);
+    //same state as before -> bounce
+    if(((in & mask) != 0) == (evt.type == VB_PRESS_EVENT)) debounceStats[evt.vb].bounces++;
+    else edgeTime[evt.vb] = timestamp;
+    if(tickDead[evt.vb/32] & mask) debounceStats[evt.vb].deadtime++;
+    switch(evt.type)
+    {
+      case VB_PRESS_EVENT:
+        __atomic_or_fetch(&tickIn[evt.vb/32],1UL << (evt.vb%32),__ATOMIC_RELAXED);
+        break;
+      case VB_RELEASE_EVENT:
+        __atomic_and_fetch(&tickIn[evt.vb/32],~(1UL << (evt.vb%32)),__ATOMIC_RELAXED);
+        break;
+      default: break;
+    }
+    return;
+  }
+  //if timer is not running, start one with the corresponding
+  //edge and set xTimerDirection.
+  if(isDebouncerActive(evt.vb) == TIMER_IDLE) 
+  {
+    //check which time to use (either VB, global value or default)
+    uint8_t t_type = TIMER_IDLE;
+    time = 0;
+    
+    switch(evt.type)
+    {
+      case VB_PRESS_EVENT:
+        t_type = TIMER_PRESS;
+        time = times->press[evt.vb];
+      break;
+      case VB_RELEASE_EVENT:
+        t_type = TIMER_RELEASE;
+        time = times->release[evt.vb];
+      break;
+      default: break;
+    }
+    edgeTime[evt.vb] = timestamp;
+    if(time != 0)
+    {
+      debcfg.vb = evt.vb;
+      debcfg.dir = t_type;
+      if(startTimer(&debcfg,time) != ESP_OK) ESP_LOGE(LOG_TAG,"Cannot start timer...");
+      else {
+        ESP_LOGD(LOG_TAG,"Debounce started for VB%d / T: %d",evt.vb,t_type);
+      }
+      return;
+    //note: currently, following branch is unused, but maybe we need a directly mapped VB.
+    } else {
+      //if no debounce time is used
+      ESP_LOGD(LOG_TAG,"Map VB%d / T: %d",evt.vb,evt.type);
+      statsLatency(evt.vb);
+      if(esp_event_post(VB_EVENT,evt.type,(void*)&evt.vb,sizeof(evt.vb),0) != ESP_OK)
+      {
+        ESP_LOGW(LOG_TAG,"Cannot post event!");
+      }
+      return;
+    }
+  } else {
+    //if timer is running, check if this flag requests the
+    //opposite direction OR the same direction is cleared
+    //if yes -> stop & delete this timer
+    switch(xTimers[evt.vb].dir)
+    {
+      case TIMER_PRESS:
+        //if release is wanted, but press timer is running
+        //->cancel timer
+        if(evt.type == VB_PRESS_EVENT) debounceStats[evt.vb].bounces++;
+        if(evt.type == VB_RELEASE_EVENT)
+        {
+          ESP_LOGD(LOG_TAG,"Press canceled for VB%d, sending release",evt.vb);
+          debounceStats[evt.vb].canceled++;
+          if(cancelTimer(evt.vb,1) == -1) //stop current press debouncer
+          { ESP_LOGE(LOG_TAG,"Cannot cancel press timer!"); }
+          ///@note We send here an additional release, just to be sure
+          /// to release any actions (avoiding sticky actions for keys...)
+          if(esp_event_post(VB_EVENT,evt.type,(void*)&evt.vb,sizeof(evt.vb),0) != ESP_OK)
+          {
+            ESP_LOGW(LOG_TAG,"Cannot post event!");
+          }
+        }
+        break;
+      case TIMER_RELEASE:
+        //if press is wanted, but release timer is running
+        //->cancel timer
+        ///@note I think we should cancel only in the event of a
+        /// set anti-tremor time. Otherwise we might loose e.g., key
+        /// release events -> sticky keys...
+        if(evt.type == VB_PRESS_EVENT) debounceStats[evt.vb].bounces++;
+        if(evt.type == VB_PRESS_EVENT && \
+          (times->releaseSet[evt.vb/32] & (1UL << (evt.vb%32))))
+        {
+          ESP_LOGD(LOG_TAG,"Release canceled for VB%d",evt.vb);
+          if(cancelTimer(evt.vb,1) == -1) //stop current press debouncer
+          { ESP_LOGE(LOG_TAG,"Cannot cancel release timer!"); }
+        }
+        break;
+      case TIMER_IDLE:
+        ESP_LOGE(LOG_TAG,"Timer is idle but a valid ID?");
+        break;
+      case TIMER_DEADTIME:
+        ESP_LOGD(LOG_TAG,"Deadtime active, waiting.");
+        debounceStats[evt.vb].deadtime++;
+        break;
+      case TIMER_ERROR:
+        ESP_LOGE(LOG_TAG,"Timer is in error state [%d]",evt.vb);
+      default:
+        ESP_LOGE(LOG_TAG,"Unknown status in xTimers[%d].dir",evt.vb);
+        break;
+    }
+  } /* else -> timerId != TIMER_IDLE */
+}
+
+/** @brief Process the published snapshot
+ * 
+ * Each VB, which changed since the last processed snapshot, is processed
+ * as one edge (with the time of its last published change).
+ * @param times Currently active debounce times
+ * */
+static void debounceSnapshot(debouncer_times_t *times)
+{
+  __atomic_store_n(&snapPending,0,__ATOMIC_RELEASE);
+  uint32_t in = __atomic_load_n(&snapIn,__ATOMIC_ACQUIRE);
+  uint32_t changed = in ^ snapLast;
+  snapLast = in;
+  while(changed != 0)
+  {
+    raw_action_t snapevt;
+    uint32_t bit = __builtin_ctz(changed);
+    changed &= changed - 1;
+    if(bit >= VB_MAX) continue;
+    snapevt.vb = bit;
+    snapevt.type = (in & (1UL << bit)) ? VB_PRESS_EVENT : VB_RELEASE_EVENT;
+    snapevt.payload = NULL;
+    debounceEdge(snapevt,times,snapTime[bit]);
+  }
+}
+
+/** @brief Debouncing is suspended for a config update
+ * @see debounceStep */
+static uint8_t debounceSuspended = 0;
+
+/** @brief One iteration of the debouncer task
+ * 
+ * If config updates are running, all timers are canceled and the
+ * debouncer waits for a stable config. Afterwards, the published
+ * snapshot is processed again: notifications were discarded while
+ * waiting, but the published state is still valid.
+ * Otherwise one raw action is received & processed.
+ * @param ticks Ticks to wait for a raw action
+ * */
+static void debounceStep(TickType_t ticks)
+{
+  debouncer_times_t *times;
+  raw_action_t evt;
+  
+  //if config updates are running, cancel all timers and wait for stable config
+  if((xEventGroupGetBits(systemStatus) & SYSTEM_STABLECONFIG) == 0)
+  {
+    //cancel all timers & the tick engine (engine is selected again afterwards)
+    snapRewind();
+    cancelTimer(VB_MAX,1);
+    tickStop();
+    //clear all VB events (the snapshot is processed after the update)
+    xQueueReset(debouncer_in);
+    __atomic_store_n(&snapPending,0,__ATOMIC_RELEASE);
+    debounceSuspended = 1;
+    //wait 5 ticks to check again
+    //If not set in time, wait again
+    if((xEventGroupWaitBits(systemStatus,SYSTEM_STABLECONFIG, \
+      pdFALSE,pdFALSE,5) & SYSTEM_STABLECONFIG) == 0)
+    {
+      ESP_LOGD(LOG_TAG,"Waiting for config");
+      return;
+    }
+  }
+  
+  //config is stable again, process the changes since the update started
+  if(debounceSuspended)
+  {
+    debounceSuspended = 0;
+    times = getTimes();
+    if(times->engine != activeEngine) selectEngine(times->engine);
+    debounceSnapshot(times);
+  }
+  
+  if(xQueueReceive(debouncer_in,&evt,ticks) == pdTRUE)
+  {
+    //use the latest debounce times, engine is selected per slot
+    times = getTimes();
+    if(times->engine != activeEngine) selectEngine(times->engine);
+    
+    //process the snapshot on each wakeup, the notification might
+    //be lost on a full queue.
+    debounceSnapshot(times);
+    if(evt.vb == RAW_ACTION_SNAPSHOT) return;
+    
+    if(evt.vb >= VB_MAX)
+    {
+      ESP_LOGE(LOG_TAG,"VB out of range!");
+      return;
+    }
+    debounceEdge(evt,times,(uint32_t)esp_timer_get_time());
+  } /* if(xQueueReceive... */
+}
+
 /** @brief Debouncing main task
  * 
  * This task is pending on raw actions, sent to the debouncer_in queue.
@@ -342,15 +951,11 @@ esp_err_t startTimer(debouncer_cfg_t *cfg, uint16_t debounceTime)
  * @see DEBOUNCE_RESOLUTION_MS
  * @see xTimers
  * @see debouncerCallback
+ * @see debounceStep
  * @todo Add anti-tremor & deadtime functionality
  * */
 void task_debouncer(void *param)
 {
-  generalConfig_t *cfg = configGetCurrent();
-  raw_action_t evt;
-  debouncer_cfg_t debcfg;
-  debcfg.handle = NULL;
-  uint16_t time = 0;
   esp_log_level_set(LOG_TAG,LOG_LEVEL_DEBOUNCE);
   
   //test if eventgroup is created
@@ -359,151 +964,20 @@ void task_debouncer(void *param)
     ESP_LOGE(LOG_TAG,"Eventgroup uninitialized, retry in 1s");
     vTaskDelay(1000/portTICK_PERIOD_MS);
   }
-  //clear the xTimers array
-  for(int i = 0; i<VB_MAX; i++)
+  //create all timers once
+  if(createTimers() != ESP_OK)
   {
-    xTimers[i].dir = TIMER_IDLE;
-    xTimers[i].handle = NULL;
-    xTimers[i].vb = i;
+    ESP_LOGE(LOG_TAG,"Cannot create debounce timers, debouncer is not working!");
   }
   
   //wait until config is valid
-  while(cfg == NULL)
+  while(getTimes() == NULL)
   {
     ESP_LOGE(LOG_TAG,"Global config uninitialized, retry in 1s");
     vTaskDelay(1000/portTICK_PERIOD_MS);
-    cfg = configGetCurrent();
   }
   
   ESP_LOGI(LOG_TAG,"Debouncer started");
 
-  while(1)
-  {
-    //if config updates are running, cancel all timers and wait for stable config
-    if((xEventGroupGetBits(systemStatus) & SYSTEM_STABLECONFIG) == 0)
-    {
-      //cancel all timers
-      cancelTimer(VB_MAX,1);
-      //clear all VB events
-      xQueueReset(debouncer_in);
-      //wait 5 ticks to check again
-      //If not set in time, wait again
-      if((xEventGroupWaitBits(systemStatus,SYSTEM_STABLECONFIG, \
-        pdFALSE,pdFALSE,5) & SYSTEM_STABLECONFIG) == 0)
-      {
-        ESP_LOGD(LOG_TAG,"Waiting for config");
-        continue;
-      }
-    }
-    
-    if(xQueueReceive(debouncer_in,&evt,portMAX_DELAY) == pdTRUE)
-    {
-      if(evt.vb >= VB_MAX)
-      {
-        ESP_LOGE(LOG_TAG,"VB out of range!");
-        continue;
-      }
-      //if timer is not running, start one with the corresponding
-      //edge and set xTimerDirection.
-      if(isDebouncerActive(evt.vb) == TIMER_IDLE) 
-      {
-        //check which time to use (either VB, global value or default)
-        uint8_t t_type = TIMER_IDLE;
-        
-        switch(evt.type)
-        {
-          case VB_PRESS_EVENT:
-            t_type = TIMER_PRESS;
-            //is a VB value set in config?
-            if(cfg->debounce_press_vb[evt.vb] != 0) time = cfg->debounce_press_vb[evt.vb];
-            //is a global value set in config?
-            if(time == 0 && cfg->debounce_press != 0) time = cfg->debounce_press;
-            //no? just use the default value
-            if(time == 0) time = DEBOUNCETIME_MS;
-          break;
-          case VB_RELEASE_EVENT:
-            t_type = TIMER_RELEASE;
-            //is a VB value set in config?
-            if(cfg->debounce_release_vb[evt.vb] != 0) time = cfg->debounce_release_vb[evt.vb];
-            //is a global value set in config?
-            if(time == 0 && cfg->debounce_release != 0) time = cfg->debounce_release;
-            //no? just use the default value
-            if(time == 0) time = DEBOUNCETIME_MS;
-          break;
-          default: break;
-        }
-        if(time > DEBOUNCETIME_MIN_MS)
-        {
-          debcfg.vb = evt.vb;
-          debcfg.dir = t_type;
-          if(startTimer(&debcfg,time) != ESP_OK) ESP_LOGE(LOG_TAG,"Cannot start timer...");
-          else {
-            ESP_LOGD(LOG_TAG,"Debounce started for VB%d / T: %d",evt.vb,t_type);
-          }
-          continue;
-        //note: currently, following branch is unused, but maybe we need a directly mapped VB.
-        } else {
-          //if no debounce time is used
-          ESP_LOGD(LOG_TAG,"Map VB%d / T: %d",evt.vb,evt.type);
-          if(esp_event_post(VB_EVENT,evt.type,(void*)&evt.vb,sizeof(evt.vb),0) != ESP_OK)
-          {
-            ESP_LOGW(LOG_TAG,"Cannot post event!");
-          }
-          continue;
-        }
-      } else {
-        //if timer is running, check if this flag requests the
-        //opposite direction OR the same direction is cleared
-        //if yes -> stop & delete this timer
-        switch(xTimers[evt.vb].dir)
-        {
-          case TIMER_PRESS:
-            //if release is wanted, but press timer is running
-            //->cancel timer
-            if(evt.type == VB_RELEASE_EVENT)
-            {
-              ESP_LOGD(LOG_TAG,"Press canceled for VB%d, sending release",evt.vb);
-              if(cancelTimer(evt.vb,1) == -1) //stop current press debouncer
-              { ESP_LOGE(LOG_TAG,"Cannot cancel press timer!"); }
-              ///@note We send here an additional release, just to be sure
-              /// to release any actions (avoiding sticky actions for keys...)
-              if(esp_event_post(VB_EVENT,evt.type,(void*)&evt.vb,sizeof(evt.vb),0) != ESP_OK)
-              {
-                ESP_LOGW(LOG_TAG,"Cannot post event!");
-              }
-            }
-            break;
-          case TIMER_RELEASE:
-            //if press is wanted, but release timer is running
-            //->cancel timer
-            ///@note I think we should cancel only in the event of a
-            /// set anti-tremor time. Otherwise we might loose e.g., key
-            /// release events -> sticky keys...
-            time = 0;
-            //is a VB value set in config?
-            if(cfg->debounce_release_vb[evt.vb] != 0) time = cfg->debounce_release_vb[evt.vb];
-            //is a global value set in config?
-            if(time == 0 && cfg->debounce_release != 0) time = cfg->debounce_release;
-            if(evt.type == VB_PRESS_EVENT && time != 0)
-            {
-              ESP_LOGD(LOG_TAG,"Release canceled for VB%d",evt.vb);
-              if(cancelTimer(evt.vb,1) == -1) //stop current press debouncer
-              { ESP_LOGE(LOG_TAG,"Cannot cancel release timer!"); }
-            }
-            break;
-          case TIMER_IDLE:
-            ESP_LOGE(LOG_TAG,"Timer is idle but a valid ID?");
-            break;
-          case TIMER_DEADTIME:
-            ESP_LOGD(LOG_TAG,"Deadtime active, waiting.");
-            break;
-          case TIMER_ERROR:
-            ESP_LOGE(LOG_TAG,"Timer is in error state [%d]",evt.vb);
-          default:
-            ESP_LOGE(LOG_TAG,"Unknown status in xTimers[%d].dir",evt.vb);
-            break;
-        }
-      } /* else -> timerId != TIMER_IDLE */
-    } /* if(xQueueReceive... */
-  } /* while(1) */
+  while(1) debounceStep(portMAX_DELAY);
 } /* task_debouncer */
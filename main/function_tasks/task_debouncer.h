@@ -28,6 +28,8 @@
  * is registered, a timer (esp_timer) will be started. On a finished
  * debounce event, the corresponding event is sent to the system event
  * loop.
+ * Each VB owns one timer, which is created on startup and reused for
+ * each edge. No memory is allocated while debouncing.
  * 
  * The debouncing itself can be controlled via following variables
  * (these settings are located in the global config):
@@ -41,6 +43,32 @@
  * there is no default setting for this device, a hardcoded debounce time
  * of DEBOUNCETIME_MS is used.
  * 
+ * Two engines are available, selected per slot (AT DM, generalConfig_t.debounce_engine):
+ * 
+ * * DEBOUNCE_ENGINE_TIMER: one esp_timer per VB, started on each edge.
+ * * DEBOUNCE_ENGINE_TICK: one periodic timer (DEBOUNCE_TICK_US) for all
+ *   VBs. The input, output and pending states are kept as bitmasks, one
+ *   bit per VB. On each tick, only VBs with a difference between input
+ *   and output (or a running counter) are processed. The work per tick
+ *   is O(VB_MAX/32) for idle VBs.
+ * 
+ * Both engines send the same VB_PRESS_EVENT/VB_RELEASE_EVENT events.
+ * Differences of the tick engine: the timing resolution is DEBOUNCE_TICK_US,
+ * edges during the deadtime are not lost but processed afterwards and
+ * a canceled press does not send an additional release (it was never
+ * sent as pressed).
+ * 
+ * Inputs are either sent as single edges (raw_action_t via debouncer_in)
+ * or published as state of a group of VBs (taskDebouncerPublish). A
+ * published state is compared to the last processed one, each changed
+ * VB is processed as one edge. Simultaneous changes need only one message
+ * and a full queue cannot drop a release. During a config update, running
+ * debounces are canceled and notifications are discarded; afterwards the
+ * published state is processed again, so no change is lost.
+ * 
+ * For tuning the debounce times, statistics are recorded for each VB
+ * (see debouncer_stats_t, AT DS).
+ * 
  * @note For each VB, a debouncer_cfg_t element will be used. The size
  * of this array is determined by VB_MAX. Please set this define accordingly!
  * 
@@ -73,9 +101,106 @@
 /** @brief Minimum debounce time, anything below will be mapped directly. */
 #define DEBOUNCETIME_MIN_MS 10
 
+/** @brief Debouncer engine: one esp_timer for each VB */
+#define DEBOUNCE_ENGINE_TIMER 0
+
+/** @brief Debouncer engine: one periodic tick for all VBs */
+#define DEBOUNCE_ENGINE_TICK 1
+
+/** @brief Tick period of the tick engine, unit: [us]
+ * @note Debounce times are rounded down to a multiple of this period. */
+#define DEBOUNCE_TICK_US 1000
+
+/** @brief Count of 32bit words for one bitmask with a bit for each VB */
+#define DEBOUNCE_MASK_WORDS ((VB_MAX+31)/32)
+
 /** Stack size for debouncer task */
 #define TASK_DEBOUNCER_STACKSIZE 2048
 
+/** @brief Effective debounce times of all VBs for one slot
+ * 
+ * Resolved once from the per-VB values, the global values and the
+ * defaults by taskDebouncerUpdateConfig. The debouncer reads only this
+ * table, never the config itself.
+ * @see taskDebouncerUpdateConfig */
+typedef struct debouncer_times {
+  /** @brief Press debounce time, unit: [ms]. 0 maps the press directly. */
+  uint16_t press[VB_MAX];
+  /** @brief Release debounce time, unit: [ms]. 0 maps the release directly. */
+  uint16_t release[VB_MAX];
+  /** @brief Deadtime after an event, unit: [ms]. 0 disables the deadtime. */
+  uint16_t idle[VB_MAX];
+  /** @brief Bit is set if a release time is configured (VB or global),
+   * a press cancels a running release debounce only in this case. */
+  uint32_t releaseSet[DEBOUNCE_MASK_WORDS];
+  /** @brief Debouncer engine, DEBOUNCE_ENGINE_TIMER or DEBOUNCE_ENGINE_TICK */
+  uint8_t engine;
+} debouncer_times_t;
+
+/** @brief Count of bins of the latency histogram */
+#define DEBOUNCE_HIST_BINS 10
+
+/** @brief Upper limit of the first bin of the latency histogram, unit: [us]
+ * 
+ * Bin n counts latencies below (DEBOUNCE_HIST_BASE_US << n), the last
+ * bin counts all latencies above. */
+#define DEBOUNCE_HIST_BASE_US 1000
+
+/** @brief Debounce statistics of one VB
+ * @note Counters are updated without locking, concurrent updates from
+ * the debouncer task & the timer task might get lost. */
+typedef struct debouncer_stats {
+  /** @brief Count of raw edges (press & release) */
+  uint32_t edges;
+  /** @brief Count of suppressed bounces (repeated edges, release bounced back to press) */
+  uint32_t bounces;
+  /** @brief Count of presses canceled by a release before the debounce time */
+  uint32_t canceled;
+  /** @brief Count of edges during the deadtime */
+  uint32_t deadtime;
+  /** @brief Maximum latency, unit: [us] */
+  uint32_t latencyMax;
+  /** @brief Histogram of latencies between the raw edge and the VB event
+   * @see DEBOUNCE_HIST_BASE_US */
+  uint32_t latency[DEBOUNCE_HIST_BINS];
+} debouncer_stats_t;
+
+/** @brief Publish the current input state of a group of VBs
+ * 
+ * Updates the published input state for all VBs in mask & notifies
+ * the debouncer task. Can be called from an ISR.
+ * @note Each VB should be published by one producer only. VBs above 31
+ * must be sent via debouncer_in.
+ * @param mask VBs owned by this producer (bit n: VB n)
+ * @param state Current state of these VBs (bit set: pressed)
+ * @param woken Pointer for the ISR yield flag, NULL if called from a task
+ * @return ESP_OK if published, ESP_FAIL if the notification could not be sent
+ * (the state is published anyway and processed with the next event)
+ * */
+esp_err_t taskDebouncerPublish(uint32_t mask, uint32_t state, BaseType_t *woken);
+
+/** @brief Get the debounce statistics of one VB
+ * @param vb Virtual button number
+ * @param stats Statistics are copied to this struct
+ * @return ESP_OK on success, ESP_FAIL on invalid parameters
+ * */
+esp_err_t taskDebouncerGetStats(uint32_t vb, debouncer_stats_t *stats);
+
+/** @brief Reset the debounce statistics of all VBs */
+void taskDebouncerResetStats(void);
+
+/** @brief Resolve & publish the debounce times of a new config
+ * 
+ * Fills the inactive one of two debouncer_times_t tables and
+ * switches the debouncer to this table afterwards. The debouncer
+ * never reads a partially written table.
+ * Called by the config switcher each time the debounce settings changed.
+ * @note Only one task may call this function.
+ * @param cfg Config to resolve the debounce times from
+ * @return ESP_OK on success, ESP_FAIL on a NULL config
+ * */
+esp_err_t taskDebouncerUpdateConfig(generalConfig_t *cfg);
+
 /** @brief Debouncing main task
  * 
  * This task is periodically testing the virtualButtonsIn flags
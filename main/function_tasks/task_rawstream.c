@@ -0,0 +1,285 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ * Copyright 2017 Benjamin Aigner <aignerb@technikum-wien.at,
+ * beni@asterics-foundation.org>
+ */
+/** @file
+ * @brief CONTINOUS TASK - Streaming of raw sensor values (AT SR)
+ *
+ * If raw value reporting is enabled (AT SR), the ADC tasks pass each
+ * sample to this module via taskRawStreamPush. The samples are decimated
+ * and stored in a lock-free single producer/single consumer ring buffer.
+ * A low priority task drains this buffer and sends the samples to the
+ * serial interface (and the websocket, if connected).
+ *
+ * @see halAdcReportRaw
+ * @see cmdSr
+ */
+
+#include "task_rawstream.h"
+#include <stdio.h>
+#include <string.h>
+#include "hal_serial.h"
+
+/** @brief Logging tag for this module */
+#define LOG_TAG "task_rawstream"
+/** @brief Set a global log limit for this file */
+#define LOG_LEVEL_RAWSTREAM ESP_LOG_INFO
+
+/** @brief Mask for ring buffer indices */
+#define RAWSTREAM_BUFFER_MASK (RAWSTREAM_BUFFER_LENGTH - 1)
+
+/** @brief Length of a full binary frame */
+#define RAWSTREAM_FULL_LENGTH (3 + 7*2)
+/** @brief Length of a delta frame */
+#define RAWSTREAM_DELTA_LENGTH (3 + 7)
+
+/** @brief One element of the ring buffer */
+typedef struct rawstream_entry {
+  /** @brief Sensor values */
+  rawstream_sample_t sample;
+  /** @brief Sequence number, assigned by the producer */
+  uint8_t seq;
+} rawstream_entry_t;
+
+/** @brief Ring buffer for samples */
+static rawstream_entry_t rawBuffer[RAWSTREAM_BUFFER_LENGTH];
+/** @brief Write index, only modified by the producer (ADC task) */
+static volatile uint32_t rawHead = 0;
+/** @brief Read index, only modified by the consumer (sender task) */
+static volatile uint32_t rawTail = 0;
+
+/** @brief Currently active output format */
+static volatile rawstream_format_t rawFormat = RAWSTREAM_ASCII;
+/** @brief Currently active decimation */
+static volatile uint8_t rawDecimation = RAWSTREAM_DEFAULT_DECIMATION_ASCII;
+
+/** @brief Count of samples, dropped because of a full ring buffer */
+static volatile uint32_t rawDropped = 0;
+
+/** @brief Handle of the sender task, used for notifications */
+static TaskHandle_t rawTaskHandle = NULL;
+
+/** @brief Put an uint16 (little endian) into a buffer, returns bytes written */
+static inline uint8_t rawPut16(uint8_t *buf, uint16_t value)
+{
+  buf[0] = value & 0xFF;
+  buf[1] = (value >> 8) & 0xFF;
+  return 2;
+}
+
+/** @brief Calculate a delta and check if it fits into an int8
+ * @return 1 if it fits, 0 otherwise */
+static inline uint8_t rawDelta(int32_t current, int32_t previous, int8_t *delta)
+{
+  int32_t d = current - previous;
+  if(d > 127 || d < -127) return 0;
+  *delta = d;
+  return 1;
+}
+
+/** @brief Encode one full binary frame
+ * @return Length of the frame */
+static uint8_t rawEncodeFull(uint8_t *buf, rawstream_entry_t *e)
+{
+  uint8_t len = 0;
+  buf[len++] = RAWSTREAM_SYNC;
+  buf[len++] = 'R';
+  buf[len++] = e->seq;
+  len += rawPut16(&buf[len],e->sample.pressure);
+  len += rawPut16(&buf[len],e->sample.up);
+  len += rawPut16(&buf[len],e->sample.down);
+  len += rawPut16(&buf[len],e->sample.left);
+  len += rawPut16(&buf[len],e->sample.right);
+  len += rawPut16(&buf[len],(uint16_t)e->sample.x);
+  len += rawPut16(&buf[len],(uint16_t)e->sample.y);
+  return len;
+}
+
+/** @brief Encode one delta frame
+ * @return Length of the frame, 0 if a delta does not fit (full frame necessary) */
+static uint8_t rawEncodeDelta(uint8_t *buf, rawstream_entry_t *e, rawstream_sample_t *prev)
+{
+  int8_t d[7];
+  if(!rawDelta(e->sample.pressure,prev->pressure,&d[0])) return 0;
+  if(!rawDelta(e->sample.up,prev->up,&d[1])) return 0;
+  if(!rawDelta(e->sample.down,prev->down,&d[2])) return 0;
+  if(!rawDelta(e->sample.left,prev->left,&d[3])) return 0;
+  if(!rawDelta(e->sample.right,prev->right,&d[4])) return 0;
+  if(!rawDelta(e->sample.x,prev->x,&d[5])) return 0;
+  if(!rawDelta(e->sample.y,prev->y,&d[6])) return 0;
+
+  buf[0] = RAWSTREAM_SYNC;
+  buf[1] = 'D';
+  buf[2] = e->seq;
+  memcpy(&buf[3],d,sizeof(d));
+  return RAWSTREAM_DELTA_LENGTH;
+}
+
+/** @brief Sender task, drains the ring buffer
+ *
+ * Waits for a notification of the producer, encodes all available
+ * samples in the current format and sends them to the serial interface.
+ * Binary frames are collected & sent in chunks of up to RAWSTREAM_TX_LENGTH.
+ * @param param Unused
+ */
+void task_rawstream(void *param)
+{
+  uint8_t tx[RAWSTREAM_TX_LENGTH];
+  uint8_t txlen = 0;
+  rawstream_format_t activeFormat = RAWSTREAM_ASCII;
+  rawstream_sample_t previous;
+  uint8_t previousSeq = 0;
+  uint8_t sinceKeyframe = RAWSTREAM_KEYFRAME_INTERVAL;
+
+  while(1)
+  {
+    //wait for new samples
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+    while(rawTail != rawHead)
+    {
+      rawstream_entry_t e = rawBuffer[rawTail & RAWSTREAM_BUFFER_MASK];
+      //make sure the sample is read before releasing the slot
+      __sync_synchronize();
+      rawTail = (rawTail + 1) & RAWSTREAM_BUFFER_MASK;
+
+      //format changed, start over with a full frame
+      if(activeFormat != rawFormat)
+      {
+        activeFormat = rawFormat;
+        sinceKeyframe = RAWSTREAM_KEYFRAME_INTERVAL;
+      }
+
+      switch(activeFormat)
+      {
+        case RAWSTREAM_ASCII:
+        {
+          char data[48];
+          sprintf(data,"VALUES:%d,%d,%d,%d,%d,%d,%d",e.sample.pressure, \
+            e.sample.up,e.sample.down,e.sample.left,e.sample.right, \
+            e.sample.x,e.sample.y);
+          halSerialSendUSBSerial(data, strnlen(data,sizeof(data)), 10);
+          break;
+        }
+        case RAWSTREAM_BINARY:
+        case RAWSTREAM_DELTA:
+        {
+          uint8_t len = 0;
+          //flush before this frame would not fit anymore
+          if(txlen + RAWSTREAM_FULL_LENGTH > RAWSTREAM_TX_LENGTH)
+          {
+            halSerialSendRawStream(tx, txlen, 10);
+            txlen = 0;
+          }
+          //delta frames are only possible without gaps in the sequence
+          if(activeFormat == RAWSTREAM_DELTA && \
+            sinceKeyframe < RAWSTREAM_KEYFRAME_INTERVAL && \
+            e.seq == (uint8_t)(previousSeq + 1))
+          {
+            len = rawEncodeDelta(&tx[txlen],&e,&previous);
+          }
+          if(len == 0)
+          {
+            len = rawEncodeFull(&tx[txlen],&e);
+            sinceKeyframe = 0;
+          } else sinceKeyframe++;
+          txlen += len;
+          break;
+        }
+      }
+      previous = e.sample;
+      previousSeq = e.seq;
+    }
+
+    //send remaining binary frames
+    if(txlen != 0)
+    {
+      halSerialSendRawStream(tx, txlen, 10);
+      txlen = 0;
+    }
+  }
+}
+
+esp_err_t taskRawStreamConfigure(rawstream_format_t format, uint8_t decimation)
+{
+  if(format != RAWSTREAM_ASCII && format != RAWSTREAM_BINARY && \
+    format != RAWSTREAM_DELTA) return ESP_FAIL;
+
+  //use defaults if no decimation is given
+  if(decimation == 0)
+  {
+    if(format == RAWSTREAM_ASCII) decimation = RAWSTREAM_DEFAULT_DECIMATION_ASCII;
+    else decimation = RAWSTREAM_DEFAULT_DECIMATION_BINARY;
+  }
+
+  rawDecimation = decimation;
+  rawFormat = format;
+  ESP_LOGI(LOG_TAG,"Raw stream format %d, decimation %d",format,decimation);
+  return ESP_OK;
+}
+
+esp_err_t taskRawStreamPush(rawstream_sample_t *sample)
+{
+  static uint8_t prescaler = 0;
+  static uint8_t seq = 0;
+
+  if(sample == NULL) return ESP_FAIL;
+
+  //apply decimation
+  if(++prescaler < rawDecimation) return ESP_OK;
+  prescaler = 0;
+
+  uint32_t head = rawHead;
+  uint32_t next = (head + 1) & RAWSTREAM_BUFFER_MASK;
+
+  //buffer full, drop this sample (sequence nr is still incremented)
+  if(next == rawTail)
+  {
+    seq++;
+    rawDropped++;
+    return ESP_FAIL;
+  }
+
+  rawBuffer[head].sample = *sample;
+  rawBuffer[head].seq = seq++;
+  //make sure the sample is written before publishing it
+  __sync_synchronize();
+  rawHead = next;
+
+  if(rawTaskHandle != NULL) xTaskNotifyGive(rawTaskHandle);
+  return ESP_OK;
+}
+
+uint32_t taskRawStreamGetDropped(void)
+{
+  return rawDropped;
+}
+
+esp_err_t taskRawStreamInit(void)
+{
+  //set log level to given log level
+  esp_log_level_set(LOG_TAG,LOG_LEVEL_RAWSTREAM);
+
+  if(xTaskCreate(task_rawstream,"rawstream",TASK_RAWSTREAM_STACKSIZE, \
+    NULL,TASK_RAWSTREAM_PRIORITY,&rawTaskHandle) != pdPASS)
+  {
+    ESP_LOGE(LOG_TAG,"Cannot create raw stream task");
+    return ESP_FAIL;
+  }
+  return ESP_OK;
+}
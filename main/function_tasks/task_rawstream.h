@@ -0,0 +1,141 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ * Copyright 2017 Benjamin Aigner <aignerb@technikum-wien.at,
+ * beni@asterics-foundation.org>
+ */
+/** @file
+ * @brief CONTINOUS TASK - Streaming of raw sensor values (AT SR)
+ *
+ * If raw value reporting is enabled (AT SR), the ADC tasks pass each
+ * sample to this module via taskRawStreamPush. The samples are decimated
+ * and stored in a lock-free single producer/single consumer ring buffer.
+ * A low priority task drains this buffer and sends the samples to the
+ * serial interface (and the websocket, if connected).
+ * The ADC tasks never block on the serial interface, if the buffer is full,
+ * the sample is dropped.
+ *
+ * Following formats are available: <br>
+ * * RAWSTREAM_ASCII: "VALUES:<pressure>,<up>,<down>,<left>,<right>,<x>,<y>" (default, one line per sample) <br>
+ * * RAWSTREAM_BINARY: one full frame per sample <br>
+ * * RAWSTREAM_DELTA: delta frames to the previous sample, a full frame
+ *   is sent every RAWSTREAM_KEYFRAME_INTERVAL samples, after a dropped
+ *   sample or if a delta does not fit into 8 bits. <br>
+ *
+ * Binary frame layout (all values little endian): <br>
+ * * Full frame: RAWSTREAM_SYNC | 'R' | sequence nr (1B) | pressure, up, down, left, right (uint16) | x, y (int16) <br>
+ * * Delta frame: RAWSTREAM_SYNC | 'D' | sequence nr (1B) | pressure, up, down, left, right, x, y (each int8) <br>
+ *
+ * The sequence number is incremented for each sample, including dropped
+ * samples. A host can detect gaps this way.
+ *
+ * @see halAdcReportRaw
+ * @see cmdSr
+ */
+
+#ifndef _TASK_RAWSTREAM_H
+#define _TASK_RAWSTREAM_H
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <esp_log.h>
+//common definitions & data for all of these functional tasks
+#include "common.h"
+
+/** @brief Stack size for the raw stream sender task */
+#define TASK_RAWSTREAM_STACKSIZE 2048
+
+/** @brief Count of samples in the ring buffer
+ * @note Must be a power of 2 */
+#define RAWSTREAM_BUFFER_LENGTH 64
+
+/** @brief Maximum size of one binary chunk, sent at once by the sender task
+ * @note Must fit into a standard length websocket frame (125 bytes) */
+#define RAWSTREAM_TX_LENGTH 119
+
+/** @brief In delta mode, send a full frame at least every n samples */
+#define RAWSTREAM_KEYFRAME_INTERVAL 32
+
+/** @brief Decimation if none is given for ASCII format (compatible to previous versions) */
+#define RAWSTREAM_DEFAULT_DECIMATION_ASCII 16
+
+/** @brief Decimation if none is given for binary formats */
+#define RAWSTREAM_DEFAULT_DECIMATION_BINARY 1
+
+/** @brief First byte of each binary frame */
+#define RAWSTREAM_SYNC 0xFE
+
+/** @brief Output format of the raw stream
+ * @note Numbers are used as parameter for AT SR */
+typedef enum rawstream_format {
+  /** @brief "VALUES:..." text line per sample */
+  RAWSTREAM_ASCII = 0,
+  /** @brief Full binary frame per sample */
+  RAWSTREAM_BINARY = 1,
+  /** @brief Delta encoded binary frames */
+  RAWSTREAM_DELTA = 2
+} rawstream_format_t;
+
+/** @brief One raw sensor sample */
+typedef struct rawstream_sample {
+  /** @brief Calibrated pressure value (512 is idle) */
+  uint16_t pressure;
+  /** @brief Raw value of FSR up */
+  uint16_t up;
+  /** @brief Raw value of FSR down */
+  uint16_t down;
+  /** @brief Raw value of FSR left */
+  uint16_t left;
+  /** @brief Raw value of FSR right */
+  uint16_t right;
+  /** @brief Calibrated X value */
+  int16_t x;
+  /** @brief Calibrated Y value */
+  int16_t y;
+} rawstream_sample_t;
+
+/** @brief Initialize the raw stream module & start the sender task
+ * @return ESP_OK on success, ESP_FAIL otherwise
+ * */
+esp_err_t taskRawStreamInit(void);
+
+/** @brief Set format & decimation of the raw stream
+ *
+ * Can be called at any time, the sender task switches the format with
+ * the next sample.
+ * @param format Output format
+ * @param decimation Send only every n-th sample (1 sends every sample). If 0,
+ * the default for this format is used.
+ * @return ESP_OK on success, ESP_FAIL on invalid parameters
+ * */
+esp_err_t taskRawStreamConfigure(rawstream_format_t format, uint8_t decimation);
+
+/** @brief Pass one sample to the raw stream
+ *
+ * Called by the ADC task on each sample. The sample is decimated and
+ * stored in the ring buffer.
+ * @note This function never blocks.
+ * @note Only one task may call this function (single producer).
+ * @param sample Current sensor values
+ * @return ESP_OK if the sample was stored or skipped by decimation,
+ * ESP_FAIL if the buffer is full (sample dropped)
+ * */
+esp_err_t taskRawStreamPush(rawstream_sample_t *sample);
+
+/** @brief Get the count of samples, which were dropped due to a full buffer */
+uint32_t taskRawStreamGetDropped(void);
+
+#endif /*_TASK_RAWSTREAM_H*/
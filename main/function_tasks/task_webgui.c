@@ -175,6 +175,7 @@ void ws_server(void *pvParameters) {
     ESP_LOGI(LOG_TAG,"Incoming WS connection");
     //add the websocket sending functions to hal_serial for getting output data
     halSerialAddOutputStream(WS_write_data);
+    halSerialAddOutputStreamBinary(WS_write_data_binary);
 		ws_server_netconn_serve(newconn);
   }
 	//close connection
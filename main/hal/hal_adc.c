@@ -37,12 +37,12 @@
  * trigger a zero-point calibration of the mouthpiece.
  * 
  * @see adc_config_t
- * @todo Add CIM reporting...
  * @todo Test the on-the-fly calibration
  * @todo Do Strong<Sip/puff>+<UP/DOWN/LEFT/RIGHT>
  * */
  
 #include "hal_adc.h"
+#include "task_debouncer.h"
 
 /** @brief Tag for ESP_LOG logging */
 #define LOG_TAG "hal_adc"
@@ -232,8 +232,15 @@ void halAdcProcessStrongMode(adcData_t *D)
 
 /** @brief Report raw values via serial interface
  * 
- * All values are sent in predefined string: <br>
- * VALUES:\<pressure\>,\<up\>,\<down\>,\<left\>,\<right\>,\<x\>,\<y\> \\r \\n
+ * If raw reporting is enabled, each sample is passed to task_rawstream,
+ * which handles decimation & formatting (default: every 16th sample as
+ * VALUES:\<pressure\>,\<up\>,\<down\>,\<left\>,\<right\>,\<x\>,\<y\> \\r \\n).
+ * This function never blocks on the serial interface.
+ * @see taskRawStreamPush
+ * 
+ * If the CIM mode is active, each sample is passed to the CIM module
+ * instead (binary frames, no prescaler).
+ * @see taskCIMReportSensors
  * 
  * @param up Up value
  * @param down Down value
@@ -245,18 +252,22 @@ void halAdcProcessStrongMode(adcData_t *D)
  * */
 void halAdcReportRaw(uint32_t up, uint32_t down, uint32_t left, uint32_t right, uint32_t pressure, int32_t x, int32_t y)
 {
-    #define REPORT_RAW_COUNT 16
-    static int prescaler = 0;
+    //in CIM mode, report every sample in binary format
+    if(xEventGroupGetBits(connectionRoutingStatus) & DATATO_CIM)
+    {
+        cim_sensordata_t cim = {
+            .up = up, .down = down, .left = left, .right = right,
+            .pressure = pressure, .x = x, .y = y };
+        taskCIMReportSensors(&cim);
+        return;
+    }
     
     if(adc_conf.reportraw != 0)
     {
-        if(prescaler % REPORT_RAW_COUNT == 0)
-        {
-            char data[40];
-            sprintf(data,"VALUES:%d,%d,%d,%d,%d,%d,%d",pressure,up,down,left,right,x,y);
-            halSerialSendUSBSerial(data, strnlen(data,40), 10);
-        }
-        prescaler++;
+        rawstream_sample_t sample = {
+            .pressure = pressure, .up = up, .down = down, .left = left,
+            .right = right, .x = x, .y = y };
+        taskRawStreamPush(&sample);
     }
 }
 
@@ -502,6 +513,9 @@ void halAdcReadData(adcData_t *values)
 #endif /* DEVICE_FLIPMOUSE */
 
 /** @brief Process pressure sensor (sip & puff)
+ * 
+ * The state of all pressure VBs is published at once to the debouncer.
+ * @see taskDebouncerPublish
  * @todo Do everything here, no sip&puff currently available.
  * @todo issue tones only if VB is NOT set (otherwise we will flood the buzzer)
  * @param pressurevalue Currently measured pressure.
@@ -516,8 +530,6 @@ void halAdcProcessPressure(adcData_t *D)
     uint32_t pressurevalue = D->pressure;
     //currently active general config
     generalConfig_t *cfg = configGetCurrent();
-    //the raw event, sent to the debouncer
-    raw_action_t evt;
     //cannot proceed if no global config is available
     if(cfg == NULL) return;
     
@@ -534,20 +546,12 @@ void halAdcProcessPressure(adcData_t *D)
         {
             //create a tone
             TONE(TONE_SIP_FREQ,TONE_SIP_DURATION);
-            //set/clear VBs
-            evt.type = VB_PRESS_EVENT;
-            evt.vb = VB_SIP;
-            xQueueSendToBack(debouncer_in,&evt,0);
             //save fired state
             fired[0] = 1;
         }
     } else {
         if(fired[0] != 2)
         {
-            //set/clear VBs
-            evt.type = VB_RELEASE_EVENT;
-            evt.vb = VB_SIP;
-            xQueueSendToBack(debouncer_in,&evt,0);
             //track fired state
             fired[0] = 2;
         }
@@ -575,10 +579,6 @@ void halAdcProcessPressure(adcData_t *D)
                 TONE(TONE_STRONGSIP_ENTER_FREQ,TONE_STRONGSIP_ENTER_DURATION);
                 //either no strong sip + <yy> action is defined or strong
                 // is used, trigger strong sip VB.
-                
-                evt.type = VB_PRESS_EVENT;
-                evt.vb = VB_STRONGSIP;
-                xQueueSendToBack(debouncer_in,&evt,0);
                 //save fired stated
                 fired[1] = 1;
             }
@@ -588,10 +588,6 @@ void halAdcProcessPressure(adcData_t *D)
     } else {
         if(fired[1] != 2)
         {
-            //set/clear VBs
-            evt.type = VB_RELEASE_EVENT;
-            evt.vb = VB_STRONGSIP;
-            xQueueSendToBack(debouncer_in,&evt,0);
             //track fired state
             fired[1] = 2;
         }
@@ -606,20 +602,12 @@ void halAdcProcessPressure(adcData_t *D)
         {
             //create a tone
             TONE(TONE_PUFF_FREQ,TONE_PUFF_DURATION);
-            //set/clear VBs
-            evt.type = VB_PRESS_EVENT;
-            evt.vb = VB_PUFF;
-            xQueueSendToBack(debouncer_in,&evt,0);
             //save fired state
             fired[2] = 1;
         }
     } else {
         if(fired[2] != 2)
         {
-            //set/clear VBs
-            evt.type = VB_RELEASE_EVENT;
-            evt.vb = VB_PUFF;
-            xQueueSendToBack(debouncer_in,&evt,0);
             //track fired state
             fired[2] = 2;
         }
@@ -647,9 +635,6 @@ void halAdcProcessPressure(adcData_t *D)
                 TONE(TONE_STRONGPUFF_ENTER_FREQ,TONE_STRONGPUFF_ENTER_DURATION);
                 //either no strong puff + <yy> action is defined or strong
                 // is used, trigger strong puff VB.
-                evt.type = VB_PRESS_EVENT;
-                evt.vb = VB_STRONGPUFF;
-                xQueueSendToBack(debouncer_in,&evt,0);
                 //save fired state
                 fired[3] = 1;
             }
@@ -660,14 +645,15 @@ void halAdcProcessPressure(adcData_t *D)
     } else {
         if(fired[3] != 2)
         {
-            //set/clear VBs
-            evt.type = VB_RELEASE_EVENT;
-            evt.vb = VB_STRONGPUFF;
-            xQueueSendToBack(debouncer_in,&evt,0);
             //track fired state
             fired[3] = 2;
         }
     }
+    
+    //publish the state of all pressure VBs at once
+    taskDebouncerPublish(HAL_ADC_PRESSURE_VBS, \
+        ((fired[0] == 1) ? (1UL<<VB_SIP) : 0) | ((fired[1] == 1) ? (1UL<<VB_STRONGSIP) : 0) | \
+        ((fired[2] == 1) ? (1UL<<VB_PUFF) : 0) | ((fired[3] == 1) ? (1UL<<VB_STRONGPUFF) : 0), NULL);
 }
 
 #ifdef DEVICE_FLIPMOUSE
@@ -997,14 +983,13 @@ void halAdcTaskThreshold(void * pvParameters)
 {
     //analog values
     adcData_t D;
-    raw_action_t evt;
     D.strongmode = STRONG_NORMAL;
     TickType_t xLastWakeTime;
     //set adc data reference for timer
     vTimerSetTimerID(adcStrongTimerHandle,&D);
     
     #ifdef DEVICE_FLIPMOUSE
-    uint8_t firedx = 0,firedy = 0;
+    uint32_t dirs = 0;
     #endif
     
     while(1)
@@ -1026,97 +1011,14 @@ void halAdcTaskThreshold(void * pvParameters)
         //TODO: wenn D.strongmode != noraml > eigene fkt. mit berechneten werten.
         //ELSE: folgendes...
         
-        //LEFT/RIGHT value exceeds threshold (deadzone) value?
-        if(D.x != 0)
-        {
-            //if yes, check if not set already (avoid lot of load)
-            if(firedx == 0)
-            {
-                ESP_LOGD(LOG_TAG,"X-axis fired in alternative mode");
-                //set either left or right bit in debouncer input event group
-                if(D.x < 0) 
-                {
-                    evt.type = VB_PRESS_EVENT;
-                    evt.vb = VB_LEFT;
-                    xQueueSendToBack(debouncer_in,&evt,0);
-                    evt.type = VB_RELEASE_EVENT;
-                    evt.vb = VB_RIGHT;
-                    xQueueSendToBack(debouncer_in,&evt,0);
-                    D.x = -1;
-                }
-                if(D.x > 0) 
-                {
-                    evt.type = VB_PRESS_EVENT;
-                    evt.vb = VB_RIGHT;
-                    xQueueSendToBack(debouncer_in,&evt,0);
-                    evt.type = VB_RELEASE_EVENT;
-                    evt.vb = VB_LEFT;
-                    xQueueSendToBack(debouncer_in,&evt,0);
-                    D.x = 1;
-                }
-                //remember that we alread set the flag
-                firedx = 1;
-            }
-        } else {
-            if(firedx != 0)
-            {
-                //below threshold, clear the one-time flag setting variable
-                firedx = 0;
-                //also clear the debouncer event bits
-                evt.type = VB_RELEASE_EVENT;
-                evt.vb = VB_LEFT;
-                xQueueSendToBack(debouncer_in,&evt,0);
-                evt.type = VB_RELEASE_EVENT;
-                evt.vb = VB_RIGHT;
-                xQueueSendToBack(debouncer_in,&evt,0);
-            }
-        }
-        
-        //UP/DOWN value exceeds threshold (deadzone) value?
-        if(D.y != 0)
-        {
-            //if yes, check if not set already (avoid lot of load)
-            if(firedy == 0)
-            {
-                ESP_LOGD(LOG_TAG,"Y-axis fired in alternative mode");
-                //set either left or right bit in debouncer input event group
-                if(D.y < 0) 
-                {
-                    evt.type = VB_PRESS_EVENT;
-                    evt.vb = VB_UP;
-                    xQueueSendToBack(debouncer_in,&evt,0);
-                    evt.type = VB_RELEASE_EVENT;
-                    evt.vb = VB_DOWN;
-                    xQueueSendToBack(debouncer_in,&evt,0);
-                    D.y = -1;
-                }
-                if(D.y > 0) 
-                {
-                    evt.type = VB_PRESS_EVENT;
-                    evt.vb = VB_DOWN;
-                    xQueueSendToBack(debouncer_in,&evt,0);
-                    evt.type = VB_RELEASE_EVENT;
-                    evt.vb = VB_UP;
-                    xQueueSendToBack(debouncer_in,&evt,0);
-                    D.y = 1;
-                }
-                //remember that we alread set the flag
-                firedy = 1;
-            }
-        } else {
-            //below threshold, clear the one-time flag setting variable
-            if(firedy != 0)
-            {
-                firedy = 0;
-                //also clear the debouncer event bits
-                evt.type = VB_RELEASE_EVENT;
-                evt.vb = VB_UP;
-                xQueueSendToBack(debouncer_in,&evt,0);
-                evt.type = VB_RELEASE_EVENT;
-                evt.vb = VB_DOWN;
-                xQueueSendToBack(debouncer_in,&evt,0);
-            }
-        }
+        //LEFT/RIGHT and UP/DOWN value exceeds threshold (deadzone) value?
+        //publish the state of all 4 directions at once (only changes are processed)
+        dirs = 0;
+        if(D.x < 0) dirs |= (1UL<<VB_LEFT);
+        if(D.x > 0) dirs |= (1UL<<VB_RIGHT);
+        if(D.y < 0) dirs |= (1UL<<VB_UP);
+        if(D.y > 0) dirs |= (1UL<<VB_DOWN);
+        taskDebouncerPublish(HAL_ADC_DIRECTION_VBS,dirs,NULL);
         
         halAdcReportRaw(D.up, D.down, D.left, D.right, D.pressure, D.x, D.y);
         
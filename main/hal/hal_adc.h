@@ -39,7 +39,6 @@
  * trigger a zero-point calibration of the mouthpiece.
  * 
  * @see adc_config_t
- * @todo Add raw value reporting for: CIM mode and serial interface
  * */
  
 #include <string.h>
@@ -52,6 +51,8 @@
 //common definitions & data for all of these functional tasks
 #include "common.h"
 #include "hal_serial.h"
+#include "task_cim.h"
+#include "task_rawstream.h"
 #include "math.h"
 
 
@@ -143,6 +144,10 @@
 /** @brief Timeout for strong sip/puff mode [ms] */
 #define HAL_ADC_TIMEOUT_STRONGMODE  1000
 
+/** @brief VBs of the 4 directions in threshold mode, published at once
+ * @see taskDebouncerPublish */
+#define HAL_ADC_DIRECTION_VBS ((1UL<<VB_UP) | (1UL<<VB_DOWN) | (1UL<<VB_LEFT) | (1UL<<VB_RIGHT))
+
 #endif /* DEVICE_FLIPMOUSE */
 
 #ifdef DEVICE_FABI
@@ -159,6 +164,10 @@
 
 #endif /* DEVICE_FABI */
 
+/** @brief VBs of the pressure sensor (sip & puff), published at once
+ * @see taskDebouncerPublish */
+#define HAL_ADC_PRESSURE_VBS ((1UL<<VB_SIP) | (1UL<<VB_STRONGSIP) | (1UL<<VB_PUFF) | (1UL<<VB_STRONGPUFF))
+
 /** @brief Task priority for ADC task */
 #define HAL_IO_ADC_TASK_PRIORITY 4
 /** @brief Stacksize for functional task task_calibration.
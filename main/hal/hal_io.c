@@ -28,8 +28,13 @@
  * * IR LED (sender)
  * * Buzzer
  * 
- * All assigned buttons are processed via one GPIO ISR, which sets press
- * and release flags in the VB input event group.
+ * All assigned buttons are processed via one GPIO ISR, which sends press
+ * and release actions to the debouncer.
+ * To avoid flooding the debouncer queue with contact bounces, the ISR
+ * timestamps each edge in a per-button record. Only the first edge of
+ * a burst is sent, all following edges are merged. After the input was
+ * stable for HAL_IO_EDGE_SETTLE_MS, the settled level is sent if it
+ * differs from the last sent one (see hal_io_edge.c).
  * In addition, one button can be configured for executing an extra handler
  * after a long press (this long press is much longer compared to "long press"
  * actions handled by task_debouncer). This handler is usually used for
@@ -50,6 +55,7 @@
  * */
  
 #include "hal_io.h"
+#include "task_debouncer.h"
 
 /** @brief Log tag */
 #define LOG_TAG "halIO"
@@ -103,6 +109,23 @@ void (*longpress_handler)(void) = NULL;
  * @see halIOAddLongPressHandler */
 TimerHandle_t longactiontimer = NULL;
 
+/** @brief Edge records, one for each VB (only button VBs are used) */
+static hal_io_edge_t edgeRecords[VB_MAX];
+
+/** @brief Lock for edgeRecords, shared by the ISR and the settle timer */
+static portMUX_TYPE edgeLock = portMUX_INITIALIZER_UNLOCKED;
+
+/** @brief Timer handle for checking merged edges
+ * @see HAL_IO_EDGE_SETTLE_MS */
+TimerHandle_t edgetimer = NULL;
+
+/** @brief Count of edges merged into a record (not sent to the debouncer) */
+static volatile uint32_t edgesMerged = 0;
+
+/** @brief Count of edges, which could not be notified due to a full debouncer queue
+ * @note The state is published anyway & processed with the next event. */
+static volatile uint32_t edgesDropped = 0;
+
 /** @brief Clock divider for RMT engine */
 #define RMT_CLK_DIV      100
 
@@ -113,20 +136,106 @@ TimerHandle_t longactiontimer = NULL;
 ledc_timer_config_t buzzer_timer;
 
 
+/** @brief Send one button transition to the debouncer
+ * 
+ * Used by the GPIO ISR and the settle timer. The state of the button
+ * is published via taskDebouncerPublish. Handles the long press
+ * timer as well.
+ * @param vb Virtual button of this input
+ * @param pin GPIO pin of this input
+ * @param level Current level of this input (0 is pressed)
+ * @param woken Pointer for the ISR yield flag, NULL if called from a task
+ */
+static void halIOEdgeSend(uint8_t vb, uint32_t pin, uint8_t level, BaseType_t *woken)
+{
+  //publish state of this button (pressed on low level)
+  if(taskDebouncerPublish(1UL<<vb,(level == 0) ? (1UL<<vb) : 0,woken) != ESP_OK) edgesDropped++;
+  
+  //extra handling for long press
+  if(pin != HAL_IO_PIN_LONGACTION || longactiontimer == NULL) return;
+  if(level == 0)
+  {
+    //reset (starts a dormant timer as well, one timer command only)
+    if(woken != NULL) xTimerResetFromISR(longactiontimer,woken);
+    else xTimerReset(longactiontimer,0);
+  } else {
+    if(woken != NULL) xTimerStopFromISR(longactiontimer,woken);
+    else xTimerStop(longactiontimer,0);
+  }
+}
+
+/** @brief Timer callback for merged edges
+ * 
+ * Checks all edge records with merged edges. If the input was stable
+ * for HAL_IO_EDGE_SETTLE_MS, the current level is sent to the debouncer
+ * (if it differs from the last sent level). Otherwise the timer is
+ * started again.
+ * @param xTimer Timer handle (unused)
+ */
+static void halIOEdgeTimerCallback(TimerHandle_t xTimer)
+{
+  uint32_t now = (uint32_t)esp_timer_get_time();
+  uint8_t restart = 0;
+  
+  for(uint8_t vb = 0; vb < VB_MAX; vb++)
+  {
+    hal_io_edge_t *rec = &edgeRecords[vb];
+    uint8_t send = 0;
+    uint8_t level = 0;
+    
+    portENTER_CRITICAL(&edgeLock);
+    switch(halIOEdgeSettle(rec,now))
+    {
+      case HAL_IO_EDGE_WAIT: restart = 1; break;
+      case HAL_IO_EDGE_STABLE:
+        level = gpio_get_level(rec->pin);
+        send = halIOEdgeReport(rec,level);
+        break;
+      default: break;
+    }
+    portEXIT_CRITICAL(&edgeLock);
+    
+    if(send) halIOEdgeSend(vb,rec->pin,level,NULL);
+  }
+  
+  if(restart) xTimerReset(edgetimer,0);
+}
+
+/** @brief Get the counters of the edge merging in the GPIO ISR
+ * @param merged Count of edges merged into a record (not sent)
+ * @param dropped Count of edges not notified due to a full debouncer queue
+ */
+void halIOGetEdgeStats(uint32_t *merged, uint32_t *dropped)
+{
+  if(merged != NULL) *merged = edgesMerged;
+  if(dropped != NULL) *dropped = edgesDropped;
+}
+
+/** @brief Reset the counters of the edge merging in the GPIO ISR */
+void halIOResetEdgeStats(void)
+{
+  edgesMerged = 0;
+  edgesDropped = 0;
+}
+
 /** @brief GPIO ISR handler for buttons (internal/external)
  * 
  * This ISR handler is called on rising&falling edge of each button
  * GPIO.
  * 
- * It sets and clears the VB flags accordingly on each call.
- * These flags are used for button debouncing.
+ * The first edge of a burst is sent to the debouncer & starts the settle
+ * timer, all further edges are merged into the edge record of this input
+ * until it is stable (see halIOEdgeTimerCallback).
  * @see task_debouncer
+ * @see HAL_IO_EDGE_SETTLE_MS
  */
 static void gpio_isr_handler(void* arg)
 {
   uint32_t pin = (uint32_t) arg;
   uint8_t vb = 0;
-  raw_action_t evt;
+  uint8_t level = 0;
+  uint8_t send = 0;
+  uint8_t start = 0;
   BaseType_t xHigherPriorityTaskWoken = pdFALSE;
   
   //determine pin of ISR reason
@@ -148,39 +257,27 @@ static void gpio_isr_handler(void* arg)
     default: return;
   }
   
-  //set VB number to event.
-  evt.vb = vb;
-  if(debouncer_in == NULL) return;
-
-  //press or release?
-  if(gpio_get_level(pin) == 0)
+  hal_io_edge_t *rec = &edgeRecords[vb];
+  level = gpio_get_level(pin);
+  
+  portENTER_CRITICAL_ISR(&edgeLock);
+  //first edge of a burst is sent, bounces are merged into the record
+  send = halIOEdgeMerge(rec,level,(uint32_t)esp_timer_get_time(),&start);
+  if(send == 0) edgesMerged++;
+  portEXIT_CRITICAL_ISR(&edgeLock);
+  
+  //check again after the input is stable. Started on the first edge of
+  //a burst only, bounces would flood the timer command queue.
+  if(start && (edgetimer == NULL || \
+    xTimerStartFromISR(edgetimer,&xHigherPriorityTaskWoken) != pdPASS))
   {
-    //set an press event
-    evt.type = VB_PRESS_EVENT;
-    //send event
-    xQueueSendToBackFromISR(debouncer_in,&evt,&xHigherPriorityTaskWoken);
-    //extra handling for long press
-    if(pin == HAL_IO_PIN_LONGACTION)
-    {
-      //check if timer is initialized, if yes reset & start
-      if(longactiontimer != NULL)
-      {
-        xTimerResetFromISR(longactiontimer,&xHigherPriorityTaskWoken);
-        xTimerStartFromISR(longactiontimer,&xHigherPriorityTaskWoken);
-      }
-    }
-  } else {
-    //set an press event
-    evt.type = VB_RELEASE_EVENT;
-    //send event
-    xQueueSendToBackFromISR(debouncer_in,&evt,&xHigherPriorityTaskWoken);
-    //extra handling for long press
-    if(pin == HAL_IO_PIN_LONGACTION)
-    {
-      //check if timer is initialized, if yes reset & start
-      if(longactiontimer != NULL) xTimerStopFromISR(longactiontimer,&xHigherPriorityTaskWoken);
-    }
+    //no settle check: the next edge is handled as first edge again
+    portENTER_CRITICAL_ISR(&edgeLock);
+    rec->pending = 0;
+    portEXIT_CRITICAL_ISR(&edgeLock);
   }
+  if(send) halIOEdgeSend(vb,pin,level,&xHigherPriorityTaskWoken);
+  
   if(xHigherPriorityTaskWoken) portYIELD_FROM_ISR();
 }
 
@@ -524,6 +621,30 @@ esp_err_t halIOInit(void)
   
   //TODO: ret vals prüfen
   
+  /*++++ init edge records & timer for merging bounces ++++*/
+  edgeRecords[VB_EXTERNAL1].pin = HAL_IO_PIN_BUTTON_EXT1;
+  edgeRecords[VB_EXTERNAL2].pin = HAL_IO_PIN_BUTTON_EXT2;
+  edgeRecords[VB_INTERNAL1].pin = HAL_IO_PIN_BUTTON_INT1;
+  #ifdef DEVICE_FLIPMOUSE
+    edgeRecords[VB_INTERNAL2].pin = HAL_IO_PIN_BUTTON_INT2;
+  #endif
+  #ifdef DEVICE_FABI
+    edgeRecords[VB_EXTERNAL3].pin = HAL_IO_PIN_BUTTON_EXT3;
+    edgeRecords[VB_EXTERNAL4].pin = HAL_IO_PIN_BUTTON_EXT4;
+    edgeRecords[VB_EXTERNAL5].pin = HAL_IO_PIN_BUTTON_EXT5;
+    edgeRecords[VB_EXTERNAL6].pin = HAL_IO_PIN_BUTTON_EXT6;
+    edgeRecords[VB_EXTERNAL7].pin = HAL_IO_PIN_BUTTON_EXT7;
+  #endif
+  //idle level is high (pull-up)
+  for(uint8_t i = 0; i<VB_MAX; i++) edgeRecords[i].reported = 1;
+  
+  edgetimer = xTimerCreate("IO_edge", HAL_IO_EDGE_SETTLE_TICKS, \
+    pdFALSE, (void *) 0, halIOEdgeTimerCallback);
+  if(edgetimer == NULL)
+  {
+    ESP_LOGE(LOG_TAG,"Edge timer cannot be initialized, settled levels are not checked");
+  }
+  
   //install gpio isr service
   gpio_install_isr_service(0);
   
@@ -57,10 +57,12 @@
 #include "freertos/queue.h"
 #include <esp_log.h>
 #include "esp_err.h"
+#include "esp_timer.h"
 #include "driver/ledc.h"
 #include "driver/gpio.h"
 #include "driver/rmt.h"
 #include "led_strip/led_strip.h"
+#include "hal_io_edge.h"
 //common definitions & data for all of these functional tasks
 #include "common.h"
 #include "../config_switcher.h"
@@ -186,6 +188,10 @@
  * @see halIOAddLongPressHandler */
 #define HAL_IO_LONGACTION_TIMEOUT  5000
 
+/** @brief HAL_IO_EDGE_SETTLE_MS in ticks, at least one tick */
+#define HAL_IO_EDGE_SETTLE_TICKS (((HAL_IO_EDGE_SETTLE_MS/portTICK_PERIOD_MS) > 0) ? \
+  (HAL_IO_EDGE_SETTLE_MS/portTICK_PERIOD_MS) : 1)
+
 /** @brief Set the count of memory blocks utilized for IR sending
  * 
  * ESP32's RMT unit has 8 64x32bits buffers for IR waveforms.
@@ -296,6 +302,16 @@ esp_err_t halIOInit(void);
  */
 void halIOAddLongPressHandler(void (*longpress_h)(void));
 
+/** @brief Get the counters of the edge merging in the GPIO ISR
+ * @param merged Count of edges merged into a record (not sent)
+ * @param dropped Count of edges not notified due to a full debouncer queue
+ * @see HAL_IO_EDGE_SETTLE_MS
+ */
+void halIOGetEdgeStats(uint32_t *merged, uint32_t *dropped);
+
+/** @brief Reset the counters of the edge merging in the GPIO ISR */
+void halIOResetEdgeStats(void);
+
 
 /** @brief Callback to free the memory after finished transmission
  * 
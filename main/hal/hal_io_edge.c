@@ -0,0 +1,53 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ * Copyright 2019 Benjamin Aigner <aignerb@technikum-wien.at,
+ * beni@asterics-foundation.org>
+ */
+/** @file
+ * @brief HAL - Merging of button edges (used by hal_io)
+ * @see hal_io_edge.h
+ */
+
+#include "hal_io_edge.h"
+
+uint8_t halIOEdgeReport(hal_io_edge_t *rec, uint8_t level)
+{
+  if(level == rec->reported) return 0;
+  rec->reported = level;
+  return 1;
+}
+
+uint8_t halIOEdgeMerge(hal_io_edge_t *rec, uint8_t level, uint32_t now, uint8_t *start)
+{
+  uint8_t send = 0;
+
+  rec->lastEdge = now;
+  //first edge of a burst, send it & start the settle timer.
+  //Otherwise: bounce, merge into record (the timer is already running)
+  *start = (rec->pending == 0);
+  if(*start) send = halIOEdgeReport(rec,level);
+  rec->pending = 1;
+  return send;
+}
+
+uint8_t halIOEdgeSettle(hal_io_edge_t *rec, uint32_t now)
+{
+  if(rec->pending == 0) return HAL_IO_EDGE_IDLE;
+  if((now - rec->lastEdge) < (HAL_IO_EDGE_SETTLE_MS * 1000)) return HAL_IO_EDGE_WAIT;
+  rec->pending = 0;
+  return HAL_IO_EDGE_STABLE;
+}
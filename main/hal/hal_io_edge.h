@@ -0,0 +1,98 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ * Copyright 2019 Benjamin Aigner <aignerb@technikum-wien.at,
+ * beni@asterics-foundation.org>
+ */
+/** @file
+ * @brief HAL - Merging of button edges (used by hal_io)
+ *
+ * The GPIO ISR of hal_io sends only the first edge of a burst to the
+ * debouncer, all following edges are merged into an edge record. After
+ * the input was stable for HAL_IO_EDGE_SETTLE_MS, the settled level is
+ * sent if it differs from the last sent one.
+ *
+ * This file contains the decisions only, without any hardware access
+ * (GPIO, timer, locking). It is used by the host simulation as well.
+ * @note All functions must be called with the lock of the record held.
+ * @see hal_io.c
+ */
+#ifndef _HAL_IO_EDGE_H
+#define _HAL_IO_EDGE_H
+
+#include <stdint.h>
+
+/** @brief Time ([ms]) a button input must be stable after a burst of edges.
+ *
+ * The GPIO ISR sends only the first edge of a burst to the debouncer,
+ * all following edges are merged. After this time without an edge,
+ * the current level is sent if it differs from the last sent one.
+ * @note Should be below DEBOUNCETIME_MIN_MS of task_debouncer. */
+#define HAL_IO_EDGE_SETTLE_MS  10
+
+/** @brief Result of halIOEdgeSettle: no merged edges */
+#define HAL_IO_EDGE_IDLE 0
+/** @brief Result of halIOEdgeSettle: input is not stable yet, check again */
+#define HAL_IO_EDGE_WAIT 1
+/** @brief Result of halIOEdgeSettle: input is stable, read & report the level */
+#define HAL_IO_EDGE_STABLE 2
+
+/** @brief Edge record of one button input, used by the GPIO ISR to merge bounces */
+typedef struct hal_io_edge {
+  /** @brief GPIO pin of this button */
+  uint8_t pin;
+  /** @brief Level which was sent last to the debouncer (0 is pressed) */
+  uint8_t reported;
+  /** @brief Edges were merged, waiting for a stable level */
+  uint8_t pending;
+  /** @brief Timestamp of the last edge, unit: [us] (lower 32bit of esp_timer_get_time) */
+  uint32_t lastEdge;
+} hal_io_edge_t;
+
+/** @brief Record one edge of a button input (called by the GPIO ISR)
+ *
+ * The first edge of a burst is sent (if the level differs from the last
+ * sent one), all further edges are merged until the input is stable.
+ * The settle timer is started on the first edge of a burst only, it is
+ * started again by its callback as long as a record is not stable.
+ * Bounces must not send timer commands, the timer command queue is
+ * short (CONFIG_TIMER_QUEUE_LENGTH) & shared with the long press timer.
+ * @param rec Edge record of this input
+ * @param level Current level of this input (0 is pressed)
+ * @param now Current time, unit: [us] (lower 32bit of esp_timer_get_time)
+ * @param start Set to 1 if the settle timer must be started, 0 otherwise
+ * @return 1 if this level must be sent, 0 if the edge was merged
+ */
+uint8_t halIOEdgeMerge(hal_io_edge_t *rec, uint8_t level, uint32_t now, uint8_t *start);
+
+/** @brief Check if a record with merged edges is stable (called by the settle timer)
+ *
+ * If the last edge is at least HAL_IO_EDGE_SETTLE_MS ago, the burst
+ * is finished. The caller reads the level & calls halIOEdgeReport.
+ * @param rec Edge record of this input
+ * @param now Current time, unit: [us] (lower 32bit of esp_timer_get_time)
+ * @return HAL_IO_EDGE_IDLE, HAL_IO_EDGE_WAIT or HAL_IO_EDGE_STABLE
+ */
+uint8_t halIOEdgeSettle(hal_io_edge_t *rec, uint32_t now);
+
+/** @brief Update the sent level of a record
+ * @param rec Edge record of this input
+ * @param level Current level of this input (0 is pressed)
+ * @return 1 if this level differs from the last sent one & must be sent, 0 otherwise
+ */
+uint8_t halIOEdgeReport(hal_io_edge_t *rec, uint8_t level);
+
+#endif /*_HAL_IO_EDGE_H*/
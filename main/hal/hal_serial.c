@@ -81,6 +81,15 @@ static const int BUF_SIZE_RX = 512;
  * */
 serialoutput_h outputcb = NULL;
 
+/** @brief Output callback for binary data
+ * 
+ * If this callback is != NULL, the function halSerialSendRawStream
+ * will send data to this callback in addition to the serial interface
+ * @see halSerialSendRawStream
+ * @see serialoutput_h
+ * */
+serialoutput_h outputcb_bin = NULL;
+
 /** @brief Length of queue for AT commands
  * @note A maximum of CMDQUEUE_SIZE x ATCMD_LENGTH can be allocated (if
  * no task receives the commands)
@@ -139,18 +148,14 @@ void halSerialRXTask(void *pvParameters)
       switch(parserstate)
       {
         case 0:
+          //if starting with '@' or CIM mode is active, pass to CIM parser.
+          //it will leave the CIM mode on a leading 'A'.
+          if(taskCIMParseByte(data) != 0) break;
           //check for leading "A"
           if(data == 'A' || data == 'a') 
           { 
-            ///@todo When CIM mode is active, switch back here to AT mode
             parserstate++; 
           }
-          //if starting with '@', go to CIM mode.
-          if(data == '@')
-          {
-            ///@todo Activate CIM mode here.
-            ESP_LOGW(LOG_TAG,"CIM mode currently unsupported!");
-          }
         break;
         
         
@@ -445,6 +450,60 @@ int halSerialSendUSBSerial(char *data, uint32_t length, TickType_t ticks_to_wait
   } else return -1;
 }
 
+/** @brief Send binary data to USB-Serial (USB-CDC)
+ * 
+ * This method sends bytes to the UART, without appending a line ending
+ * and without sending to the additional output stream.
+ * Used for binary protocols (CIM mode).
+ * 
+ * @return -1 on error, number of sent bytes otherwise
+ * @param data Data to be sent
+ * @param length Number of bytes to send
+ * @param ticks_to_wait Maximum time to wait for a free UART
+ * */
+int halSerialSendUSBSerialBinary(uint8_t *data, uint32_t length, TickType_t ticks_to_wait) 
+{
+  if(serialsendingsem == NULL) return -1;
+  
+  //acquire mutex to have TX permission on UART
+  if(xSemaphoreTake(serialsendingsem, ticks_to_wait) == pdTRUE)
+  {
+    //send the data
+    int txBytes = uart_write_bytes(HAL_SERIAL_UART, (const char*)data, length);
+    //release mutex
+    xSemaphoreGive(serialsendingsem);
+    
+    return txBytes;
+  } else return -1;
+}
+
+/** @brief Send a frame of the raw value stream
+ * 
+ * Same as halSerialSendUSBSerialBinary, but the data is passed to the
+ * additional binary output stream as well (webgui). Other binary
+ * protocols (CIM) are not sent there.
+ * 
+ * @return -1 on error, number of sent bytes otherwise
+ * @param data Data to be sent
+ * @param length Number of bytes to send
+ * @param ticks_to_wait Maximum time to wait for a free UART
+ * */
+int halSerialSendRawStream(uint8_t *data, uint32_t length, TickType_t ticks_to_wait)
+{
+  if(serialsendingsem == NULL) return -1;
+  
+  //send to additional binary output stream
+  if(outputcb_bin != NULL)
+  {
+    if(outputcb_bin((char*)data,length) != ESP_OK)
+    {
+      ESP_LOGE(LOG_TAG,"Additional binary stream cannot be sent,removing stream!");
+      outputcb_bin = NULL;
+    }
+  }
+  return halSerialSendUSBSerialBinary(data,length,ticks_to_wait);
+}
+
 /** @brief Reset the serial HID report data
  * 
  * Used for slot/config switchers.
@@ -508,6 +567,7 @@ void halSerialReset(uint8_t exceptDevice)
 void halSerialRemoveOutputStream(void)
 {
   outputcb = NULL;
+  outputcb_bin = NULL;
 }
 
 /** @brief Set an additional function for outputting the serial data
@@ -523,6 +583,16 @@ void halSerialAddOutputStream(serialoutput_h cb)
   outputcb = cb;
 }
 
+/** @brief Set an additional function for outputting binary serial data
+ * 
+ * This callback receives all data sent by halSerialSendRawStream.
+ * @param cb Function callback
+*/
+void halSerialAddOutputStreamBinary(serialoutput_h cb)
+{
+  outputcb_bin = cb;
+}
+
 /** @brief CB for finished HID output (RMT), releases mutex */
 void halSerialHIDFinished(rmt_channel_t channel, void *arg)
 {
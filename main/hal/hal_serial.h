@@ -58,6 +58,8 @@
 #include "keyboard.h"
 //used to get current locale information
 #include "../config_switcher.h"
+//CIM mode parser
+#include "task_cim.h"
 
 /** @brief TX pin for serial IF to LPC chip */
 #define HAL_SERIAL_TXPIN      (GPIO_NUM_17)
@@ -116,11 +118,21 @@ typedef esp_err_t (*serialoutput_h)(char* p_data, size_t length);
 */
 void halSerialAddOutputStream(serialoutput_h cb);
 
+/** @brief Set an additional function for outputting binary serial data
+ * 
+ * Similar to halSerialAddOutputStream, but this callback receives
+ * all data sent via halSerialSendRawStream (binary raw value stream).
+ * The webgui sends this data as binary websocket frames.
+ * @see halSerialSendRawStream
+ * @param cb Function callback
+*/
+void halSerialAddOutputStreamBinary(serialoutput_h cb);
+
 
 /** @brief Remove the additional function for outputting the serial data
  * 
- * This function removes the callback, which is used if the program needs
- * an additional output despite the serial interface.
+ * This function removes the callbacks (text & binary), which are used if
+ * the program needs an additional output despite the serial interface.
 */
 void halSerialRemoveOutputStream(void);
 
@@ -175,6 +187,32 @@ void halSerialReset(uint8_t exceptDevice);
  * */
 int halSerialSendUSBSerial(char *data, uint32_t length, TickType_t ticks_to_wait);
 
+/** @brief Send binary data to USB-Serial (USB-CDC)
+ * 
+ * This method sends bytes to the UART, without appending a line ending
+ * and without sending to the additional output streams.
+ * Used for binary protocols (CIM mode).
+ * 
+ * @return -1 on error, number of sent bytes otherwise
+ * @param data Data to be sent
+ * @param length Number of bytes to send
+ * @param ticks_to_wait Maximum time to wait for a free UART
+ * */
+int halSerialSendUSBSerialBinary(uint8_t *data, uint32_t length, TickType_t ticks_to_wait);
+
+/** @brief Send a frame of the raw value stream
+ * 
+ * Same as halSerialSendUSBSerialBinary, but the data is passed to the
+ * additional binary output stream as well (if registered).
+ * @see halSerialAddOutputStreamBinary
+ * 
+ * @return -1 on error, number of sent bytes otherwise
+ * @param data Data to be sent
+ * @param length Number of bytes to send
+ * @param ticks_to_wait Maximum time to wait for a free UART
+ * */
+int halSerialSendRawStream(uint8_t *data, uint32_t length, TickType_t ticks_to_wait);
+
 /** @brief Flush Serial RX input buffer */
 void halSerialFlushRX(void);
 
@@ -50,8 +50,26 @@
  * Slots are stored in following naming convention (8.3 rule applies here):
  * general slot config:
  * xxx.set (slot number, e.g., 000.set for slot 1)
+ * precompiled image of a slot (see slot_image.h)
+ * xxx.sbi
+ * index of the slots (name, size, checksum & image size for each slot)
+ * SLOTS.BIN
  * infrared commands
  * xxx_IR.set
+ * index of the infrared commands (name, length & checksum for each command)
+ * IR_INDEX.BIN
+ * 
+ * The IR index is loaded into RAM on init, IR commands are found without
+ * opening the IR files. It is updated on each store/delete (written to
+ * IR_INDEX.TMP, which replaces the index). If the index is missing or
+ * corrupt, it is rebuilt by reading all IR files.
+ * The slot index is handled the same way (SLOTS.TMP replaces SLOTS.BIN),
+ * slot names & counts are answered from RAM. The index is updated when
+ * a stored slot is finished (halStorageFinishTransaction) and on delete.
+ * 
+ * Images of the current slot & its neighbours are kept in RAM (slot
+ * cache, see halStoragePrefetch), limited by a memory budget. The cache
+ * is cleared on each store or delete.
  * 
  * @note Maximum number of slots: 250! (e.g. 000.set - 249.set)
  * @note Maximum number of IR commands: 250 (e.g. IR_000.set - IR_249.set)
@@ -62,6 +80,8 @@
  */
 
 #include "hal_storage.h"
+#include "slot_image.h"
+#include <rom/crc.h>
 
 #define LOG_TAG "hal_storage"
 #define LOG_LEVEL_STORAGE ESP_LOG_DEBUG
@@ -80,6 +100,13 @@ static uint8_t storageCurrentSlotNumber = 0;
  * on halStorageFinishTransaction
  * */
 static FILE *storeHandle = NULL;
+/** @brief Slot number of the file in storeHandle, the slot index is
+ * updated for this slot on halStorageFinishTransaction */
+static uint8_t storeSlotNumber = 0;
+/** @brief Set if the last slot loaded by halStorageLoadNumber was
+ * installed from its image
+ * @see halStorageIsImageLoaded */
+static uint8_t storageImageLoaded = 0;
 
 /** @brief Wear levelling handle */
 static wl_handle_t s_wl_handle = WL_INVALID_HANDLE;
@@ -95,6 +122,629 @@ const static char *base_path = "/spiflash";
  * */
 char storageCurrentTIDHolder[32];
 
+/** @brief Count of changes of the stored IR commands
+ * @see halStorageGetIRGeneration */
+static volatile uint32_t storageIRGeneration = 0;
+
+uint32_t halStorageGetIRGeneration(void)
+{
+  return storageIRGeneration;
+}
+
+/** @brief Magic number of the IR index file ("FLIX") */
+#define IR_INDEX_MAGIC 0x58494C46
+/** @brief Version of the IR index file, increase on each change of the layout */
+#define IR_INDEX_VERSION 1
+/** @brief Maximum count of IR commands (IR_000.set - IR_249.set) */
+#define IR_INDEX_MAX 250
+
+/** @brief Header of the IR index file, followed by count x ir_index_entry_t */
+typedef struct __attribute__ ((packed)) ir_index_header {
+  /** @brief Must be IR_INDEX_MAGIC */
+  uint32_t magic;
+  /** @brief Must be IR_INDEX_VERSION */
+  uint16_t version;
+  /** @brief Count of entries */
+  uint16_t count;
+  /** @brief CRC32 of all entries */
+  uint32_t crc;
+} ir_index_header_t;
+
+/** @brief One IR command in the index, entry n is stored in IR_n.set */
+typedef struct __attribute__ ((packed)) ir_index_entry {
+  /** @brief Name of the IR command */
+  char name[SLOTNAME_LENGTH];
+  /** @brief Count of IR edges */
+  uint16_t length;
+  /** @brief CRC32 of the IR edges */
+  uint32_t checksum;
+} ir_index_entry_t;
+
+/** @brief IR index, loaded into RAM on init (name -> number, length, checksum)
+ * @note Only accessed with a valid transaction (or on init) */
+static ir_index_entry_t *irIndex = NULL;
+/** @brief Count of IR commands in irIndex */
+static uint8_t irIndexCount = 0;
+/** @brief Set if irIndex is loaded (or rebuilt) */
+static uint8_t irIndexValid = 0;
+
+/** @brief Write the IR index file
+ * 
+ * The index is written to a temporary file first, which replaces the
+ * previous one. If this fails, the index is rebuilt on the next start.
+ * @return ESP_OK on success, ESP_FAIL otherwise */
+static esp_err_t halStorageIRIndexWrite(void)
+{
+  char file[sizeof(base_path)+32];
+  char filetmp[sizeof(base_path)+32];
+  ir_index_header_t header;
+  
+  sprintf(file,"%s/IR_INDEX.BIN",base_path);
+  sprintf(filetmp,"%s/IR_INDEX.TMP",base_path);
+  
+  header.magic = IR_INDEX_MAGIC;
+  header.version = IR_INDEX_VERSION;
+  header.count = irIndexCount;
+  header.crc = crc32_le(0,(uint8_t*)irIndex,sizeof(ir_index_entry_t)*irIndexCount);
+  
+  FILE *f = fopen(filetmp, "wb");
+  if(f == NULL)
+  {
+    ESP_LOGE(LOG_TAG,"cannot open file for writing: %s",filetmp);
+    return ESP_FAIL;
+  }
+  if(fwrite(&header,sizeof(ir_index_header_t),1,f) != 1 || \
+    fwrite(irIndex,sizeof(ir_index_entry_t),irIndexCount,f) != irIndexCount)
+  {
+    ESP_LOGE(LOG_TAG,"Error writing IR index");
+    fclose(f);
+    remove(filetmp);
+    return ESP_FAIL;
+  }
+  fclose(f);
+  
+  //replace the previous index (FAT cannot rename to an existing file)
+  remove(file);
+  if(rename(filetmp,file) != 0)
+  {
+    ESP_LOGE(LOG_TAG,"Cannot rename IR index");
+    return ESP_FAIL;
+  }
+  return ESP_OK;
+}
+
+/** @brief Load the IR index file into RAM
+ * @return ESP_OK on success, ESP_FAIL if not available or corrupt */
+static esp_err_t halStorageIRIndexLoad(void)
+{
+  char file[sizeof(base_path)+32];
+  ir_index_header_t header;
+  
+  sprintf(file,"%s/IR_INDEX.BIN",base_path);
+  FILE *f = fopen(file, "rb");
+  if(f == NULL) return ESP_FAIL;
+  
+  if(fread(&header,sizeof(ir_index_header_t),1,f) != 1 || \
+    header.magic != IR_INDEX_MAGIC || header.version != IR_INDEX_VERSION || \
+    header.count > IR_INDEX_MAX)
+  {
+    ESP_LOGW(LOG_TAG,"Invalid IR index header");
+    fclose(f);
+    return ESP_FAIL;
+  }
+  
+  ir_index_entry_t *entries = malloc(sizeof(ir_index_entry_t)*(header.count+1));
+  if(entries == NULL)
+  {
+    fclose(f);
+    return ESP_FAIL;
+  }
+  if(fread(entries,sizeof(ir_index_entry_t),header.count,f) != header.count || \
+    crc32_le(0,(uint8_t*)entries,sizeof(ir_index_entry_t)*header.count) != header.crc)
+  {
+    ESP_LOGW(LOG_TAG,"IR index is corrupt");
+    free(entries);
+    fclose(f);
+    return ESP_FAIL;
+  }
+  fclose(f);
+  
+  free(irIndex);
+  irIndex = entries;
+  irIndexCount = header.count;
+  irIndexValid = 1;
+  ESP_LOGI(LOG_TAG,"Loaded IR index, %u cmds",irIndexCount);
+  return ESP_OK;
+}
+
+/** @brief Rebuild the IR index by reading all IR command files
+ * 
+ * IR commands are read in order until the first missing file.
+ * The new index is written to the IR index file.
+ * @return ESP_OK on success, ESP_FAIL otherwise */
+static esp_err_t halStorageIRIndexRebuild(void)
+{
+  char file[sizeof(base_path)+32];
+  uint32_t namelen;
+  rmt_item32_t *buf = malloc(sizeof(rmt_item32_t)*TASK_HAL_IR_RECV_MAXIMUM_EDGES);
+  ir_index_entry_t *entries = malloc(sizeof(ir_index_entry_t)*IR_INDEX_MAX);
+  uint8_t count = 0;
+  
+  if(buf == NULL || entries == NULL)
+  {
+    ESP_LOGE(LOG_TAG,"No memory for rebuilding IR index");
+    free(buf);
+    free(entries);
+    return ESP_FAIL;
+  }
+  
+  while(count < IR_INDEX_MAX)
+  {
+    ir_index_entry_t *e = &entries[count];
+    sprintf(file,"%s/IR_%03d.set",base_path,count);
+    FILE *f = fopen(file, "rb");
+    if(f == NULL) break;
+    
+    //name, length & IR edges
+    memset(e,0,sizeof(ir_index_entry_t));
+    if(fread(&namelen,sizeof(uint32_t),1,f) != 1 || namelen >= SLOTNAME_LENGTH || \
+      fread(e->name,sizeof(char),namelen+1,f) != namelen+1 || \
+      fread(&e->length,sizeof(uint16_t),1,f) != 1 || \
+      e->length > TASK_HAL_IR_RECV_MAXIMUM_EDGES || \
+      fread(buf,sizeof(rmt_item32_t),e->length,f) != e->length)
+    {
+      ESP_LOGE(LOG_TAG,"IR cmd %u is corrupt, stopped rebuilding index",count);
+      fclose(f);
+      break;
+    }
+    fclose(f);
+    e->name[namelen] = '\0';
+    e->checksum = crc32_le(0,(uint8_t*)buf,sizeof(rmt_item32_t)*e->length);
+    count++;
+  }
+  free(buf);
+  
+  //shrink to the used size (+1 for a new command)
+  ir_index_entry_t *shrinked = realloc(entries,sizeof(ir_index_entry_t)*(count+1));
+  if(shrinked != NULL) entries = shrinked;
+  free(irIndex);
+  irIndex = entries;
+  irIndexCount = count;
+  irIndexValid = 1;
+  ESP_LOGW(LOG_TAG,"Rebuilt IR index, %u cmds",count);
+  return halStorageIRIndexWrite();
+}
+
+/** @brief Ensure the IR index is available, rebuild it if necessary
+ * @return ESP_OK if the index is valid, ESP_FAIL otherwise */
+static esp_err_t halStorageIRIndexCheck(void)
+{
+  if(irIndexValid) return ESP_OK;
+  if(halStorageIRIndexLoad() == ESP_OK) return ESP_OK;
+  halStorageIRIndexRebuild();
+  return irIndexValid ? ESP_OK : ESP_FAIL;
+}
+
+/** @brief Discard the IR index (RAM & file), it is rebuilt on the next access */
+static void halStorageIRIndexInvalidate(void)
+{
+  char file[sizeof(base_path)+32];
+  sprintf(file,"%s/IR_INDEX.BIN",base_path);
+  remove(file);
+  irIndexValid = 0;
+}
+
+/** @brief One slot image kept in RAM by the slot cache */
+typedef struct slot_cache_entry {
+  /** @brief Image data (as in n.sbi), NULL if this entry is unused */
+  uint8_t *image;
+  /** @brief Size of the image in bytes */
+  uint32_t size;
+  /** @brief Number of the slot */
+  uint8_t slot;
+} slot_cache_entry_t;
+
+/** @brief Slot cache, images of the current slot & its neighbours
+ * @note Only accessed with a valid transaction
+ * @see halStoragePrefetch */
+static slot_cache_entry_t slotCache[SLOT_CACHE_ENTRIES];
+/** @brief Statistics of the slot cache, the budget is set by
+ * halStorageSetCacheBudget */
+static slot_cache_stats_t slotCacheStats = { .budget = SLOT_CACHE_BUDGET_DEFAULT };
+
+/** @brief Remove all images from the slot cache
+ * 
+ * Called on each change of slot files or images (store, delete, index
+ * rebuild), cached images are never used for a changed slot. */
+static void halStorageSlotCacheClear(void)
+{
+  for(uint8_t i = 0; i<SLOT_CACHE_ENTRIES; i++)
+  {
+    free(slotCache[i].image);
+    slotCache[i].image = NULL;
+  }
+  slotCacheStats.entries = 0;
+  slotCacheStats.bytes = 0;
+}
+
+/** @brief Magic number of the slot index file ("FLSX") */
+#define SLOT_INDEX_MAGIC 0x58534C46
+/** @brief Version of the slot index file, increase on each change of the layout */
+#define SLOT_INDEX_VERSION 1
+/** @brief Maximum count of slots (000.set - 249.set) */
+#define SLOT_INDEX_MAX 250
+/** @brief Count of hash buckets for the name lookup (power of 2) */
+#define SLOT_INDEX_BUCKETS 64
+/** @brief Marks the end of a hash chain */
+#define SLOT_INDEX_NONE 0xFF
+
+/** @brief Header of the slot index file, followed by count x slot_index_entry_t */
+typedef struct __attribute__ ((packed)) slot_index_header {
+  /** @brief Must be SLOT_INDEX_MAGIC */
+  uint32_t magic;
+  /** @brief Must be SLOT_INDEX_VERSION */
+  uint16_t version;
+  /** @brief Count of entries */
+  uint16_t count;
+  /** @brief CRC32 of all entries */
+  uint32_t crc;
+} slot_index_header_t;
+
+/** @brief One slot in the index, entry n is stored in n.set (e.g. 000.set) */
+typedef struct __attribute__ ((packed)) slot_index_entry {
+  /** @brief Name of the slot, empty if the slot tag is missing */
+  char name[SLOTNAME_LENGTH];
+  /** @brief Size of the slot file in bytes */
+  uint32_t size;
+  /** @brief CRC32 of the slot file (same as slot_image_header_t.sourcecrc) */
+  uint32_t checksum;
+  /** @brief Size of the precompiled image (n.sbi), 0 if there is no
+   * image or if it was not created from this slot file */
+  uint32_t image;
+} slot_index_entry_t;
+
+/** @brief Slot index, loaded into RAM on init (name -> number, size, checksum, image)
+ * @note Only accessed with a valid transaction (or on init) */
+static slot_index_entry_t *slotIndex = NULL;
+/** @brief Count of slots in slotIndex */
+static uint8_t slotIndexCount = 0;
+/** @brief Set if slotIndex is loaded (or rebuilt) */
+static uint8_t slotIndexValid = 0;
+/** @brief Hash buckets of the slot names, first slot number of each chain */
+static uint8_t slotIndexBuckets[SLOT_INDEX_BUCKETS];
+/** @brief Next slot number in the hash chain for each slot */
+static uint8_t slotIndexChain[SLOT_INDEX_MAX];
+
+/** @brief Hash bucket of a slot name (FNV-1a) */
+static uint8_t halStorageSlotIndexBucket(const char *name)
+{
+  uint32_t hash = 2166136261u;
+  while(*name != 0) hash = (hash ^ (uint8_t)*name++) * 16777619u;
+  return hash & (SLOT_INDEX_BUCKETS - 1);
+}
+
+/** @brief Rebuild the hash chains for the name lookup
+ * 
+ * Slots are inserted from the last to the first one, the lowest slot
+ * number of equal names is found first. */
+static void halStorageSlotIndexHash(void)
+{
+  memset(slotIndexBuckets,SLOT_INDEX_NONE,sizeof(slotIndexBuckets));
+  for(int16_t i = slotIndexCount-1; i >= 0; i--)
+  {
+    uint8_t bucket = halStorageSlotIndexBucket(slotIndex[i].name);
+    slotIndexChain[i] = slotIndexBuckets[bucket];
+    slotIndexBuckets[bucket] = i;
+  }
+}
+
+/** @brief Read one slot file (and its image) to create an index entry
+ * @param slotnumber Number of the slot
+ * @param e Entry to be filled
+ * @return ESP_OK on success, ESP_FAIL if the slot file is not available */
+static esp_err_t halStorageSlotIndexScan(uint8_t slotnumber, slot_index_entry_t *e)
+{
+  char file[sizeof(base_path)+32];
+  size_t len;
+  slot_image_header_t header;
+  
+  sprintf(file,"%s/%03d.set",base_path,slotnumber);
+  FILE *f = fopen(file, "rb");
+  if(f == NULL) return ESP_FAIL;
+  
+  char *buf = malloc(512);
+  if(buf == NULL)
+  {
+    ESP_LOGE(LOG_TAG,"No memory for scanning slot %u",slotnumber);
+    fclose(f);
+    return ESP_FAIL;
+  }
+  memset(e,0,sizeof(slot_index_entry_t));
+  
+  //slot name ("Slot XXX:<name>")
+  if(fgets(buf,SLOTNAME_LENGTH+10,f) != NULL && \
+    strncmp(buf,"Slot",strlen("Slot")) == 0 && strpbrk(buf,":") != NULL)
+  {
+    char *begin = strpbrk(buf,":");
+    strip(begin);
+    strncpy(e->name,begin+1,SLOTNAME_LENGTH-1);
+  } else {
+    ESP_LOGE(LOG_TAG,"Missing \"Slot XXX:\" tag in slot %u",slotnumber);
+  }
+  
+  //size & checksum of the whole file
+  fseek(f,0,SEEK_SET);
+  while((len = fread(buf,1,512,f)) > 0)
+  {
+    e->checksum = crc32_le(e->checksum,(uint8_t*)buf,len);
+    e->size += len;
+  }
+  fclose(f);
+  free(buf);
+  
+  //precompiled image, only used if it was created from this slot file
+  sprintf(file,"%s/%03d.%s",base_path,slotnumber,SLOT_IMAGE_EXTENSION);
+  f = fopen(file, "rb");
+  if(f != NULL)
+  {
+    if(fread(&header,sizeof(slot_image_header_t),1,f) == 1 && \
+      header.magic == SLOT_IMAGE_MAGIC && header.version == SLOT_IMAGE_VERSION && \
+      header.configsize == sizeof(generalConfig_t) && header.sourcecrc == e->checksum)
+    {
+      fseek(f,0,SEEK_END);
+      e->image = ftell(f);
+    } else {
+      ESP_LOGW(LOG_TAG,"Image of slot %u is outdated",slotnumber);
+    }
+    fclose(f);
+  }
+  return ESP_OK;
+}
+
+/** @brief Write the slot index file
+ * 
+ * The index is written to a temporary file first, which replaces the
+ * previous one. If this fails, the index is rebuilt on the next start.
+ * @return ESP_OK on success, ESP_FAIL otherwise */
+static esp_err_t halStorageSlotIndexWrite(void)
+{
+  char file[sizeof(base_path)+32];
+  char filetmp[sizeof(base_path)+32];
+  slot_index_header_t header;
+  
+  sprintf(file,"%s/SLOTS.BIN",base_path);
+  sprintf(filetmp,"%s/SLOTS.TMP",base_path);
+  
+  header.magic = SLOT_INDEX_MAGIC;
+  header.version = SLOT_INDEX_VERSION;
+  header.count = slotIndexCount;
+  header.crc = crc32_le(0,(uint8_t*)slotIndex,sizeof(slot_index_entry_t)*slotIndexCount);
+  
+  FILE *f = fopen(filetmp, "wb");
+  if(f == NULL)
+  {
+    ESP_LOGE(LOG_TAG,"cannot open file for writing: %s",filetmp);
+    return ESP_FAIL;
+  }
+  if(fwrite(&header,sizeof(slot_index_header_t),1,f) != 1 || \
+    fwrite(slotIndex,sizeof(slot_index_entry_t),slotIndexCount,f) != slotIndexCount)
+  {
+    ESP_LOGE(LOG_TAG,"Error writing slot index");
+    fclose(f);
+    remove(filetmp);
+    return ESP_FAIL;
+  }
+  fclose(f);
+  
+  //replace the previous index (FAT cannot rename to an existing file)
+  remove(file);
+  if(rename(filetmp,file) != 0)
+  {
+    ESP_LOGE(LOG_TAG,"Cannot rename slot index");
+    return ESP_FAIL;
+  }
+  return ESP_OK;
+}
+
+/** @brief Load the slot index file into RAM
+ * @return ESP_OK on success, ESP_FAIL if not available or corrupt */
+static esp_err_t halStorageSlotIndexLoad(void)
+{
+  char file[sizeof(base_path)+32];
+  slot_index_header_t header;
+  
+  sprintf(file,"%s/SLOTS.BIN",base_path);
+  FILE *f = fopen(file, "rb");
+  if(f == NULL) return ESP_FAIL;
+  
+  if(fread(&header,sizeof(slot_index_header_t),1,f) != 1 || \
+    header.magic != SLOT_INDEX_MAGIC || header.version != SLOT_INDEX_VERSION || \
+    header.count > SLOT_INDEX_MAX)
+  {
+    ESP_LOGW(LOG_TAG,"Invalid slot index header");
+    fclose(f);
+    return ESP_FAIL;
+  }
+  
+  slot_index_entry_t *entries = malloc(sizeof(slot_index_entry_t)*(header.count+1));
+  if(entries == NULL)
+  {
+    fclose(f);
+    return ESP_FAIL;
+  }
+  if(fread(entries,sizeof(slot_index_entry_t),header.count,f) != header.count || \
+    crc32_le(0,(uint8_t*)entries,sizeof(slot_index_entry_t)*header.count) != header.crc)
+  {
+    ESP_LOGW(LOG_TAG,"Slot index is corrupt");
+    free(entries);
+    fclose(f);
+    return ESP_FAIL;
+  }
+  fclose(f);
+  
+  free(slotIndex);
+  slotIndex = entries;
+  slotIndexCount = header.count;
+  slotIndexValid = 1;
+  halStorageSlotIndexHash();
+  ESP_LOGI(LOG_TAG,"Loaded slot index, %u slots",slotIndexCount);
+  return ESP_OK;
+}
+
+/** @brief Rebuild the slot index by reading all slot files
+ * 
+ * Slots are read in order until the first missing file.
+ * The new index is written to the slot index file.
+ * @return ESP_OK on success, ESP_FAIL otherwise */
+static esp_err_t halStorageSlotIndexRebuild(void)
+{
+  slot_index_entry_t *entries = malloc(sizeof(slot_index_entry_t)*SLOT_INDEX_MAX);
+  uint8_t count = 0;
+  
+  if(entries == NULL)
+  {
+    ESP_LOGE(LOG_TAG,"No memory for rebuilding slot index");
+    return ESP_FAIL;
+  }
+  
+  while(count < SLOT_INDEX_MAX && halStorageSlotIndexScan(count,&entries[count]) == ESP_OK) count++;
+  
+  //shrink to the used size (+1 for a new slot)
+  slot_index_entry_t *shrinked = realloc(entries,sizeof(slot_index_entry_t)*(count+1));
+  if(shrinked != NULL) entries = shrinked;
+  free(slotIndex);
+  slotIndex = entries;
+  slotIndexCount = count;
+  slotIndexValid = 1;
+  halStorageSlotIndexHash();
+  halStorageSlotCacheClear();
+  ESP_LOGW(LOG_TAG,"Rebuilt slot index, %u slots",count);
+  return halStorageSlotIndexWrite();
+}
+
+/** @brief Ensure the slot index is available, rebuild it if necessary
+ * @return ESP_OK if the index is valid, ESP_FAIL otherwise */
+static esp_err_t halStorageSlotIndexCheck(void)
+{
+  if(slotIndexValid) return ESP_OK;
+  if(halStorageSlotIndexLoad() == ESP_OK) return ESP_OK;
+  halStorageSlotIndexRebuild();
+  return slotIndexValid ? ESP_OK : ESP_FAIL;
+}
+
+/** @brief Discard the slot index (RAM & file), it is rebuilt on the next access */
+static void halStorageSlotIndexInvalidate(void)
+{
+  char file[sizeof(base_path)+32];
+  sprintf(file,"%s/SLOTS.BIN",base_path);
+  remove(file);
+  slotIndexValid = 0;
+  halStorageSlotCacheClear();
+}
+
+/** @brief Update the index entry of one stored slot
+ * 
+ * Called after a slot file is written. The slot is appended if it is
+ * the next free slot number.
+ * If the index cannot be updated, it is rebuilt on the next access.
+ * @param slotnumber Number of the stored slot */
+static void halStorageSlotIndexUpdate(uint8_t slotnumber)
+{
+  slot_index_entry_t e;
+  
+  if(halStorageSlotIndexCheck() != ESP_OK) return;
+  if(slotnumber > slotIndexCount || halStorageSlotIndexScan(slotnumber,&e) != ESP_OK)
+  {
+    halStorageSlotIndexInvalidate();
+    return;
+  }
+  if(slotnumber == slotIndexCount)
+  {
+    slot_index_entry_t *entries = realloc(slotIndex,sizeof(slot_index_entry_t)*(slotnumber+2));
+    if(entries == NULL)
+    {
+      halStorageSlotIndexInvalidate();
+      return;
+    }
+    slotIndex = entries;
+    slotIndexCount++;
+  }
+  memcpy(&slotIndex[slotnumber],&e,sizeof(slot_index_entry_t));
+  halStorageSlotIndexHash();
+  if(halStorageSlotIndexWrite() != ESP_OK) halStorageSlotIndexInvalidate();
+}
+
+/** @brief Distance of a slot to the current slot (NEXT/PREV wrap around) */
+static uint8_t halStorageSlotCacheDistance(uint8_t slotnumber)
+{
+  uint8_t d = (slotnumber > storageCurrentSlotNumber) ? \
+    slotnumber - storageCurrentSlotNumber : storageCurrentSlotNumber - slotnumber;
+  if(slotIndexCount > d && slotIndexCount - d < d) d = slotIndexCount - d;
+  return d;
+}
+
+/** @brief Get the image of a slot from the slot cache
+ * @param slotnumber Number of the slot
+ * @param size Output of the image size
+ * @return Cached image (still owned by the cache), NULL if not cached */
+static uint8_t *halStorageSlotCacheGet(uint8_t slotnumber, uint32_t *size)
+{
+  for(uint8_t i = 0; i<SLOT_CACHE_ENTRIES; i++)
+  {
+    if(slotCache[i].image != NULL && slotCache[i].slot == slotnumber)
+    {
+      *size = slotCache[i].size;
+      return slotCache[i].image;
+    }
+  }
+  return NULL;
+}
+
+/** @brief Add an image to the slot cache
+ * 
+ * If there is no free entry or the budget is exceeded, images of slots
+ * farther away from the current slot are removed. If the new image is
+ * the farthest one or it does not fit into the budget at all, it is not
+ * cached.
+ * @param slotnumber Number of the slot
+ * @param image Image, the cache takes the ownership (freed if not cached)
+ * @param size Size of the image */
+static void halStorageSlotCachePut(uint8_t slotnumber, uint8_t *image, uint32_t size)
+{
+  uint8_t distance = halStorageSlotCacheDistance(slotnumber);
+  
+  while(1)
+  {
+    int free_entry = -1, victim = -1;
+    for(uint8_t i = 0; i<SLOT_CACHE_ENTRIES; i++)
+    {
+      if(slotCache[i].image == NULL) free_entry = i;
+      else if(victim == -1 || halStorageSlotCacheDistance(slotCache[i].slot) > \
+        halStorageSlotCacheDistance(slotCache[victim].slot)) victim = i;
+    }
+    //fits, add it
+    if(free_entry != -1 && slotCacheStats.bytes + size <= slotCacheStats.budget)
+    {
+      slotCache[free_entry].image = image;
+      slotCache[free_entry].size = size;
+      slotCache[free_entry].slot = slotnumber;
+      slotCacheStats.entries++;
+      slotCacheStats.bytes += size;
+      return;
+    }
+    //nothing to remove (or only nearer slots), don't cache it
+    if(victim == -1 || halStorageSlotCacheDistance(slotCache[victim].slot) < distance)
+    {
+      free(image);
+      return;
+    }
+    slotCacheStats.entries--;
+    slotCacheStats.bytes -= slotCache[victim].size;
+    free(slotCache[victim].image);
+    slotCache[victim].image = NULL;
+  }
+}
+
 /** @brief Load a string from NVS (global, no slot assignment)
  * 
  * This method is used to load a string from a non-volatile storage.
@@ -216,6 +866,10 @@ esp_err_t halStorageInit(void)
   //return on an error
   if(ret != ESP_OK) { ESP_LOGE(LOG_TAG,"Error mounting FATFS"); return ret; }
   
+  //load the IR & slot index, rebuild them from the files if they are corrupt
+  halStorageIRIndexCheck();
+  halStorageSlotIndexCheck();
+  
   //initialize nvs
   ret = nvs_flash_init();
   
@@ -225,6 +879,14 @@ esp_err_t halStorageInit(void)
     ESP_ERROR_CHECK(nvs_flash_erase());
     ret = nvs_flash_init();
   }
+  
+  //memory budget of the slot cache (default if not set)
+  nvs_handle my_handle;
+  if(ret == ESP_OK && nvs_open(HAL_STORAGE_NVS_NAMESPACE, NVS_READONLY, &my_handle) == ESP_OK)
+  {
+    nvs_get_u32(my_handle, NVS_SLOTCACHE, &slotCacheStats.budget);
+    nvs_close(my_handle);
+  }
   return ret;
 }
 
@@ -334,6 +996,9 @@ void halStorageCreateDefault(uint32_t tid)
   free(buffer);
   fclose(source);
   fclose(target);
+  
+  //all slot files are replaced, rebuild the index
+  halStorageSlotIndexRebuild();
 }
 
 /** @brief Get number of currently loaded slot
@@ -348,6 +1013,16 @@ uint8_t halStorageGetCurrentSlotNumber(void)
   return storageCurrentSlotNumber;
 }
 
+/** @brief Check if the last loaded slot was installed from its image
+ * 
+ * If set, no AT commands were sent to the command parser for this slot.
+ * @return 1 if installed from the image, 0 if the slot file was parsed
+ * */
+uint8_t halStorageIsImageLoaded(void)
+{
+  return storageImageLoaded;
+}
+
 /** @brief Get the number of stored slots
  * 
  * This method returns the number of available slots (the default slot
@@ -362,36 +1037,11 @@ uint8_t halStorageGetCurrentSlotNumber(void)
  * */
 esp_err_t halStorageGetNumberOfSlots(uint32_t tid, uint8_t *slotsavailable)
 {
-  uint8_t currentSlot = 0;
-  char file[sizeof(base_path)+32];
-  FILE *f;
-
   if(halStorageChecks(tid) != ESP_OK) return ESP_FAIL;
+  if(halStorageSlotIndexCheck() != ESP_OK) return ESP_FAIL;
   
-  do {
-    //create filename string to search if this slot is available
-    sprintf(file,"%s/%03d.set",base_path,currentSlot);
-    
-    //open file for reading
-    #if LOG_LEVEL_STORAGE >= ESP_LOG_DEBUG
-    ESP_LOGD(LOG_TAG,"Opening file %s",file);
-    #endif
-    
-    f = fopen(file, "rb");
-    
-    //check if this file is available
-    //if one file is not available, we assume this is the end of configs
-    if(f == NULL)
-    {
-      ESP_LOGI(LOG_TAG,"Available slots: %u",currentSlot);
-      *slotsavailable = currentSlot;
-      return ESP_OK;
-    } else {
-      fclose(f);
-      currentSlot++;
-    }
-  } while(1);
-  
+  ESP_LOGI(LOG_TAG,"Available slots: %u",slotIndexCount);
+  *slotsavailable = slotIndexCount;
   return ESP_OK;
 }
 
@@ -411,52 +1061,26 @@ esp_err_t halStorageGetNumberOfSlots(uint32_t tid, uint8_t *slotsavailable)
  * */
 esp_err_t halStorageGetNameForNumberIR(uint32_t tid, uint8_t slotnumber, char *cmdName)
 {
-  uint32_t slotnamelen = 0;
-  char file[sizeof(base_path)+32];
-  FILE *f;
-
   if(halStorageChecks(tid) != ESP_OK) return ESP_FAIL;
   
   //check for slot number
-  if(slotnumber >= 250)
+  if(slotnumber >= IR_INDEX_MAX)
   {
     ESP_LOGE(LOG_TAG,"IR commands maximum: 250");
     return ESP_FAIL;
   }
   
-  //create filename string to search if this slot is available
-  sprintf(file,"%s/IR_%03d.set",base_path,slotnumber);
-  
-  //open file for reading
-  #if LOG_LEVEL_STORAGE >= ESP_LOG_DEBUG
-  ESP_LOGD(LOG_TAG,"Opening file %s",file);
-  #endif
-  f = fopen(file, "rb");
-  
-  if(f == NULL)
+  //names are taken from the IR index
+  if(halStorageIRIndexCheck() != ESP_OK) return ESP_FAIL;
+  if(slotnumber >= irIndexCount)
   {
-    ESP_LOGW(LOG_TAG,"Invalid slot number %d, cannot load file",slotnumber);
-    return ESP_FAIL;
-  }
-  
-  fseek(f,0,SEEK_SET);
-
-  //read slot name
-  fread(&slotnamelen,sizeof(uint32_t),1,f);
-  if(slotnamelen > SLOTNAME_LENGTH + 1)
-  {
-    ESP_LOGE(LOG_TAG,"IR name too long: %u",slotnamelen);
-    fclose(f);
+    ESP_LOGW(LOG_TAG,"Invalid slot number %d, no IR cmd",slotnumber);
     return ESP_FAIL;
   }
-  fread(cmdName,sizeof(char),slotnamelen+1,f);
-  cmdName[slotnamelen] = '\0';
+  strcpy(cmdName,irIndex[slotnumber].name);
   #if LOG_LEVEL_STORAGE >= ESP_LOG_DEBUG
-  ESP_LOGD(LOG_TAG,"IR name: %s, length %d",cmdName,slotnamelen);
+  ESP_LOGD(LOG_TAG,"IR name: %s",cmdName);
   #endif
-  
-  //clean up & return
-  if(f!=NULL) fclose(f);
   return ESP_OK;
 }
 /** @brief Delete one or all IR commands
@@ -495,6 +1119,12 @@ esp_err_t halStorageDeleteIRCmd(uint8_t slotnr, uint32_t tid)
   //check for valid storage handle
   if(halStorageChecks(tid) != ESP_OK) return ESP_FAIL;
   
+  //cached IR commands are invalid now (names & numbers change)
+  storageIRGeneration++;
+  
+  //load the index before, it is updated afterwards
+  uint8_t indexed = (halStorageIRIndexCheck() == ESP_OK);
+  
   //delete one or all slots
   for(uint8_t i = from; i<=to; i++)
   {
@@ -520,6 +1150,20 @@ esp_err_t halStorageDeleteIRCmd(uint8_t slotnr, uint32_t tid)
       }
     }
   }
+  
+  //update the IR index, following commands are moved by one
+  if(indexed)
+  {
+    if(slotnr == 250) irIndexCount = 0;
+    else if(slotnr < irIndexCount)
+    {
+      memmove(&irIndex[slotnr],&irIndex[slotnr+1],sizeof(ir_index_entry_t)*(irIndexCount-slotnr-1));
+      irIndexCount--;
+    }
+    //a stale index file must not be loaded on the next start
+    if(halStorageIRIndexWrite() != ESP_OK) halStorageIRIndexInvalidate();
+  }
+  
   if(slotnr == 250) 
   {
     ESP_LOGW(LOG_TAG,"Deleted all IR commands");
@@ -542,34 +1186,11 @@ esp_err_t halStorageDeleteIRCmd(uint8_t slotnr, uint32_t tid)
  * */
 esp_err_t halStorageGetNumberOfIRCmds(uint32_t tid, uint8_t *slotsavailable)
 {
-  uint8_t current = 0;
-  uint8_t count = 0;
-  char file[sizeof(base_path)+32];
-  FILE *f;
-
   if(halStorageChecks(tid) != ESP_OK) return ESP_FAIL;
+  if(halStorageIRIndexCheck() != ESP_OK) return ESP_FAIL;
   
-  do {
-    //create filename string to search if this slot is available
-    sprintf(file,"%s/IR_%03d.set",base_path,current);
-    
-    f = fopen(file, "rb");
-    
-    //check if this file is available
-    if(f != NULL)
-    {
-      //open file for reading
-      #if LOG_LEVEL_STORAGE >= ESP_LOG_DEBUG
-      ESP_LOGD(LOG_TAG,"Opening file %s",file);
-      #endif
-      count++;
-      fclose(f);
-    }
-    current++;
-    if(current == 250) break;
-  } while(1);
-  ESP_LOGI(LOG_TAG,"Available IR cmds: %u",count);
-  *slotsavailable = count;
+  ESP_LOGI(LOG_TAG,"Available IR cmds: %u",irIndexCount);
+  *slotsavailable = irIndexCount;
   return ESP_OK;
 }
 
@@ -637,63 +1258,25 @@ void strip(char *s) {
  * */
 esp_err_t halStorageGetNameForNumber(uint32_t tid, uint8_t slotnumber, char *slotname)
 {
-  //file name buffer
-  char file[sizeof(base_path)+32];
-  //malloc a buffer for SLOTNAME_LENGTH + strlen("Slot XXX:")
-  char *slotnamebuf = malloc(SLOTNAME_LENGTH+10);
-  FILE *f;
-  
-  if(slotnamebuf == NULL)
-  {
-    ESP_LOGE(LOG_TAG,"Cannot alloc buffer for slotname");
-    return ESP_FAIL;
-  }
-
   if(halStorageChecks(tid) != ESP_OK) return ESP_FAIL;
+  if(halStorageSlotIndexCheck() != ESP_OK) return ESP_FAIL;
   
-  //create filename string to search if this slot is available
-  sprintf(file,"%s/%03d.set",base_path,slotnumber);
-  
-  //open file for reading
-  #if LOG_LEVEL_STORAGE >= ESP_LOG_DEBUG
-  ESP_LOGD(LOG_TAG,"Opening file %s",file);
-  #endif
-  f = fopen(file, "rb");
-  
-  if(f == NULL)
+  if(slotnumber >= slotIndexCount)
   {
-    ESP_LOGW(LOG_TAG,"Invalid file");
-    free(slotnamebuf);
+    ESP_LOGW(LOG_TAG,"Invalid slot number %u",slotnumber);
     return ESP_FAIL;
   }
-  
-  fseek(f,0,SEEK_SET);
-
-  //read slot name
-  fgets(slotnamebuf,SLOTNAME_LENGTH+10,f);
-  //check if we have "Slot XXX:"
-  if((strncmp(slotnamebuf,"Slot",strlen("Slot")) == 0) && (strpbrk(slotnamebuf,":") != NULL))
+  //slot file without a "Slot XXX:" tag
+  if(slotIndex[slotnumber].name[0] == '\0')
   {
-    //if yes, strip "Slot..." & save to caller
-    char *begin = strpbrk(slotnamebuf,":");
-    //remove \n \r
-    strip(begin);
-    strncpy(slotname,begin+1,SLOTNAME_LENGTH);
-  } else {
-    //if no, config is invalid
-    ESP_LOGE(LOG_TAG,"Missing \"Slot XXX:\" tag (%s)!",slotnamebuf);
-    free(slotnamebuf);
-    fclose(f);
+    ESP_LOGE(LOG_TAG,"Missing \"Slot XXX:\" tag in slot %u!",slotnumber);
     return ESP_FAIL;
   }
+  strncpy(slotname,slotIndex[slotnumber].name,SLOTNAME_LENGTH);
   
   #if LOG_LEVEL_STORAGE >= ESP_LOG_DEBUG
   ESP_LOGD(LOG_TAG,"Read slotname: %s",slotname);
   #endif
-  
-  //clean up & return
-  if(f!=NULL) fclose(f);
-  free(slotnamebuf);
   return ESP_OK;
 }
 
@@ -711,37 +1294,31 @@ esp_err_t halStorageGetNameForNumber(uint32_t tid, uint8_t slotnumber, char *slo
  * */
 esp_err_t halStorageGetNumberForName(uint32_t tid, uint8_t *slotnumber, char *slotname)
 {
-  uint8_t currentSlot = 0;
-  char fileSlotName[SLOTNAME_LENGTH+4];
-
   if(halStorageChecks(tid) != ESP_OK) return ESP_FAIL;
+  if(halStorageSlotIndexCheck() != ESP_OK) return ESP_FAIL;
   
-  do {
-    //get name for slot number
-    if(halStorageGetNameForNumber(tid,currentSlot,fileSlotName) != ESP_OK)
-    {
-      *slotnumber = 0;
-      ESP_LOGI(LOG_TAG,"Cannot find slot %s",slotname);
-      return ESP_FAIL;
-    }
-    
-    //compare parameter & file slotname
-    if(strcmp(slotname, fileSlotName) == 0)
+  //empty names are used for slots without a slot tag
+  if(slotname[0] != '\0')
+  {
+    uint8_t i = slotIndexBuckets[halStorageSlotIndexBucket(slotname)];
+    for(; i != SLOT_INDEX_NONE; i = slotIndexChain[i])
     {
-      //found a slot
-      *slotnumber = currentSlot;
-      #if LOG_LEVEL_STORAGE >= ESP_LOG_DEBUG
-      ESP_LOGD(LOG_TAG,"Found slot \"%s\" @%u",slotname,currentSlot);
-      #endif
-      return ESP_OK;
+      //compare parameter & indexed name
+      if(strcmp(slotname, slotIndex[i].name) == 0)
+      {
+        //found a slot
+        *slotnumber = i;
+        #if LOG_LEVEL_STORAGE >= ESP_LOG_DEBUG
+        ESP_LOGD(LOG_TAG,"Found slot \"%s\" @%u",slotname,i);
+        #endif
+        return ESP_OK;
+      }
     }
-    
-    //go to next possible slot & clean up
-    currentSlot++;
-  } while(1);
-
-  //we should never be here...
-  return ESP_OK;
+  }
+  
+  *slotnumber = 0;
+  ESP_LOGI(LOG_TAG,"Cannot find slot %s",slotname);
+  return ESP_FAIL;
 }
 
 /** @brief Get the number for an IR cmd name
@@ -758,22 +1335,13 @@ esp_err_t halStorageGetNumberForName(uint32_t tid, uint8_t *slotnumber, char *sl
  * */
 esp_err_t halStorageGetNumberForNameIR(uint32_t tid, uint8_t *slotnumber, char *cmdName)
 {
-  uint8_t currentSlot = 0;
-  char fileSlotName[SLOTNAME_LENGTH+4];
-
   if(halStorageChecks(tid) != ESP_OK) return ESP_FAIL;
+  if(halStorageIRIndexCheck() != ESP_OK) return ESP_FAIL;
   
-  do {
-    //get name for slot number
-    if(halStorageGetNameForNumberIR(tid,currentSlot,fileSlotName) != ESP_OK)
-    {
-      *slotnumber = 0;
-      ESP_LOGI(LOG_TAG,"Cannot find IR cmd %s",cmdName);
-      return ESP_FAIL;
-    }
-    
-    //compare parameter & file slotname
-    if(strcmp(cmdName, fileSlotName) == 0)
+  for(uint8_t currentSlot = 0; currentSlot<irIndexCount; currentSlot++)
+  {
+    //compare parameter & indexed name
+    if(strcmp(cmdName, irIndex[currentSlot].name) == 0)
     {
       //found a slot
       *slotnumber = currentSlot;
@@ -782,12 +1350,10 @@ esp_err_t halStorageGetNumberForNameIR(uint32_t tid, uint8_t *slotnumber, char *
       #endif
       return ESP_OK;
     }
-    
-    //go to next possible slot & clean up
-    currentSlot++;
-  } while(1);
-
-  //we should never be here...
+  }
+  
+  *slotnumber = 0;
+  ESP_LOGI(LOG_TAG,"Cannot find IR cmd %s",cmdName);
   return ESP_FAIL;
 }
 
@@ -872,6 +1438,147 @@ esp_err_t halStorageLoad(hal_storage_load_action navigate, uint32_t tid)
   return ESP_OK;
 }
 
+/** @brief Read the precompiled image of a slot
+ * 
+ * The image is read at once, it is only returned if it was created from
+ * the current slot file. The content is checked on installing.
+ * @param slotnumber Number of the slot
+ * @param size Output of the image size
+ * @return Image (must be freed), NULL if there is no valid image */
+static uint8_t *halStorageReadImage(uint8_t slotnumber, uint32_t *size)
+{
+  char file[sizeof(base_path)+32];
+  
+  if(halStorageSlotIndexCheck() != ESP_OK) return NULL;
+  if(slotnumber >= slotIndexCount || slotIndex[slotnumber].image == 0) return NULL;
+  
+  *size = slotIndex[slotnumber].image;
+  uint8_t *image = malloc(*size);
+  if(image == NULL)
+  {
+    ESP_LOGE(LOG_TAG,"No memory for image of slot %u",slotnumber);
+    return NULL;
+  }
+  sprintf(file,"%s/%03d.%s",base_path,slotnumber,SLOT_IMAGE_EXTENSION);
+  FILE *f = fopen(file, "rb");
+  if(f != NULL)
+  {
+    //the image must belong to the current slot file
+    if(fread(image,1,*size,f) == *size && *size >= sizeof(slot_image_header_t) && \
+      ((slot_image_header_t *)image)->sourcecrc == slotIndex[slotnumber].checksum)
+    {
+      fclose(f);
+      return image;
+    }
+    fclose(f);
+  }
+  free(image);
+  return NULL;
+}
+
+/** @brief Install the precompiled image of a slot, if there is a valid one
+ * 
+ * The image is taken from the slot cache or read at once from the
+ * storage & installed via slotImageInstall. Images read from the storage
+ * are added to the slot cache.
+ * An image, which cannot be installed, is removed from the index (the
+ * slot file is parsed instead).
+ * @param slotnumber Number of the slot
+ * @return ESP_OK if the image is installed, ESP_FAIL otherwise */
+static esp_err_t halStorageLoadImage(uint8_t slotnumber)
+{
+  esp_err_t ret = ESP_FAIL;
+  uint32_t size;
+  
+  //installed from RAM, no storage access
+  uint8_t *image = halStorageSlotCacheGet(slotnumber,&size);
+  if(image != NULL)
+  {
+    slotCacheStats.hits++;
+    if(slotImageInstall(image,size,configGetCurrent()) == ESP_OK) return ESP_OK;
+    halStorageSlotCacheClear();
+  } else {
+    if(halStorageSlotIndexCheck() != ESP_OK) return ESP_FAIL;
+    if(slotnumber >= slotIndexCount || slotIndex[slotnumber].image == 0) return ESP_FAIL;
+    slotCacheStats.misses++;
+    image = halStorageReadImage(slotnumber,&size);
+    if(image != NULL)
+    {
+      ret = slotImageInstall(image,size,configGetCurrent());
+      if(ret == ESP_OK) halStorageSlotCachePut(slotnumber,image,size);
+      else free(image);
+    }
+  }
+  
+  if(ret != ESP_OK)
+  {
+    ESP_LOGW(LOG_TAG,"Image of slot %u not usable, parsing slot file",slotnumber);
+    slotIndex[slotnumber].image = 0;
+    if(halStorageSlotIndexWrite() != ESP_OK) halStorageSlotIndexInvalidate();
+  }
+  return ret;
+}
+
+esp_err_t halStoragePrefetch(uint32_t tid, uint8_t slotnumber)
+{
+  uint32_t size;
+  
+  if(halStorageChecks(tid) != ESP_OK) return ESP_FAIL;
+  if(halStorageSlotCacheGet(slotnumber,&size) != NULL) return ESP_OK;
+  uint8_t *image = halStorageReadImage(slotnumber,&size);
+  if(image == NULL) return ESP_FAIL;
+  halStorageSlotCachePut(slotnumber,image,size);
+  //not cached if the budget is too small
+  if(halStorageSlotCacheGet(slotnumber,&size) == NULL) return ESP_FAIL;
+  ESP_LOGD(LOG_TAG,"Prefetched image of slot %u, %u bytes",slotnumber,size);
+  return ESP_OK;
+}
+
+esp_err_t halStorageSetCacheBudget(uint32_t tid, uint32_t budget)
+{
+  nvs_handle my_handle;
+  esp_err_t ret;
+  
+  if(halStorageChecks(tid) != ESP_OK) return ESP_FAIL;
+  slotCacheStats.budget = budget;
+  //images are prefetched again with the new budget
+  halStorageSlotCacheClear();
+  
+  //store the budget for the next boot
+  ret = nvs_open(HAL_STORAGE_NVS_NAMESPACE, NVS_READWRITE, &my_handle);
+  if(ret != ESP_OK) return ret;
+  ret = nvs_set_u32(my_handle, NVS_SLOTCACHE, budget);
+  if(ret == ESP_OK) ret = nvs_commit(my_handle);
+  nvs_close(my_handle);
+  return ret;
+}
+
+void halStorageGetCacheStats(slot_cache_stats_t *stats)
+{
+  if(stats == NULL) return;
+  memcpy(stats,&slotCacheStats,sizeof(slot_cache_stats_t));
+}
+
+/** @brief Queue a marker for the begin or end of a slot file to task_commands
+ * @param marker CMD_SLOT_BEGIN or CMD_SLOT_END
+ * @return ESP_OK if queued, ESP_FAIL otherwise */
+static esp_err_t halStorageQueueMarker(const char *marker)
+{
+  atcmd_t cmd;
+  
+  if(halSerialATCmds == NULL) return ESP_FAIL;
+  //freed by task_commands
+  cmd.buf = (uint8_t *)strdup(marker);
+  if(cmd.buf == NULL) return ESP_FAIL;
+  cmd.len = strlen(marker);
+  if(xQueueSend(halSerialATCmds,(void*)&cmd,100/portTICK_PERIOD_MS) != pdTRUE)
+  {
+    free(cmd.buf);
+    return ESP_FAIL;
+  }
+  return ESP_OK;
+}
+
 /** @brief Load a slot by a slot number (starting with 0)
  * 
  * This method loads a slot & saves the general config to the given
@@ -894,6 +1601,11 @@ esp_err_t halStorageLoad(hal_storage_load_action navigate, uint32_t tid)
  * @param tid Transaction ID, which must match the one given by halStorageStartTransaction
  * @param outputSerial Either the loaded AT commands are sent to the command parser (== 0) or sent to the serial output
  * @note If sending to serial port, the slot name is printed as well ("Slot <number>:<name>).
+ * @note If the AT commands are for the command parser & a valid image of this
+ * slot exists (halStorageStoreImage), the image is installed instead
+ * (see halStorageIsImageLoaded).
+ * @note The AT commands for the command parser are enclosed by CMD_SLOT_BEGIN
+ * & CMD_SLOT_END. The end marker is only sent if all lines were queued.
  * @note If param outputserial is set to 1, the full config is printed. If set to 2, only slotnames are printed (used for "AT LI").
  * In addition, for compatibility reasons, AT LI outputs e.g. "Slot 1:mouse", AT LA outputs "Slot:mouse".
  * @return ESP_OK if everything is fine, ESP_FAIL if the command was not successful (slot number not found)
@@ -911,6 +1623,16 @@ esp_err_t halStorageLoadNumber(uint8_t slotnumber, uint32_t tid, uint8_t outputS
     return ESP_FAIL;
   }
   
+  //install the precompiled image instead of parsing the slot file
+  storageImageLoaded = 0;
+  if(outputSerial == 0 && halStorageLoadImage(slotnumber) == ESP_OK)
+  {
+    ESP_LOGI(LOG_TAG,"Loaded slot nr: %d from image",slotnumber);
+    storageImageLoaded = 1;
+    storageCurrentSlotNumber = slotnumber;
+    return ESP_OK;
+  }
+  
   //file naming convention for general config: xxx.set
   //create filename from slotnumber
   sprintf(file,"%s/%03d.set",base_path,slotnumber);
@@ -932,6 +1654,8 @@ esp_err_t halStorageLoadNumber(uint8_t slotnumber, uint32_t tid, uint8_t outputS
       if(f == NULL) return ESP_FAIL;
     } else {
       ESP_LOGE(LOG_TAG,"cannot load requested slot number %u",slotnumber);
+      //slot files were changed without the index, rebuild on next access
+      if(slotnumber < slotIndexCount) halStorageSlotIndexInvalidate();
       return ESP_FAIL;
     }
   }
@@ -992,6 +1716,9 @@ esp_err_t halStorageLoadNumber(uint8_t slotnumber, uint32_t tid, uint8_t outputS
 
   /*++++ read each line as AT cmd ++++*/
   uint32_t cmdcount = 0;
+  //all lines are queued to task_commands, between the begin & end marker
+  uint8_t complete = 0;
+  if(outputSerial == 0) complete = (halStorageQueueMarker(CMD_SLOT_BEGIN) == ESP_OK);
   while(outputSerial != 2)
   {
     //allocate one line
@@ -1055,6 +1782,7 @@ esp_err_t halStorageLoadNumber(uint8_t slotnumber, uint32_t tid, uint8_t outputS
       {
         ESP_LOGE(LOG_TAG,"AT cmd queue is full, cannot send cmd");
         free(at);
+        complete = 0;
       } else {
         ///@note we cannot print buffer here, might be already freed by task_commands.c
         //remove \r \n for printing...
@@ -1080,6 +1808,12 @@ esp_err_t halStorageLoadNumber(uint8_t slotnumber, uint32_t tid, uint8_t outputS
   ///@todo Ab hier wäre es wieder passend den debouncer zu aktivieren?!?
   ESP_LOGI(LOG_TAG,"Loaded slot %s,nr: %d, %u commands",slotname,slotnumber,cmdcount);
   
+  //without the end marker, the config switcher does not store an image
+  if(outputSerial == 0 && (complete == 0 || halStorageQueueMarker(CMD_SLOT_END) != ESP_OK))
+  {
+    ESP_LOGW(LOG_TAG,"Slot %d was not queued completely",slotnumber);
+  }
+  
   //save current slot number, if processed by parser
   if(outputSerial == 0) storageCurrentSlotNumber = slotnumber;
   //clean up
@@ -1159,7 +1893,12 @@ esp_err_t halStorageDeleteSlot(int16_t slotnr, uint32_t tid)
   //check for valid storage handle
   if(halStorageChecks(tid) != ESP_OK) return ESP_FAIL;
   
-  //delete one or all slots
+  //load the index before the files are changed
+  uint8_t indexed = (halStorageSlotIndexCheck() == ESP_OK);
+  //slot numbers are changed, cached images are not valid anymore
+  halStorageSlotCacheClear();
+  
+  //delete one or all slots (and their images)
   for(uint8_t i = from; i<=to; i++)
   {
     sprintf(file,"%s/%03d.set",base_path,i); 
@@ -1170,6 +1909,8 @@ esp_err_t halStorageDeleteSlot(int16_t slotnr, uint32_t tid)
       remove(file);
       f = NULL;
     }
+    sprintf(file,"%s/%03d.%s",base_path,i,SLOT_IMAGE_EXTENSION);
+    remove(file);
     //not necessary, ESP32 uses preemption
     //taskYIELD();
   }
@@ -1188,10 +1929,27 @@ esp_err_t halStorageDeleteSlot(int16_t slotnr, uint32_t tid)
         ESP_LOGI(LOG_TAG,"Stopped renaming @ slot %d",i);
         break;
       }
+      //an image follows its slot file
+      sprintf(file,"%s/%03d.%s",base_path,i,SLOT_IMAGE_EXTENSION);
+      sprintf(filenew,"%s/%03d.%s",base_path,i-1,SLOT_IMAGE_EXTENSION);
+      rename(file,filenew);
       //not necessary, ESP32 uses preemption
       //taskYIELD();
     }
   }
+  
+  //update the index the same way
+  if(indexed)
+  {
+    if(slotnr == -1) slotIndexCount = 0;
+    else if(slotnr < slotIndexCount)
+    {
+      memmove(&slotIndex[slotnr],&slotIndex[slotnr+1],sizeof(slot_index_entry_t)*(slotIndexCount-slotnr-1));
+      slotIndexCount--;
+    }
+    halStorageSlotIndexHash();
+    if(halStorageSlotIndexWrite() != ESP_OK) halStorageSlotIndexInvalidate();
+  }
 
   ESP_LOGI(LOG_TAG,"Deleted slot %d (-1 means delete all), renamed remaining",slotnr);
   return ESP_OK;
@@ -1213,7 +1971,7 @@ esp_err_t halStorageDeleteSlot(int16_t slotnr, uint32_t tid)
  * */
 esp_err_t halStorageStore(uint32_t tid, char *cfgstring, uint8_t slotnumber)
 {
-  char file[sizeof(base_path)+12];
+  char file[sizeof(base_path)+32];
   
   if(halStorageChecks(tid) != ESP_OK) return ESP_FAIL;
   
@@ -1256,6 +2014,9 @@ esp_err_t halStorageStore(uint32_t tid, char *cfgstring, uint8_t slotnumber)
     ///@todo not necessary anymore?
     //save current slot number to access the VB configs
     storageCurrentSlotNumber = slotnumber;
+    //the index entry is updated when the file is closed
+    storeSlotNumber = slotnumber;
+    halStorageSlotCacheClear();
   } else {
     //file was opened on previous call, append AT cmds now.
     fputs(cfgstring,storeHandle);
@@ -1263,6 +2024,108 @@ esp_err_t halStorageStore(uint32_t tid, char *cfgstring, uint8_t slotnumber)
   return ESP_OK;
 }
 
+/** @brief Close the slot file written by halStorageStore (if open)
+ * & update the index entry of this slot */
+static void halStorageStoreClose(void)
+{
+  if(storeHandle == NULL) return;
+  fclose(storeHandle);
+  storeHandle = NULL;
+  halStorageSlotIndexUpdate(storeSlotNumber);
+}
+
+/** @brief Create the precompiled image of a slot
+ * 
+ * The image is created from the current config & the current HID/VB
+ * commands (see slotImageCreate), which must be the result of the
+ * given slot file. A slot file, which is currently stored by
+ * halStorageStore, is finished before.
+ * 
+ * @param tid Transaction id
+ * @param slotnumber Number of the slot
+ * @param image Created image (allocated), freed by halStorageStoreImage
+ * @param size Size of the image in bytes
+ * @return ESP_OK on success, ESP_FAIL otherwise
+ * @see halStorageStoreImage
+ * */
+esp_err_t halStorageCreateImage(uint32_t tid, uint8_t slotnumber, uint8_t **image, uint32_t *size)
+{
+  if(halStorageChecks(tid) != ESP_OK) return ESP_FAIL;
+  //finish a slot file, which is currently stored (updates the checksum)
+  halStorageStoreClose();
+  if(halStorageSlotIndexCheck() != ESP_OK) return ESP_FAIL;
+  if(slotnumber >= slotIndexCount)
+  {
+    ESP_LOGE(LOG_TAG,"No slot %u for creating an image",slotnumber);
+    return ESP_FAIL;
+  }
+  slot_index_entry_t *e = &slotIndex[slotnumber];
+  return slotImageCreate(configGetCurrent(),e->name,e->checksum,image,size);
+}
+
+/** @brief Store the precompiled image of a slot
+ * 
+ * The image is not stored, if the slot file was changed since the
+ * image was created. A slot file, which is currently stored by
+ * halStorageStore, is finished before.
+ * 
+ * @param tid Transaction id
+ * @param slotnumber Number of the slot
+ * @param image Image, created by halStorageCreateImage. It is freed here in any case.
+ * @param size Size of the image in bytes
+ * @return ESP_OK on success, ESP_FAIL otherwise
+ * @see halStorageLoadNumber
+ * */
+esp_err_t halStorageStoreImage(uint32_t tid, uint8_t slotnumber, uint8_t *image, uint32_t size)
+{
+  char file[sizeof(base_path)+32];
+  esp_err_t ret = ESP_FAIL;
+  
+  if(image == NULL) return ESP_FAIL;
+  if(halStorageChecks(tid) != ESP_OK)
+  {
+    free(image);
+    return ESP_FAIL;
+  }
+  halStorageStoreClose();
+  if(halStorageSlotIndexCheck() != ESP_OK)
+  {
+    free(image);
+    return ESP_FAIL;
+  }
+  //slot file was changed or deleted in the meantime
+  if(slotnumber >= slotIndexCount || \
+    ((slot_image_header_t *)image)->sourcecrc != slotIndex[slotnumber].checksum)
+  {
+    ESP_LOGW(LOG_TAG,"Slot %u changed, image is not stored",slotnumber);
+    free(image);
+    return ESP_FAIL;
+  }
+  
+  slot_index_entry_t *e = &slotIndex[slotnumber];
+  halStorageSlotCacheClear();
+  sprintf(file,"%s/%03d.%s",base_path,slotnumber,SLOT_IMAGE_EXTENSION);
+  FILE *f = fopen(file, "wb");
+  if(f != NULL)
+  {
+    if(fwrite(image,1,size,f) == size) ret = ESP_OK;
+    if(fclose(f) != 0) ret = ESP_FAIL;
+  }
+  free(image);
+  
+  if(ret != ESP_OK)
+  {
+    ESP_LOGE(LOG_TAG,"cannot write image: %s",file);
+    remove(file);
+    size = 0;
+  } else {
+    ESP_LOGI(LOG_TAG,"Stored image of slot %u, %u bytes",slotnumber,size);
+  }
+  e->image = size;
+  if(halStorageSlotIndexWrite() != ESP_OK) halStorageSlotIndexInvalidate();
+  return ret;
+}
+
 /** @brief Store an infrared command to storage
  * 
  * This method stores a set of IR edges with a given length and a given
@@ -1278,7 +2141,7 @@ esp_err_t halStorageStore(uint32_t tid, char *cfgstring, uint8_t slotnumber)
  * */
 esp_err_t halStorageStoreIR(uint32_t tid, halIOIR_t *cfg, char *cmdName)
 {
-  char file[sizeof(base_path)+12];
+  char file[sizeof(base_path)+32];
   char nullterm = '\0';
   uint32_t namelen;
 
@@ -1306,6 +2169,9 @@ esp_err_t halStorageStoreIR(uint32_t tid, halIOIR_t *cfg, char *cmdName)
     ESP_LOGI(LOG_TAG,"Overwriting @%d",cmdnumber);
   }
   
+  //cached IR commands are invalid now (might be overwritten)
+  storageIRGeneration++;
+  
   //create filename from slotnumber
   sprintf(file,"%s/IR_%03d.set",base_path,cmdnumber);
   
@@ -1337,6 +2203,8 @@ esp_err_t halStorageStoreIR(uint32_t tid, halIOIR_t *cfg, char *cmdName)
     //did not write a full config
     ESP_LOGE(LOG_TAG,"Error writing IR cmd");
     fclose(f);
+    //the file might be incomplete, rebuild the index on the next access
+    halStorageIRIndexInvalidate();
     return ESP_FAIL;
   } else {
     ESP_LOGI(LOG_TAG,"Stored IR cmd %u (%s) with %u bytes payload (length %d)", \
@@ -1348,6 +2216,27 @@ esp_err_t halStorageStoreIR(uint32_t tid, halIOIR_t *cfg, char *cmdName)
   
   //clean up
   fclose(f);
+  
+  //update the IR index (new command or overwritten one)
+  if(cmdnumber >= irIndexCount)
+  {
+    ir_index_entry_t *entries = realloc(irIndex,sizeof(ir_index_entry_t)*(cmdnumber+1));
+    if(entries == NULL)
+    {
+      ESP_LOGE(LOG_TAG,"No memory for IR index");
+      halStorageIRIndexInvalidate();
+      return ESP_OK;
+    }
+    irIndex = entries;
+    irIndexCount = cmdnumber + 1;
+  }
+  ir_index_entry_t *e = &irIndex[cmdnumber];
+  memset(e,0,sizeof(ir_index_entry_t));
+  strncpy(e->name,cmdName,SLOTNAME_LENGTH-1);
+  e->length = cfg->count;
+  e->checksum = crc32_le(0,(uint8_t*)cfg->buffer,sizeof(rmt_item32_t)*cfg->count);
+  //a stale index file must not be loaded on the next start
+  if(halStorageIRIndexWrite() != ESP_OK) halStorageIRIndexInvalidate();
   return ESP_OK;
 }
 
@@ -1372,8 +2261,8 @@ esp_err_t halStorageLoadIR(char *cmdName, halIOIR_t *cfg, uint32_t tid)
 {
   uint8_t currentSlot = 0;
   uint32_t slotnamelen = 0;
+  uint16_t irlength = 0;
   char file[sizeof(base_path)+32];
-  char fileSlotName[SLOTNAME_LENGTH+4];
   FILE *f;
   
   //do some checks for file system
@@ -1385,86 +2274,62 @@ esp_err_t halStorageLoadIR(char *cmdName, halIOIR_t *cfg, uint32_t tid)
     return ESP_FAIL;
   }
   
-  do {
-    //create filename string to search if this slot is available
-    sprintf(file,"%s/IR_%03d.set",base_path,currentSlot);
-    
-    //open file for reading
-    #if LOG_LEVEL_STORAGE >= ESP_LOG_DEBUG
-    ESP_LOGD(LOG_TAG,"Opening file %s",file);
-    #endif
-    f = fopen(file, "rb");
-
-    //Currently: return ESP_FAIL for first not found file
-    if(f == NULL)
-    {
-      ESP_LOGI(LOG_TAG,"Stopped at IR cmd number %u, didn't found the given name",currentSlot);
-      return ESP_FAIL;
-    }
-    
-    fseek(f,0,SEEK_SET);
+  //get the number from the IR index, only this file is opened
+  if(halStorageGetNumberForNameIR(tid,&currentSlot,cmdName) != ESP_OK) return ESP_FAIL;
+  ir_index_entry_t *e = &irIndex[currentSlot];
   
-    //read slot name
-    fread(&slotnamelen,sizeof(uint32_t),1,f);
-    if(slotnamelen > SLOTNAME_LENGTH + 1)
-    {
-      ESP_LOGE(LOG_TAG,"CMD name too long: %u",slotnamelen);
-      fclose(f);
-      return ESP_FAIL;
-    }
-    fread(fileSlotName,sizeof(char),slotnamelen+1,f);
-    fileSlotName[slotnamelen] = '\0';
-    #if LOG_LEVEL_STORAGE >= ESP_LOG_DEBUG
-    ESP_LOGD(LOG_TAG,"Read cmdname: %s, length %d",fileSlotName,slotnamelen);
-    #endif
-      
-    //compare parameter & file slotname
-    if(strcmp(cmdName, fileSlotName) == 0)
-    {
-      //found a slot
-      ESP_LOGI(LOG_TAG,"Found IR slot \"%s\" @%u",cmdName,currentSlot);
-      //read length of recorded items
-      uint16_t irlength = 0;
-      fread(&irlength,sizeof(uint16_t),1,f);
-      
-      //allocate amount of IR edges.
-      cfg->buffer = malloc(sizeof(rmt_item32_t)*irlength);
-      
-      if(cfg->buffer != NULL)
-      {
-          //read from file to buffer
-          if(fread(cfg->buffer,sizeof(rmt_item32_t),irlength,f) != irlength)
-          {
-            //maybe EOF, didn't read as many bytes as requested
-            ESP_LOGE(LOG_TAG,"Cannot read data from file");
-            fclose(f);
-            free(cfg->buffer);
-            return ESP_FAIL;
-          }
-          //save length to struct as well
-          cfg->count = irlength;
-          
-          //debug output
-          ESP_LOG_BUFFER_HEXDUMP(LOG_TAG,cfg->buffer,sizeof(rmt_item32_t)*cfg->count,ESP_LOG_VERBOSE);
-      } else {
-        //didn't get a buffer pointer
-        ESP_LOGE(LOG_TAG,"No memory for IR command");
-        fclose(f);
-        return ESP_FAIL;
-      }
-      
-      //clean up / return
-      fclose(f);
-      return ESP_OK;
-    }
-    
-    //go to next possible slot & clean up
-    currentSlot++;
+  sprintf(file,"%s/IR_%03d.set",base_path,currentSlot);
+  #if LOG_LEVEL_STORAGE >= ESP_LOG_DEBUG
+  ESP_LOGD(LOG_TAG,"Opening file %s",file);
+  #endif
+  f = fopen(file, "rb");
+  if(f == NULL)
+  {
+    ESP_LOGE(LOG_TAG,"Cannot open IR cmd %u, rebuilding index",currentSlot);
+    halStorageIRIndexInvalidate();
+    return ESP_FAIL;
+  }
+  
+  //skip the name, read length of recorded items
+  fread(&slotnamelen,sizeof(uint32_t),1,f);
+  fseek(f,slotnamelen+1,SEEK_CUR);
+  fread(&irlength,sizeof(uint16_t),1,f);
+  if(irlength != e->length)
+  {
+    ESP_LOGE(LOG_TAG,"IR cmd %u does not match index, rebuilding index",currentSlot);
+    halStorageIRIndexInvalidate();
     fclose(f);
-  } while(1);
-
-  //we should never be here...
-  if(f!=NULL) fclose(f);
+    return ESP_FAIL;
+  }
+  
+  //allocate amount of IR edges.
+  cfg->buffer = malloc(sizeof(rmt_item32_t)*irlength);
+  if(cfg->buffer == NULL)
+  {
+    //didn't get a buffer pointer
+    ESP_LOGE(LOG_TAG,"No memory for IR command");
+    fclose(f);
+    return ESP_FAIL;
+  }
+  
+  //read from file to buffer & verify it
+  if(fread(cfg->buffer,sizeof(rmt_item32_t),irlength,f) != irlength || \
+    crc32_le(0,(uint8_t*)cfg->buffer,sizeof(rmt_item32_t)*irlength) != e->checksum)
+  {
+    ESP_LOGE(LOG_TAG,"Cannot read IR cmd %u or checksum mismatch",currentSlot);
+    fclose(f);
+    free(cfg->buffer);
+    return ESP_FAIL;
+  }
+  //save length to struct as well
+  cfg->count = irlength;
+  ESP_LOGI(LOG_TAG,"Loaded IR slot \"%s\" @%u",cmdName,currentSlot);
+  
+  //debug output
+  ESP_LOG_BUFFER_HEXDUMP(LOG_TAG,cfg->buffer,sizeof(rmt_item32_t)*cfg->count,ESP_LOG_VERBOSE);
+  
+  //clean up / return
+  fclose(f);
   return ESP_OK;
 }
 
@@ -1556,8 +2421,8 @@ esp_err_t halStorageFinishTransaction(uint32_t tid)
     return ESP_FAIL;
   }
   
-  //if we have used a store file handle, close it.
-  if(storeHandle != NULL) fclose(storeHandle);
+  //if we have used a store file handle, close it & update the index
+  halStorageStoreClose();
   
   //reset caller & id
   storageCurrentTID = 0;
@@ -101,6 +101,28 @@
  * */
 #define HAL_STORAGE_NVS_NAMESPACE "devcfg"
 
+/** @brief Count of slot images kept in RAM (current slot & both neighbours)
+ * @see halStoragePrefetch */
+#define SLOT_CACHE_ENTRIES 3
+
+/** @brief Default memory budget of the slot cache [bytes]
+ * @see halStorageSetCacheBudget */
+#define SLOT_CACHE_BUDGET_DEFAULT 8192
+
+/** @brief Statistics of the slot cache */
+typedef struct slot_cache_stats {
+  /** @brief Slots installed from the cache */
+  uint32_t hits;
+  /** @brief Slot images read from the storage on loading */
+  uint32_t misses;
+  /** @brief Count of cached images */
+  uint32_t entries;
+  /** @brief Bytes used by the cached images */
+  uint32_t bytes;
+  /** @brief Memory budget of the cache [bytes] */
+  uint32_t budget;
+} slot_cache_stats_t;
+
 typedef enum {
   NEXT, /** load next slot (no name needed) **/
   PREV, /** load previous slot (no name needed) **/
@@ -160,6 +182,14 @@ esp_err_t halStorageNVSStoreString(const char *key, char *string);
  * */
 uint8_t halStorageGetCurrentSlotNumber(void);
 
+/** @brief Check if the last loaded slot was installed from its image
+ * 
+ * If set, no AT commands were sent to the command parser for this slot.
+ * @see halStorageLoadNumber
+ * @return 1 if installed from the image, 0 if the slot file was parsed
+ * */
+uint8_t halStorageIsImageLoaded(void);
+
 /** Get the name of a slot number
  * 
  * This method returns the name of the given slot number.
@@ -265,6 +295,9 @@ esp_err_t halStorageLoad(hal_storage_load_action navigate, uint32_t tid);
  * @param tid Transaction ID, which must match the one given by halStorageStartTransaction
  * @param outputSerial Either the loaded AT commands are sent to the command parser (== 0) or sent to the serial output
  * @note If sending to serial port, the slot name is printed as well ("Slot <number>:<name>).
+ * @note If the AT commands are for the command parser & a valid image of this
+ * slot exists (halStorageStoreImage), the image is installed instead
+ * (see halStorageIsImageLoaded).
  * @return ESP_OK if everything is fine, ESP_FAIL if the command was not successful (slot number not found)
  * */
 esp_err_t halStorageLoadNumber(uint8_t slotnumber, uint32_t tid, uint8_t outputSerial);
@@ -355,6 +388,16 @@ esp_err_t halStorageGetNameForNumberIR(uint32_t tid, uint8_t slotnumber, char *c
  * */
 esp_err_t halStorageStoreIR(uint32_t tid, halIOIR_t *cfg, char *cmdName);
 
+/** @brief Get the generation of the stored IR commands
+ * 
+ * This counter is increased each time IR commands are stored or deleted.
+ * Cached IR commands are valid as long as the generation does not change.
+ * @return Current generation of the IR commands
+ * @see halStorageStoreIR
+ * @see halStorageDeleteIRCmd
+ * */
+uint32_t halStorageGetIRGeneration(void);
+
 /** @brief Get the number of an IR command
  * 
  * This method returns the number of the given IR command name.
@@ -451,6 +494,63 @@ esp_err_t halStorageFinishTransaction(uint32_t tid);
  * */
 esp_err_t halStorageStore(uint32_t tid, char *cfgstring, uint8_t slotnumber);
 
+/** @brief Create the precompiled image of a slot
+ * 
+ * The image (slot_image.h) is created from the current config & the
+ * current HID/VB commands, which must be the result of the given slot
+ * file. Store it with halStorageStoreImage. A slot file, which is
+ * currently stored by halStorageStore, is finished before.
+ * 
+ * @param tid Transaction id
+ * @param slotnumber Number of the slot
+ * @param image Created image (allocated), freed by halStorageStoreImage
+ * @param size Size of the image in bytes
+ * @return ESP_OK on success, ESP_FAIL otherwise
+ * */
+esp_err_t halStorageCreateImage(uint32_t tid, uint8_t slotnumber, uint8_t **image, uint32_t *size);
+
+/** @brief Store the precompiled image of a slot
+ * 
+ * The image (created by halStorageCreateImage) is installed by
+ * halStorageLoadNumber instead of parsing the slot file, as long as
+ * the slot file is not changed. If the slot file was changed since the
+ * image was created, it is not stored.
+ * 
+ * @param tid Transaction id
+ * @param slotnumber Number of the slot
+ * @param image Image, created by halStorageCreateImage. It is freed here in any case.
+ * @param size Size of the image in bytes
+ * @return ESP_OK on success, ESP_FAIL otherwise
+ * */
+esp_err_t halStorageStoreImage(uint32_t tid, uint8_t slotnumber, uint8_t *image, uint32_t size);
+
+/** @brief Load the image of a slot into the slot cache
+ * 
+ * A cached image is installed by halStorageLoadNumber without accessing
+ * the storage. Images of slots farther away from the current slot are
+ * removed from the cache, if necessary. Slots without a valid image are
+ * not cached.
+ * 
+ * @param tid Transaction id
+ * @param slotnumber Number of the slot
+ * @return ESP_OK if the image is cached, ESP_FAIL otherwise
+ * */
+esp_err_t halStoragePrefetch(uint32_t tid, uint8_t slotnumber);
+
+/** @brief Set the memory budget of the slot cache
+ * 
+ * The cache is cleared, the budget is stored in the NVS & loaded on
+ * the next boot.
+ * @param tid Transaction id
+ * @param budget Maximum bytes used by cached images, 0 disables the cache
+ * @return ESP_OK on success, ESP_FAIL otherwise
+ * */
+esp_err_t halStorageSetCacheBudget(uint32_t tid, uint32_t budget);
+
+/** @brief Get the statistics of the slot cache
+ * @param stats Output of the statistics */
+void halStorageGetCacheStats(slot_cache_stats_t *stats);
+
 /** @brief Store a virtual button config struct
  * 
  * This method stores the config structs for virtual buttons.
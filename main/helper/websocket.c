@@ -55,7 +55,8 @@ const char WS_sec_conKey[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
 const char WS_srv_hs[] ="HTTP/1.1 101 Switching Protocols \r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: %.*s\r\n\r\n";
 
 
-esp_err_t WS_write_data(char* p_data, size_t length) {
+/** \brief Send one websocket frame with the given opcode */
+static esp_err_t WS_write_frame(char* p_data, size_t length, WS_OPCODES opcode) {
 
 	//check if we have an open connection
 	if (WS_conn == NULL)
@@ -74,7 +75,7 @@ esp_err_t WS_write_data(char* p_data, size_t length) {
 	hdr.payload_length = length;
 	hdr.mask = 0;
 	hdr.reserved = 0;
-	hdr.opcode = WS_OP_TXT;
+	hdr.opcode = opcode;
 
 	//send header
 	result = netconn_write(WS_conn, &hdr, sizeof(WS_frame_header_t), NETCONN_COPY);
@@ -87,6 +88,14 @@ esp_err_t WS_write_data(char* p_data, size_t length) {
 	return netconn_write(WS_conn, p_data, length, NETCONN_COPY);
 }
 
+esp_err_t WS_write_data(char* p_data, size_t length) {
+	return WS_write_frame(p_data, length, WS_OP_TXT);
+}
+
+esp_err_t WS_write_data_binary(char* p_data, size_t length) {
+	return WS_write_frame(p_data, length, WS_OP_BIN);
+}
+
 
 void ws_server_netconn_serve(struct netconn *conn) {
 
@@ -89,5 +89,6 @@ typedef struct{
 
 void ws_server_netconn_serve(struct netconn *conn);
 esp_err_t WS_write_data(char* p_data, size_t length);
+esp_err_t WS_write_data_binary(char* p_data, size_t length);
 
 #endif  /*_WEBSOCKET_H_*/
@@ -0,0 +1,277 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ * Copyright 2019 Benjamin Aigner <aignerb@technikum-wien.at,
+ * beni@asterics-foundation.org>
+ */
+/** @file
+ * @brief Host simulation - benchmark of the timer engine vs. the tick engine
+ *
+ * Synthetic bounce traces are fed to both debouncer engines
+ * (DEBOUNCE_ENGINE_TIMER & DEBOUNCE_ENGINE_TICK). Each trace consists of
+ * bursts on all VBs: the first edge of a burst is the new level, followed
+ * by bounces (alternating edges), the last edge is the new level again.
+ *
+ * For each trace profile & engine, following is reported:
+ * * VB events: matched to a burst, extra (e.g. release of a canceled press)
+ *   and missed bursts
+ * * Latency between the start of a burst & its event (average, maximum)
+ * * esp_timer API calls (start & stop) and timer callbacks
+ * * Host time for the simulation (relative cost only, not the ESP32 time)
+ *
+ * Usage: debouncer_bench [<seconds>] <br>
+ * Exit code is 1 if a burst is missed or memory is allocated, 0 otherwise.
+ * @see sim_debouncer.h
+ */
+
+#include "sim_debouncer.h"
+#include <time.h>
+
+/** @brief Debounce time for press & release of the benchmark, unit: [ms] */
+#define BENCH_DEBOUNCE_MS 30
+/** @brief Minimum time between two bursts of one VB, unit: [us] */
+#define BENCH_HOLD_MIN_US 60000
+/** @brief Maximum time between two bursts of one VB, unit: [us] */
+#define BENCH_HOLD_MAX_US 300000
+/** @brief Maximum count of bursts of one trace */
+#define BENCH_BURSTS 8192
+/** @brief Maximum count of edges of one trace */
+#define BENCH_EDGES 131072
+
+/** @brief One trace profile */
+typedef struct bench_profile {
+  /** @brief Name for messages */
+  const char *name;
+  /** @brief Maximum count of bounces (edge pairs) per burst */
+  uint32_t bounces;
+  /** @brief Maximum duration of the bounces, unit: [us] */
+  uint32_t duration;
+} bench_profile_t;
+
+/** @brief One burst of a trace */
+typedef struct bench_burst {
+  /** @brief Time of the first edge, unit: [us] */
+  int64_t start;
+  /** @brief Virtual button */
+  uint32_t vb;
+  /** @brief New level (VB_PRESS_EVENT or VB_RELEASE_EVENT) */
+  vb_event_t type;
+  /** @brief An event was matched to this burst */
+  uint8_t matched;
+} bench_burst_t;
+
+/** @brief One edge of a trace */
+typedef struct bench_edge {
+  /** @brief Time of this edge, unit: [us] */
+  int64_t time;
+  /** @brief Virtual button */
+  uint32_t vb;
+  /** @brief Edge (VB_PRESS_EVENT or VB_RELEASE_EVENT) */
+  vb_event_t type;
+} bench_edge_t;
+
+/** @brief Results of one run */
+typedef struct bench_result {
+  uint32_t events;
+  uint32_t extra;
+  uint32_t missed;
+  uint64_t latencySum;
+  uint32_t latencyMax;
+  uint32_t timerCalls;
+  uint32_t callbacks;
+  uint32_t allocs;
+  uint64_t hostNs;
+} bench_result_t;
+
+/** @brief All profiles */
+static const bench_profile_t profiles[] = {
+  { "clean", 0, 0 },
+  { "bounce", 3, 2000 },
+  { "heavy", 15, 8000 },
+};
+
+/** @brief Bursts of the current trace, sorted by VB & time */
+static bench_burst_t bursts[BENCH_BURSTS];
+/** @brief Count of bursts */
+static uint32_t burstCount = 0;
+/** @brief Edges of the current trace, sorted by time */
+static bench_edge_t edges[BENCH_EDGES];
+/** @brief Count of edges */
+static uint32_t edgeCount = 0;
+/** @brief State of the random generator */
+static uint32_t seed = 1;
+
+/** @brief Simple LCG, same sequence on each host */
+static uint32_t rnd(uint32_t max)
+{
+  seed = seed * 1103515245 + 12345;
+  return (seed >> 8) % max;
+}
+
+/** @brief Compare two edges by time (VB on equal time) */
+static int edgeCompare(const void *a, const void *b)
+{
+  const bench_edge_t *ea = a, *eb = b;
+  if(ea->time != eb->time) return (ea->time < eb->time) ? -1 : 1;
+  return (int)ea->vb - (int)eb->vb;
+}
+
+/** @brief Generate a trace for all VBs
+ * @param p Profile
+ * @param duration Length of the trace, unit: [us] */
+static void generateTrace(const bench_profile_t *p, int64_t duration)
+{
+  burstCount = 0;
+  edgeCount = 0;
+  seed = 1;
+  for(uint32_t vb = 0; vb<VB_MAX; vb++)
+  {
+    int64_t time = rnd(BENCH_HOLD_MAX_US);
+    vb_event_t type = VB_PRESS_EVENT;
+    while(time < duration && burstCount < BENCH_BURSTS)
+    {
+      uint32_t bounces = (p->bounces != 0) ? rnd(p->bounces + 1) : 0;
+      if(edgeCount + 2*bounces + 1 > BENCH_EDGES) break;
+      bursts[burstCount].start = time;
+      bursts[burstCount].vb = vb;
+      bursts[burstCount].type = type;
+      bursts[burstCount].matched = 0;
+      burstCount++;
+
+      //first edge, bounces back & forth, last edge is the new level again
+      int64_t t = time;
+      for(uint32_t i = 0; i<2*bounces+1; i++)
+      {
+        edges[edgeCount].time = t;
+        edges[edgeCount].vb = vb;
+        edges[edgeCount].type = ((i % 2) == 0) ? type : \
+          ((type == VB_PRESS_EVENT) ? VB_RELEASE_EVENT : VB_PRESS_EVENT);
+        edgeCount++;
+        if(bounces != 0) t += 1 + rnd(p->duration / (2*bounces));
+      }
+      time += BENCH_HOLD_MIN_US + rnd(BENCH_HOLD_MAX_US - BENCH_HOLD_MIN_US);
+      type = (type == VB_PRESS_EVENT) ? VB_RELEASE_EVENT : VB_PRESS_EVENT;
+    }
+  }
+  qsort(edges,edgeCount,sizeof(bench_edge_t),edgeCompare);
+}
+
+/** @brief Match the recorded events to the bursts of the trace */
+static void matchEvents(bench_result_t *r)
+{
+  uint32_t first[VB_MAX+1];
+  uint32_t current[VB_MAX];
+
+  //bursts are sorted by VB, find the first one of each VB
+  for(uint32_t vb = 0, i = 0; vb<=VB_MAX; vb++)
+  {
+    while(i < burstCount && bursts[i].vb < vb) i++;
+    first[vb] = i;
+    if(vb < VB_MAX) current[vb] = i;
+  }
+
+  for(uint32_t i = 0; i<hostsimStats.events && i<HOSTSIM_EVENTS; i++)
+  {
+    hostsim_event_t *e = &hostsimEvents[i];
+    uint32_t vb = e->data;
+    //latest burst of this VB, started before the event
+    while(current[vb]+1 < first[vb+1] && bursts[current[vb]+1].start <= e->time) current[vb]++;
+    bench_burst_t *b = &bursts[current[vb]];
+    if(current[vb] < first[vb+1] && b->start <= e->time && b->type == e->id && b->matched == 0)
+    {
+      uint32_t latency = (uint32_t)(e->time - b->start);
+      b->matched = 1;
+      r->latencySum += latency;
+      if(latency > r->latencyMax) r->latencyMax = latency;
+    } else r->extra++;
+  }
+  for(uint32_t i = 0; i<burstCount; i++) if(bursts[i].matched == 0) r->missed++;
+}
+
+/** @brief Run the current trace with one engine */
+static void runEngine(uint8_t engine, int64_t duration, bench_result_t *r)
+{
+  generalConfig_t cfg;
+  struct timespec start, end;
+
+  memset(&cfg,0,sizeof(cfg));
+  memset(r,0,sizeof(bench_result_t));
+  cfg.debounce_press = BENCH_DEBOUNCE_MS;
+  cfg.debounce_release = BENCH_DEBOUNCE_MS;
+  cfg.debounce_engine = engine;
+  for(uint32_t i = 0; i<burstCount; i++) bursts[i].matched = 0;
+
+  hostsimReset();
+  simDebouncerConfig(&cfg);
+  //count the engine switch as well
+  clock_gettime(CLOCK_MONOTONIC,&start);
+  for(uint32_t i = 0; i<edgeCount; i++)
+  {
+    hostsimRun(edges[i].time);
+    simDebouncerEdge(edges[i].vb,edges[i].type);
+  }
+  hostsimRun(duration + 1000000);
+  clock_gettime(CLOCK_MONOTONIC,&end);
+
+  r->hostNs = (uint64_t)(end.tv_sec - start.tv_sec) * 1000000000ULL + end.tv_nsec - start.tv_nsec;
+  r->events = hostsimStats.events;
+  r->timerCalls = hostsimStats.timerStarts + hostsimStats.timerStops;
+  r->callbacks = hostsimStats.timerCallbacks;
+  r->allocs = hostsimStats.allocs;
+  matchEvents(r);
+}
+
+int main(int argc, char **argv)
+{
+  int64_t duration = 20 * 1000000LL;
+  uint32_t errors = 0;
+
+  if(argc > 1) duration = strtol(argv[1],NULL,0) * 1000000LL;
+  if(simDebouncerInit() != ESP_OK)
+  {
+    fprintf(stderr,"bench: error: cannot create the debounce timers\n");
+    return 1;
+  }
+
+  for(uint32_t p = 0; p<sizeof(profiles)/sizeof(profiles[0]); p++)
+  {
+    generateTrace(&profiles[p],duration);
+    for(uint8_t engine = DEBOUNCE_ENGINE_TIMER; engine<=DEBOUNCE_ENGINE_TICK; engine++)
+    {
+      bench_result_t r;
+      const char *name = (engine == DEBOUNCE_ENGINE_TICK) ? "tick" : "timer";
+      runEngine(engine,duration,&r);
+      uint32_t matched = burstCount - r.missed;
+
+      printf("bench: %s/%s: %u VBs, %u bursts, %u edges, %u events (%u extra, %u missed), " \
+        "latency avg %u max %uus, %u timer calls, %u callbacks, %u allocations, %lu ns/edge\n", \
+        profiles[p].name,name,VB_MAX,burstCount,edgeCount,r.events,r.extra,r.missed, \
+        (matched != 0) ? (uint32_t)(r.latencySum / matched) : 0,r.latencyMax, \
+        r.timerCalls,r.callbacks,r.allocs,(unsigned long)(r.hostNs / (edgeCount ? edgeCount : 1)));
+      if(r.missed != 0)
+      {
+        fprintf(stderr,"bench: %s/%s: error: %u bursts missed\n",profiles[p].name,name,r.missed);
+        errors++;
+      }
+      if(r.allocs != 0)
+      {
+        fprintf(stderr,"bench: %s/%s: error: %u allocations\n",profiles[p].name,name,r.allocs);
+        errors++;
+      }
+    }
+  }
+  return (errors != 0) ? 1 : 0;
+}
@@ -0,0 +1,399 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ * Copyright 2019 Benjamin Aigner <aignerb@technikum-wien.at,
+ * beni@asterics-foundation.org>
+ */
+/** @file
+ * @brief Host simulation - model check of the debouncer's timer engine
+ *
+ * Random bounce traces are fed to the timer engine (DEBOUNCE_ENGINE_TIMER,
+ * one esp_timer per VB). The posted VB events are compared to a
+ * reference model of the per-VB state machine:
+ *
+ * * IDLE: an edge starts the press/release time, a time of 0 is mapped directly
+ * * PRESS: a release cancels & is sent immediately, a press is a bounce
+ * * RELEASE: a press cancels (only if a release time is configured)
+ * * DEADTIME: all edges are ignored
+ * * Expired PRESS/RELEASE: the event is sent, the deadtime starts (if set)
+ *
+ * Published VBs (taskDebouncerPublish) are checked across a config update
+ * for both engines: changes during the update must be processed afterwards,
+ * the latency is measured for each VB of a snapshot.
+ *
+ * In addition, following is checked while debouncing (after createTimers):
+ * * no memory is allocated
+ * * no timer is created
+ * * no running timer is started again (ESP_ERR_INVALID_STATE on the ESP32)
+ *
+ * Usage: debouncer_model [<seed> ...] <br>
+ * Exit code is 0 if all scenarios match the model, 1 otherwise.
+ * @see sim_debouncer.h
+ */
+
+#include "sim_debouncer.h"
+
+/** @brief Count of VBs used in the traces */
+#define MODEL_VBS 6
+/** @brief Count of edges of one trace */
+#define MODEL_EDGES 4000
+
+/** @brief State of one VB in the reference model */
+typedef enum {
+  MODEL_IDLE,
+  MODEL_PRESS,
+  MODEL_RELEASE,
+  MODEL_DEADTIME
+} model_state_t;
+
+/** @brief Reference model of one VB */
+typedef struct model_vb {
+  /** @brief Current state */
+  model_state_t state;
+  /** @brief Expiry of the running time (not IDLE), unit: [us] */
+  int64_t deadline;
+  /** @brief Press time, unit: [ms], 0 is mapped directly */
+  uint16_t press;
+  /** @brief Release time, unit: [ms], 0 is mapped directly */
+  uint16_t release;
+  /** @brief Deadtime, unit: [ms] */
+  uint16_t idle;
+  /** @brief A release time is configured, a press cancels the release */
+  uint8_t releaseSet;
+} model_vb_t;
+
+/** @brief One test scenario */
+typedef struct model_scenario {
+  /** @brief Name for messages */
+  const char *name;
+  /** @brief Global press, release & idle time */
+  uint16_t press, release, idle;
+  /** @brief Individual times (vb, press, release, idle) */
+  vb_param_t vb[4];
+  /** @brief Count of individual times */
+  uint8_t vbcount;
+} model_scenario_t;
+
+/** @brief All scenarios */
+static const model_scenario_t scenarios[] = {
+  { "defaults", 0, 0, 0, {{0}}, 0 },
+  { "global", 30, 20, 0, {{0}}, 0 },
+  { "deadtime", 25, 40, 30, {{0}}, 0 },
+  { "direct", 5, 5, 0, {{0}}, 0 },
+  { "individual", 15, 0, 0, {{0,5,0,0},{1,0,100,15},{2,80,8,0},{3,0,0,50}}, 4 },
+};
+
+/** @brief Model state of all VBs */
+static model_vb_t model[VB_MAX];
+/** @brief Events of the model */
+static hostsim_event_t modelEvents[HOSTSIM_EVENTS];
+/** @brief Count of events of the model */
+static uint32_t modelCount = 0;
+/** @brief State of the random generator */
+static uint32_t seed = 1;
+
+/** @brief Simple LCG, same sequence on each host */
+static uint32_t rnd(uint32_t max)
+{
+  seed = seed * 1103515245 + 12345;
+  return (seed >> 8) % max;
+}
+
+/** @brief Record one event of the model */
+static void modelPost(int64_t time, uint32_t vb, vb_event_t type)
+{
+  if(modelCount < HOSTSIM_EVENTS)
+  {
+    modelEvents[modelCount].time = time;
+    modelEvents[modelCount].id = type;
+    modelEvents[modelCount].data = vb;
+  }
+  modelCount++;
+}
+
+/** @brief Resolve the times of all VBs (VB value, global value, default) */
+static void modelConfig(generalConfig_t *cfg)
+{
+  memset(model,0,sizeof(model));
+  modelCount = 0;
+  for(uint32_t vb = 0; vb<VB_MAX; vb++)
+  {
+    uint16_t press = cfg->debounce_press;
+    uint16_t release = cfg->debounce_release;
+    uint16_t idle = cfg->debounce_idle;
+    for(uint8_t i = 0; i<cfg->debounce_vb_count; i++)
+    {
+      if(cfg->debounce_vb[i].vb != vb) continue;
+      if(cfg->debounce_vb[i].press) press = cfg->debounce_vb[i].press;
+      if(cfg->debounce_vb[i].release) release = cfg->debounce_vb[i].release;
+      if(cfg->debounce_vb[i].idle) idle = cfg->debounce_vb[i].idle;
+    }
+    model[vb].releaseSet = (release != 0);
+    if(press == 0) press = DEBOUNCETIME_MS;
+    if(release == 0) release = DEBOUNCETIME_MS;
+    model[vb].press = (press > DEBOUNCETIME_MIN_MS) ? press : 0;
+    model[vb].release = (release > DEBOUNCETIME_MIN_MS) ? release : 0;
+    model[vb].idle = idle;
+  }
+}
+
+/** @brief Process all times expiring until (ordered by expiry, then VB) */
+static void modelExpire(int64_t until)
+{
+  while(1)
+  {
+    model_vb_t *m = NULL;
+    uint32_t vb = 0;
+    for(uint32_t i = 0; i<VB_MAX; i++)
+    {
+      if(model[i].state == MODEL_IDLE || model[i].deadline > until) continue;
+      if(m == NULL || model[i].deadline < m->deadline) { m = &model[i]; vb = i; }
+    }
+    if(m == NULL) return;
+
+    if(m->state == MODEL_DEADTIME) { m->state = MODEL_IDLE; continue; }
+    modelPost(m->deadline,vb,(m->state == MODEL_PRESS) ? VB_PRESS_EVENT : VB_RELEASE_EVENT);
+    if(m->idle != 0)
+    {
+      m->state = MODEL_DEADTIME;
+      m->deadline += m->idle * 1000;
+    } else m->state = MODEL_IDLE;
+  }
+}
+
+/** @brief Process one edge of the model */
+static void modelEdge(int64_t time, uint32_t vb, vb_event_t type)
+{
+  model_vb_t *m = &model[vb];
+  switch(m->state)
+  {
+    case MODEL_IDLE:
+    {
+      uint16_t t = (type == VB_PRESS_EVENT) ? m->press : m->release;
+      if(t == 0) modelPost(time,vb,type);
+      else {
+        m->state = (type == VB_PRESS_EVENT) ? MODEL_PRESS : MODEL_RELEASE;
+        m->deadline = time + t * 1000;
+      }
+      break;
+    }
+    case MODEL_PRESS:
+      if(type == VB_RELEASE_EVENT)
+      {
+        modelPost(time,vb,VB_RELEASE_EVENT);
+        m->state = MODEL_IDLE;
+      }
+      break;
+    case MODEL_RELEASE:
+      if(type == VB_PRESS_EVENT && m->releaseSet) m->state = MODEL_IDLE;
+      break;
+    case MODEL_DEADTIME:
+      break;
+  }
+}
+
+/** @brief Run one scenario with one random trace
+ * @return Count of errors */
+static uint32_t runScenario(const model_scenario_t *s, uint32_t traceSeed)
+{
+  generalConfig_t cfg;
+  uint8_t level[MODEL_VBS];
+  int64_t time = 0;
+  uint32_t errors = 0;
+
+  memset(&cfg,0,sizeof(cfg));
+  memset(level,0,sizeof(level));
+  cfg.debounce_press = s->press;
+  cfg.debounce_release = s->release;
+  cfg.debounce_idle = s->idle;
+  cfg.debounce_engine = DEBOUNCE_ENGINE_TIMER;
+  memcpy(cfg.debounce_vb,s->vb,s->vbcount * sizeof(vb_param_t));
+  cfg.debounce_vb_count = s->vbcount;
+
+  hostsimReset();
+  simDebouncerConfig(&cfg);
+  modelConfig(&cfg);
+  seed = traceSeed;
+
+  for(uint32_t i = 0; i<MODEL_EDGES; i++)
+  {
+    //mostly bounces, sometimes a long hold
+    if(rnd(4) == 0) time += 5000 + rnd(150000);
+    else time += 50 + rnd(3000);
+    uint32_t vb = rnd(MODEL_VBS);
+    //mostly a transition, sometimes the same edge again
+    if(rnd(8) != 0) level[vb] ^= 1;
+    vb_event_t type = level[vb] ? VB_PRESS_EVENT : VB_RELEASE_EVENT;
+
+    hostsimRun(time);
+    modelExpire(time);
+    simDebouncerEdge(vb,type);
+    modelEdge(time,vb,type);
+  }
+  time += 2000000;
+  hostsimRun(time);
+  modelExpire(time);
+
+  /*++++ compare to the model ++++*/
+  if(hostsimStats.events != modelCount)
+  {
+    fprintf(stderr,"model: %s/%u: error: %u events, model: %u\n", \
+      s->name,traceSeed,hostsimStats.events,modelCount);
+    errors++;
+  }
+  if(modelCount > HOSTSIM_EVENTS)
+  {
+    fprintf(stderr,"model: %s/%u: error: too many events\n",s->name,traceSeed);
+    errors++;
+  }
+  for(uint32_t i = 0; i<modelCount && i<hostsimStats.events && i<HOSTSIM_EVENTS; i++)
+  {
+    hostsim_event_t *a = &hostsimEvents[i], *b = &modelEvents[i];
+    if(a->time == b->time && a->id == b->id && a->data == b->data) continue;
+    fprintf(stderr,"model: %s/%u: error: event %u is VB%u/%d @%ldus, model: VB%u/%d @%ldus\n", \
+      s->name,traceSeed,i,a->data,a->id,(long)a->time,b->data,b->id,(long)b->time);
+    errors++;
+    break;
+  }
+
+  /*++++ check the runtime ++++*/
+  if(hostsimStats.allocs != 0)
+  {
+    fprintf(stderr,"model: %s/%u: error: %u allocations\n",s->name,traceSeed,hostsimStats.allocs);
+    errors++;
+  }
+  if(hostsimStats.timerCreates != 0)
+  {
+    fprintf(stderr,"model: %s/%u: error: %u timers created\n",s->name,traceSeed,hostsimStats.timerCreates);
+    errors++;
+  }
+  if(hostsimStats.timerRestarts != 0)
+  {
+    fprintf(stderr,"model: %s/%u: error: %u starts of running timers\n",s->name,traceSeed,hostsimStats.timerRestarts);
+    errors++;
+  }
+
+  printf("model: %s/%u: %u edges, %u events, %u timer starts, %u allocations, %u errors\n", \
+    s->name,traceSeed,MODEL_EDGES,hostsimStats.events,hostsimStats.timerStarts, \
+    hostsimStats.allocs,errors);
+  return errors;
+}
+
+/** @brief Check published VBs across a config update
+ * @param engine DEBOUNCE_ENGINE_TIMER or DEBOUNCE_ENGINE_TICK
+ * @return Count of errors */
+static uint32_t checkConfigUpdate(uint8_t engine)
+{
+  const char *name = (engine == DEBOUNCE_ENGINE_TICK) ? "tick" : "timer";
+  //VB, event & earliest time (the tick engine might be up to 2 ticks later)
+  const hostsim_event_t expected[] = {
+    { 30000, VB_PRESS_EVENT, 2 },
+    { 110000, VB_RELEASE_EVENT, 2 },
+    { 110000, VB_PRESS_EVENT, 3 },
+    { 236000, VB_PRESS_EVENT, 4 },
+    { 236000, VB_PRESS_EVENT, 5 },
+  };
+  const uint32_t count = sizeof(expected)/sizeof(expected[0]);
+  generalConfig_t cfg;
+  debouncer_stats_t stats4, stats5;
+  uint32_t errors = 0;
+
+  memset(&cfg,0,sizeof(cfg));
+  cfg.debounce_press = 30;
+  cfg.debounce_release = 30;
+  cfg.debounce_engine = engine;
+  hostsimReset();
+  simDebouncerConfig(&cfg);
+
+  //VB2 is pressed & sent
+  taskDebouncerPublish(1UL<<2,1UL<<2,NULL);
+  simDebouncerTask();
+  //VB3 is pressed, the config update starts during its debounce
+  hostsimRun(50000);
+  taskDebouncerPublish(1UL<<3,1UL<<3,NULL);
+  simDebouncerTask();
+  hostsimRun(60000);
+  xEventGroupClearBits(systemStatus,SYSTEM_STABLECONFIG);
+  simDebouncerTask();
+  //VB2 is released during the update, the notification is discarded
+  hostsimRun(70000);
+  taskDebouncerPublish(1UL<<2,0,NULL);
+  simDebouncerTask();
+  hostsimRun(80000);
+  xEventGroupSetBits(systemStatus,SYSTEM_STABLECONFIG);
+  simDebouncerTask();
+  //two changes in one snapshot
+  hostsimRun(200000);
+  taskDebouncerPublish(1UL<<4,1UL<<4,NULL);
+  hostsimRun(205000);
+  taskDebouncerPublish(1UL<<5,1UL<<5,NULL);
+  hostsimRun(206000);
+  simDebouncerTask();
+  hostsimRun(400000);
+
+  if(hostsimStats.events != count)
+  {
+    fprintf(stderr,"model: update/%s: error: %u events, expected: %u\n",name,hostsimStats.events,count);
+    errors++;
+  }
+  for(uint32_t i = 0; i<count && i<hostsimStats.events; i++)
+  {
+    hostsim_event_t *a = &hostsimEvents[i];
+    const hostsim_event_t *b = &expected[i];
+    if(a->id == b->id && a->data == b->data && a->time >= b->time && a->time <= b->time + 2000) continue;
+    fprintf(stderr,"model: update/%s: error: event %u is VB%u/%d @%ldus, expected: VB%u/%d @%ldus\n", \
+      name,i,a->data,a->id,(long)a->time,b->data,b->id,(long)b->time);
+    errors++;
+  }
+  //latency from the change of each VB, not from the last change of the snapshot
+  taskDebouncerGetStats(4,&stats4);
+  taskDebouncerGetStats(5,&stats5);
+  if(stats4.latencyMax < 36000 || stats4.latencyMax > 38000 || \
+    stats5.latencyMax < 31000 || stats5.latencyMax > 33000)
+  {
+    fprintf(stderr,"model: update/%s: error: latency VB4 %uus, VB5 %uus, expected: 36000/31000us\n", \
+      name,stats4.latencyMax,stats5.latencyMax);
+    errors++;
+  }
+
+  printf("model: update/%s: %u events, %u allocations, %u errors\n", \
+    name,hostsimStats.events,hostsimStats.allocs,errors);
+  return errors;
+}
+
+int main(int argc, char **argv)
+{
+  uint32_t seeds[] = { 1, 2, 3 };
+  uint32_t errors = 0;
+
+  if(simDebouncerInit() != ESP_OK)
+  {
+    fprintf(stderr,"model: error: cannot create the debounce timers\n");
+    return 1;
+  }
+  for(uint32_t s = 0; s<sizeof(scenarios)/sizeof(scenarios[0]); s++)
+  {
+    if(argc > 1)
+    {
+      for(int i = 1; i<argc; i++) errors += runScenario(&scenarios[s],strtoul(argv[i],NULL,0));
+    } else {
+      for(uint32_t i = 0; i<sizeof(seeds)/sizeof(seeds[0]); i++) errors += runScenario(&scenarios[s],seeds[i]);
+    }
+  }
+  errors += checkConfigUpdate(DEBOUNCE_ENGINE_TIMER);
+  errors += checkConfigUpdate(DEBOUNCE_ENGINE_TICK);
+  return (errors != 0) ? 1 : 0;
+}
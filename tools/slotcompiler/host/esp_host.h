@@ -0,0 +1,119 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ * Copyright 2017 Benjamin Aigner <aignerb@technikum-wien.at,
+ * beni@asterics-foundation.org>
+ */
+/** @file
+ * @brief Minimal ESP-IDF/FreeRTOS replacement for host builds
+ *
+ * The slot compiler compiles the firmware's command parser sources on
+ * a PC. All ESP-IDF headers included by these sources are redirected
+ * to this file, which provides only the types, constants & functions
+ * used by the parser. Logging is disabled.
+ *
+ * The host simulations (hostsim.h) compile further firmware modules
+ * (e.g. the debouncer) with these headers. The esp_timer/esp_event API
+ * and the additional FreeRTOS functions are implemented in hostsim.c only.
+ *
+ * @note Do not include this file in the firmware.
+ */
+#ifndef _ESP_HOST_H
+#define _ESP_HOST_H
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+typedef int32_t esp_err_t;
+#define ESP_OK 0
+#define ESP_FAIL -1
+#define ESP_ERR_NO_MEM 0x101
+#define ESP_ERR_INVALID_STATE 0x103
+
+typedef uint32_t TickType_t;
+typedef int32_t BaseType_t;
+typedef uint32_t UBaseType_t;
+typedef uint32_t EventBits_t;
+typedef void * EventGroupHandle_t;
+typedef void * QueueHandle_t;
+typedef void * SemaphoreHandle_t;
+typedef void * TaskHandle_t;
+typedef void * esp_timer_handle_t;
+typedef const char * esp_event_base_t;
+typedef void (*esp_event_handler_t)(void *arg, esp_event_base_t base, int32_t id, void *data);
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS 1
+#define portMAX_DELAY 0xFFFFFFFF
+#define portTICK_PERIOD_MS 1
+#define tskIDLE_PRIORITY 0
+#define configMAX_PRIORITIES 25
+#define ESP_EVENT_DECLARE_BASE(id) extern esp_event_base_t id
+#define ESP_EVENT_DEFINE_BASE(id) esp_event_base_t id = #id
+
+typedef struct { uint32_t val; } rmt_item32_t;
+typedef int rmt_channel_t;
+typedef int esp_gatt_if_t;
+typedef uint8_t esp_bd_addr_t[6];
+typedef int wl_handle_t;
+
+typedef enum { ESP_LOG_NONE, ESP_LOG_ERROR, ESP_LOG_WARN, ESP_LOG_INFO, \
+  ESP_LOG_DEBUG, ESP_LOG_VERBOSE } esp_log_level_t;
+static inline void esp_log_level_set(const char *tag, esp_log_level_t level) {}
+#define ESP_LOGE(tag, format, ...) do {} while(0)
+#define ESP_LOGW(tag, format, ...) do {} while(0)
+#define ESP_LOGI(tag, format, ...) do {} while(0)
+#define ESP_LOGD(tag, format, ...) do {} while(0)
+#define ESP_LOGV(tag, format, ...) do {} while(0)
+
+//FreeRTOS API, as used by the parser sources (implemented in host_stubs.c)
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks);
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue);
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group);
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, const EventBits_t bits);
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, const EventBits_t bits);
+void vTaskDelay(const TickType_t ticks);
+BaseType_t xTaskCreate(void (*task)(void*), const char * const name, \
+  const uint32_t stack, void * const param, UBaseType_t prio, TaskHandle_t * const handle);
+
+//FreeRTOS, esp_timer & esp_event API, as used by the simulated modules (implemented in hostsim.c)
+BaseType_t xQueueSendToBack(QueueHandle_t queue, const void *item, TickType_t ticks);
+BaseType_t xQueueSendToBackFromISR(QueueHandle_t queue, const void *item, BaseType_t *woken);
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks);
+BaseType_t xQueueReset(QueueHandle_t queue);
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, const EventBits_t bits, \
+  const BaseType_t clear, const BaseType_t all, TickType_t ticks);
+
+typedef void (*esp_timer_cb_t)(void *arg);
+typedef enum { ESP_TIMER_TASK } esp_timer_dispatch_t;
+typedef struct {
+  esp_timer_cb_t callback;
+  void *arg;
+  esp_timer_dispatch_t dispatch_method;
+  const char *name;
+} esp_timer_create_args_t;
+int64_t esp_timer_get_time(void);
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *handle);
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us);
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period);
+esp_err_t esp_timer_stop(esp_timer_handle_t timer);
+esp_err_t esp_event_post(esp_event_base_t base, int32_t id, void *data, size_t size, TickType_t ticks);
+
+#endif
@@ -0,0 +1,160 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ * Copyright 2017 Benjamin Aigner <aignerb@technikum-wien.at,
+ * beni@asterics-foundation.org>
+ */
+/** @file
+ * @brief Host tool - replacements for firmware & FreeRTOS functions
+ *
+ * The command parser calls functions of other firmware modules, which
+ * are not available on the host. They are replaced here.
+ * Any function with an effect beyond the config & VB commands reports
+ * this via slotcompilerSideEffect.
+ */
+
+#include "slotcompiler.h"
+
+/*++++ global handles, normally created in main.c ++++*/
+EventGroupHandle_t connectionRoutingStatus = (void*)1;
+EventGroupHandle_t systemStatus = (void*)2;
+QueueHandle_t hid_usb = (void*)3;
+QueueHandle_t hid_ble = (void*)4;
+QueueHandle_t config_switcher = (void*)5;
+QueueHandle_t debouncer_in = (void*)6;
+
+/*++++ FreeRTOS ++++*/
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks)
+{
+  if(queue == config_switcher) slotcompilerSideEffect("requests a slot change");
+  else if(queue == hid_usb || queue == hid_ble) slotcompilerSideEffect("sends a HID command immediately");
+  else slotcompilerSideEffect("sends to a queue");
+  return pdTRUE;
+}
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) { return 0; }
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group)
+{
+  //report only one route, each HID command should be reported once.
+  if(group == connectionRoutingStatus) return DATATO_USB;
+  return 0;
+}
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, const EventBits_t bits) { return bits; }
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, const EventBits_t bits) { return 0; }
+void vTaskDelay(const TickType_t ticks) {}
+BaseType_t xTaskCreate(void (*task)(void*), const char * const name, \
+  const uint32_t stack, void * const param, UBaseType_t prio, TaskHandle_t * const handle)
+{
+  return pdFALSE;
+}
+
+/*++++ config_switcher ++++*/
+generalConfig_t *configGetCurrent(void) { return NULL; }
+esp_err_t configRequestUpdate(void) { return ESP_OK; }
+uint32_t configGetUpdatesAvoided(void) { return 0; }
+void configGetSwitchStats(config_switch_stats_t *stats)
+{
+  slotcompilerSideEffect("reports the slot switch timing");
+  memset(stats,0,sizeof(config_switch_stats_t));
+}
+
+/*++++ hal_serial & hal_ble ++++*/
+int halSerialSendUSBSerial(char *data, uint32_t length, TickType_t ticks_to_wait) { return length; }
+int halSerialReceiveUSBSerial(uint8_t **data) { return -1; }
+void halSerialReset(uint8_t exceptDevice) { slotcompilerSideEffect("resets the HID reports"); }
+void halBLEReset(uint8_t exceptDevice) {}
+
+/*++++ hal_adc, task_rawstream ++++*/
+void halAdcCalibrate(void) { slotcompilerSideEffect("triggers a calibration"); }
+esp_err_t taskRawStreamConfigure(rawstream_format_t format, uint8_t decimation)
+{
+  slotcompilerSideEffect("configures the raw value stream");
+  return ESP_OK;
+}
+
+/*++++ task_debouncer ++++*/
+esp_err_t taskDebouncerGetStats(uint32_t vb, debouncer_stats_t *stats)
+{
+  slotcompilerSideEffect("reports the debounce statistics");
+  return ESP_FAIL;
+}
+void taskDebouncerResetStats(void) { slotcompilerSideEffect("resets the debounce statistics"); }
+
+/*++++ slot_arena ++++*/
+void slotArenaGetStats(slot_arena_stats_t *stats)
+{
+  slotcompilerSideEffect("reports the memory statistics");
+  memset(stats,0,sizeof(slot_arena_stats_t));
+}
+
+/*++++ hal_io ++++*/
+void halIOGetEdgeStats(uint32_t *merged, uint32_t *dropped) { *merged = 0; *dropped = 0; }
+void halIOResetEdgeStats(void) {}
+
+/*++++ fct_macros & fct_infrared ++++*/
+esp_err_t fct_macro(char *param, uint16_t vb)
+{
+  slotcompilerSideEffect("executes a macro immediately");
+  return ESP_OK;
+}
+void fct_infrared_send(char* cmdName) { slotcompilerSideEffect("sends an IR command immediately"); }
+void fct_infrared_get_stats(ir_cache_stats_t *stats) { memset(stats,0,sizeof(ir_cache_stats_t)); }
+esp_err_t fct_infrared_record(char* cmdName, uint8_t outputtoserial)
+{
+  slotcompilerSideEffect("records an IR command");
+  return ESP_OK;
+}
+
+/*++++ hal_storage ++++*/
+esp_err_t halStorageStartTransaction(uint32_t *tid, TickType_t tickstowait, const char* caller)
+{
+  slotcompilerSideEffect("accesses the storage");
+  return ESP_FAIL;
+}
+esp_err_t halStorageFinishTransaction(uint32_t tid) { return ESP_OK; }
+esp_err_t halStorageNVSStoreString(const char *key, char *string)
+{
+  slotcompilerSideEffect("stores a setting to the NVS");
+  return ESP_OK;
+}
+esp_err_t halStorageGetFree(uint32_t *total, uint32_t *free) { return ESP_FAIL; }
+esp_err_t halStorageGetNumberOfSlots(uint32_t tid, uint8_t *slotsavailable) { return ESP_FAIL; }
+esp_err_t halStorageGetNumberForName(uint32_t tid, uint8_t *slotnumber, char *slotname) { return ESP_FAIL; }
+esp_err_t halStorageGetNumberForNameIR(uint32_t tid, uint8_t *slotnumber, char *cmdName) { return ESP_FAIL; }
+esp_err_t halStorageGetNameForNumberIR(uint32_t tid, uint8_t slotnumber, char *cmdName) { return ESP_FAIL; }
+esp_err_t halStorageGetNumberOfIRCmds(uint32_t tid, uint8_t *slotsavailable) { return ESP_FAIL; }
+esp_err_t halStorageLoadNumber(uint8_t slotnumber, uint32_t tid, uint8_t outputSerial) { return ESP_FAIL; }
+esp_err_t halStorageStore(uint32_t tid, char *cfgstring, uint8_t slotnumber) { return ESP_FAIL; }
+esp_err_t halStorageCreateImage(uint32_t tid, uint8_t slotnumber, uint8_t **image, uint32_t *size) { return ESP_FAIL; }
+esp_err_t halStorageStoreImage(uint32_t tid, uint8_t slotnumber, uint8_t *image, uint32_t size) { return ESP_FAIL; }
+esp_err_t halStorageSetCacheBudget(uint32_t tid, uint32_t budget) { return ESP_FAIL; }
+void halStorageGetCacheStats(slot_cache_stats_t *stats) { memset(stats,0,sizeof(slot_cache_stats_t)); }
+esp_err_t halStorageDeleteSlot(int16_t slotnr, uint32_t tid) { return ESP_FAIL; }
+esp_err_t halStorageDeleteIRCmd(uint8_t slotnr, uint32_t tid) { return ESP_FAIL; }
+void halStorageCreateDefault(uint32_t tid) {}
+
+/** @brief Strips away \\r\\t and \\n (same as in hal_storage.c) */
+void strip(char *s)
+{
+  char *p2 = s;
+  while(*s != '\0') {
+    if(*s != '\r' && *s != '\t' && *s != '\n') {
+      *p2++ = *s++;
+    } else {
+      ++s;
+    }
+  }
+  *p2 = '\0';
+}
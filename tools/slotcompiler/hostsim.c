@@ -0,0 +1,288 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ * Copyright 2019 Benjamin Aigner <aignerb@technikum-wien.at,
+ * beni@asterics-foundation.org>
+ */
+/** @file
+ * @brief Host simulation - ESP-IDF/FreeRTOS replacements with virtual time
+ *
+ * All objects are allocated statically, the allocation counter
+ * (hostsimStats.allocs) counts calls of the simulated code only.
+ * @see hostsim.h
+ */
+
+#include "hostsim.h"
+
+/** @brief One simulated esp_timer */
+typedef struct hostsim_timer {
+  /** @brief Callback & argument, as given to esp_timer_create */
+  esp_timer_create_args_t args;
+  /** @brief Time of the next expiry, unit: [us] */
+  int64_t expiry;
+  /** @brief Period, 0 for a one-shot timer, unit: [us] */
+  uint64_t period;
+  /** @brief Timer is running */
+  uint8_t armed;
+} hostsim_timer_t;
+
+/** @brief One simulated queue (ring buffer) */
+typedef struct hostsim_queue {
+  /** @brief Storage for length items */
+  uint8_t *buffer;
+  /** @brief Maximum count of items */
+  uint32_t length;
+  /** @brief Size of one item */
+  uint32_t itemsize;
+  /** @brief Index of the oldest item */
+  uint32_t head;
+  /** @brief Counters, waiting is the count of items */
+  hostsim_queue_stats_t stats;
+} hostsim_queue_t;
+
+/** @brief Size of the storage, shared by all queues */
+#define HOSTSIM_QUEUE_STORAGE 4096
+
+hostsim_event_t hostsimEvents[HOSTSIM_EVENTS];
+hostsim_stats_t hostsimStats;
+
+/** @brief Current virtual time, unit: [us] */
+static int64_t now = 0;
+/** @brief All created timers */
+static hostsim_timer_t timers[HOSTSIM_TIMERS];
+/** @brief Count of created timers */
+static uint32_t timerCount = 0;
+/** @brief All created queues */
+static hostsim_queue_t queues[HOSTSIM_QUEUES];
+/** @brief Count of created queues */
+static uint32_t queueCount = 0;
+/** @brief Storage of all queues */
+static uint8_t queueStorage[HOSTSIM_QUEUE_STORAGE];
+/** @brief Used size of queueStorage */
+static uint32_t queueStorageUsed = 0;
+/** @brief All created event groups */
+static EventBits_t groups[HOSTSIM_EVENTGROUPS];
+/** @brief Count of created event groups */
+static uint32_t groupCount = 0;
+
+void hostsimReset(void)
+{
+  now = 0;
+  for(uint32_t i = 0; i<timerCount; i++) timers[i].armed = 0;
+  for(uint32_t i = 0; i<queueCount; i++)
+  {
+    queues[i].head = 0;
+    memset(&queues[i].stats,0,sizeof(hostsim_queue_stats_t));
+  }
+  memset(&hostsimStats,0,sizeof(hostsimStats));
+}
+
+void hostsimRun(int64_t until)
+{
+  while(1)
+  {
+    //earliest timer, on equal expiry the one created first
+    hostsim_timer_t *next = NULL;
+    for(uint32_t i = 0; i<timerCount; i++)
+    {
+      if(timers[i].armed == 0 || timers[i].expiry > until) continue;
+      if(next == NULL || timers[i].expiry < next->expiry) next = &timers[i];
+    }
+    if(next == NULL) break;
+
+    now = next->expiry;
+    if(next->period != 0) next->expiry += next->period;
+    else next->armed = 0;
+    hostsimStats.timerCallbacks++;
+    next->args.callback(next->args.arg);
+  }
+  if(until > now) now = until;
+}
+
+QueueHandle_t hostsimQueueCreate(uint32_t length, uint32_t itemsize)
+{
+  if(queueCount >= HOSTSIM_QUEUES) return NULL;
+  if(queueStorageUsed + length*itemsize > HOSTSIM_QUEUE_STORAGE) return NULL;
+  hostsim_queue_t *q = &queues[queueCount++];
+  memset(q,0,sizeof(hostsim_queue_t));
+  q->buffer = &queueStorage[queueStorageUsed];
+  q->length = length;
+  q->itemsize = itemsize;
+  queueStorageUsed += length*itemsize;
+  return (QueueHandle_t)q;
+}
+
+void hostsimQueueGetStats(QueueHandle_t queue, hostsim_queue_stats_t *stats)
+{
+  memcpy(stats,&((hostsim_queue_t *)queue)->stats,sizeof(hostsim_queue_stats_t));
+}
+
+EventGroupHandle_t hostsimEventGroupCreate(EventBits_t bits)
+{
+  if(groupCount >= HOSTSIM_EVENTGROUPS) return NULL;
+  groups[groupCount] = bits;
+  return (EventGroupHandle_t)&groups[groupCount++];
+}
+
+/*++++ FreeRTOS ++++*/
+BaseType_t xQueueSendToBack(QueueHandle_t queue, const void *item, TickType_t ticks)
+{
+  hostsim_queue_t *q = (hostsim_queue_t *)queue;
+  if(q == NULL) return pdFALSE;
+  if(q->stats.waiting >= q->length)
+  {
+    q->stats.failed++;
+    return pdFALSE;
+  }
+  uint32_t index = (q->head + q->stats.waiting) % q->length;
+  memcpy(&q->buffer[index*q->itemsize],item,q->itemsize);
+  q->stats.waiting++;
+  q->stats.sent++;
+  if(q->stats.waiting > q->stats.max) q->stats.max = q->stats.waiting;
+  return pdTRUE;
+}
+BaseType_t xQueueSendToBackFromISR(QueueHandle_t queue, const void *item, BaseType_t *woken)
+{
+  return xQueueSendToBack(queue,item,0);
+}
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks)
+{
+  return xQueueSendToBack(queue,item,ticks);
+}
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks)
+{
+  hostsim_queue_t *q = (hostsim_queue_t *)queue;
+  if(q == NULL || q->stats.waiting == 0) return pdFALSE;
+  memcpy(item,&q->buffer[q->head*q->itemsize],q->itemsize);
+  q->head = (q->head + 1) % q->length;
+  q->stats.waiting--;
+  return pdTRUE;
+}
+BaseType_t xQueueReset(QueueHandle_t queue)
+{
+  hostsim_queue_t *q = (hostsim_queue_t *)queue;
+  if(q == NULL) return pdFALSE;
+  q->head = 0;
+  q->stats.waiting = 0;
+  return pdPASS;
+}
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+  hostsim_queue_t *q = (hostsim_queue_t *)queue;
+  return (q == NULL) ? 0 : q->stats.waiting;
+}
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group)
+{
+  return (group == NULL) ? 0 : *(EventBits_t *)group;
+}
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, const EventBits_t bits)
+{
+  if(group == NULL) return 0;
+  *(EventBits_t *)group |= bits;
+  return *(EventBits_t *)group;
+}
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, const EventBits_t bits)
+{
+  if(group == NULL) return 0;
+  EventBits_t ret = *(EventBits_t *)group;
+  *(EventBits_t *)group &= ~bits;
+  return ret;
+}
+//no other task can set the bits, return immediately
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, const EventBits_t bits, \
+  const BaseType_t clear, const BaseType_t all, TickType_t ticks)
+{
+  EventBits_t ret = xEventGroupGetBits(group);
+  if(clear && (ret & bits)) xEventGroupClearBits(group,bits);
+  return ret;
+}
+void vTaskDelay(const TickType_t ticks) { hostsimRun(now + (int64_t)ticks * portTICK_PERIOD_MS * 1000); }
+BaseType_t xTaskCreate(void (*task)(void*), const char * const name, \
+  const uint32_t stack, void * const param, UBaseType_t prio, TaskHandle_t * const handle)
+{
+  return pdFALSE;
+}
+
+/*++++ esp_timer ++++*/
+int64_t esp_timer_get_time(void) { return now; }
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *handle)
+{
+  if(timerCount >= HOSTSIM_TIMERS) return ESP_ERR_NO_MEM;
+  memset(&timers[timerCount],0,sizeof(hostsim_timer_t));
+  memcpy(&timers[timerCount].args,args,sizeof(esp_timer_create_args_t));
+  *handle = (esp_timer_handle_t)&timers[timerCount++];
+  hostsimStats.timerCreates++;
+  return ESP_OK;
+}
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us)
+{
+  hostsim_timer_t *t = (hostsim_timer_t *)timer;
+  if(t->armed)
+  {
+    hostsimStats.timerRestarts++;
+    return ESP_ERR_INVALID_STATE;
+  }
+  t->expiry = now + timeout_us;
+  t->period = 0;
+  t->armed = 1;
+  hostsimStats.timerStarts++;
+  return ESP_OK;
+}
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period)
+{
+  hostsim_timer_t *t = (hostsim_timer_t *)timer;
+  if(t->armed)
+  {
+    hostsimStats.timerRestarts++;
+    return ESP_ERR_INVALID_STATE;
+  }
+  t->expiry = now + period;
+  t->period = period;
+  t->armed = 1;
+  hostsimStats.timerStarts++;
+  return ESP_OK;
+}
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+  hostsim_timer_t *t = (hostsim_timer_t *)timer;
+  if(t->armed == 0) return ESP_ERR_INVALID_STATE;
+  t->armed = 0;
+  hostsimStats.timerStops++;
+  return ESP_OK;
+}
+
+/*++++ esp_event ++++*/
+esp_err_t esp_event_post(esp_event_base_t base, int32_t id, void *data, size_t size, TickType_t ticks)
+{
+  if(hostsimStats.events < HOSTSIM_EVENTS)
+  {
+    hostsim_event_t *evt = &hostsimEvents[hostsimStats.events];
+    evt->time = now;
+    evt->id = id;
+    evt->data = 0;
+    if(data != NULL) memcpy(&evt->data,data,(size < sizeof(uint32_t)) ? size : sizeof(uint32_t));
+  }
+  hostsimStats.events++;
+  return ESP_OK;
+}
+
+/*++++ allocation counter (linked with -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc) ++++*/
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void *__wrap_malloc(size_t size) { hostsimStats.allocs++; return __real_malloc(size); }
+void *__wrap_calloc(size_t n, size_t size) { hostsimStats.allocs++; return __real_calloc(n,size); }
+void *__wrap_realloc(void *ptr, size_t size) { hostsimStats.allocs++; return __real_realloc(ptr,size); }
@@ -0,0 +1,135 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ * Copyright 2019 Benjamin Aigner <aignerb@technikum-wien.at,
+ * beni@asterics-foundation.org>
+ */
+/** @file
+ * @brief Host simulation - virtual time for firmware modules
+ *
+ * Firmware modules with timers & queues (e.g. task_debouncer.c) are
+ * compiled for the host with the headers in ./host. The ESP-IDF/FreeRTOS
+ * functions used by these modules are simulated in hostsim.c:
+ *
+ * * Time is virtual (unit: [us]) and advanced by hostsimRun only.
+ * * esp_timer callbacks are called synchronously by hostsimRun, in order
+ *   of their expiry. As on the ESP32, a running timer cannot be started again.
+ * * Queues are ring buffers without blocking, the maximum occupancy is recorded.
+ * * Events posted to the event loop are recorded (hostsimEvents).
+ * * Each malloc/calloc/realloc of the simulated code is counted (the
+ *   simulations are linked with -Wl,--wrap=malloc,...).
+ *
+ * Tasks are not simulated, a simulation calls the task's functions directly.
+ *
+ * @note Do not include this file in the firmware.
+ */
+
+#ifndef _HOSTSIM_H
+#define _HOSTSIM_H
+
+#include "esp_host.h"
+
+/** @brief Maximum count of esp_timers */
+#define HOSTSIM_TIMERS 64
+/** @brief Maximum count of queues */
+#define HOSTSIM_QUEUES 4
+/** @brief Maximum count of event groups */
+#define HOSTSIM_EVENTGROUPS 4
+/** @brief Maximum count of recorded events, further events are counted only */
+#define HOSTSIM_EVENTS 16384
+
+/** @brief One event, posted to the event loop */
+typedef struct hostsim_event {
+  /** @brief Time of posting, unit: [us] */
+  int64_t time;
+  /** @brief Event id (e.g. VB_PRESS_EVENT) */
+  int32_t id;
+  /** @brief First 32bit of the event data (e.g. VB number) */
+  uint32_t data;
+} hostsim_event_t;
+
+/** @brief Counters of the simulated runtime */
+typedef struct hostsim_stats {
+  /** @brief Count of created esp_timers */
+  uint32_t timerCreates;
+  /** @brief Count of successfully started esp_timers */
+  uint32_t timerStarts;
+  /** @brief Count of starts of an already running esp_timer (ESP_ERR_INVALID_STATE) */
+  uint32_t timerRestarts;
+  /** @brief Count of stopped esp_timers */
+  uint32_t timerStops;
+  /** @brief Count of esp_timer callbacks */
+  uint32_t timerCallbacks;
+  /** @brief Count of malloc/calloc/realloc calls */
+  uint32_t allocs;
+  /** @brief Count of posted events */
+  uint32_t events;
+} hostsim_stats_t;
+
+/** @brief Counters of one simulated queue */
+typedef struct hostsim_queue_stats {
+  /** @brief Currently waiting items */
+  uint32_t waiting;
+  /** @brief Maximum count of waiting items */
+  uint32_t max;
+  /** @brief Count of sent items */
+  uint32_t sent;
+  /** @brief Count of items, which could not be sent (queue full) */
+  uint32_t failed;
+} hostsim_queue_stats_t;
+
+/** @brief Recorded events, the first hostsimStats.events (max. HOSTSIM_EVENTS) are valid */
+extern hostsim_event_t hostsimEvents[HOSTSIM_EVENTS];
+
+/** @brief Counters of the simulated runtime, reset by hostsimReset */
+extern hostsim_stats_t hostsimStats;
+
+/** @brief Reset the simulation
+ *
+ * Time is set to 0, all timers are stopped (not deleted), all queues
+ * are cleared. Recorded events & counters are cleared.
+ */
+void hostsimReset(void);
+
+/** @brief Advance the virtual time
+ *
+ * All timers expiring until this time are processed in order, the
+ * callbacks are called with esp_timer_get_time() set to the expiry.
+ * Periodic timers are started again.
+ * @param until Absolute time to advance to, unit: [us]
+ */
+void hostsimRun(int64_t until);
+
+/** @brief Create a queue (replacement for xQueueCreate)
+ * @param length Maximum count of items
+ * @param itemsize Size of one item
+ * @return Queue handle, NULL if no more queues are available
+ */
+QueueHandle_t hostsimQueueCreate(uint32_t length, uint32_t itemsize);
+
+/** @brief Get the counters of a queue
+ * @param queue Queue handle
+ * @param stats Counters are copied to this struct
+ */
+void hostsimQueueGetStats(QueueHandle_t queue, hostsim_queue_stats_t *stats);
+
+/** @brief Create an event group (replacement for xEventGroupCreate)
+ * @param bits Initial bits
+ * @return Event group handle, NULL if no more groups are available
+ */
+EventGroupHandle_t hostsimEventGroupCreate(EventBits_t bits);
+
+#endif /*_HOSTSIM_H*/
@@ -0,0 +1,408 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ * Copyright 2019 Benjamin Aigner <aignerb@technikum-wien.at,
+ * beni@asterics-foundation.org>
+ */
+/** @file
+ * @brief Host simulation - edge merging of the GPIO ISR (hal_io_edge.c)
+ *
+ * Bounce bursts on the button inputs are fed to the merge & settle
+ * functions of hal_io_edge.c, the GPIO ISR and the settle timer of
+ * hal_io.c are rebuilt here with the simulated timers. The debouncer
+ * task (sim_debouncer.c) is busy & empties debouncer_in only every
+ * IO_TASK_PERIOD_US.
+ *
+ * The FreeRTOS timers (settle & long press timer) are controlled via
+ * the timer command queue (CONFIG_TIMER_QUEUE_LENGTH), which is emptied
+ * by the timer service task. This task has a low priority and runs only
+ * every IO_TIMER_TASK_PERIOD_US. A command is lost if the queue is full.
+ *
+ * Each trace is run three times:
+ * * per edge: each edge is sent as raw_action_t to debouncer_in (without merging)
+ * * reset per edge: hal_io_edge.c, the settle timer is reset on each edge
+ * * merged: hal_io_edge.c & taskDebouncerPublish, the settle timer is
+ *   started on the first edge of a burst, as in hal_io.c
+ *
+ * Reported are the edges sent, merged & dropped (queue full), the
+ * maximum occupancy of debouncer_in, the sent & lost timer commands
+ * with the maximum occupancy of the timer command queue and VBs with a
+ * wrong debounced state at the end of a burst. The merged run fails on
+ * a dropped edge, an occupancy above 1, a lost timer command or a wrong
+ * state. In addition, single bursts are checked for the exact count of
+ * sent & merged edges.
+ *
+ * Usage: io_merge <br>
+ * Exit code is 0 if all checks passed, 1 otherwise.
+ * @see hal_io_edge.h
+ */
+
+#include "sim_debouncer.h"
+#include "hal_io_edge.h"
+
+/** @brief Count of simulated button inputs (VB 0...IO_BUTTONS-1) */
+#define IO_BUTTONS 5
+/** @brief Wakeup period of the (busy) debouncer task, unit: [us] */
+#define IO_TASK_PERIOD_US 20000
+/** @brief Length of one trace, unit: [us] */
+#define IO_DURATION_US 10000000
+/** @brief Maximum count of bounces (edge pairs) per burst */
+#define IO_BOUNCES 15
+/** @brief Maximum duration of the bounces of one burst, unit: [us] */
+#define IO_BOUNCE_US 5000
+/** @brief Minimum time between two bursts of one input, unit: [us] */
+#define IO_HOLD_MIN_US 150000
+/** @brief Maximum time between two bursts of one input, unit: [us] */
+#define IO_HOLD_MAX_US 400000
+/** @brief Length of the timer command queue (CONFIG_TIMER_QUEUE_LENGTH) */
+#define IO_TIMER_QUEUE 16
+/** @brief Wakeup period of the timer service task, unit: [us]
+ * @note CONFIG_TIMER_TASK_PRIORITY is 1, the task runs if all others are idle. */
+#define IO_TIMER_TASK_PERIOD_US 20000
+/** @brief VB of the long press input (HAL_IO_PIN_LONGACTION) */
+#define IO_LONGACTION_VB 0
+/** @brief Long press time, unit: [us] (HAL_IO_LONGACTION_TIMEOUT) */
+#define IO_LONGACTION_US 1000000
+
+/** @brief Mode of a run: each edge is sent (no merging, no settle timer) */
+#define IO_PER_EDGE 0
+/** @brief Mode of a run: edges are merged, the settle timer is reset on each edge */
+#define IO_RESET_PER_EDGE 1
+/** @brief Mode of a run: edges are merged, the settle timer is started on the first edge (hal_io.c) */
+#define IO_MERGED 2
+
+/** @brief One command of the timer command queue */
+typedef struct io_timer_cmd {
+  /** @brief Timer (settle or long press timer) */
+  esp_timer_handle_t timer;
+  /** @brief Period for xTimerReset/xTimerStart, 0 for xTimerStop, unit: [us] */
+  uint64_t period;
+} io_timer_cmd_t;
+
+/** @brief Counters of one run */
+typedef struct io_result {
+  uint32_t bursts;
+  uint32_t edges;
+  uint32_t sent;
+  uint32_t merged;
+  uint32_t dropped;
+  uint32_t wrong;
+  uint32_t timerCmds;
+  uint32_t timerLost;
+} io_result_t;
+
+/** @brief Edge records, as in hal_io.c */
+static hal_io_edge_t edgeRecords[VB_MAX];
+/** @brief Current level of each input (0 is pressed) */
+static uint8_t pinLevel[VB_MAX];
+/** @brief Settle timer (FreeRTOS timer in hal_io.c) */
+static esp_timer_handle_t edgetimer = NULL;
+/** @brief Long press timer (FreeRTOS timer in hal_io.c) */
+static esp_timer_handle_t longactiontimer = NULL;
+/** @brief Periodic wakeup of the debouncer task */
+static esp_timer_handle_t tasktimer = NULL;
+/** @brief Periodic wakeup of the timer service task */
+static esp_timer_handle_t timertask = NULL;
+/** @brief Timer command queue of the timer service task */
+static QueueHandle_t timerQueue = NULL;
+/** @brief Mode of the current run (IO_PER_EDGE, IO_RESET_PER_EDGE or IO_MERGED) */
+static uint8_t mode = IO_MERGED;
+/** @brief Counters of the current run */
+static io_result_t result;
+/** @brief State of the random generator */
+static uint32_t seed = 1;
+
+/** @brief Simple LCG, same sequence on each host */
+static uint32_t rnd(uint32_t max)
+{
+  seed = seed * 1103515245 + 12345;
+  return (seed >> 8) % max;
+}
+
+/** @brief Send one timer command (xTimerReset/xTimerStart/xTimerStop)
+ * @param timer Timer to control
+ * @param period Period to start the timer with, 0 to stop it
+ * @return 1 if the command was queued, 0 if it was lost (queue full) */
+static uint8_t timerCommand(esp_timer_handle_t timer, uint64_t period)
+{
+  io_timer_cmd_t cmd;
+  cmd.timer = timer;
+  cmd.period = period;
+  result.timerCmds++;
+  if(xQueueSendToBackFromISR(timerQueue,&cmd,NULL) == pdTRUE) return 1;
+  result.timerLost++;
+  return 0;
+}
+
+/** @brief Wakeup of the timer service task, processes all queued commands */
+static void timerTaskCallback(void *arg)
+{
+  io_timer_cmd_t cmd;
+  while(xQueueReceive(timerQueue,&cmd,0) == pdTRUE)
+  {
+    esp_timer_stop(cmd.timer);
+    if(cmd.period != 0) esp_timer_start_once(cmd.timer,cmd.period);
+  }
+}
+
+/** @brief Long press timer callback (unused, the commands are counted only) */
+static void longactionTimerCallback(void *arg) { }
+
+/** @brief Send one level to the debouncer (halIOEdgeSend of hal_io.c) */
+static void edgeSend(uint8_t vb, uint8_t level)
+{
+  result.sent++;
+  if(taskDebouncerPublish(1UL<<vb,(level == 0) ? (1UL<<vb) : 0,NULL) != ESP_OK) result.dropped++;
+  //extra handling for long press
+  if(vb == IO_LONGACTION_VB) timerCommand(longactiontimer,(level == 0) ? IO_LONGACTION_US : 0);
+}
+
+/** @brief Settle timer callback (halIOEdgeTimerCallback of hal_io.c) */
+static void edgeTimerCallback(void *arg)
+{
+  uint32_t now = (uint32_t)esp_timer_get_time();
+  uint8_t restart = 0;
+
+  for(uint8_t vb = 0; vb<VB_MAX; vb++)
+  {
+    hal_io_edge_t *rec = &edgeRecords[vb];
+    uint8_t send = 0;
+    uint8_t level = 0;
+    switch(halIOEdgeSettle(rec,now))
+    {
+      case HAL_IO_EDGE_WAIT: restart = 1; break;
+      case HAL_IO_EDGE_STABLE:
+        level = pinLevel[vb];
+        send = halIOEdgeReport(rec,level);
+        break;
+      default: break;
+    }
+    if(send) edgeSend(vb,level);
+  }
+  //xTimerReset, called in the timer service task
+  if(restart) timerCommand(edgetimer,HAL_IO_EDGE_SETTLE_MS * 1000);
+}
+
+/** @brief Wakeup of the debouncer task */
+static void taskTimerCallback(void *arg) { simDebouncerTask(); }
+
+/** @brief One edge on an input (gpio_isr_handler of hal_io.c) */
+static void edgeISR(uint8_t vb, uint8_t level)
+{
+  pinLevel[vb] = level;
+  result.edges++;
+
+  if(mode == IO_PER_EDGE)
+  {
+    //without merging: each edge is one raw action
+    raw_action_t evt;
+    evt.vb = vb;
+    evt.type = (level == 0) ? VB_PRESS_EVENT : VB_RELEASE_EVENT;
+    evt.payload = NULL;
+    result.sent++;
+    if(xQueueSendToBackFromISR(debouncer_in,&evt,NULL) != pdTRUE) result.dropped++;
+    return;
+  }
+
+  uint8_t start = 0;
+  uint8_t send = halIOEdgeMerge(&edgeRecords[vb],level,(uint32_t)esp_timer_get_time(),&start);
+  if(send == 0) result.merged++;
+  if(mode == IO_RESET_PER_EDGE)
+  {
+    //xTimerResetFromISR on each edge
+    timerCommand(edgetimer,HAL_IO_EDGE_SETTLE_MS * 1000);
+  } else if(start && timerCommand(edgetimer,HAL_IO_EDGE_SETTLE_MS * 1000) == 0) {
+    //xTimerStartFromISR failed, as in hal_io.c
+    edgeRecords[vb].pending = 0;
+  }
+  if(send) edgeSend(vb,level);
+}
+
+/** @brief Reset the simulation & all inputs (released)
+ * @param m Mode of this run (IO_PER_EDGE, IO_RESET_PER_EDGE or IO_MERGED) */
+static void ioReset(uint8_t m)
+{
+  generalConfig_t cfg;
+  memset(&cfg,0,sizeof(cfg));
+  hostsimReset();
+  simDebouncerConfig(&cfg);
+  memset(&result,0,sizeof(result));
+  memset(edgeRecords,0,sizeof(edgeRecords));
+  for(uint32_t i = 0; i<VB_MAX; i++)
+  {
+    edgeRecords[i].reported = 1;
+    pinLevel[i] = 1;
+  }
+  mode = m;
+  esp_timer_start_periodic(tasktimer,IO_TASK_PERIOD_US);
+  esp_timer_start_periodic(timertask,IO_TIMER_TASK_PERIOD_US);
+}
+
+/** @brief Stop the periodic tasks at the end of a run */
+static void ioStop(void)
+{
+  esp_timer_stop(tasktimer);
+  esp_timer_stop(timertask);
+}
+
+/** @brief Debounced state of a VB (last posted event), 0 if released */
+static uint8_t debouncedState(uint32_t vb)
+{
+  uint8_t pressed = 0;
+  for(uint32_t i = 0; i<hostsimStats.events && i<HOSTSIM_EVENTS; i++)
+  {
+    if(hostsimEvents[i].data == vb) pressed = (hostsimEvents[i].id == VB_PRESS_EVENT);
+  }
+  return pressed;
+}
+
+/** @brief Run a random trace of bounce bursts on all inputs
+ * @param m Mode of this run (IO_PER_EDGE, IO_RESET_PER_EDGE or IO_MERGED)
+ * @param queue Occupancy of debouncer_in is returned here
+ * @param timers Occupancy of the timer command queue is returned here */
+static void runTrace(uint8_t m, hostsim_queue_stats_t *queue, hostsim_queue_stats_t *timers)
+{
+  int64_t next[IO_BUTTONS];
+
+  ioReset(m);
+  seed = 1;
+  for(uint32_t vb = 0; vb<IO_BUTTONS; vb++) next[vb] = rnd(IO_HOLD_MAX_US);
+
+  while(1)
+  {
+    //next burst of all inputs
+    uint32_t vb = 0;
+    for(uint32_t i = 1; i<IO_BUTTONS; i++) if(next[i] < next[vb]) vb = i;
+    if(next[vb] >= IO_DURATION_US) break;
+
+    //the previous burst of this input is debounced now
+    hostsimRun(next[vb]);
+    if(debouncedState(vb) != (pinLevel[vb] == 0)) result.wrong++;
+
+    //first edge, bounces back & forth, last edge is the new level again
+    uint8_t level = pinLevel[vb] ^ 1;
+    uint32_t bounces = rnd(IO_BOUNCES + 1);
+    int64_t t = next[vb];
+    for(uint32_t i = 0; i<2*bounces+1; i++)
+    {
+      hostsimRun(t);
+      edgeISR(vb,((i % 2) == 0) ? level : level ^ 1);
+      if(bounces != 0) t += 1 + rnd(IO_BOUNCE_US / (2*bounces));
+    }
+    result.bursts++;
+    next[vb] += IO_HOLD_MIN_US + rnd(IO_HOLD_MAX_US - IO_HOLD_MIN_US);
+  }
+  hostsimRun(IO_DURATION_US + IO_HOLD_MIN_US);
+  for(uint32_t i = 0; i<IO_BUTTONS; i++) if(debouncedState(i) != (pinLevel[i] == 0)) result.wrong++;
+  ioStop();
+  hostsimQueueGetStats(debouncer_in,queue);
+  hostsimQueueGetStats(timerQueue,timers);
+}
+
+/** @brief Check the sent & merged edges of one burst
+ * @param name Name for messages
+ * @param levels Levels of the burst (edge every 500us), terminated by 0xFF
+ * @param sent Expected count of sent levels
+ * @param merged Expected count of merged edges
+ * @return Count of errors */
+static uint32_t checkBurst(const char *name, const uint8_t *levels, uint32_t sent, uint32_t merged)
+{
+  int64_t t = 1000;
+  ioReset(IO_MERGED);
+  for(uint32_t i = 0; levels[i] != 0xFF; i++, t += 500)
+  {
+    hostsimRun(t);
+    edgeISR(0,levels[i]);
+  }
+  hostsimRun(t + 200000);
+  ioStop();
+  if(result.sent == sent && result.merged == merged && \
+    edgeRecords[0].reported == pinLevel[0] && edgeRecords[0].pending == 0) return 0;
+  fprintf(stderr,"io_merge: %s: error: %u sent, %u merged, expected %u/%u\n", \
+    name,result.sent,result.merged,sent,merged);
+  return 1;
+}
+
+int main(int argc, char **argv)
+{
+  static const uint8_t bounce[] = { 0, 1, 0, 1, 0, 0xFF };
+  static const uint8_t glitch[] = { 0, 1, 0xFF };
+  static const uint8_t back[] = { 0, 1, 0, 1, 0xFF };
+  esp_timer_create_args_t args;
+  hostsim_queue_stats_t queue;
+  hostsim_queue_stats_t timers;
+  uint32_t errors = 0;
+
+  if(simDebouncerInit() != ESP_OK)
+  {
+    fprintf(stderr,"io_merge: error: cannot create the debounce timers\n");
+    return 1;
+  }
+  memset(&args,0,sizeof(args));
+  args.callback = edgeTimerCallback;
+  args.name = "IO_edge";
+  esp_timer_create(&args,&edgetimer);
+  args.callback = longactionTimerCallback;
+  args.name = "IO_longaction";
+  esp_timer_create(&args,&longactiontimer);
+  args.callback = taskTimerCallback;
+  args.name = "task";
+  esp_timer_create(&args,&tasktimer);
+  args.callback = timerTaskCallback;
+  args.name = "timertask";
+  esp_timer_create(&args,&timertask);
+  timerQueue = hostsimQueueCreate(IO_TIMER_QUEUE,sizeof(io_timer_cmd_t));
+  if(timerQueue == NULL)
+  {
+    fprintf(stderr,"io_merge: error: cannot create the timer command queue\n");
+    return 1;
+  }
+
+  /*++++ single bursts ++++*/
+  //first edge is sent, the settled level is the same
+  errors += checkBurst("bounce",bounce,1,4);
+  //first edge is sent, the settled level is sent again
+  errors += checkBurst("glitch",glitch,2,1);
+  errors += checkBurst("back",back,2,3);
+
+  /*++++ random traces, without & with merging ++++*/
+  runTrace(IO_PER_EDGE,&queue,&timers);
+  printf("io_merge: per edge: %u buttons, %u bursts, %u edges, %u sent, %u dropped, " \
+    "queue max %u/32, %u wrong states\n",IO_BUTTONS,result.bursts,result.edges, \
+    result.sent,result.dropped,queue.max,result.wrong);
+
+  runTrace(IO_RESET_PER_EDGE,&queue,&timers);
+  printf("io_merge: reset per edge: %u sent, %u merged, %u dropped, queue max %u/32, " \
+    "%u timer commands, %u lost, timer queue max %u/%u, %u wrong states\n", \
+    result.sent,result.merged,result.dropped,queue.max,result.timerCmds, \
+    result.timerLost,timers.max,IO_TIMER_QUEUE,result.wrong);
+
+  runTrace(IO_MERGED,&queue,&timers);
+  uint32_t traceErrors = 0;
+  if(result.dropped != 0 || queue.max > 1 || result.timerLost != 0 || result.wrong != 0) traceErrors++;
+  printf("io_merge: merged: %u buttons, %u bursts, %u edges, %u sent, %u merged, %u dropped, " \
+    "queue max %u/32, %u timer commands, %u lost, timer queue max %u/%u, %u wrong states, " \
+    "%u errors\n",IO_BUTTONS,result.bursts,result.edges,result.sent,result.merged, \
+    result.dropped,queue.max,result.timerCmds,result.timerLost,timers.max,IO_TIMER_QUEUE, \
+    result.wrong,traceErrors + errors);
+  errors += traceErrors;
+  if(hostsimStats.allocs != 0)
+  {
+    fprintf(stderr,"io_merge: error: %u allocations\n",hostsimStats.allocs);
+    errors++;
+  }
+  return (errors != 0) ? 1 : 0;
+}
@@ -0,0 +1,82 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ * Copyright 2019 Benjamin Aigner <aignerb@technikum-wien.at,
+ * beni@asterics-foundation.org>
+ */
+/** @file
+ * @brief Host simulation - debouncer of the firmware & its environment
+ *
+ * The firmware source is included, its static functions are used
+ * directly.
+ * @see sim_debouncer.h
+ */
+
+#include "sim_debouncer.h"
+#include "task_debouncer.c"
+
+/*++++ global handles, normally created in main.c ++++*/
+ESP_EVENT_DEFINE_BASE(VB_EVENT);
+EventGroupHandle_t systemStatus = NULL;
+QueueHandle_t debouncer_in = NULL;
+
+/** @brief Config of the simulation (button learning is disabled) */
+static generalConfig_t simConfig;
+
+/*++++ config_switcher & hal_serial ++++*/
+generalConfig_t *configGetCurrent(void) { return &simConfig; }
+int halSerialSendUSBSerial(char *data, uint32_t length, TickType_t ticks_to_wait) { return length; }
+
+esp_err_t simDebouncerInit(void)
+{
+  systemStatus = hostsimEventGroupCreate(SYSTEM_STABLECONFIG);
+  debouncer_in = hostsimQueueCreate(32,sizeof(raw_action_t));
+  return createTimers();
+}
+
+void simDebouncerConfig(generalConfig_t *cfg)
+{
+  //nothing published yet
+  xQueueReset(debouncer_in);
+  snapIn = 0;
+  snapMask = 0;
+  snapPending = 0;
+  snapLast = 0;
+  debounceSuspended = 0;
+  memcpy(&simConfig,cfg,sizeof(generalConfig_t));
+  simConfig.button_learn = 0;
+  taskDebouncerUpdateConfig(&simConfig);
+  //switch via the timer engine, all timers & states are cleared
+  selectEngine(DEBOUNCE_ENGINE_TIMER);
+  selectEngine(getTimes()->engine);
+  taskDebouncerResetStats();
+}
+
+void simDebouncerEdge(uint32_t vb, vb_event_t type)
+{
+  raw_action_t evt;
+  evt.vb = vb;
+  evt.type = type;
+  evt.payload = NULL;
+  debounceEdge(evt,getTimes(),(uint32_t)esp_timer_get_time());
+}
+
+void simDebouncerTask(void)
+{
+  do {
+    debounceStep(0);
+  } while(uxQueueMessagesWaiting(debouncer_in) != 0);
+}
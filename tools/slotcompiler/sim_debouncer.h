@@ -0,0 +1,64 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ * Copyright 2019 Benjamin Aigner <aignerb@technikum-wien.at,
+ * beni@asterics-foundation.org>
+ */
+/** @file
+ * @brief Host simulation - access to the debouncer of the firmware
+ *
+ * sim_debouncer.c includes task_debouncer.c of the firmware and
+ * provides its internal functions to the simulations. The task itself
+ * is not started, each simulation feeds edges with the functions below
+ * and advances the time with hostsimRun.
+ * @see hostsim.h
+ */
+
+#ifndef _SIM_DEBOUNCER_H
+#define _SIM_DEBOUNCER_H
+
+#include "hostsim.h"
+#include "task_debouncer.h"
+
+/** @brief Set up the environment of the debouncer & create its timers
+ *
+ * Creates systemStatus (with SYSTEM_STABLECONFIG set) and debouncer_in
+ * (same size as in main.c). Call once.
+ * @return ESP_OK on success, ESP_FAIL if the timers cannot be created
+ */
+esp_err_t simDebouncerInit(void);
+
+/** @brief Apply a config & select its engine
+ *
+ * Running debounce timers are canceled, the published state & statistics are reset.
+ * @param cfg Config with the debounce settings
+ */
+void simDebouncerConfig(generalConfig_t *cfg);
+
+/** @brief Feed one raw edge to the debouncer, at the current time
+ * @param vb Virtual button
+ * @param type VB_PRESS_EVENT or VB_RELEASE_EVENT
+ */
+void simDebouncerEdge(uint32_t vb, vb_event_t type);
+
+/** @brief Run the debouncer task until debouncer_in is empty
+ *
+ * Each iteration of the task loop (debounceStep) is called without
+ * blocking, at the current time.
+ */
+void simDebouncerTask(void);
+
+#endif /*_SIM_DEBOUNCER_H*/
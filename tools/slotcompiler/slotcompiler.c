@@ -0,0 +1,496 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ * Copyright 2017 Benjamin Aigner <aignerb@technikum-wien.at,
+ * beni@asterics-foundation.org>
+ */
+/** @file
+ * @brief Host tool - slot file validator & compiler
+ *
+ * This tool reads slot files (xxx.set), feeds each line to the
+ * command parser of the firmware (task_commands.c, compiled for the host)
+ * and reports all lines which would be rejected by the device.
+ *
+ * If a slot file is valid, a binary slot image (xxx.sbi, see slot_image.h)
+ * is written. It contains the resulting general config and all HID/VB
+ * commands of this slot.
+ *
+ * The handler functions (handler_hid_addCmd, handler_vb_addCmd,...) are
+ * replaced here to collect the VB commands instead of activating them.
+ *
+ * Usage: slotcompiler [-n] [-q] [-o <dir>] <file.set> [<file.set> ...] <br>
+ * * -n: validate only, no images are written <br>
+ * * -q: print errors & warnings only <br>
+ * * -o: write images to this directory (default: next to the slot file) <br>
+ *
+ * Exit code is 0 if all files are valid, 1 otherwise.
+ *
+ * @note The config starts zeroed for each slot (as after a reboot of the device).
+ * @note Commands with side effects (e.g. "AT CA" without "AT BM", "AT DE")
+ * are reported as warnings, no image is written for such a slot.
+ * @note Files with more than one slot ("AT LA" output) are split, see compileFile.
+ * @see slot_image.h
+ */
+
+#include "slotcompiler.h"
+#include <unistd.h>
+#include <libgen.h>
+
+/** @brief Name of the currently compiled file (for messages) */
+static const char *currentFile = NULL;
+/** @brief Line number of the currently compiled file (for messages) */
+static uint32_t currentLine = 0;
+/** @brief Count of side effects in the current slot */
+static uint32_t sideEffects = 0;
+/** @brief Count of errors in the current slot */
+static uint32_t errors = 0;
+
+/** @brief Collected HID commands of the current slot */
+static hid_cmd_t *hidTable = NULL;
+/** @brief Count of collected HID commands */
+static uint32_t hidCount = 0;
+/** @brief Collected VB commands of the current slot */
+static vb_cmd_t *vbTable = NULL;
+/** @brief Count of collected VB commands */
+static uint32_t vbCount = 0;
+
+/** @brief String table of the current image */
+static char *strTable = NULL;
+/** @brief Used size of the string table */
+static uint32_t strSize = 0;
+
+void slotcompilerSideEffect(const char *what)
+{
+  static uint32_t lastLine = 0;
+  static const char *lastFile = NULL;
+  //report each line only once (e.g. press & release action)
+  if(lastLine == currentLine && lastFile == currentFile) return;
+  lastLine = currentLine;
+  lastFile = currentFile;
+  fprintf(stderr,"%s:%u: warning: %s, cannot be stored in an image\n", \
+    currentFile,currentLine,what);
+  sideEffects++;
+}
+
+uint32_t slotcompilerCRC32(uint32_t crc, const uint8_t *buf, uint32_t len)
+{
+  crc = ~crc;
+  for(uint32_t i = 0; i<len; i++)
+  {
+    crc ^= buf[i];
+    for(uint8_t j = 0; j<8; j++) crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+  }
+  return ~crc;
+}
+
+/*++++ replacements for handler_hid & handler_vb ++++*/
+
+esp_err_t handler_hid_delCmd(uint16_t vb)
+{
+  uint32_t count = 0;
+  for(uint32_t i = 0; i<hidCount; )
+  {
+    if(hidTable[i].vb == vb)
+    {
+      if(hidTable[i].atoriginal != NULL) free(hidTable[i].atoriginal);
+      memmove(&hidTable[i],&hidTable[i+1],(hidCount-i-1)*sizeof(hid_cmd_t));
+      hidCount--;
+      count++;
+    } else i++;
+  }
+  if(count != 0) return ESP_OK;
+  else return ESP_FAIL;
+}
+
+esp_err_t handler_hid_addCmd(hid_cmd_t *newCmd, uint8_t replace)
+{
+  if(newCmd == NULL) return ESP_FAIL;
+  if(newCmd->vb >= VB_MAX_BINDABLE)
+  {
+    fprintf(stderr,"%s:%u: error: VB %d out of range\n",currentFile, \
+      currentLine,newCmd->vb);
+    errors++;
+    return ESP_FAIL;
+  }
+  if(replace) handler_hid_delCmd(newCmd->vb);
+  hid_cmd_t *t = realloc(hidTable,(hidCount+1)*sizeof(hid_cmd_t));
+  if(t == NULL) return ESP_FAIL;
+  hidTable = t;
+  memcpy(&hidTable[hidCount],newCmd,sizeof(hid_cmd_t));
+  //strings are copied, as done by the firmware handler
+  if(newCmd->atoriginal != NULL) hidTable[hidCount].atoriginal = strdup(newCmd->atoriginal);
+  hidCount++;
+  return ESP_OK;
+}
+
+esp_err_t handler_vb_delCmd(uint16_t vb)
+{
+  uint32_t count = 0;
+  for(uint32_t i = 0; i<vbCount; )
+  {
+    if(vbTable[i].vb == vb)
+    {
+      if(vbTable[i].atoriginal != NULL) free(vbTable[i].atoriginal);
+      if(vbTable[i].cmdparam != NULL) free(vbTable[i].cmdparam);
+      memmove(&vbTable[i],&vbTable[i+1],(vbCount-i-1)*sizeof(vb_cmd_t));
+      vbCount--;
+      count++;
+    } else i++;
+  }
+  if(count != 0) return ESP_OK;
+  else return ESP_FAIL;
+}
+
+esp_err_t handler_vb_addCmd(vb_cmd_t *newCmd, uint8_t replace)
+{
+  if(newCmd == NULL) return ESP_FAIL;
+  if(newCmd->vb >= VB_MAX_BINDABLE)
+  {
+    fprintf(stderr,"%s:%u: error: VB %d out of range\n",currentFile, \
+      currentLine,newCmd->vb);
+    errors++;
+    return ESP_FAIL;
+  }
+  if(replace) handler_vb_delCmd(newCmd->vb);
+  vb_cmd_t *t = realloc(vbTable,(vbCount+1)*sizeof(vb_cmd_t));
+  if(t == NULL) return ESP_FAIL;
+  vbTable = t;
+  memcpy(&vbTable[vbCount],newCmd,sizeof(vb_cmd_t));
+  //strings are copied, as done by the firmware handler
+  if(newCmd->atoriginal != NULL) vbTable[vbCount].atoriginal = strdup(newCmd->atoriginal);
+  if(newCmd->cmdparam != NULL) vbTable[vbCount].cmdparam = strdup(newCmd->cmdparam);
+  //compiled macros are not stored in the image, the firmware compiles them on loading
+  vbTable[vbCount].macro = NULL;
+  vbCount++;
+  return ESP_OK;
+}
+
+esp_err_t handler_hid_getAT(char* output, uint16_t vb) { return ESP_FAIL; }
+esp_err_t handler_vb_getAT(char* output, uint16_t vb) { return ESP_FAIL; }
+esp_err_t handler_hid_publish(void) { return ESP_OK; }
+esp_err_t handler_vb_publish(void) { return ESP_OK; }
+
+/*++++ image creation ++++*/
+
+/** @brief Remove all collected commands & strings */
+static void clearTables(void)
+{
+  while(hidCount) handler_hid_delCmd(hidTable[0].vb);
+  while(vbCount) handler_vb_delCmd(vbTable[0].vb);
+  free(strTable);
+  strTable = NULL;
+  strSize = 0;
+}
+
+/** @brief Add a string to the string table (equal strings are stored once)
+ * @return Offset of this string, SLOT_IMAGE_NOSTRING if str is NULL or the
+ * string table is full */
+static uint16_t addString(const char *str)
+{
+  if(str == NULL) return SLOT_IMAGE_NOSTRING;
+  //search for an equal string
+  for(uint32_t i = 0; i<strSize; i += strlen(&strTable[i])+1)
+  {
+    if(strcmp(&strTable[i],str) == 0) return i;
+  }
+  uint32_t len = strlen(str)+1;
+  if(strSize + len >= SLOT_IMAGE_NOSTRING) return SLOT_IMAGE_NOSTRING;
+  char *t = realloc(strTable,strSize+len);
+  if(t == NULL) return SLOT_IMAGE_NOSTRING;
+  strTable = t;
+  memcpy(&strTable[strSize],str,len);
+  strSize += len;
+  return strSize - len;
+}
+
+/** @brief Write a slot image
+ * @param path Image file name
+ * @param header Prepared header (magic, crc, name)
+ * @param cfg General config of this slot
+ * @return Size of the image, 0 on an error */
+static uint32_t writeImage(const char *path, slot_image_header_t *header, generalConfig_t *cfg)
+{
+  slot_image_hid_t *hid = calloc(hidCount+1,sizeof(slot_image_hid_t));
+  slot_image_vb_t *vb = calloc(vbCount+1,sizeof(slot_image_vb_t));
+  uint32_t size = 0;
+
+  if(hid == NULL || vb == NULL)
+  {
+    free(hid); free(vb);
+    return 0;
+  }
+
+  //pack all commands, strings are referenced by offset
+  for(uint32_t i = 0; i<hidCount; i++)
+  {
+    hid[i].vb = hidTable[i].vb;
+    hid[i].event = hidTable[i].event;
+    memcpy(hid[i].cmd,hidTable[i].cmd,sizeof(hid[i].cmd));
+    hid[i].atoriginal = addString(hidTable[i].atoriginal);
+  }
+  for(uint32_t i = 0; i<vbCount; i++)
+  {
+    vb[i].vb = vbTable[i].vb;
+    vb[i].event = vbTable[i].event;
+    vb[i].cmd = vbTable[i].cmd;
+    vb[i].atoriginal = addString(vbTable[i].atoriginal);
+    vb[i].cmdparam = addString(vbTable[i].cmdparam);
+    if(vbTable[i].cmdparam != NULL && vb[i].cmdparam == SLOT_IMAGE_NOSTRING)
+    {
+      fprintf(stderr,"%s: error: string table overflow\n",currentFile);
+      free(hid); free(vb);
+      return 0;
+    }
+  }
+  header->hidcount = hidCount;
+  header->vbcount = vbCount;
+  header->stringsize = strSize;
+
+  FILE *f = fopen(path,"wb");
+  if(f == NULL)
+  {
+    fprintf(stderr,"%s: error: cannot write image %s\n",currentFile,path);
+    free(hid); free(vb);
+    return 0;
+  }
+  size += fwrite(header,1,sizeof(slot_image_header_t),f);
+  size += fwrite(cfg,1,sizeof(generalConfig_t),f);
+  size += fwrite(hid,1,hidCount*sizeof(slot_image_hid_t),f);
+  size += fwrite(vb,1,vbCount*sizeof(slot_image_vb_t),f);
+  size += fwrite(strTable,1,strSize,f);
+  if(fclose(f) != 0) size = 0;
+
+  free(hid); free(vb);
+  return size;
+}
+
+/** @brief Text for a parser result, as error message */
+static const char *retvalText(cmd_retval r)
+{
+  switch(r)
+  {
+    case NOCOMMAND: return "unknown command";
+    case PARAMERROR: return "invalid parameter(s)";
+    case FORMATERROR: return "invalid format";
+    case HANDLERERROR: return "command failed";
+    case POINTERERROR: return "internal parser error";
+    default: return "unknown error";
+  }
+}
+
+/** @brief Check if a line is a slot tag ("Slot XXX:<name>")
+ * @return Pointer to the name, NULL if this line is no slot tag */
+static char *slotTag(char *line)
+{
+  char *name = strpbrk(line,":");
+  if(strncmp(line,"Slot",strlen("Slot")) != 0 || name == NULL) return NULL;
+  return name+1;
+}
+
+/** @brief Finish one slot: write the image & print a summary
+ * @param header Header, prepared with slot name
+ * @param cfg Config of this slot
+ * @param imgpath Image file name, NULL if no image should be written
+ * @param commands Count of parsed commands
+ * @param crc CRC of the slot text
+ * @param quiet If != 0, no summary is printed */
+static void finishSlot(slot_image_header_t *header, generalConfig_t *cfg, \
+  const char *imgpath, uint32_t commands, uint32_t crc, uint8_t quiet)
+{
+  header->magic = SLOT_IMAGE_MAGIC;
+  header->version = SLOT_IMAGE_VERSION;
+  header->configsize = sizeof(generalConfig_t);
+  header->sourcecrc = crc;
+
+  if(errors == 0 && sideEffects == 0 && imgpath != NULL)
+  {
+    uint32_t size = writeImage(imgpath,header,cfg);
+    if(size == 0) errors++;
+    else if(!quiet) printf("%s: image %s, %u bytes\n",currentFile,imgpath,size);
+  }
+  if(!quiet)
+  {
+    printf("%s: slot \"%s\", %u commands, %u HID / %u VB actions, %u errors, %u warnings\n", \
+      currentFile,header->slotname,commands,hidCount,vbCount,errors,sideEffects);
+  }
+  clearTables();
+}
+
+/** @brief Validate & compile one slot file
+ *
+ * Usually, a slot file contains one slot. The image is named
+ * like the slot file (xxx.set -> xxx.sbi).
+ * Files with more than one slot (output of "AT LA", as used by the
+ * WebGUI) are split, the images are named by the slot number of each
+ * slot tag ("Slot 1:..." -> 000.sbi).
+ *
+ * @param path Slot file
+ * @param outdir Directory for the image, NULL for the directory of the slot file
+ * @param write If != 0, images are written
+ * @param quiet If != 0, no summary is printed
+ * @return 0 if the file is valid, 1 otherwise */
+static int compileFile(const char *path, const char *outdir, uint8_t write, uint8_t quiet)
+{
+  char line[ATCMD_LENGTH];
+  slot_image_header_t header;
+  generalConfig_t cfg;
+  cmd_context_t ctx;
+  uint32_t commands = 0;
+  uint32_t slots = 0;
+  uint32_t crc = 0;
+  int result = 0;
+  char *name;
+
+  currentFile = path;
+  currentLine = 0;
+
+  FILE *f = fopen(path,"rb");
+  if(f == NULL)
+  {
+    fprintf(stderr,"%s: error: cannot open file\n",path);
+    return 1;
+  }
+
+  //create image file names
+  char *tmp = strdup(path);
+  char *tmpdir = strdup(path);
+  char *base = basename(tmp);
+  const char *dir = (outdir != NULL) ? outdir : dirname(tmpdir);
+  char *ext = strrchr(base,'.');
+  if(ext != NULL) *ext = '\0';
+  char *imgpath = malloc(strlen(dir)+strlen(base)+sizeof(SLOT_IMAGE_EXTENSION)+8);
+
+  //the first line must be a slot tag (same check as halStorageLoadNumber)
+  currentLine++;
+  if(fgets(line,ATCMD_LENGTH,f) == NULL) line[0] = '\0';
+  crc = slotcompilerCRC32(0,(uint8_t*)line,strlen(line));
+  strip(line);
+  if((name = slotTag(line)) == NULL)
+  {
+    fprintf(stderr,"%s:1: error: missing \"Slot XXX:\" tag\n",path);
+    result = 1;
+  }
+
+  while(name != NULL)
+  {
+    /*++++ start a new slot ++++*/
+    sideEffects = 0;
+    errors = 0;
+    commands = 0;
+    memset(&header,0,sizeof(header));
+    memset(&cfg,0,sizeof(cfg));
+    cmdContextInit(&ctx,&cfg);
+    strncpy(header.slotname,name,SLOTNAME_LENGTH-1);
+    strncpy(cfg.slotName,name,SLOTNAME_LENGTH-1);
+    //image name for multiple slots: number of the slot tag
+    long nr = strtol(&line[strlen("Slot")],NULL,10);
+    slots++;
+    name = NULL;
+
+    /*++++ each line is an AT command, until EOF or the next slot ++++*/
+    while(fgets(line,ATCMD_LENGTH,f) != NULL)
+    {
+      currentLine++;
+      size_t len = strnlen(line,ATCMD_LENGTH);
+      if(len == ATCMD_LENGTH-1 && line[len-1] != '\n' && !feof(f))
+      {
+        fprintf(stderr,"%s:%u: error: line too long (max. %d characters)\n", \
+          path,currentLine,ATCMD_LENGTH-2);
+        errors++;
+        //skip remaining characters of this line
+        int c;
+        while((c = fgetc(f)) != EOF && c != '\n');
+        continue;
+      }
+      if((name = slotTag(line)) != NULL) break;
+      crc = slotcompilerCRC32(crc,(uint8_t*)line,len);
+
+      //lines are passed unmodified (including \n), as on the device
+      uint32_t hostEffects = sideEffects;
+      uint32_t deviceEffects = ctx.sideEffects;
+      cmd_retval r = cmdParser(line,&ctx);
+      if(r != SUCCESS && r != PREFIXONLY)
+      {
+        strip(line);
+        fprintf(stderr,"%s:%u: error: %s: \"%s\"\n",path,currentLine,retvalText(r),line);
+        errors++;
+      }
+      cmdContextFinish(&ctx,r);
+      commands++;
+      //the device must detect the same side effects, otherwise it stores
+      //an image with missing actions (or none for a valid slot)
+      if(ctx.sideEffects != deviceEffects && sideEffects == hostEffects)
+      {
+        slotcompilerSideEffect("has side effects on the device");
+      } else if(ctx.sideEffects == deviceEffects && sideEffects != hostEffects) {
+        strip(line);
+        fprintf(stderr,"%s:%u: error: side effect is not detected by the device: \"%s\"\n", \
+          path,currentLine,line);
+        errors++;
+      }
+    }
+
+    /*++++ finish this slot ++++*/
+    if(name == NULL && slots == 1) sprintf(imgpath,"%s/%s.%s",dir,base,SLOT_IMAGE_EXTENSION);
+    else sprintf(imgpath,"%s/%03ld.%s",dir,(nr > 0 && nr <= 250) ? nr-1 : 0,SLOT_IMAGE_EXTENSION);
+    finishSlot(&header,&cfg,write ? imgpath : NULL,commands,crc,quiet);
+    if(errors != 0) result = 1;
+
+    //next slot starts with this tag line
+    if(name != NULL)
+    {
+      crc = slotcompilerCRC32(0,(uint8_t*)line,strlen(line));
+      strip(line);
+      name = slotTag(line);
+    }
+  }
+
+  fclose(f);
+  free(imgpath);
+  free(tmp);
+  free(tmpdir);
+  return result;
+}
+
+int main(int argc, char **argv)
+{
+  const char *outdir = NULL;
+  uint8_t write = 1;
+  uint8_t quiet = 0;
+  int opt;
+  int result = 0;
+
+  while((opt = getopt(argc,argv,"nqo:")) != -1)
+  {
+    switch(opt)
+    {
+      case 'n': write = 0; break;
+      case 'q': quiet = 1; break;
+      case 'o': outdir = optarg; break;
+      default:
+        fprintf(stderr,"Usage: %s [-n] [-q] [-o <dir>] <file.set> ...\n",argv[0]);
+        return 2;
+    }
+  }
+  if(optind >= argc)
+  {
+    fprintf(stderr,"Usage: %s [-n] [-q] [-o <dir>] <file.set> ...\n",argv[0]);
+    return 2;
+  }
+
+  for(int i = optind; i<argc; i++) result |= compileFile(argv[i],outdir,write,quiet);
+  return result;
+}
@@ -0,0 +1,51 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ * Copyright 2017 Benjamin Aigner <aignerb@technikum-wien.at,
+ * beni@asterics-foundation.org>
+ */
+/** @file
+ * @brief Host tool - slot file validator & compiler
+ *
+ * Interface between the compiler (slotcompiler.c) and the replacements
+ * of firmware functions (host_stubs.c).
+ */
+
+#ifndef _SLOTCOMPILER_H
+#define _SLOTCOMPILER_H
+
+#include "task_commands.h"
+#include "slot_image.h"
+
+/** @brief Report a side effect of the currently parsed line
+ *
+ * Called by the replaced firmware functions, if a command does more than
+ * modifying the config or the VB commands (e.g. sending a HID report
+ * immediately or accessing the storage). Such a command cannot be
+ * represented in a slot image.
+ * @param what Description of the side effect
+ */
+void slotcompilerSideEffect(const char *what);
+
+/** @brief Calculate a CRC32, compatible to crc32_le of the ESP32 ROM
+ * @param crc Start value (0 for a new CRC)
+ * @param buf Data
+ * @param len Length of data
+ * @return CRC32
+ */
+uint32_t slotcompilerCRC32(uint32_t crc, const uint8_t *buf, uint32_t len);
+
+#endif /*_SLOTCOMPILER_H*/